@@ -39,6 +39,16 @@
 static int sBatchSize = 100;
 // This interval directly affects the roundtrip time of single commands
 static int sCommitInterval = 10;
+// Checking whether compaction is worth it requires going through the freelist, so we don't do it too often
+static int sCompactionInterval = 10 * 60 * 1000;
+// The number of revisions that are indexed per transaction when rebuilding the indexes in the background
+static int sIndexRebuildBatchSize = 1000;
+// The pause between batches of the index rebuild, so incoming commands are picked up in between
+static int sIndexRebuildInterval = 10;
+// The number of changes that are committed to the fulltext index at once. Larger batches are cheaper per change.
+static int sFulltextIndexBatchSize = 1000;
+// The delay before indexing the fulltext queue again after a failure
+static int sFulltextIndexRetryInterval = 1000;
 
 
 using namespace Sink;
@@ -49,7 +59,8 @@ CommandProcessor::CommandProcessor(Sink::Pipeline *pipeline, const QByteArray &i
     mLogCtx(ctx.subContext("commandprocessor")),
     mPipeline(pipeline),
     mUserQueue(Sink::storageLocation(), instanceId + ".userqueue"),
-    mSynchronizerQueue(Sink::storageLocation(), instanceId + ".synchronizerqueue"),
+    //The synchronizer queue is refilled by the next sync, so we don't need to flush it on every commit.
+    mSynchronizerQueue(Sink::storageLocation(), instanceId + ".synchronizerqueue", Sink::Storage::StorageProfile::disposable()),
     mCommandQueues({&mUserQueue, &mSynchronizerQueue}), mProcessingLock(false), mLowerBoundRevision(0)
 {
     for (auto queue : mCommandQueues) {
@@ -64,6 +75,15 @@ CommandProcessor::CommandProcessor(Sink::Pipeline *pipeline, const QByteArray &i
     mCommitQueueTimer.setInterval(sCommitInterval);
     mCommitQueueTimer.setSingleShot(true);
     QObject::connect(&mCommitQueueTimer, &QTimer::timeout, &mUserQueue, &MessageQueue::commit);
+
+    //An upgrade may have left indexes to rebuild, which we continue whenever we're idle
+    mIndexRebuildTimer.setInterval(sIndexRebuildInterval);
+    mIndexRebuildTimer.setSingleShot(true);
+    QObject::connect(&mIndexRebuildTimer, &QTimer::timeout, this, &CommandProcessor::rebuildIndexes);
+    mIndexRebuildTimer.start();
+
+    //A previous run may have left fulltext changes to index
+    QTimer::singleShot(0, this, &CommandProcessor::indexFulltext);
 }
 
 static void enqueueCommand(MessageQueue &mq, int commandId, const QByteArray &data)
@@ -182,11 +202,100 @@ void CommandProcessor::process()
                         mProcessingLock = false;
                         if (messagesToProcessAvailable()) {
                             process();
+                        } else {
+                            compactIfRequired();
+                            if (mIndexRebuildPending) {
+                                mIndexRebuildTimer.start();
+                            }
                         }
                     })
                     .exec();
 }
 
+void CommandProcessor::compactIfRequired()
+{
+    if (mCompactionTimer.isValid() && !mCompactionTimer.hasExpired(sCompactionInterval)) {
+        return;
+    }
+    mCompactionTimer.start();
+    mPipeline->compactIfRequired();
+}
+
+void CommandProcessor::rebuildIndexes()
+{
+    //Commands have priority, we continue once they are processed
+    if (mProcessingLock) {
+        return;
+    }
+    if (messagesToProcessAvailable()) {
+        process();
+        return;
+    }
+    qint64 progress = 0;
+    qint64 total = 0;
+    const auto type = mPipeline->rebuildPropertyIndexes(sIndexRebuildBatchSize, progress, total);
+    if (type.isEmpty()) {
+        mIndexRebuildPending = false;
+        return;
+    }
+    SinkTraceCtx(mLogCtx) << "Rebuilt the indexes of " << type << ": " << progress << " of " << total << " revisions";
+    Sink::Notification n;
+    n.type = Sink::Notification::Progress;
+    n.id = "indexrebuild";
+    n.entitiesType = type;
+    n.progress = progress;
+    n.total = total;
+    emit notify(n);
+    mIndexRebuildTimer.start();
+}
+
+void CommandProcessor::indexFulltext()
+{
+    if (mFulltextIndexing) {
+        //Run again once the current batch is done, so we pick up the latest commit
+        mFulltextIndexPending = true;
+        return;
+    }
+    mFulltextIndexing = true;
+    mFulltextIndexPending = false;
+    const auto flushes = mUnindexedFlushes;
+    mUnindexedFlushes.clear();
+    mPipeline->indexFulltext(sFulltextIndexBatchSize)
+        .guard(this)
+        .then([this, flushes](const KAsync::Error &error, bool drained) {
+            mFulltextIndexing = false;
+            if (error) {
+                SinkWarningCtx(mLogCtx) << "Failed to index the fulltext queue: " << error.errorMessage;
+                //The changes stay queued, so the flushes complete once a retry indexed them
+                mUnindexedFlushes = flushes + mUnindexedFlushes;
+                QTimer::singleShot(sFulltextIndexRetryInterval, this, &CommandProcessor::indexFulltext);
+                return;
+            }
+            if (drained) {
+                completeFlushes(flushes);
+            } else {
+                mUnindexedFlushes = flushes + mUnindexedFlushes;
+                mFulltextIndexPending = true;
+            }
+            if (mFulltextIndexPending) {
+                indexFulltext();
+            }
+        })
+        .exec();
+}
+
+void CommandProcessor::completeFlushes(const QVector<QByteArray> &flushIds)
+{
+    for (const auto &flushId : flushIds) {
+        SinkTraceCtx(mLogCtx) << "Emitting flush completion" << flushId;
+        mSynchronizer->flushComplete(flushId);
+        Sink::Notification n;
+        n.type = Sink::Notification::FlushCompletion;
+        n.id = flushId;
+        emit notify(n);
+    }
+}
+
 KAsync::Job<qint64> CommandProcessor::processQueuedCommand(const Sink::QueuedCommand &queuedCommand)
 {
     SinkTraceCtx(mLogCtx) << "Processing command: " << Sink::Commands::name(queuedCommand.commandId());
@@ -255,17 +364,23 @@ KAsync::Job<void> CommandProcessor::processQueue(MessageQueue *queue)
                     });
             })
         .then([=](const KAsync::Error &) {
-            mPipeline->commit();
-            //The flushed content has been persistet, we can notify the world
-            for (const auto &flushId : mCompleteFlushes) {
-                SinkTraceCtx(mLogCtx) << "Emitting flush completion" << flushId;
-                mSynchronizer->flushComplete(flushId);
-                Sink::Notification n;
-                n.type = Sink::Notification::FlushCompletion;
-                n.id = flushId;
-                emit notify(n);
-            }
+            const auto completeFlushes = mCompleteFlushes;
             mCompleteFlushes.clear();
+            //We continue with the next batch while the commit is flushed, so consecutive commits share the flush.
+            mPipeline->commitAsync()
+                .guard(this)
+                .then([=](const KAsync::Error &error) {
+                    if (error) {
+                        //The content is not durable yet, so the flushes complete with the next successful commit instead
+                        SinkWarningCtx(mLogCtx) << "Failed to commit, delaying flush completion: " << error.errorMessage;
+                        mCompleteFlushes = completeFlushes + mCompleteFlushes;
+                        return;
+                    }
+                    //The flushed content has been persistet, we can notify the world once it's searchable as well
+                    mUnindexedFlushes += completeFlushes;
+                    indexFulltext();
+                })
+                .exec();
             QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
         });
 
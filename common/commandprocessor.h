@@ -24,6 +24,7 @@
 #include <QObject>
 #include <QTimer>
 #include <QTime>
+#include <QElapsedTimer>
 #include <KAsync/Async>
 #include <functional>
 
@@ -63,6 +64,13 @@ signals:
 
 private:
     bool messagesToProcessAvailable();
+    // Compacts the store once we're idle
+    void compactIfRequired();
+    // Rebuilds a batch of the indexes if a rebuild is pending, see Pipeline::rebuildPropertyIndexes
+    void rebuildIndexes();
+    // Indexes the queued fulltext changes in the background until the queue is drained, see Pipeline::indexFulltext
+    void indexFulltext();
+    void completeFlushes(const QVector<QByteArray> &flushIds);
 
 private slots:
     void process();
@@ -92,7 +100,14 @@ private:
     QSharedPointer<Inspector> mInspector;
     QTimer mCommitQueueTimer;
     QTime mTime;
+    QElapsedTimer mCompactionTimer;
+    QTimer mIndexRebuildTimer;
+    bool mIndexRebuildPending = true;
     QVector<QByteArray> mCompleteFlushes;
+    // Flushes are only complete once their changes are in the fulltext index
+    QVector<QByteArray> mUnindexedFlushes;
+    bool mFulltextIndexing = false;
+    bool mFulltextIndexPending = false;
 };
 
 };
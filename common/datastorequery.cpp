@@ -56,10 +56,15 @@ class Source : public FilterBase {
 
     QVector<Identifier> mIds;
     QVector<Identifier>::ConstIterator mIt;
+    //The values stored in a covering index for mIds, if the initial set was read from one
+    QVector<QByteArray> mProjections;
     QVector<Identifier> mIncrementalIds;
     QVector<Identifier>::ConstIterator mIncrementalIt{};
     bool mHaveIncrementalChanges{false};
     bool mIdsAreFinal{false};
+    //Resumes an index lookup that only returned the first page of mIds
+    QByteArray mContinuation;
+    int mPageSize{0};
 
     Source (const QVector<Identifier> &ids, DataStoreQuery *store, bool idsAreFinal = false)
         : FilterBase(store),
@@ -69,15 +74,46 @@ class Source : public FilterBase {
         mIt = mIds.constBegin();
     }
 
+    Source (const QVector<Identifier> &ids, const QVector<QByteArray> &projections, DataStoreQuery *store)
+        : FilterBase(store),
+        mIds(ids),
+        mProjections(projections)
+    {
+        Q_ASSERT(mIds.size() == mProjections.size());
+        mIt = mIds.constBegin();
+    }
+
     ~Source() override = default;
 
     void skip() override
     {
-        if (mIt != mIds.constEnd()) {
+        if (fetchPage()) {
             mIt++;
         }
     };
 
+    /*
+     * Loads the next page of ids from the index once the current one has been consumed.
+     *
+     * Returns false if there are no ids left.
+     */
+    bool fetchPage()
+    {
+        while (mIt == mIds.constEnd()) {
+            if (mContinuation.isEmpty()) {
+                return false;
+            }
+            mIds = mDatastore->indexLookupMore(mContinuation, mPageSize);
+            mIt = mIds.constBegin();
+        }
+        return true;
+    }
+
+    bool hasMore() const
+    {
+        return mIt != mIds.constEnd() || !mContinuation.isEmpty();
+    }
+
     void add(const QVector<Key> &keys)
     {
         mIncrementalIds.clear();
@@ -106,15 +142,23 @@ class Source : public FilterBase {
 
             return mIncrementalIt != mIncrementalIds.constEnd();
         }
-        if (mIt == mIds.constEnd()) {
+        if (!fetchPage()) {
             return false;
         }
+        if (!mProjections.isEmpty()) {
+            //Everything in a covering index exists, so the initial set consists of creations
+            const auto entity = mDatastore->createCoveredEntity(*mIt, mProjections.at(mIt - mIds.constBegin()));
+            SinkTraceCtx(mDatastore->mLogCtx) << "Source: Read covered entity: " << entity.identifier();
+            callback({entity, Sink::Operation_Creation});
+            mIt++;
+            return hasMore();
+        }
         readEntity(*mIt, [this, callback](const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Operation operation) {
             SinkTraceCtx(mDatastore->mLogCtx) << "Source: Read entity: " << entity.identifier() << operationName(operation);
             callback({entity, operation});
         });
         mIt++;
-        return mIt != mIds.constEnd();
+        return hasMore();
     }
 };
 
@@ -210,6 +254,10 @@ public:
             } else if (!comparator.matches(property)) {
                 SinkTraceCtx(mDatastore->mLogCtx) << "Filtering entity due to property mismatch on filter: " << entity.identifier() << "Property: " << filterProperty << property << " Filter:" << comparator.value;
                 return false;
+            } else if (comparator.comparator == QueryBase::Comparator::Overlap && !occursIn(filterProperty, comparator, entity)) {
+                //The period of a recurring entity spans the whole series, so it has to be checked for an occurrence like the interval index does.
+                SinkTraceCtx(mDatastore->mLogCtx) << "Filtering entity without an occurrence in the period: " << entity.identifier() << "Property: " << filterProperty << property << " Filter:" << comparator.value;
+                return false;
             }
         }
         return true;
@@ -604,11 +652,32 @@ DataStoreQuery::State::Ptr DataStoreQuery::getState()
     return state;
 }
 
+QVector<Identifier> DataStoreQuery::indexLookupMore(QByteArray &continuation, int limit)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const auto result = mStore.indexLookupMore(mType, continuation, limit);
+    if (timer.elapsed() > 2) {
+        SinkLogCtx(mLogCtx) << "Continued index lookup returned " << result.size() << "results, in " << Sink::Log::TraceTime(timer.elapsed());
+    }
+    return result;
+}
+
+bool DataStoreQuery::occursIn(const QByteArrayList &properties, const QueryBase::Comparator &filter, const Sink::ApplicationDomain::ApplicationDomainType &entity)
+{
+    return mStore.occursIn(mType, properties, filter, entity);
+}
+
 void DataStoreQuery::readEntity(const Identifier &id, const BufferCallback &resultCallback)
 {
     mStore.readLatest(mType, id, resultCallback);
 }
 
+Sink::ApplicationDomain::ApplicationDomainType DataStoreQuery::createCoveredEntity(const Identifier &id, const QByteArray &projection)
+{
+    return mStore.createCoveredEntity(id, projection);
+}
+
 void DataStoreQuery::readPrevious(const Identifier &id, const std::function<void (const ApplicationDomain::ApplicationDomainType &)> &callback)
 {
     mStore.readPrevious(mType, id, mStore.maxRevision(), callback);
@@ -752,16 +821,30 @@ void DataStoreQuery::setupQuery(const Sink::QueryBase &query_)
 
             return Source::Ptr::create(ids, this, resultSetIsFinal);
         } else {
-            QSet<QByteArrayList> appliedFilters;
             QElapsedTimer timer;
             timer.start();
-            auto resultSet = mStore.indexLookup(mType, query, appliedFilters, appliedSorting);
+            QVector<Identifier> coveredIds;
+            QVector<QByteArray> projections;
+            if (mStore.coveringLookup(mType, query, coveredIds, projections, appliedSorting)) {
+                if (timer.elapsed() > 2) {
+                    SinkLogCtx(mLogCtx) << "Covering index lookup returned " << coveredIds.size() << "results, in " << Sink::Log::TraceTime(timer.elapsed());
+                }
+                //We don't have to read the entities
+                return Source::Ptr::create(coveredIds, projections, this);
+            }
+            QSet<QByteArrayList> appliedFilters;
+            QByteArray continuation;
+            auto resultSet = mStore.indexLookup(mType, query, appliedFilters, appliedSorting, &continuation);
             if (timer.elapsed() > 2) {
                 SinkLogCtx(mLogCtx) << "Index lookup returned " << resultSet.size() << "results, in " << Sink::Log::TraceTime(timer.elapsed());
             }
             if (!appliedFilters.isEmpty() || !appliedSorting.isEmpty()) {
                 //We have an index lookup as starting point
-                return Source::Ptr::create(resultSet, this);
+                auto source = Source::Ptr::create(resultSet, this);
+                //Further pages are only read once the source runs out of ids, so fetching more doesn't walk past the previous pages again
+                source->mContinuation = continuation;
+                source->mPageSize = query.limit();
+                return source;
             }
             // We do a full scan if there were no indexes available to create the initial set (this is going to be expensive for large sets).
             return Source::Ptr::create(mStore.fullScan(mType), this);
@@ -819,19 +902,19 @@ void DataStoreQuery::setupQuery(const Sink::QueryBase &query_)
     mCollector = Collector::Ptr::create(baseSet, this);
 }
 
-QVector<Key> DataStoreQuery::loadIncrementalResultSet(qint64 baseRevision)
+QVector<Key> DataStoreQuery::loadIncrementalResultSet(qint64 baseRevision, qint64 topRevision)
 {
     QVector<Key> changedKeys;
-    mStore.readRevisions(baseRevision, mType, [&](const Key &key) {
+    mStore.readRevisions(baseRevision, topRevision, mType, [&](const Key &key) {
         changedKeys << key;
     });
     return changedKeys;
 }
 
-ResultSet DataStoreQuery::update(qint64 baseRevision)
+ResultSet DataStoreQuery::update(qint64 baseRevision, qint64 topRevision)
 {
-    SinkTraceCtx(mLogCtx) << "Executing query update from revision " << baseRevision << " to revision " << mStore.maxRevision();
-    auto incrementalResultSet = loadIncrementalResultSet(baseRevision);
+    SinkTraceCtx(mLogCtx) << "Executing query update from revision " << baseRevision << " to revision " << topRevision;
+    auto incrementalResultSet = loadIncrementalResultSet(baseRevision, topRevision);
     SinkTraceCtx(mLogCtx) << "Incremental changes: " << incrementalResultSet;
     mSource->add(incrementalResultSet);
     ResultSet::ValueGenerator generator = [this](const ResultSet::Callback &callback) -> bool {
@@ -26,6 +26,8 @@
 #include "storage/entitystore.h"
 #include "storage/key.h"
 
+#include <limits>
+
 class Source;
 class Bloom;
 class Reduce;
@@ -51,7 +53,10 @@ public:
     DataStoreQuery(const DataStoreQuery::State &state, const QByteArray &type, Sink::Storage::EntityStore &store, bool incremental);
     ~DataStoreQuery();
     ResultSet execute();
-    ResultSet update(qint64 baseRevision);
+    /**
+     * Updates the results with the changes from @param baseRevision until @param topRevision.
+     */
+    ResultSet update(qint64 baseRevision, qint64 topRevision = std::numeric_limits<qint64>::max());
     void updateComplete();
 
     State::Ptr getState();
@@ -62,12 +67,15 @@ private:
     typedef std::function<void(const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Operation)> BufferCallback;
 
     QVector<Sink::Storage::Identifier> indexLookup(const QByteArray &property, const QVariant &value, const QVector<Sink::Storage::Identifier> &filter = {});
+    QVector<Sink::Storage::Identifier> indexLookupMore(QByteArray &continuation, int limit);
+    bool occursIn(const QByteArrayList &properties, const Sink::QueryBase::Comparator &filter, const Sink::ApplicationDomain::ApplicationDomainType &entity);
 
     void readEntity(const Sink::Storage::Identifier &id, const BufferCallback &resultCallback);
+    Sink::ApplicationDomain::ApplicationDomainType createCoveredEntity(const Sink::Storage::Identifier &id, const QByteArray &projection);
     void readPrevious(const Sink::Storage::Identifier &id, const std::function<void (const Sink::ApplicationDomain::ApplicationDomainType &)> &callback);
 
     ResultSet createFilteredSet(ResultSet &resultSet, const FilterFunction &);
-    QVector<Sink::Storage::Key> loadIncrementalResultSet(qint64 baseRevision);
+    QVector<Sink::Storage::Key> loadIncrementalResultSet(qint64 baseRevision, qint64 topRevision);
 
     void setupQuery(const Sink::QueryBase &query_);
     QByteArrayList executeSubquery(const Sink::QueryBase &subquery);
@@ -110,6 +118,12 @@ public:
         return mDatastore->indexLookup(property, value, filter);
     }
 
+    bool occursIn(const QByteArrayList &properties, const Sink::QueryBase::Comparator &filter, const Sink::ApplicationDomain::ApplicationDomainType &entity)
+    {
+        Q_ASSERT(mDatastore);
+        return mDatastore->occursIn(properties, filter, entity);
+    }
+
     void readPrevious(const Sink::Storage::Identifier &id, const std::function<void (const Sink::ApplicationDomain::ApplicationDomainType &)> &callback)
     {
         Q_ASSERT(mDatastore);
@@ -28,6 +28,7 @@
 #include "entity_generated.h"
 #include "mail/threadindexer.h"
 #include "mail/fulltextindexer.h"
+#include "eventrecurrence.h"
 #include "domainadaptor.h"
 #include "typeimplementations_p.h"
 
@@ -44,6 +45,7 @@ typedef IndexConfig<Mail,
         ValueIndex<Mail::MessageId>,
         ValueIndex<Mail::Draft>,
         SortedIndex<Mail::Folder, Mail::Date>,
+        CoveringIndex<Mail::Folder, Mail::Date, Mail::Subject, Mail::Sender, Mail::Unread>,
         SecondaryIndex<Mail::MessageId, Mail::ThreadId>,
         SecondaryIndex<Mail::ThreadId, Mail::MessageId>,
         CustomSecondaryIndex<Mail::MessageId, Mail::ThreadId, ThreadIndexer>,
@@ -57,7 +59,9 @@ typedef IndexConfig<Folder,
 
 typedef IndexConfig<Contact,
         ValueIndex<Contact::Uid>,
-        ValueIndex<Contact::Addressbook>
+        ValueIndex<Contact::Addressbook>,
+        NgramIndex<Contact::Fn>,
+        NgramIndex<Contact::Emails>
     > ContactIndexConfig;
 
 typedef IndexConfig<Addressbook,
@@ -70,7 +74,7 @@ typedef IndexConfig<Event,
         ValueIndex<Event::AllDay>,
         ValueIndex<Event::Recurring>,
         SortedIndex<Event::StartTime>,
-        SampledPeriodIndex<Event::StartTime, Event::EndTime>
+        IntervalIndex<Event::StartTime, Event::EndTime, EventRecurrence>
     > EventIndexConfig;
 
 typedef IndexConfig<Todo,
@@ -86,7 +90,10 @@ typedef IndexConfig<Calendar,
 template <typename EntityType, typename EntityIndexConfig>
 QMap<QByteArray, int> defaultTypeDatabases()
 {
-    return merge(QMap<QByteArray, int>{{QByteArray{EntityType::name} + ".main", Storage::IntegerKeys}}, EntityIndexConfig::databases());
+    return merge(QMap<QByteArray, int>{
+            {QByteArray{EntityType::name} + ".main", Storage::IntegerKeys},
+            {IndexStatistics::databaseName(EntityType::name), 0}
+        }, EntityIndexConfig::databases());
 }
 
 void TypeImplementation<Mail>::configure(TypeIndex &index)
@@ -94,6 +94,22 @@ public:
     }
 };
 
+template <typename Property, typename SortProperty, typename ... CoveredProperties>
+class CoveringIndex
+{
+public:
+    static void configure(TypeIndex &index)
+    {
+        index.addCoveringIndex<Property, SortProperty, CoveredProperties...>();
+    }
+
+    template <typename EntityType>
+    static QMap<QByteArray, int> databases()
+    {
+        return {{QByteArray{EntityType::name} +".index." + Property::name + ".sort." + SortProperty::name + ".covering", 0}};
+    }
+};
+
 template <typename Property, typename SecondaryProperty>
 class SecondaryIndex
 {
@@ -126,23 +142,40 @@ public:
     }
 };
 
-template <typename RangeBeginProperty, typename RangeEndProperty>
-class SampledPeriodIndex
+template <typename Property>
+class NgramIndex
+{
+public:
+    static void configure(TypeIndex &index)
+    {
+        index.addNgramIndex<Property>();
+    }
+
+    template <typename EntityType>
+    static QMap<QByteArray, int> databases()
+    {
+        return {{QByteArray{EntityType::name} +".index." + Property::name + ".ngram", Sink::Storage::AllowDuplicates}};
+    }
+};
+
+template <typename BeginProperty, typename EndProperty, typename ... Recurrence>
+class IntervalIndex
 {
-    static_assert(std::is_same<typename RangeBeginProperty::Type, QDateTime>::value &&
-                      std::is_same<typename RangeEndProperty::Type, QDateTime>::value,
-        "Date range index is not supported for types other than 'QDateTime's");
+    static_assert(std::is_same<typename BeginProperty::Type, QDateTime>::value &&
+                      std::is_same<typename EndProperty::Type, QDateTime>::value,
+        "Interval index is not supported for types other than 'QDateTime's");
 
 public:
     static void configure(TypeIndex &index)
     {
-        index.addSampledPeriodIndex<RangeBeginProperty, RangeEndProperty>();
+        index.addIntervalIndex<BeginProperty, EndProperty, Recurrence...>();
     }
 
     template <typename EntityType>
     static QMap<QByteArray, int> databases()
     {
-        return {{QByteArray{EntityType::name} +".index." + RangeBeginProperty::name + ".range." + RangeEndProperty::name, Sink::Storage::AllowDuplicates}};
+        const auto name = QByteArray{EntityType::name} +".index." + BeginProperty::name + ".interval." + EndProperty::name;
+        return {{name, Sink::Storage::AllowDuplicates}, {name + ".recurrence", 0}};
     }
 };
 
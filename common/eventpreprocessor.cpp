@@ -40,34 +40,26 @@ void EventPropertyExtractor::updatedIndexedProperties(Event &event, const QByteA
     event.setExtractedAllDay(icalEvent->allDay());
     event.setExtractedRecurring(icalEvent->recurs());
 
+    //The occurrences are not expanded here, the interval index only expands them for the queried period, see EventRecurrence.
     if (icalEvent->recurs() && icalEvent->recurrence()) {
-        QList<QPair<QDateTime, QDateTime>> ranges;
-        const auto duration = icalEvent->hasDuration() ? icalEvent->duration().asSeconds() : 0;
-        const auto occurrences = icalEvent->recurrence()->timesInInterval(icalEvent->dtStart(), icalEvent->dtStart().addYears(10));
-        for (const auto &start : occurrences) {
-            ranges.append(qMakePair(start, start.addSecs(duration)));
+        const auto duration = icalEvent->dtStart().secsTo(icalEvent->dtEnd());
+        auto lastOccurrence = icalEvent->recurrence()->endDateTime();
+        if (!lastOccurrence.isValid()) {
+            //Recurrences without end are covered for ten years
+            lastOccurrence = icalEvent->recurrence()->getPreviousDateTime(icalEvent->dtStart().addYears(10));
         }
-        if (!ranges.isEmpty()) {
-            event.setExtractedEndTime(ranges.last().second);
-            event.setProperty("indexRanges", QVariant::fromValue(ranges));
+        if (lastOccurrence.isValid()) {
+            event.setExtractedEndTime(lastOccurrence.addSecs(duration));
         }
     }
     if (icalEvent->hasRecurrenceId()) {
-        const auto duration = icalEvent->hasDuration() ? icalEvent->duration().asSeconds() : 0;
-        QList<QPair<QDateTime, QDateTime>> ranges;
-
+        const auto duration = icalEvent->dtStart().secsTo(icalEvent->dtEnd());
         const auto start = icalEvent->dtStart();
-        ranges.append(qMakePair(start, start.addSecs(duration)));
-
         const auto recurrenceId = icalEvent->recurrenceId();
-        ranges.append(qMakePair(recurrenceId, recurrenceId.addSecs(duration)));
 
         //recurrenceId can be earlier or later and we need to cover both cases
-        std::sort(ranges.begin(), ranges.end());
-        event.setExtractedStartTime(ranges.first().first);
-        event.setExtractedEndTime(ranges.last().second);
-
-        event.setProperty("indexRanges", QVariant::fromValue(ranges));
+        event.setExtractedStartTime(qMin(start, recurrenceId));
+        event.setExtractedEndTime(qMax(start, recurrenceId).addSecs(duration));
     }
 }
 
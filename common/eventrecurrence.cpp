@@ -0,0 +1,82 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "eventrecurrence.h"
+
+#include "log.h"
+
+#include <KCalendarCore/ICalFormat>
+#include <KCalendarCore/Event>
+
+using namespace Sink::ApplicationDomain;
+
+QByteArrayList EventRecurrence::sourceProperties()
+{
+    return {Event::Ical::name};
+}
+
+QByteArray EventRecurrence::encode(const ApplicationDomainType &event)
+{
+    const auto icalEvent = KCalendarCore::ICalFormat().readIncidence(event.getProperty(Event::Ical::name).toByteArray()).dynamicCast<KCalendarCore::Event>();
+    if (!icalEvent || (!icalEvent->recurs() && !icalEvent->hasRecurrenceId())) {
+        return {};
+    }
+    const auto duration = icalEvent->dtStart().secsTo(icalEvent->dtEnd());
+
+    auto recurrence = KCalendarCore::Event::Ptr::create();
+    recurrence->setUid(icalEvent->uid());
+    recurrence->setAllDay(icalEvent->allDay());
+    if (icalEvent->hasRecurrenceId()) {
+        //recurrenceId can be earlier or later than the start and we need to cover both cases
+        const auto start = qMin(icalEvent->dtStart(), icalEvent->recurrenceId());
+        recurrence->setDtStart(start);
+        recurrence->setDtEnd(start.addSecs(duration));
+        recurrence->recurrence()->addRDateTime(qMax(icalEvent->dtStart(), icalEvent->recurrenceId()));
+    } else {
+        recurrence->setDtStart(icalEvent->dtStart());
+        recurrence->setDtEnd(icalEvent->dtEnd());
+        const auto source = icalEvent->recurrence();
+        for (const auto rule : source->rRules()) {
+            recurrence->recurrence()->addRRule(new KCalendarCore::RecurrenceRule(*rule));
+        }
+        for (const auto rule : source->exRules()) {
+            recurrence->recurrence()->addExRule(new KCalendarCore::RecurrenceRule(*rule));
+        }
+        recurrence->recurrence()->setRDateTimes(source->rDateTimes());
+        recurrence->recurrence()->setRDates(source->rDates());
+        recurrence->recurrence()->setExDateTimes(source->exDateTimes());
+        recurrence->recurrence()->setExDates(source->exDates());
+    }
+    return KCalendarCore::ICalFormat().toICalString(recurrence).toUtf8();
+}
+
+bool EventRecurrence::occursIn(const QByteArray &recurrence, const QDateTime &begin, const QDateTime &end)
+{
+    const auto icalEvent = KCalendarCore::ICalFormat().readIncidence(recurrence).dynamicCast<KCalendarCore::Event>();
+    if (!icalEvent) {
+        SinkWarning() << "Invalid recurrence, assuming it occurs: " << recurrence;
+        return true;
+    }
+    //An occurrence overlaps the period if it starts at most its duration before it
+    const auto from = begin.addSecs(-icalEvent->dtStart().secsTo(icalEvent->dtEnd()));
+    const auto first = icalEvent->dtStart();
+    if (first >= from && first <= end) {
+        return true;
+    }
+    return !icalEvent->recurrence()->timesInInterval(from, end).isEmpty();
+}
@@ -0,0 +1,43 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "sink_export.h"
+#include "applicationdomaintype.h"
+
+#include <QByteArray>
+#include <QDateTime>
+
+/**
+ * The recurrence of events for the interval index, see TypeIndex::addIntervalIndex.
+ *
+ * The recurrence is encoded as a minimal iCalendar event with the start, end and recurrence rules of the event,
+ * so lookups don't have to read the full event to expand its occurrences.
+ * Exceptions are encoded as recurring on both the original and the new start.
+ */
+class SINK_EXPORT EventRecurrence
+{
+public:
+    static QByteArrayList sourceProperties();
+    static QByteArray encode(const Sink::ApplicationDomain::ApplicationDomainType &event);
+    /**
+     * Only the occurrences that can overlap the period from @param begin to @param end are expanded.
+     */
+    static bool occursIn(const QByteArray &recurrence, const QDateTime &begin, const QDateTime &end);
+};
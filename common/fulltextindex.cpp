@@ -24,6 +24,12 @@
 #include <QElapsedTimer>
 #include <QDir>
 #include <QDateTime>
+#include <QDataStream>
+#include <QHash>
+#include <QMutex>
+#include <QUuid>
+#include <algorithm>
+#include <vector>
 
 #include "log.h"
 #include "definitions.h"
@@ -68,6 +74,88 @@ bool FulltextIndex::exists(const QByteArray &resourceInstanceIdentifier)
     return QFile{QFile::encodeName(Sink::resourceStorageLocation(resourceInstanceIdentifier) + '/' + "fulltext/iamglass")}.exists();
 }
 
+static QByteArray readMetadata(const Sink::Storage::DataStore::Transaction &transaction, const QByteArray &key)
+{
+    QByteArray r;
+    transaction.openDatabase("__metadata").scan(key,
+        [&](const QByteArray &, const QByteArray &value) -> bool {
+            r = value;
+            return false;
+        },
+        [&](const Sink::Storage::DataStore::Error &error) {
+            if (error.code != Sink::Storage::DataStore::NotFound) {
+                SinkWarning() << "Couldn't find the fulltext " << key << ": " << error;
+            }
+        });
+    return r;
+}
+
+FulltextIndex::Generation FulltextIndex::generation(const Sink::Storage::DataStore::Transaction &transaction)
+{
+    return {readMetadata(transaction, "fulltextInstance"), readMetadata(transaction, "fulltextGeneration").toLongLong()};
+}
+
+void FulltextIndex::increaseGeneration(Sink::Storage::DataStore::Transaction &transaction)
+{
+    const auto current = generation(transaction);
+    auto metadata = transaction.openDatabase("__metadata");
+    if (current.instance.isEmpty()) {
+        metadata.write("fulltextInstance", QUuid::createUuid().toByteArray());
+    }
+    metadata.write("fulltextGeneration", QByteArray::number(current.counter + 1));
+}
+
+namespace {
+struct SharedReader {
+    QMutex mutex;
+    std::unique_ptr<FulltextIndex> index;
+    FulltextIndex::Generation generation;
+};
+}
+
+static QMutex sReadersLock;
+static QHash<QByteArray, std::shared_ptr<SharedReader>> sReaders;
+
+void FulltextIndex::withReader(const QByteArray &resourceInstanceIdentifier, const Generation &generation, const std::function<void(FulltextIndex &)> &callback)
+{
+    std::shared_ptr<SharedReader> reader;
+    {
+        QMutexLocker locker{&sReadersLock};
+        auto &entry = sReaders[resourceInstanceIdentifier];
+        if (!entry) {
+            entry = std::make_shared<SharedReader>();
+        }
+        reader = entry;
+    }
+
+    QMutexLocker locker{&reader->mutex};
+    //A different instance means the resource has been recreated, so the old files are gone
+    if (!reader->index || !reader->index->mDb || generation.instance != reader->generation.instance) {
+        reader->index.reset(new FulltextIndex{resourceInstanceIdentifier, Sink::Storage::DataStore::ReadOnly});
+        reader->generation = generation;
+    } else if (generation.counter > reader->generation.counter) {
+        if (!reader->index->reopen()) {
+            reader->index.reset(new FulltextIndex{resourceInstanceIdentifier, Sink::Storage::DataStore::ReadOnly});
+        }
+        reader->generation = generation;
+    }
+    callback(*reader->index);
+}
+
+bool FulltextIndex::reopen()
+{
+    if (!mDb) {
+        return false;
+    }
+    try {
+        mDb->reopen();
+        return true;
+    } catch (const Xapian::Error &error) {
+        SinkWarning() << "Failed to reopen database" << mDbPath << ":" << QString::fromStdString(error.get_msg());
+    }
+    return false;
+}
+
 static std::string idTerm(const Identifier &key)
 {
     return "Q" + key.toInternalByteArray().toStdString();
@@ -181,66 +269,299 @@ void FulltextIndex::remove(const Identifier &key)
     }
 }
 
-QVector<Identifier> FulltextIndex::lookup(const QString &searchTerm, const Identifier &entity)
+QByteArray FulltextIndex::queueDatabase()
 {
-    if (!mDb) {
-        return {};
+    return "fulltext.queue";
+}
+
+void FulltextIndex::enqueue(Sink::Storage::DataStore::Transaction &transaction, qint64 revision, const QVector<QueuedChange> &changes)
+{
+    QByteArray data;
+    QDataStream stream{&data, QIODevice::WriteOnly};
+    stream << quint32(changes.size());
+    for (const auto &change : changes) {
+        stream << change.identifier.toInternalByteArray() << change.removal << change.values << change.date;
     }
-    QVector<Identifier> results;
+    //Revisions only increase, so we always append to the queue
+    transaction.openDatabase(queueDatabase(), {}, Sink::Storage::IntegerKeys).append(revision, data,
+        [](const Sink::Storage::DataStore::Error &error) {
+            SinkWarning() << "Failed to queue the fulltext changes: " << error.message;
+        });
+}
 
-    try {
-        QElapsedTimer time;
-        time.start();
-        Xapian::QueryParser parser;
-        for (const auto& [name, prefix] : prefixes()) {
-            parser.add_prefix(name, prefix);
-            //Search through all prefixes by default
-            parser.add_prefix("", prefix);
+static QVector<FulltextIndex::QueuedChange> readQueuedChanges(const QByteArray &data)
+{
+    QVector<FulltextIndex::QueuedChange> changes;
+    QDataStream stream{data};
+    quint32 count = 0;
+    stream >> count;
+    for (quint32 i = 0; i < count; i++) {
+        QByteArray identifier;
+        FulltextIndex::QueuedChange change;
+        stream >> identifier >> change.removal >> change.values >> change.date;
+        if (stream.status() != QDataStream::Ok) {
+            SinkWarning() << "Failed to read the queued fulltext changes.";
+            break;
         }
-        //Also search through the empty prefix by default
-        parser.add_prefix("", "");
-        parser.add_boolean_prefix("identifier", "Q");
-        parser.set_default_op(Xapian::Query::OP_AND);
-        parser.set_database(*mDb);
-        parser.set_max_expansion(100, Xapian::Query::WILDCARD_LIMIT_MOST_FREQUENT, Xapian::QueryParser::FLAG_PARTIAL);
-        const auto mainQuery = parser.parse_query(searchTerm.toStdString(), Xapian::QueryParser::FLAG_PHRASE|Xapian::QueryParser::FLAG_BOOLEAN|Xapian::QueryParser::FLAG_LOVEHATE|Xapian::QueryParser::FLAG_PARTIAL);
-        const auto query = [&] {
-            if (!entity.isNull()) {
-                return Xapian::Query{Xapian::Query::OP_AND, Xapian::Query{idTerm(entity)}, mainQuery};
+        change.identifier = Identifier::fromInternalByteArray(identifier);
+        changes << change;
+    }
+    return changes;
+}
+
+qint64 FulltextIndex::indexedRevision(const Sink::Storage::DataStore::Transaction &transaction)
+{
+    auto cursor = transaction.openDatabase(queueDatabase(), {}, Sink::Storage::IntegerKeys).cursor();
+    if (cursor.first()) {
+        //Everything before the oldest queued change is indexed
+        return qint64(cursor.current().integerKey()) - 1;
+    }
+    return Sink::Storage::DataStore::maxRevision(transaction);
+}
+
+bool FulltextIndex::hasQueuedChanges(const Sink::Storage::DataStore::Transaction &transaction)
+{
+    return transaction.openDatabase(queueDatabase(), {}, Sink::Storage::IntegerKeys).cursor().first();
+}
+
+bool FulltextIndex::indexQueue(const QByteArray &resourceInstanceIdentifier, int batchSize, qint64 &indexedRevision)
+{
+    using Sink::Storage::DataStore;
+    QElapsedTimer time;
+    time.start();
+
+    DataStore store{Sink::storageLocation(), resourceInstanceIdentifier, DataStore::ReadWrite};
+    QVector<size_t> revisions;
+    QVector<QueuedChange> changes;
+    bool drained = true;
+    {
+        auto transaction = store.createTransaction(DataStore::ReadOnly);
+        //Changes of a transaction are consumed together, so the queue never starts in the middle of a transaction
+        for (const auto &entry : transaction.openDatabase(queueDatabase(), {}, Sink::Storage::IntegerKeys).cursor()) {
+            if (changes.size() >= batchSize) {
+                drained = false;
+                break;
             }
-            return mainQuery;
-        }();
-        SinkTrace() << "Running xapian query: " << QString::fromStdString(query.get_description());
-        Xapian::Enquire enquire(*mDb);
-        enquire.set_query(query);
-        enquire.set_sort_by_value_then_relevance(1, true);
-
-        const Xapian::doccount limit = [&] {
-            switch (searchTerm.size()) {
-                case 1:
-                case 2:
-                case 3:
-                    return 500;
-                default:
-                    return 20000;
+            revisions << entry.integerKey();
+            changes += readQueuedChanges(QByteArray::fromRawData(entry.value.data(), entry.value.size()));
+        }
+    }
+    if (revisions.isEmpty()) {
+        return drained;
+    }
+
+    {
+        FulltextIndex index{resourceInstanceIdentifier, DataStore::ReadWrite};
+        for (const auto &change : changes) {
+            if (change.removal) {
+                index.remove(change.identifier);
+            } else {
+                index.add(change.identifier, change.values, change.date);
             }
-        }();
-        Xapian::MSet mset = enquire.get_mset(0, limit);
-        results.reserve(mset.size());
-        for (Xapian::MSetIterator it = mset.begin(); it != mset.end(); it++) {
-            auto doc = it.get_document();
-            const auto data = doc.get_value(0);
-            results << Identifier::fromInternalByteArray({data.c_str(), int(data.length())});
         }
+        index.commitTransaction();
+    }
+
+    //If we crash before this commit the changes are indexed again, which replaces the same documents
+    auto transaction = store.createTransaction(DataStore::ReadWrite);
+    auto queue = transaction.openDatabase(queueDatabase(), {}, Sink::Storage::IntegerKeys);
+    for (const auto revision : revisions) {
+        queue.remove(revision);
+    }
+    increaseGeneration(transaction);
+    indexedRevision = FulltextIndex::indexedRevision(transaction);
+    transaction.commit();
+    SinkTrace() << "Indexed " << changes.size() << " changes until revision " << indexedRevision << " in " << Sink::Log::TraceTime(time.elapsed());
+    return drained;
+}
+
+//The number of matches that are read at once when all of them are looked up
+static const int sBatchSize = 500;
+
+struct FulltextIndex::Continuation {
+    qint32 order{DateOrder};
+    QString searchTerm;
+    //The sort value and document of the last match in date order
+    QByteArray lastValue;
+    quint32 lastDocument{0};
+    //The number of matches handed out so far in relevance order
+    quint32 offset{0};
+};
+
+static QByteArray serialize(qint32 order, const QString &searchTerm, const QByteArray &lastValue, quint32 lastDocument, quint32 offset)
+{
+    QByteArray token;
+    QDataStream stream{&token, QIODevice::WriteOnly};
+    stream << order << searchTerm << lastValue << lastDocument << offset;
+    return token;
+}
 
-        SinkTrace() << "Found " << mset.size() << " results, limited to " << limit << " in " << Sink::Log::TraceTime(time.elapsed());
-        //Print a hint why a query could lack some expected results (Not for small limits because that becomes noisy)
-        if (searchTerm.size() >= 4 && mset.size() >= limit) {
-            SinkLog() << "Result set exceeding limit of " << limit << QString::fromStdString(query.get_description());
+/*
+ * Resolves the identifiers of @param documents, in the same order.
+ *
+ * The identifiers are read from the value stream of their slot in document order,
+ * which avoids fetching each matching document, and reads large results in a single pass over the stream.
+ */
+static QVector<Identifier> identifiers(const Xapian::Database &db, const std::vector<Xapian::docid> &documents)
+{
+    auto sorted = documents;
+    std::sort(sorted.begin(), sorted.end());
+    QHash<Xapian::docid, Identifier> identifierByDocument;
+    identifierByDocument.reserve(int(sorted.size()));
+    auto it = db.valuestream_begin(0);
+    const auto end = db.valuestream_end(0);
+    for (const auto document : sorted) {
+        it.skip_to(document);
+        if (it == end) {
+            break;
+        }
+        if (it.get_docid() == document) {
+            const auto data = *it;
+            identifierByDocument.insert(document, Identifier::fromInternalByteArray({data.c_str(), int(data.length())}));
         }
     }
-    catch (const Xapian::Error &) {
-        // Nothing to do, move along
+    QVector<Identifier> results;
+    results.reserve(int(documents.size()));
+    for (const auto document : documents) {
+        const auto identifier = identifierByDocument.value(document);
+        if (identifier.isNull()) {
+            SinkWarning() << "Missing the identifier of document " << document;
+            continue;
+        }
+        results << identifier;
+    }
+    return results;
+}
+
+QVector<Identifier> FulltextIndex::lookup(const QString &searchTerm, const Identifier &entity)
+{
+    Continuation continuation;
+    continuation.searchTerm = searchTerm;
+    bool exhausted = false;
+    if (!entity.isNull()) {
+        return lookupPage(continuation, false, 1, exhausted, entity);
+    }
+    auto results = lookupPage(continuation, false, sBatchSize, exhausted);
+    while (!exhausted) {
+        results << lookupPage(continuation, true, sBatchSize, exhausted);
+    }
+    return results;
+}
+
+QVector<Identifier> FulltextIndex::lookup(const QString &searchTerm, Order order, int limit, QByteArray &token)
+{
+    Continuation continuation;
+    continuation.order = order;
+    continuation.searchTerm = searchTerm;
+    bool exhausted = false;
+    const auto results = lookupPage(continuation, false, limit, exhausted);
+    token = exhausted ? QByteArray{} : serialize(continuation.order, continuation.searchTerm, continuation.lastValue, continuation.lastDocument, continuation.offset);
+    return results;
+}
+
+QVector<Identifier> FulltextIndex::lookupMore(int limit, QByteArray &token)
+{
+    Continuation continuation;
+    QDataStream stream{token};
+    stream >> continuation.order >> continuation.searchTerm >> continuation.lastValue >> continuation.lastDocument >> continuation.offset;
+    if (stream.status() != QDataStream::Ok) {
+        SinkWarning() << "Invalid continuation token";
+        token.clear();
+        return {};
+    }
+    bool exhausted = false;
+    const auto results = lookupPage(continuation, true, limit, exhausted);
+    token = exhausted ? QByteArray{} : serialize(continuation.order, continuation.searchTerm, continuation.lastValue, continuation.lastDocument, continuation.offset);
+    return results;
+}
+
+QVector<Identifier> FulltextIndex::lookupPage(Continuation &continuation, bool resume, int limit, bool &exhausted, const Identifier &entity)
+{
+    exhausted = true;
+    if (!mDb || limit <= 0) {
+        return {};
+    }
+    QVector<Identifier> results;
+    const auto initial = continuation;
+
+    //A reader that is kept open can fall behind the writer far enough for its revision to vanish, so we retry once with the latest revision
+    for (int attempt = 0; attempt < 2; attempt++) {
+        try {
+            QElapsedTimer time;
+            time.start();
+            Xapian::QueryParser parser;
+            for (const auto& [name, prefix] : prefixes()) {
+                parser.add_prefix(name, prefix);
+                //Search through all prefixes by default
+                parser.add_prefix("", prefix);
+            }
+            //Also search through the empty prefix by default
+            parser.add_prefix("", "");
+            parser.add_boolean_prefix("identifier", "Q");
+            parser.set_default_op(Xapian::Query::OP_AND);
+            parser.set_database(*mDb);
+            parser.set_max_expansion(100, Xapian::Query::WILDCARD_LIMIT_MOST_FREQUENT, Xapian::QueryParser::FLAG_PARTIAL);
+            const auto mainQuery = parser.parse_query(continuation.searchTerm.toStdString(), Xapian::QueryParser::FLAG_PHRASE|Xapian::QueryParser::FLAG_BOOLEAN|Xapian::QueryParser::FLAG_LOVEHATE|Xapian::QueryParser::FLAG_PARTIAL);
+            const bool byDate = continuation.order == DateOrder;
+            const auto query = [&] {
+                if (!entity.isNull()) {
+                    return Xapian::Query{Xapian::Query::OP_AND, Xapian::Query{idTerm(entity)}, mainQuery};
+                }
+                if (resume && byDate) {
+                    //Continue with the matches that are not newer than the last one
+                    return Xapian::Query{Xapian::Query::OP_FILTER, mainQuery, Xapian::Query{Xapian::Query::OP_VALUE_LE, 1, continuation.lastValue.toStdString()}};
+                }
+                return mainQuery;
+            }();
+            SinkTrace() << "Running xapian query: " << QString::fromStdString(query.get_description());
+            Xapian::Enquire enquire(*mDb);
+            enquire.set_query(query);
+            if (byDate) {
+                //Matches of the same date are ordered by document, so a page can continue after the last one
+                enquire.set_sort_by_value(1, true);
+                enquire.set_docid_order(Xapian::Enquire::DESCENDING);
+            }
+
+            Xapian::doccount first = resume && !byDate ? continuation.offset : 0;
+            std::vector<Xapian::docid> documents;
+            exhausted = false;
+            while (!exhausted && int(documents.size()) < limit) {
+                const Xapian::doccount batchSize = limit - documents.size();
+                const auto mset = enquire.get_mset(first, batchSize);
+                exhausted = mset.size() < batchSize;
+                first += mset.size();
+                for (auto it = mset.begin(); it != mset.end(); it++) {
+                    if (byDate) {
+                        //The sort key is the date, which the match set already holds
+                        const auto value = QByteArray::fromStdString(it.get_sort_key());
+                        //Skip the matches of the same date up to the last one
+                        if (resume && value == continuation.lastValue && *it >= continuation.lastDocument) {
+                            continue;
+                        }
+                        continuation.lastValue = value;
+                        continuation.lastDocument = *it;
+                    }
+                    documents.push_back(*it);
+                }
+            }
+            continuation.offset = first;
+            results = identifiers(*mDb, documents);
+
+            SinkTrace() << "Found " << results.size() << " results, limited to " << limit << " in " << Sink::Log::TraceTime(time.elapsed());
+        }
+        catch (const Xapian::DatabaseModifiedError &) {
+            results.clear();
+            continuation = initial;
+            exhausted = true;
+            if (reopen()) {
+                continue;
+            }
+        }
+        catch (const Xapian::Error &) {
+            // Nothing to do, move along
+            exhausted = true;
+        }
+        break;
     }
     return results;
 }
@@ -18,11 +18,82 @@ namespace Xapian {
 class SINK_EXPORT FulltextIndex
 {
 public:
+    enum Order {
+        //Newest first
+        DateOrder,
+        //Best match first
+        RelevanceOrder
+    };
+
     FulltextIndex(const QByteArray &resourceInstanceIdentifier, Sink::Storage::DataStore::AccessMode mode = Sink::Storage::DataStore::ReadOnly);
     ~FulltextIndex();
 
     static bool exists(const QByteArray &resourceInstanceIdentifier);
 
+    /**
+     * The generation of the index, which increases with every commit that changed it.
+     *
+     * It is stored in the resource database, so readers in other processes notice changes in their next transaction.
+     */
+    struct Generation {
+        //Created along with the first commit, so a recreated resource is told apart from an older generation
+        QByteArray instance;
+        qint64 counter{0};
+    };
+    static Generation generation(const Sink::Storage::DataStore::Transaction &transaction);
+    static void increaseGeneration(Sink::Storage::DataStore::Transaction &transaction);
+
+    /**
+     * Calls @param callback with the process-wide reader of the resource.
+     *
+     * The reader is shared between threads and kept open across queries, so it keeps its block caches warm,
+     * and is only reopened if @param generation is newer than the one it was opened with.
+     * Callers are serialized, since Xapian databases can't be used from multiple threads at once.
+     */
+    static void withReader(const QByteArray &resourceInstanceIdentifier, const Generation &generation, const std::function<void(FulltextIndex &)> &callback);
+
+    /**
+     * A change of a document, queued by the pipeline and indexed later on by indexQueue.
+     */
+    struct QueuedChange {
+        Sink::Storage::Identifier identifier;
+        //Removes the document instead of replacing it
+        bool removal{false};
+        QList<QPair<QString, QString>> values;
+        QDateTime date;
+    };
+
+    /**
+     * The database of the queue, keyed by the first revision of the changes of a transaction.
+     */
+    static QByteArray queueDatabase();
+
+    /**
+     * Queues the @param changes of a transaction, made from @param revision on.
+     *
+     * The queue is part of the resource database, so it survives restarts and commits atomically with the changed entities.
+     */
+    static void enqueue(Sink::Storage::DataStore::Transaction &transaction, qint64 revision, const QVector<QueuedChange> &changes);
+
+    /**
+     * The revision up to which all changes are in the index.
+     */
+    static qint64 indexedRevision(const Sink::Storage::DataStore::Transaction &transaction);
+
+    /**
+     * Returns true if there are changes in the queue, which is never the case for resources without a fulltext indexer.
+     */
+    static bool hasQueuedChanges(const Sink::Storage::DataStore::Transaction &transaction);
+
+    /**
+     * Indexes at least @param batchSize queued changes, or all of them if there are fewer, in a single index commit,
+     * and removes them from the queue. Must not be called concurrently for the same resource.
+     *
+     * @param indexedRevision is set to the revision up to which changes are indexed if anything was indexed.
+     * Returns true once the queue is drained.
+     */
+    static bool indexQueue(const QByteArray &resourceInstanceIdentifier, int batchSize, qint64 &indexedRevision);
+
     void add(const Sink::Storage::Identifier &key, const QString &value, const QDateTime &date = {});
     void add(const Sink::Storage::Identifier &key, const QList<QPair<QString, QString>> &values, const QDateTime &date = {});
     void remove(const Sink::Storage::Identifier &key);
@@ -30,7 +101,22 @@ public:
     void commitTransaction();
     void abortTransaction();
 
+    /**
+     * Looks up all matches of @param key by date, or checks whether the entity @param id matches.
+     */
     QVector<Sink::Storage::Identifier> lookup(const QString &key, const Sink::Storage::Identifier &id = {});
+    /**
+     * Looks up the first @param limit matches of @param key in @param order.
+     *
+     * @param continuation is set to an opaque token that lookupMore continues from, or left empty if there are no further matches.
+     */
+    QVector<Sink::Storage::Identifier> lookup(const QString &key, Order order, int limit, QByteArray &continuation);
+    /**
+     * Looks up the next @param limit matches after @param continuation, which is updated accordingly.
+     *
+     * Matches by date continue after the date and document of the last match, so deep pages cost as much as the first one.
+     */
+    QVector<Sink::Storage::Identifier> lookupMore(int limit, QByteArray &continuation);
 
     qint64 getDoccount() const;
     struct Result {
@@ -44,7 +130,10 @@ public:
     }
 
 private:
+    struct Continuation;
     Xapian::WritableDatabase* writableDatabase();
+    bool reopen();
+    QVector<Sink::Storage::Identifier> lookupPage(Continuation &continuation, bool resume, int limit, bool &exhausted, const Sink::Storage::Identifier &id = {});
     Q_DISABLE_COPY(FulltextIndex);
     Xapian::Database *mDb{nullptr};
     QString mName;
@@ -25,6 +25,7 @@
 #include "commandprocessor.h"
 #include "definitions.h"
 #include "storage.h"
+#include "storage/entitystore.h"
 
 using namespace Sink;
 using namespace Sink::Storage;
@@ -40,6 +41,12 @@ GenericResource::GenericResource(const ResourceContext &resourceContext, const Q
     QObject::connect(mProcessor.data(), &CommandProcessor::error, [this](int errorCode, const QString &msg) { onProcessorError(errorCode, msg); });
     QObject::connect(mProcessor.data(), &CommandProcessor::notify, this, &GenericResource::notify);
     QObject::connect(mPipeline.data(), &Pipeline::revisionUpdated, this, &Resource::revisionUpdated);
+    //The revision only increases with commits, the progress of the fulltext index is announced separately
+    QObject::connect(mPipeline.data(), &Pipeline::fulltextIndexed, this, [this](qint64) {
+        Sink::Notification n;
+        n.type = Sink::Notification::FulltextIndexed;
+        emit notify(n);
+    });
 }
 
 GenericResource::~GenericResource()
@@ -74,16 +81,46 @@ bool GenericResource::checkForUpgrade()
     if (currentDatabaseVersion != Sink::latestDatabaseVersion()) {
         SinkLog() << "Starting database upgrade from " << currentDatabaseVersion << " to " << Sink::latestDatabaseVersion();
 
+        //The upgrades that only require rebuilding the property indexes from the stored entities, by the version they upgrade from.
+        //Only the property indexes of the listed types are rebuilt, or those of all types if none are listed.
+        static const QMap<int, QByteArrayList> indexUpgrades{
+            //Version 9 changed the key encoding of the value and sorted indexes.
+            {8, {}},
+            //Version 10 added the statistics of those indexes, which are collected while rebuilding them.
+            {9, {}},
+            //Version 11 added the covering index of mails.
+            {10, {ApplicationDomain::getTypeName<ApplicationDomain::Mail>()}},
+            //Version 12 replaced the sampled period index of events with an interval index.
+            {11, {ApplicationDomain::getTypeName<ApplicationDomain::Event>()}},
+            //Version 13 added the n-gram indexes of contacts.
+            {12, {ApplicationDomain::getTypeName<ApplicationDomain::Contact>()}}
+        };
+
         bool nukeDatabases = false;
+        bool rebuildAllIndexes = false;
+        QByteArrayList rebuildTypes;
         //Only apply the necessary updates.
         for (int i = currentDatabaseVersion; i < Sink::latestDatabaseVersion(); i++) {
-            //TODO implement specific upgrade paths where applicable, and only nuke otherwise
-            nukeDatabases = true;
+            if (indexUpgrades.contains(i)) {
+                const auto types = indexUpgrades.value(i);
+                rebuildAllIndexes |= types.isEmpty();
+                rebuildTypes << types;
+            } else {
+                //TODO implement specific upgrade paths where applicable, and only nuke otherwise
+                nukeDatabases = true;
+            }
         }
         if (nukeDatabases) {
             SinkLog() << "Wiping all databases during upgrade, you will have to resync.";
             //Right now upgrading just means removing all local storage so we will resync
             GenericResource::removeFromDisk(mResourceContext.instanceId());
+        } else if (rebuildAllIndexes || !rebuildTypes.isEmpty()) {
+            //The indexes are rebuilt in the background by the command processor, queries scan the entities until then.
+            SinkLog() << "Rebuilding the indexes in the background.";
+            Sink::Storage::EntityStore entityStore{mResourceContext, {"upgrade"}};
+            entityStore.startTransaction(Storage::DataStore::ReadWrite);
+            entityStore.startPropertyIndexRebuild(rebuildAllIndexes ? QByteArrayList{} : rebuildTypes);
+            entityStore.commitTransaction();
         }
         auto store = Sink::Storage::DataStore(Sink::storageLocation(), mResourceContext.instanceId(), Sink::Storage::DataStore::ReadWrite);
         auto t = store.createTransaction(Storage::DataStore::ReadWrite);
@@ -2,8 +2,36 @@
 
 #include "log.h"
 
+#include <QtEndian>
+
 using Sink::Storage::Identifier;
 
+/*
+ * A continuation token consists of the length of the key, followed by the key and the value of the last entry that was handed out.
+ */
+static QByteArray continuationToken(const std::string_view &key, const std::string_view &value)
+{
+    QByteArray token(sizeof(quint32), Qt::Uninitialized);
+    qToBigEndian<quint32>(key.size(), token.data());
+    token.append(key.data(), key.size());
+    token.append(value.data(), value.size());
+    return token;
+}
+
+static bool parseContinuationToken(const QByteArray &token, QByteArray &key, QByteArray &value)
+{
+    if (token.size() < int(sizeof(quint32))) {
+        return false;
+    }
+    const auto keySize = qFromBigEndian<quint32>(token.constData());
+    if (keySize > token.size() - sizeof(quint32)) {
+        return false;
+    }
+    key = token.mid(sizeof(quint32), keySize);
+    value = token.mid(sizeof(quint32) + keySize);
+    return true;
+}
+
 Index::Index(const QString &storageRoot, const QString &dbName, const QString &indexName, Sink::Storage::DataStore::AccessMode mode)
     : mTransaction(Sink::Storage::DataStore(storageRoot, dbName, mode).createTransaction(mode)),
       mDb(mTransaction.openDatabase(indexName.toLatin1(), std::function<void(const Sink::Storage::DataStore::Error &)>(), Sink::Storage::AllowDuplicates)),
@@ -63,15 +91,17 @@ void Index::remove(const QByteArray &key, const QByteArray &value, bool ignoreRe
 
 void Index::lookup(const QByteArray &key, const std::function<bool(const QByteArray &value)> &resultHandler, const std::function<void(const Error &error)> &errorHandler, bool matchSubStringKeys)
 {
-    mDb.scan(key,
-        [&](const QByteArray &key, const QByteArray &value) -> bool {
-            return resultHandler(value);
-        },
-        [&](const Sink::Storage::DataStore::Error &error) {
-            SinkWarningCtx(mLogCtx) << "Error while retrieving value:" << error << mName;
-            errorHandler(Error(error.store, error.code, error.message));
-        },
-        matchSubStringKeys);
+    const auto onError = [&](const Sink::Storage::DataStore::Error &error) {
+        SinkWarningCtx(mLogCtx) << "Error while retrieving value:" << error << mName;
+        errorHandler(Error(error.store, error.code, error.message));
+    };
+    //An empty key results in a full scan
+    auto cursor = (matchSubStringKeys || key.isEmpty()) ? mDb.prefix(key, onError) : mDb.find(key, onError);
+    for (const auto &entry : cursor) {
+        if (!resultHandler(QByteArray::fromRawData(entry.value.data(), entry.value.size()))) {
+            break;
+        }
+    }
 }
 
 QByteArray Index::lookup(const QByteArray &key)
@@ -95,3 +125,44 @@ void Index::rangeLookup(const QByteArray &lowerBound, const QByteArray &upperBou
                 errorHandler(Error(error.store, error.code, error.message));
             });
 }
+
+void Index::rangeLookup(const QByteArray &lowerBound, const QByteArray &upperBound, QByteArray &continuation,
+        const std::function<bool(const QByteArray &value)> &resultHandler,
+        const std::function<void(const Error &error)> &errorHandler)
+{
+    const auto onError = [&](const Sink::Storage::DataStore::Error &error) {
+        SinkWarningCtx(mLogCtx) << "Error while retrieving value:" << error << mName;
+        errorHandler(Error(error.store, error.code, error.message));
+    };
+    QByteArray lastKey;
+    QByteArray lastValue;
+    const bool resume = !continuation.isEmpty();
+    if (resume && !parseContinuationToken(continuation, lastKey, lastValue)) {
+        SinkWarningCtx(mLogCtx) << "Invalid continuation token for " << mName;
+        continuation.clear();
+        return;
+    }
+    continuation.clear();
+
+    auto cursor = mDb.range(lowerBound, upperBound, onError);
+    bool valid = resume ? cursor.seek(lastKey) : cursor.first();
+    if (resume) {
+        //Duplicates are sorted by value, so we only have to skip those of the last key up to the last value
+        const std::string_view key{lastKey.constData(), size_t(lastKey.size())};
+        const std::string_view value{lastValue.constData(), size_t(lastValue.size())};
+        while (valid) {
+            const auto entry = cursor.current();
+            if (entry.key != key || entry.value > value) {
+                break;
+            }
+            valid = cursor.next();
+        }
+    }
+    for (; valid; valid = cursor.next()) {
+        const auto entry = cursor.current();
+        if (!resultHandler(QByteArray::fromRawData(entry.value.data(), entry.value.size()))) {
+            continuation = continuationToken(entry.key, entry.value);
+            return;
+        }
+    }
+}
@@ -48,6 +48,17 @@ public:
         const std::function<void(const QByteArray &value)> &resultHandler,
         const std::function<void(const Error &error)> &errorHandler);
 
+    /**
+     * Looks up the entries between the bounds in index order, resuming after the entry @param continuation points to.
+     *
+     * Returning false from @param resultHandler stops the lookup after that entry, and leaves an opaque token in @param continuation
+     * that resumes the lookup right after it with a single seek, so every page costs the same no matter how deep it is.
+     * The token is cleared once the range is exhausted. An empty bound leaves the range open on that side.
+     */
+    void rangeLookup(const QByteArray &lowerBound, const QByteArray &upperBound, QByteArray &continuation,
+        const std::function<bool(const QByteArray &value)> &resultHandler,
+        const std::function<void(const Error &error)> &errorHandler);
+
 private:
     Q_DISABLE_COPY(Index);
     Sink::Storage::DataStore::Transaction mTransaction;
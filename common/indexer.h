@@ -20,6 +20,7 @@
 
 #include "storage.h"
 #include <QSharedPointer>
+#include <QByteArrayList>
 
 class TypeIndex;
 namespace Sink {
@@ -39,6 +40,12 @@ public:
         add(newEntity);
     }
     virtual void remove(const ApplicationDomain::ApplicationDomainType &entity) = 0;
+    /**
+     * The properties the indexer depends on.
+     *
+     * modify is only called if any of them changed. With no properties it is always called.
+     */
+    virtual QByteArrayList inputProperties() const { return {}; }
     virtual void commitTransaction() {};
     virtual void abortTransaction() {};
 
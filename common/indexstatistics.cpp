@@ -0,0 +1,125 @@
+#include "indexstatistics.h"
+
+#include "log.h"
+
+#include <QHash>
+#include <QtEndian>
+#include <algorithm>
+
+using Sink::Storage::DataStore;
+
+int IndexStatistics::bucketOf(const QByteArray &key)
+{
+    //The hash has to be stable across processes, so we can't use a seeded qHash
+    return qChecksum(key.constData(), key.size()) % BucketCount;
+}
+
+void IndexStatistics::add(const QByteArray &key)
+{
+    mEntries++;
+    mBuckets[bucketOf(key)]++;
+}
+
+void IndexStatistics::remove(const QByteArray &key)
+{
+    mEntries--;
+    mBuckets[bucketOf(key)]--;
+}
+
+qint64 IndexStatistics::entries() const
+{
+    //Failed removals can leave us with slightly off numbers
+    return qMax(mEntries, qint64{0});
+}
+
+int IndexStatistics::usedBuckets() const
+{
+    return std::count_if(mBuckets.cbegin(), mBuckets.cend(), [](qint64 count) { return count > 0; });
+}
+
+qint64 IndexStatistics::largestBucket() const
+{
+    return qMax(*std::max_element(mBuckets.cbegin(), mBuckets.cend()), qint64{0});
+}
+
+qint64 IndexStatistics::estimateEquals(const QByteArray &key) const
+{
+    return qMax(mBuckets[bucketOf(key)], qint64{0});
+}
+
+bool IndexStatistics::isEmpty() const
+{
+    return !mEntries && std::all_of(mBuckets.cbegin(), mBuckets.cend(), [](qint64 count) { return count == 0; });
+}
+
+QByteArray IndexStatistics::toByteArray() const
+{
+    QByteArray data(sizeof(qint64) * (1 + BucketCount), Qt::Uninitialized);
+    auto out = data.data();
+    qToLittleEndian<qint64>(mEntries, out);
+    for (int i = 0; i < BucketCount; i++) {
+        qToLittleEndian<qint64>(mBuckets[i], out + sizeof(qint64) * (i + 1));
+    }
+    return data;
+}
+
+IndexStatistics IndexStatistics::fromByteArray(const QByteArray &data)
+{
+    IndexStatistics statistics;
+    if (data.size() != int(sizeof(qint64) * (1 + BucketCount))) {
+        SinkWarning() << "Invalid index statistics of size " << data.size();
+        return statistics;
+    }
+    const auto in = data.constData();
+    statistics.mEntries = qFromLittleEndian<qint64>(in);
+    for (int i = 0; i < BucketCount; i++) {
+        statistics.mBuckets[i] = qFromLittleEndian<qint64>(in + sizeof(qint64) * (i + 1));
+    }
+    return statistics;
+}
+
+QByteArray IndexStatistics::databaseName(const QByteArray &type)
+{
+    return type + ".index.stats";
+}
+
+bool IndexStatistics::read(const DataStore::Transaction &transaction, const QByteArray &type, const QByteArray &indexName, IndexStatistics &statistics)
+{
+    bool found = false;
+    transaction.openDatabase(databaseName(type)).scan(indexName,
+        [&](const QByteArray &, const QByteArray &value) -> bool {
+            statistics = fromByteArray(value);
+            found = true;
+            return false;
+        },
+        [](const DataStore::Error &error) {
+            if (error.code != DataStore::NotFound) {
+                SinkWarning() << "Failed to read the index statistics: " << error.message;
+            }
+        });
+    return found;
+}
+
+void IndexStatistics::merge(DataStore::Transaction &transaction, const QByteArray &type, const QByteArray &indexName, const IndexStatistics &changes)
+{
+    IndexStatistics statistics;
+    read(transaction, type, indexName, statistics);
+    statistics.mEntries += changes.mEntries;
+    for (int i = 0; i < BucketCount; i++) {
+        statistics.mBuckets[i] += changes.mBuckets[i];
+    }
+    transaction.openDatabase(databaseName(type)).write(indexName, statistics.toByteArray(),
+        [](const DataStore::Error &error) {
+            SinkWarning() << "Failed to write the index statistics: " << error.message;
+        });
+}
+
+void IndexStatistics::remove(DataStore::Transaction &transaction, const QByteArray &type, const QByteArray &indexName)
+{
+    transaction.openDatabase(databaseName(type)).remove(indexName,
+        [](const DataStore::Error &error) {
+            if (error.code != DataStore::NotFound) {
+                SinkWarning() << "Failed to remove the index statistics: " << error.message;
+            }
+        });
+}
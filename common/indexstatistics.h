@@ -0,0 +1,56 @@
+#pragma once
+
+#include "sink_export.h"
+#include "storage.h"
+
+#include <QByteArray>
+#include <array>
+
+/**
+ * Cardinality statistics of an index, used to estimate the cost of lookups.
+ *
+ * Besides the number of entries, the entries are counted in a small histogram of key hash buckets.
+ * For an equality lookup the bucket of the key is an upper bound of the number of matching entries,
+ * which is exact as long as no other key falls into the same bucket.
+ *
+ * The statistics of all indexes of a type are persisted in the "<type>.index.stats" database, by index name.
+ * Changes are accumulated in memory and applied with merge, so index updates don't have to read and write them each time.
+ */
+class SINK_EXPORT IndexStatistics
+{
+public:
+    static const int BucketCount = 64;
+
+    void add(const QByteArray &key);
+    void remove(const QByteArray &key);
+
+    qint64 entries() const;
+    /**
+     * The number of buckets that contain entries, which approximates the number of distinct keys.
+     */
+    int usedBuckets() const;
+    qint64 largestBucket() const;
+    qint64 estimateEquals(const QByteArray &key) const;
+
+    bool isEmpty() const;
+
+    QByteArray toByteArray() const;
+    static IndexStatistics fromByteArray(const QByteArray &data);
+
+    static QByteArray databaseName(const QByteArray &type);
+
+    /**
+     * Reads the statistics of @param indexName, returns false if there are none.
+     */
+    static bool read(const Sink::Storage::DataStore::Transaction &transaction, const QByteArray &type, const QByteArray &indexName, IndexStatistics &statistics);
+    /**
+     * Adds @param changes to the persisted statistics of @param indexName.
+     */
+    static void merge(Sink::Storage::DataStore::Transaction &transaction, const QByteArray &type, const QByteArray &indexName, const IndexStatistics &changes);
+    static void remove(Sink::Storage::DataStore::Transaction &transaction, const QByteArray &type, const QByteArray &indexName);
+
+private:
+    static int bucketOf(const QByteArray &key);
+    qint64 mEntries = 0;
+    std::array<qint64, BucketCount> mBuckets{};
+};
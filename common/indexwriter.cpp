@@ -0,0 +1,103 @@
+#include "indexwriter.h"
+
+#include "log.h"
+
+using Sink::Storage::DataStore;
+
+IndexWriter::Database &IndexWriter::database(const QByteArray &indexName, int flags)
+{
+    mEmpty = false;
+    auto it = mDatabases.find(indexName);
+    if (it == mDatabases.end()) {
+        it = mDatabases.insert(indexName, Database{DataStore::DatabaseHandle{indexName, flags}, {}, {}});
+    }
+    return it.value();
+}
+
+void IndexWriter::add(const QByteArray &indexName, const QByteArray &key, const QByteArray &value)
+{
+    Q_ASSERT(!key.isEmpty());
+    database(indexName, Sink::Storage::AllowDuplicates).entries[qMakePair(key, value)].count++;
+}
+
+void IndexWriter::remove(const QByteArray &indexName, const QByteArray &key, const QByteArray &value, bool ignoreRemovalFailure)
+{
+    auto &mutation = database(indexName, Sink::Storage::AllowDuplicates).entries[qMakePair(key, value)];
+    mutation.count--;
+    mutation.ignoreRemovalFailure = ignoreRemovalFailure;
+}
+
+void IndexWriter::write(const QByteArray &indexName, const QByteArray &key, const QByteArray &value)
+{
+    Q_ASSERT(!key.isEmpty());
+    Q_ASSERT(!value.isNull());
+    database(indexName, 0).values.insert(key, value);
+}
+
+void IndexWriter::erase(const QByteArray &indexName, const QByteArray &key)
+{
+    database(indexName, 0).values.insert(key, QByteArray{});
+}
+
+bool IndexWriter::isEmpty() const
+{
+    return mEmpty;
+}
+
+void IndexWriter::flush(DataStore::Transaction &transaction)
+{
+    if (mEmpty) {
+        return;
+    }
+    for (auto it = mDatabases.begin(); it != mDatabases.end(); it++) {
+        auto &database = it.value();
+        if (database.entries.isEmpty() && database.values.isEmpty()) {
+            continue;
+        }
+        const auto &name = it.key();
+        auto db = transaction.openDatabase(database.handle);
+        for (auto entry = database.entries.constBegin(); entry != database.entries.constEnd(); entry++) {
+            const auto &key = entry.key().first;
+            const auto &value = entry.key().second;
+            const auto &mutation = entry.value();
+            if (mutation.count > 0) {
+                db.write(key, value, [&](const DataStore::Error &error) {
+                    SinkWarning() << "Error while writing to the index " << name << error;
+                });
+            } else if (mutation.count < 0) {
+                db.remove(key, value, [&](const DataStore::Error &error) {
+                    if (!mutation.ignoreRemovalFailure || error.code != DataStore::NotFound) {
+                        SinkWarning() << "Error while removing from the index " << name << key << value << error;
+                    }
+                });
+            }
+        }
+        for (auto entry = database.values.constBegin(); entry != database.values.constEnd(); entry++) {
+            const auto &key = entry.key();
+            if (entry.value().isNull()) {
+                //The key may have been added and removed within this transaction
+                db.remove(key, [&](const DataStore::Error &error) {
+                    if (error.code != DataStore::NotFound) {
+                        SinkWarning() << "Error while removing from the index " << name << key << error;
+                    }
+                });
+            } else {
+                db.write(key, entry.value(), [&](const DataStore::Error &error) {
+                    SinkWarning() << "Error while writing to the index " << name << error;
+                });
+            }
+        }
+        database.entries.clear();
+        database.values.clear();
+    }
+    mEmpty = true;
+}
+
+void IndexWriter::clear()
+{
+    for (auto &database : mDatabases) {
+        database.entries.clear();
+        database.values.clear();
+    }
+    mEmpty = true;
+}
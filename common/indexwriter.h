@@ -0,0 +1,60 @@
+#pragma once
+
+#include "sink_export.h"
+#include "storage.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QPair>
+
+/**
+ * Buffers the mutations of indexes during a write transaction.
+ *
+ * The databases are opened once per flush via handles, which also skips the lookup by name in later transactions.
+ * The mutations are applied per database in key order, so the writes to the B-trees stay local,
+ * and the removal and addition of the same entry cancel out, as happens when a modification doesn't change an indexed value.
+ *
+ * Buffered mutations are not visible to lookups, so the writer has to be flushed before the indexes are read.
+ */
+class SINK_EXPORT IndexWriter
+{
+public:
+    /**
+     * Adds @param value to @param key in an index that allows duplicates.
+     */
+    void add(const QByteArray &indexName, const QByteArray &key, const QByteArray &value);
+    void remove(const QByteArray &indexName, const QByteArray &key, const QByteArray &value, bool ignoreRemovalFailure = false);
+
+    /**
+     * Sets the only value of @param key in an index without duplicates.
+     */
+    void write(const QByteArray &indexName, const QByteArray &key, const QByteArray &value);
+    void erase(const QByteArray &indexName, const QByteArray &key);
+
+    bool isEmpty() const;
+
+    void flush(Sink::Storage::DataStore::Transaction &transaction);
+    /**
+     * Discards all buffered mutations.
+     */
+    void clear();
+
+private:
+    struct Mutation {
+        //Additions minus removals
+        int count = 0;
+        bool ignoreRemovalFailure = false;
+    };
+    struct Database {
+        Sink::Storage::DataStore::DatabaseHandle handle;
+        //<(key, value), mutation> of an index with duplicates
+        QMap<QPair<QByteArray, QByteArray>, Mutation> entries;
+        //<key, value> of an index without duplicates, a null value removes the key
+        QMap<QByteArray, QByteArray> values;
+    };
+    Database &database(const QByteArray &indexName, int flags);
+    //Kept across transactions, so the handles stay resolved
+    QHash<QByteArray, Database> mDatabases;
+    bool mEmpty = true;
+};
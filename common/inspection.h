@@ -78,12 +78,26 @@ struct Inspection
         return inspection;
     }
 
+    /**
+     * Collect the operation metrics of the storage layer in the resource process.
+     *
+     * Handled by every resource, see ResourceControl::storageMetrics.
+     */
+    static Inspection StorageMetricsInspection(const QByteArray &resourceIdentifier)
+    {
+        Inspection inspection;
+        inspection.resourceIdentifier = resourceIdentifier;
+        inspection.type = StorageMetricsInspectionType;
+        return inspection;
+    }
+
     enum Type
     {
         PropertyInspectionType,
         ExistenceInspectionType,
         CacheIntegrityInspectionType,
         ConnectionInspectionType,
+        StorageMetricsInspectionType,
     };
     QByteArray resourceIdentifier;
     QByteArray entityIdentifier;
@@ -22,6 +22,8 @@
 #include "resourcecontext.h"
 #include "inspection_generated.h"
 #include "bufferutils.h"
+#include "inspection.h"
+#include "storage/metrics.h"
 
 #include <QDataStream>
 
@@ -63,6 +65,15 @@ KAsync::Job<void> Inspector::processCommand(void const *command, size_t size)
         QDataStream s(expectedValueString);
         QVariant expectedValue;
         s >> expectedValue;
+        if (inspectionType == ResourceControl::Inspection::StorageMetricsInspectionType) {
+            Sink::Notification n;
+            n.type = Sink::Notification::Inspection;
+            n.id = inspectionId;
+            n.code = Sink::Notification::Success;
+            n.message = QString::fromUtf8(Storage::OperationMetrics::Snapshot::toJson(Storage::OperationMetrics::snapshot()));
+            emit notify(n);
+            return KAsync::null<void>();
+        }
         inspect(inspectionType, inspectionId, domainType, entityId, property, expectedValue)
             .then<void>(
                 [=](const KAsync::Error &error) {
@@ -291,6 +291,7 @@ void Listener::processCommand(int commandId, uint messageId, const QByteArray &c
         } break;
         case Sink::Commands::UpgradeCommand:
             //Because we synchronously run the update directly on resource start, we know that the upgrade is complete once this message completes.
+            //Indexes that have to be rebuilt are rebuilt in the background afterwards.
             break;
         default:
             if (commandId > Sink::Commands::CustomCommand) {
@@ -29,36 +29,49 @@ using namespace Sink::ApplicationDomain;
 
 void FulltextIndexer::add(const ApplicationDomain::ApplicationDomainType &entity)
 {
-    if (!index) {
-        index.reset(new FulltextIndex{mResourceInstanceIdentifier, Storage::DataStore::ReadWrite});
+    if (mChanges.isEmpty()) {
+        //The revision of the first change of the transaction
+        mRevision = Storage::DataStore::maxRevision(transaction()) + 1;
     }
-    index->add(Sink::Storage::Identifier::fromDisplayByteArray(entity.identifier()), entity.getProperty("index").value<QList<QPair<QString, QString>>>(), entity.getProperty("indexDate").value<QDateTime>());
+    mChanges << FulltextIndex::QueuedChange{Sink::Storage::Identifier::fromDisplayByteArray(entity.identifier()), false,
+        entity.getProperty("index").value<QList<QPair<QString, QString>>>(), entity.getProperty("indexDate").value<QDateTime>()};
+}
+
+void FulltextIndexer::modify(const ApplicationDomain::ApplicationDomainType &, const ApplicationDomain::ApplicationDomainType &newEntity)
+{
+    //Adding replaces the existing document
+    add(newEntity);
 }
 
 void FulltextIndexer::remove(const ApplicationDomain::ApplicationDomainType &entity)
 {
-    if (!index) {
-        index.reset(new FulltextIndex{mResourceInstanceIdentifier, Storage::DataStore::ReadWrite});
+    if (mChanges.isEmpty()) {
+        mRevision = Storage::DataStore::maxRevision(transaction()) + 1;
     }
-    index->remove(Sink::Storage::Identifier::fromDisplayByteArray(entity.identifier()));
+    mChanges << FulltextIndex::QueuedChange{Sink::Storage::Identifier::fromDisplayByteArray(entity.identifier()), true, {}, {}};
+}
+
+QByteArrayList FulltextIndexer::inputProperties() const
+{
+    //The indexed content is extracted from the message by the preprocessor
+    return {Mail::MimeMessage::name, Mail::Date::name};
 }
 
 void FulltextIndexer::commitTransaction()
 {
-    if (index) {
-        index->commitTransaction();
+    if (!mChanges.isEmpty()) {
+        //Written to the resource database that is committed right after, so the queue is exactly as durable as the entities
+        FulltextIndex::enqueue(transaction(), mRevision, mChanges);
+        mChanges.clear();
     }
 }
 
 void FulltextIndexer::abortTransaction()
 {
-    if (index) {
-        index->abortTransaction();
-    }
+    mChanges.clear();
 }
 
 QMap<QByteArray, int> FulltextIndexer::databases()
 {
-    return {};
+    return {{FulltextIndex::queueDatabase(), Sink::Storage::IntegerKeys}};
 }
-
@@ -19,21 +19,27 @@
 #pragma once
 
 #include "indexer.h"
+#include "fulltextindex.h"
 
-class FulltextIndex;
 namespace Sink {
 
+/**
+ * Queues the changes for the fulltext index, which are indexed by FulltextIndex::indexQueue outside of the pipeline.
+ */
 class FulltextIndexer : public Indexer
 {
 public:
     typedef QSharedPointer<FulltextIndexer> Ptr;
     virtual void add(const ApplicationDomain::ApplicationDomainType &entity) Q_DECL_OVERRIDE;
+    virtual void modify(const ApplicationDomain::ApplicationDomainType &oldEntity, const ApplicationDomain::ApplicationDomainType &newEntity) Q_DECL_OVERRIDE;
     virtual void remove(const ApplicationDomain::ApplicationDomainType &entity) Q_DECL_OVERRIDE;
+    virtual QByteArrayList inputProperties() const Q_DECL_OVERRIDE;
     virtual void commitTransaction() Q_DECL_OVERRIDE;
     virtual void abortTransaction() Q_DECL_OVERRIDE;
     static QMap<QByteArray, int> databases();
 private:
-    QSharedPointer<FulltextIndex> index;
+    QVector<FulltextIndex::QueuedChange> mChanges;
+    qint64 mRevision{0};
 };
 
 }
@@ -111,6 +111,11 @@ void ThreadIndexer::modify(const ApplicationDomain::ApplicationDomainType &oldEn
     //Emails are immutable (for everything threading relevant), so we don't care about it so far.
 }
 
+QByteArrayList ThreadIndexer::inputProperties() const
+{
+    return {Mail::MessageId::name, Mail::ParentMessageIds::name};
+}
+
 void ThreadIndexer::remove(const ApplicationDomain::ApplicationDomainType &entity)
 {
     const auto messageId = entity.getProperty(Mail::MessageId::name);
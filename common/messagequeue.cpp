@@ -19,13 +19,17 @@
  */
 #include "messagequeue.h"
 #include "storage.h"
-#include "storage/key.h"
 #include <log.h>
 
 using namespace Sink::Storage;
 
-MessageQueue::MessageQueue(const QString &storageRoot, const QString &name) : mStorage(storageRoot, name, DataStore::ReadWrite), mReplayedRevision{-1}, mName{name}
+MessageQueue::MessageQueue(const QString &storageRoot, const QString &name, const Sink::Storage::StorageProfile &profile)
+    : mStorage(storageRoot, {name.toUtf8(), {{"__metadata", 0}, {"messages", IntegerKeys}}, profile}, DataStore::ReadWrite),
+    mMessages{"messages", IntegerKeys},
+    mReplayedRevision{-1},
+    mName{name}
 {
+    migrateDisplayKeys();
 }
 
 MessageQueue::~MessageQueue()
@@ -40,6 +44,59 @@ QString MessageQueue::name() const
     return mName;
 }
 
+static bool isMigrated(const DataStore::Transaction &transaction)
+{
+    bool migrated = false;
+    transaction.openDatabase("__metadata").scan("displayKeysMigrated",
+        [&](const QByteArray &, const QByteArray &) -> bool {
+            migrated = true;
+            return false;
+        },
+        [](const DataStore::Error &error) {
+            if (error.code != DataStore::NotFound) {
+                SinkWarning() << "Couldn't read the migration state of the queue: " << error;
+            }
+        });
+    return migrated;
+}
+
+/*
+ * Queues used to store the messages under the zero padded decimal revision in the default database.
+ * Move what is left of such a queue over, so no messages are lost on upgrade.
+ *
+ * The emptied default database can't be dropped, so we record the migration instead of checking it on every start.
+ */
+void MessageQueue::migrateDisplayKeys()
+{
+    {
+        const auto transaction = mStorage.createTransaction(DataStore::ReadOnly);
+        if (!transaction.getDatabaseNames().contains("default") || isMigrated(transaction)) {
+            return;
+        }
+    }
+    auto transaction = mStorage.createTransaction(DataStore::ReadWrite);
+    auto legacy = transaction.openDatabase();
+    auto messages = transaction.openDatabase(mMessages);
+    QByteArrayList keys;
+    for (const auto &entry : legacy.cursor()) {
+        const auto key = QByteArray{entry.key.data(), int(entry.key.size())};
+        messages.append(size_t(key.toLongLong()), QByteArray::fromRawData(entry.value.data(), entry.value.size()));
+        keys << key;
+    }
+    for (const auto &key : keys) {
+        legacy.remove(key);
+    }
+    transaction.openDatabase("__metadata").write("displayKeysMigrated", "1");
+    SinkTrace() << "Migrated " << keys.size() << " messages of " << mName;
+    transaction.commit();
+}
+
+qint64 MessageQueue::replayedRevision(const DataStore::Transaction &transaction) const
+{
+    //Everything up to the cleaned up revision has been replayed and removed already
+    return qMax(mReplayedRevision, DataStore::cleanedUpRevision(transaction));
+}
+
 void MessageQueue::enqueue(void const *msg, size_t size)
 {
     enqueue(QByteArray::fromRawData(static_cast<const char *>(msg), size));
@@ -56,7 +113,12 @@ void MessageQueue::startTransaction()
 
 void MessageQueue::commit()
 {
-    mWriteTransaction.commit();
+    //Nothing waits for the messages to be on disk, so we don't block on the flush.
+    mWriteTransaction.commitAsync()
+        .onError([name = name()](const KAsync::Error &error) {
+            SinkWarning() << "Failed to flush the queue to disk: " << name << error.errorMessage;
+        })
+        .exec();
     mWriteTransaction = DataStore::Transaction();
     processRemovals();
     emit messageReady();
@@ -70,7 +132,8 @@ void MessageQueue::enqueue(const QByteArray &value)
         startTransaction();
     }
     const qint64 revision = DataStore::maxRevision(mWriteTransaction) + 1;
-    mWriteTransaction.openDatabase().write(Revision{size_t(revision)}.toDisplayByteArray(), value);
+    //Revisions only ever grow, so we can always append
+    mWriteTransaction.openDatabase(mMessages).append(size_t(revision), value);
     DataStore::setMaxRevision(mWriteTransaction, revision);
     if (implicitTransaction) {
         commit();
@@ -90,9 +153,9 @@ void MessageQueue::processRemovals()
     }
     if (mReplayedRevision >= 0) {
         auto transaction = mStorage.createTransaction(DataStore::ReadWrite);
-        auto db = transaction.openDatabase();
+        auto db = transaction.openDatabase(mMessages);
         for (auto revision = DataStore::cleanedUpRevision(transaction) + 1; revision <= mReplayedRevision; revision++) {
-            db.remove(Revision{size_t(revision)}.toDisplayByteArray());
+            db.remove(size_t(revision));
         }
         DataStore::setCleanedUpRevision(transaction, mReplayedRevision);
         transaction.commit();
@@ -114,28 +177,22 @@ KAsync::Job<void> MessageQueue::dequeueBatch(int maxBatchSize, const std::functi
     return KAsync::start<void>([this, maxBatchSize, resultHandler](KAsync::Future<void> &future) {
         int count = 0;
         QList<KAsync::Future<void>> waitCondition;
-        mStorage.createTransaction(DataStore::ReadOnly)
-            .openDatabase()
-            .scan("",
-                [&](const QByteArray &key, const QByteArray &value) -> bool {
-                    const auto revision = key.toLongLong();
-                    if (revision <= mReplayedRevision) {
-                        return true;
-                    }
-                    mReplayedRevision = revision;
-
-                    waitCondition << resultHandler(value).exec();
+        {
+            auto transaction = mStorage.createTransaction(DataStore::ReadOnly);
+            auto cursor = transaction.openDatabase(mMessages).cursor([](const DataStore::Error &error) {
+                SinkError() << "Error while retrieving value" << error.message;
+                // errorHandler(Error(error.store, error.code, error.message));
+            });
+            //Skip directly past everything that has already been replayed
+            for (bool valid = cursor.seek(size_t(replayedRevision(transaction) + 1)); valid && count < maxBatchSize; valid = cursor.next()) {
+                const auto entry = cursor.current();
+                mReplayedRevision = entry.integerKey();
+
+                waitCondition << resultHandler(QByteArray::fromRawData(entry.value.data(), entry.value.size())).exec();
 
-                    count++;
-                    if (count < maxBatchSize) {
-                        return true;
-                    }
-                    return false;
-                },
-                [](const DataStore::Error &error) {
-                    SinkError() << "Error while retrieving value" << error.message;
-                    // errorHandler(Error(error.store, error.code, error.message));
-                });
+                count++;
+            }
+        }
 
         // Trace() << "Waiting on " << waitCondition.size() << " results";
         KAsync::waitForCompletion(waitCondition)
@@ -156,22 +213,9 @@ KAsync::Job<void> MessageQueue::dequeueBatch(int maxBatchSize, const std::functi
 
 bool MessageQueue::isEmpty()
 {
-    int count = 0;
     auto t = mStorage.createTransaction(DataStore::ReadOnly);
-    auto db = t.openDatabase();
-    if (db) {
-        db.scan("",
-            [&count, this](const QByteArray &key, const QByteArray &value) -> bool {
-                const auto revision = key.toLongLong();
-                if (revision <= mReplayedRevision) {
-                    return true;
-                }
-                count++;
-                return false;
-            },
-            [](const DataStore::Error &error) { SinkError() << "Error while checking if empty" << error.message; });
-    }
-    return count == 0;
+    //Messages are never written past the maximum revision
+    return DataStore::maxRevision(t) <= replayedRevision(t);
 }
 
 #pragma clang diagnostic push
@@ -30,6 +30,10 @@
 
 /**
  * A persistent FIFO message queue.
+ *
+ * Messages are stored under consecutive integer keys.
+ * The maximum revision of the store is the tail of the queue, and the cleaned up revision its head,
+ * so a dequeue can seek directly to the first message that has not been replayed yet.
  */
 class SINK_EXPORT MessageQueue : public QObject
 {
@@ -50,7 +54,7 @@ public:
         int code;
     };
 
-    MessageQueue(const QString &storageRoot, const QString &name);
+    MessageQueue(const QString &storageRoot, const QString &name, const Sink::Storage::StorageProfile &profile = {});
     ~MessageQueue();
 
     QString name() const;
@@ -77,7 +81,11 @@ private slots:
 
 private:
     Q_DISABLE_COPY(MessageQueue);
+    qint64 replayedRevision(const Sink::Storage::DataStore::Transaction &transaction) const;
+    void migrateDisplayKeys();
+
     Sink::Storage::DataStore mStorage;
+    Sink::Storage::DataStore::DatabaseHandle mMessages;
     Sink::Storage::DataStore::Transaction mWriteTransaction;
     qint64 mReplayedRevision;
     QString mName;
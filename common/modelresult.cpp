@@ -31,7 +31,8 @@ using namespace Sink;
 
 static uint getInternalIdentifer(const QByteArray &resourceId, const QByteArray &entityId)
 {
-    return qHash(resourceId + entityId);
+    //Seeded instead of hashing the concatenation, which would allocate for every entity
+    return qHash(entityId, qHash(resourceId));
 }
 
 static uint qHash(const Sink::ApplicationDomain::ApplicationDomainType &type)
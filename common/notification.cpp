@@ -42,6 +42,8 @@ static QByteArray name(int type)
             return "revisionupdate";
         case Notification::FlushCompletion:
             return "flushcompletion";
+        case Notification::FulltextIndexed:
+            return "fulltextindexed";
     }
     return "Unknown:" + QByteArray::number(type);
 }
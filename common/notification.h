@@ -40,7 +40,9 @@ public:
         Progress,
         Inspection,
         RevisionUpdate,
-        FlushCompletion
+        FlushCompletion,
+        //The fulltext index caught up with more revisions
+        FulltextIndexed
     };
     /**
      * Used as code for Inspection type notifications
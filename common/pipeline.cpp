@@ -25,6 +25,7 @@
 #include <QVector>
 #include <QDebug>
 #include <QTime>
+#include <functional>
 #include "entity_generated.h"
 #include "metadata_generated.h"
 #include "createentity_generated.h"
@@ -38,6 +39,8 @@
 #include "bufferutils.h"
 #include "storage/entitystore.h"
 #include "store.h"
+#include "fulltextindex.h"
+#include "asyncutils.h"
 
 using namespace Sink;
 using namespace Sink::Storage;
@@ -56,6 +59,26 @@ public:
     bool revisionChanged;
     QTime transactionTime;
     int transactionItemCount;
+
+    /*
+     * Commits the transaction using @param commit, or aborts it if nothing changed.
+     *
+     * Returns the committed revision, or -1 if the transaction was aborted.
+     */
+    qint64 commitTransaction(const std::function<void()> &commit)
+    {
+        if (!revisionChanged) {
+            entityStore.abortTransaction();
+            return -1;
+        }
+        const auto revision = entityStore.maxRevision();
+        commit();
+        const auto elapsed = transactionTime.elapsed();
+        SinkTraceCtx(logCtx) << "Committing revision: " << revision << ":" << transactionItemCount << " items in: " << Log::TraceTime(elapsed) << " "
+                << (double)elapsed / (double)qMax(transactionItemCount, 1) << "[ms/item]";
+        revisionChanged = false;
+        return revision;
+    }
 };
 
 
@@ -99,21 +122,31 @@ void Pipeline::commit()
     // for (auto processor : d->processors[bufferType]) {
     //     processor->finalize();
     // }
-    if (!d->revisionChanged) {
-        d->entityStore.abortTransaction();
-        return;
-    }
-    const auto revision = d->entityStore.maxRevision();
-    d->entityStore.commitTransaction();
-    const auto elapsed = d->transactionTime.elapsed();
-    SinkTraceCtx(d->logCtx) << "Committing revision: " << revision << ":" << d->transactionItemCount << " items in: " << Log::TraceTime(elapsed) << " "
-            << (double)elapsed / (double)qMax(d->transactionItemCount, 1) << "[ms/item]";
-    if (d->revisionChanged) {
-        d->revisionChanged = false;
+    const auto revision = d->commitTransaction([this] { d->entityStore.commitTransaction(); });
+    if (revision >= 0) {
         emit revisionUpdated(revision);
     }
 }
 
+KAsync::Job<void> Pipeline::commitAsync()
+{
+    auto durable = KAsync::null<void>();
+    const auto revision = d->commitTransaction([&] { durable = d->entityStore.commitTransactionAsync(); });
+    if (revision < 0) {
+        return KAsync::null<void>();
+    }
+    return durable
+        .guard(this)
+        .then([this, revision](const KAsync::Error &error) {
+            if (error) {
+                SinkErrorCtx(d->logCtx) << "Failed to flush revision " << revision << " to disk: " << error.errorMessage;
+                return KAsync::error<void>(error);
+            }
+            emit revisionUpdated(revision);
+            return KAsync::null<void>();
+        });
+}
+
 KAsync::Job<qint64> Pipeline::newEntity(void const *command, size_t size)
 {
     d->transactionItemCount++;
@@ -397,6 +430,48 @@ void Pipeline::cleanupRevisions(qint64 revision)
     d->revisionChanged = d->entityStore.cleanupRevisions(revision);
 }
 
+void Pipeline::compactIfRequired()
+{
+    d->entityStore.compactIfRequired();
+}
+
+QByteArray Pipeline::rebuildPropertyIndexes(qint64 batchSize, qint64 &progress, qint64 &total)
+{
+    d->entityStore.startTransaction(DataStore::ReadWrite);
+    const auto type = d->entityStore.continuePropertyIndexRebuild(batchSize, progress, total);
+    if (type.isEmpty()) {
+        d->entityStore.abortTransaction();
+        return {};
+    }
+    d->entityStore.commitTransaction();
+    return type;
+}
+
+KAsync::Job<bool> Pipeline::indexFulltext(int batchSize)
+{
+    const auto resourceInstanceIdentifier = d->resourceContext.instanceId();
+    {
+        //Resources without a fulltext indexer never queue anything, so we don't bother the worker
+        DataStore store{Sink::storageLocation(), resourceInstanceIdentifier, DataStore::ReadOnly};
+        if (!FulltextIndex::hasQueuedChanges(store.createTransaction(DataStore::ReadOnly))) {
+            return KAsync::value(true);
+        }
+    }
+    auto indexedRevision = QSharedPointer<qint64>::create(-1);
+    return async::run<bool>([=] {
+            return FulltextIndex::indexQueue(resourceInstanceIdentifier, batchSize, *indexedRevision);
+        })
+        .guard(this)
+        .then([this, indexedRevision](bool drained) {
+            if (*indexedRevision >= 0) {
+                SinkTraceCtx(d->logCtx) << "Indexed fulltext until revision: " << *indexedRevision;
+                //Fulltext queries only read until the indexed revision, so they have to pick up the rest now
+                emit fulltextIndexed(*indexedRevision);
+            }
+            return drained;
+        });
+}
+
 
 class Preprocessor::Private {
 public:
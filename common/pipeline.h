@@ -52,6 +52,13 @@ public:
     void setPreprocessors(const QString &entityType, const QVector<Preprocessor *> &preprocessors);
     void startTransaction();
     void commit();
+    /*
+     * Commits without waiting for the disk, and announces the revision once it is on disk.
+     *
+     * The returned job completes after the revision has been announced,
+     * or fails without announcing it if the revision could not be flushed to disk.
+     */
+    KAsync::Job<void> commitAsync();
 
     KAsync::Job<qint64> newEntity(void const *command, size_t size);
     KAsync::Job<qint64> modifiedEntity(void const *command, size_t size);
@@ -62,9 +69,35 @@ public:
      */
     void cleanupRevisions(qint64 revision);
 
+    /*
+     * Compacts the store if enough space can be reclaimed. Must be called outside of a transaction.
+     */
+    void compactIfRequired();
+
+    /*
+     * Continues a rebuild of the property indexes with up to @param batchSize revisions, in its own transaction.
+     * Must be called outside of a transaction.
+     *
+     * Returns the rebuilt type, or an empty type if there is nothing left to rebuild.
+     * See Storage::EntityStore::continuePropertyIndexRebuild.
+     */
+    QByteArray rebuildPropertyIndexes(qint64 batchSize, qint64 &progress, qint64 &total);
+
+    /*
+     * Indexes a batch of the queued fulltext changes in a worker thread, and announces the indexed revision.
+     * Must not be called again before the returned job completes.
+     *
+     * The returned job yields true once the queue is drained. See FulltextIndex::indexQueue.
+     */
+    KAsync::Job<bool> indexFulltext(int batchSize);
+
 
 signals:
     void revisionUpdated(qint64);
+    /*
+     * The fulltext index caught up with @param revision, which can be behind the latest revision.
+     */
+    void fulltextIndexed(qint64 revision);
 
 private:
     class Private;
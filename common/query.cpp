@@ -22,6 +22,8 @@
 #include <QList>
 #include <QDataStream>
 
+#include <algorithm>
+
 using namespace Sink;
 
 static const int registerQuery = qRegisterMetaTypeStreamOperators<Sink::QueryBase>();
@@ -155,6 +157,30 @@ QueryBase::Comparator::Comparator(const QVariant &v, Comparators c) : value(v),
 {
 }
 
+bool QueryBase::Comparator::containedTexts(const QVariant &value, QStringList &texts)
+{
+    const auto type = value.userType();
+    if (type == QMetaType::QString) {
+        texts << value.toString();
+    } else if (type == QMetaType::QStringList) {
+        texts << value.toStringList();
+    } else if (type == qMetaTypeId<QList<ApplicationDomain::Contact::Email>>()) {
+        for (const auto &email : value.value<QList<ApplicationDomain::Contact::Email>>()) {
+            texts << email.email;
+        }
+    } else if (type == qMetaTypeId<ApplicationDomain::Mail::Contact>()) {
+        const auto contact = value.value<ApplicationDomain::Mail::Contact>();
+        texts << contact.name << contact.emailAddress;
+    } else if (type == qMetaTypeId<QList<ApplicationDomain::Mail::Contact>>()) {
+        for (const auto &contact : value.value<QList<ApplicationDomain::Mail::Contact>>()) {
+            texts << contact.name << contact.emailAddress;
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
 bool QueryBase::Comparator::matches(const QVariant &v) const
 {
     switch(comparator) {
@@ -166,11 +192,17 @@ bool QueryBase::Comparator::matches(const QVariant &v) const
                 return false;
             }
             return v == value;
-        case Contains:
+        case Contains: {
             if (!v.isValid()) {
                 return false;
             }
+            QStringList texts;
+            if (containedTexts(v, texts)) {
+                const auto substring = value.toString();
+                return std::any_of(texts.cbegin(), texts.cend(), [&](const QString &text) { return text.contains(substring, Qt::CaseInsensitive); });
+            }
             return v.value<QByteArrayList>().contains(value.toByteArray());
+        }
         case In:
             if (!v.isValid()) {
                 return false;
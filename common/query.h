@@ -44,7 +44,17 @@ public:
         Comparator();
         Comparator(const QVariant &v);
         Comparator(const QVariant &v, Comparators c);
+        /**
+         * Contains matches a member of a QByteArrayList, and a case insensitive substring of any of the containedTexts otherwise.
+         */
         bool matches(const QVariant &v) const;
+
+        /**
+         * The texts of a string, string list, or email address property value, which Contains matches substrings of.
+         *
+         * Returns false for other values.
+         */
+        static bool containedTexts(const QVariant &value, QStringList &texts);
         bool operator==(const Comparator &other) const;
 
         QVariant value;
@@ -461,10 +471,14 @@ public:
         return *this;
     }
 
+    /**
+     * Filters by a member of a QByteArrayList property, or by a case insensitive substring of a text property.
+     *
+     * See QueryBase::Comparator::containedTexts for the text properties.
+     */
     template <typename T>
-    Query &containsFilter(const QByteArray &value)
+    Query &containsFilter(const typename std::conditional<std::is_same<typename T::Type, QByteArrayList>::value, QByteArray, QString>::type &value)
     {
-        static_assert(std::is_same<typename T::Type, QByteArrayList>::value, "The contains filter is only implemented for QByteArray in QByteArrayList");
         QueryBase::filter(T::name, QueryBase::Comparator(QVariant::fromValue(value), QueryBase::Comparator::Contains));
         return *this;
     }
@@ -23,6 +23,7 @@
 #include <QPointer>
 #include <thread>
 #include <chrono>
+#include <algorithm>
 
 #include "commands.h"
 #include "asyncutils.h"
@@ -38,6 +39,14 @@ struct ReplayResult {
     DataStoreQuery::State::Ptr queryState;
 };
 
+static bool isFulltextQuery(const Sink::Query &query)
+{
+    const auto filters = query.getBaseFilters();
+    return std::any_of(filters.cbegin(), filters.cend(), [](const QueryBase::Comparator &comparator) {
+        return comparator.comparator == QueryBase::Comparator::Fulltext;
+    });
+}
+
 /*
  * This class wraps the actual query implementation.
  *
@@ -81,6 +90,10 @@ QueryRunner<DomainType>::QueryRunner(const Sink::Query &query, const Sink::Resou
         // Ensure the connection is open, if it wasn't already opened
         mResourceAccess->open();
         QObject::connect(mResourceAccess.data(), &Sink::ResourceAccess::revisionChanged, this, &QueryRunner::revisionChanged);
+        // Fulltext queries lag behind the revision until the fulltext index caught up
+        if (isFulltextQuery(query)) {
+            QObject::connect(mResourceAccess.data(), &Sink::ResourceAccess::fulltextIndexed, this, &QueryRunner::revisionChanged);
+        }
         // open is not synchronous, so from the time when the initial query is started until we have started and connected to the resource, it's possible to miss updates. We therefore unconditionally try to fetch new entities once we are connected.
         QObject::connect(mResourceAccess.data(), &Sink::ResourceAccess::ready, this, [this] (bool ready) {
             if (ready) {
@@ -307,6 +320,17 @@ void QueryWorker<DomainType>::resultProviderCallback(const Sink::Query &query, S
     }
 }
 
+/*
+ * The revision up to which the query reads changes.
+ *
+ * Fulltext queries would filter out entities that are not indexed yet for good,
+ * so they only read until the indexed revision and pick up the rest once it is indexed.
+ */
+static qint64 readableRevision(const Sink::Query &query, EntityStore &entityStore)
+{
+    return isFulltextQuery(query) ? entityStore.fulltextIndexedRevision() : entityStore.maxRevision();
+}
+
 template <class DomainType>
 ReplayResult QueryWorker<DomainType>::executeIncrementalQuery(const Sink::Query &query, Sink::ResultProviderInterface<typename DomainType::Ptr> &resultProvider, DataStoreQuery::State::Ptr state)
 {
@@ -316,7 +340,7 @@ ReplayResult QueryWorker<DomainType>::executeIncrementalQuery(const Sink::Query
     const qint64 baseRevision = resultProvider.revision() + 1;
 
     auto entityStore = EntityStore{mResourceContext, mLogCtx};
-    const qint64 topRevision = entityStore.maxRevision();
+    const qint64 topRevision = readableRevision(query, entityStore);
     SinkTraceCtx(mLogCtx) << "Running query update from revision: " << baseRevision << " to revision " << topRevision;
     if (entityStore.lastCleanRevision() >= baseRevision) {
         //This is a situation we should never end up in. In case of removals some revisions may be gone entirely, which will result in failures later on.
@@ -329,7 +353,7 @@ ReplayResult QueryWorker<DomainType>::executeIncrementalQuery(const Sink::Query
         return {0, 0, false, DataStoreQuery::State::Ptr{}};
     }
     auto preparedQuery = DataStoreQuery{*state, ApplicationDomain::getTypeName<DomainType>(), entityStore, true};
-    auto resultSet = preparedQuery.update(baseRevision);
+    auto resultSet = preparedQuery.update(baseRevision, topRevision);
     SinkTraceCtx(mLogCtx) << "Filtered set retrieved. " << Log::TraceTime(time.elapsed());
     auto replayResult = resultSet.replaySet(0, 0, [this, query, &resultProvider](const ResultSet::Result &result) {
         resultProviderCallback(query, resultProvider, result);
@@ -349,7 +373,7 @@ ReplayResult QueryWorker<DomainType>::executeInitialQuery(
     time.start();
 
     auto entityStore = EntityStore{mResourceContext, mLogCtx};
-    const qint64 topRevision = entityStore.maxRevision();
+    const qint64 topRevision = readableRevision(query, entityStore);
     SinkTraceCtx(mLogCtx) << "Running query from revision: " << topRevision;
     auto preparedQuery = [&] {
         if (state) {
@@ -710,6 +710,10 @@ bool ResourceAccess::processMessageBuffer()
                     n.resource = d->resourceInstanceIdentifier;
                     emit notification(n);
                 } break;
+                case Sink::Notification::FulltextIndexed:
+                    SinkTraceCtx(d->logCtx) << "Fulltext index updated";
+                    emit fulltextIndexed();
+                    break;
                 case Sink::Notification::RevisionUpdate:
                 default:
                     SinkWarningCtx(d->logCtx) << "Received unknown notification: " << buffer->type();
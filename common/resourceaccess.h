@@ -99,6 +99,8 @@ public:
 signals:
     void ready(bool isReady);
     void revisionChanged(qint64 revision);
+    //The fulltext index caught up with more revisions, see Notification::FulltextIndexed
+    void fulltextIndexed();
     void notification(Notification notification);
 
 public slots:
@@ -152,5 +152,28 @@ KAsync::Job<void> ResourceControl::inspect(const Inspection &inspectionCommand,
         });
 }
 
+KAsync::Job<QByteArray> ResourceControl::storageMetrics(const QByteArray &resourceIdentifier)
+{
+    auto resourceAccess = ResourceAccessFactory::instance().getAccess(resourceIdentifier, ResourceConfig::getResourceType(resourceIdentifier));
+    auto notifier = QSharedPointer<Sink::Notifier>::create(resourceAccess);
+    auto id = createUuid();
+    return KAsync::start<QByteArray>([=](KAsync::Future<QByteArray> &future) {
+            notifier->registerHandler([&future, id](const Notification &notification) {
+                if (notification.id == id) {
+                    if (notification.code) {
+                        future.setError(-1, "Failed to collect the storage metrics: " + notification.message);
+                    } else {
+                        future.setValue(notification.message.toUtf8());
+                        future.setFinished();
+                    }
+                }
+            });
+            resourceAccess->sendInspectionCommand(Inspection::StorageMetricsInspectionType, id, {}, {}, {}, {}).onError([&future] (const KAsync::Error &error) {
+                SinkWarning() << "Failed to send command";
+                future.setError(1, "Failed to send command: " + error.errorMessage);
+            }).exec();
+        });
+}
+
 
 } // namespace Sink
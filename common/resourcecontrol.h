@@ -39,6 +39,14 @@ KAsync::Job<void> SINK_EXPORT inspect(const Inspection &inspectionCommand)
     return inspect(inspectionCommand, ApplicationDomain::getTypeName<DomainType>());
 }
 
+/**
+ * The operation metrics of the storage layer in the resource process.
+ *
+ * Returns the json encoded metrics, see Storage::OperationMetrics::Snapshot::fromJson.
+ * The counters accumulate over the lifetime of the resource process.
+ */
+KAsync::Job<QByteArray> SINK_EXPORT storageMetrics(const QByteArray &resourceIdentifier);
+
 /**
  * Shutdown resource.
  */
@@ -25,9 +25,12 @@
 #include "utils.h"
 #include "storage/key.h"
 #include <string>
+#include <string_view>
+#include <iterator>
 #include <functional>
 #include <QString>
 #include <QMap>
+#include <KAsync/Async>
 
 namespace Sink {
 namespace Storage {
@@ -37,12 +40,67 @@ extern SINK_EXPORT int IntegerKeys;
 // Only useful with AllowDuplicates
 extern SINK_EXPORT int IntegerValues;
 
+/**
+ * Trades durability for throughput of an environment.
+ *
+ * The profile is applied when the environment is opened for the first time in the process.
+ */
+struct SINK_EXPORT StorageProfile {
+    enum Durability {
+        // Every commit is flushed to disk.
+        Synchronous,
+        // The meta page is not flushed on commit. A system crash may undo the last transactions, but the database stays consistent.
+        NoMetaSync,
+        // Nothing is flushed on commit. A system crash may corrupt the database, so this is only suitable for stores we can afford to lose.
+        NoSync
+    };
+
+    Durability durability = Synchronous;
+    // Environments that are not flushed on commit are flushed periodically with this interval (in ms).
+    int checkpointInterval = 1000;
+    // Write through a writable memory map, which saves a copy per write.
+    bool writeMap = false;
+    // Disable readahead, which only pollutes the page cache with random access patterns such as index lookups.
+    bool noReadAhead = false;
+    // The initial size of the memory map. If set the map is grown as required, otherwise the map has the (large) platform default size.
+    size_t initialMapSize = 0;
+
+    /**
+     * For stores that can be lost without losing any user data, such as queues that are refilled by a sync.
+     */
+    static StorageProfile disposable();
+
+    /**
+     * For stores where losing the last few transactions is acceptable, but not a corrupted database.
+     */
+    static StorageProfile relaxed();
+};
+
+/**
+ * The engine that stores the data.
+ *
+ * The memory backend keeps all stores in the memory of the process, so it can only be used where no other process
+ * accesses the stores, such as in tests and benchmarks that don't start resource processes.
+ */
+enum class StorageBackend {
+    Lmdb,
+    Memory
+};
+
+/**
+ * Selects the backend of all stores that are opened from now on in this process.
+ */
+void SINK_EXPORT setStorageBackend(StorageBackend);
+StorageBackend SINK_EXPORT storageBackend();
+
 struct SINK_EXPORT DbLayout {
     typedef QMap<QByteArray, int> Databases;
     DbLayout();
     DbLayout(const QByteArray &, const Databases &);
+    DbLayout(const QByteArray &, const Databases &, const StorageProfile &);
     QByteArray name;
     Databases tables;
+    StorageProfile profile;
 };
 
 class SINK_EXPORT DataStore
@@ -75,6 +133,28 @@ public:
     };
 
     class Transaction;
+
+    /**
+     * A named database that can be resolved once and then be kept around.
+     *
+     * Once a database has been opened via a handle, subsequent transactions of the same environment
+     * can open the database without looking it up by name.
+     */
+    class SINK_EXPORT DatabaseHandle
+    {
+    public:
+        DatabaseHandle(const QByteArray &name_ = {}, int flags_ = 0) : name(name_), flags(flags_)
+        {
+        }
+        QByteArray name;
+        int flags;
+
+    private:
+        friend Transaction;
+        quint64 environment = 0;
+        int index = -1;
+    };
+
     class SINK_EXPORT NamedDatabase
     {
     public:
@@ -88,6 +168,17 @@ public:
         // of QByteArray for keys
         bool write(const size_t key, const QByteArray &value, const std::function<void(const DataStore::Error &error)> &errorHandler = std::function<void(const DataStore::Error &error)>());
 
+        /**
+         * Append a value
+         *
+         * Meant for sorted runs of writes, such as monotonically increasing revisions.
+         * The key (or the value for databases with duplicates) must sort after all existing entries,
+         * which avoids the lookup in the tree. If the ordering is violated we fall back to a regular write.
+         */
+        bool append(const QByteArray &key, const QByteArray &value, const std::function<void(const DataStore::Error &error)> &errorHandler = std::function<void(const DataStore::Error &error)>());
+
+        bool append(const size_t key, const QByteArray &value, const std::function<void(const DataStore::Error &error)> &errorHandler = std::function<void(const DataStore::Error &error)>());
+
         /**
          * Remove a key
          */
@@ -102,6 +193,11 @@ public:
 
         void remove(const size_t key, const QByteArray &value, const std::function<void(const DataStore::Error &error)> &errorHandler = std::function<void(const DataStore::Error &error)>());
 
+        /**
+         * Remove all entries, without removing the database itself.
+         */
+        void clear(const std::function<void(const DataStore::Error &error)> &errorHandler = std::function<void(const DataStore::Error &error)>());
+
         /**
         * Read values with a given key.
         *
@@ -150,6 +246,133 @@ public:
             const std::function<void(size_t key, const QByteArray &value)> &resultHandler,
             const std::function<void(const DataStore::Error &error)> &errorHandler = {}) const;
 
+        /**
+         * A cursor over a bounded range of the database.
+         *
+         * In contrast to scan, a cursor hands out views into the database instead of invoking a callback per entry.
+         * The views remain valid until the cursor is moved, or the database is modified.
+         * A cursor must not outlive the transaction it was created from.
+         *
+         * Cursors can be used with range-based for loops:
+         * for (const auto &entry : db.prefix("key")) { ... }
+         */
+        class SINK_EXPORT Cursor
+        {
+        public:
+            struct Entry {
+                std::string_view key;
+                std::string_view value;
+
+                // Only valid for databases with IntegerKeys
+                size_t integerKey() const;
+            };
+
+            class iterator
+            {
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using value_type = Entry;
+                using difference_type = std::ptrdiff_t;
+                using pointer = const Entry *;
+                using reference = Entry;
+
+                iterator(Cursor *cursor = nullptr) : mCursor(cursor) {}
+
+                Entry operator*() const
+                {
+                    return mCursor->current();
+                }
+
+                iterator &operator++()
+                {
+                    if (!mCursor->next()) {
+                        mCursor = nullptr;
+                    }
+                    return *this;
+                }
+
+                bool operator==(const iterator &other) const
+                {
+                    return mCursor == other.mCursor;
+                }
+
+                bool operator!=(const iterator &other) const
+                {
+                    return mCursor != other.mCursor;
+                }
+
+            private:
+                Cursor *mCursor;
+            };
+
+            Cursor();
+            ~Cursor();
+            Cursor(Cursor &&other);
+            Cursor &operator=(Cursor &&other);
+            Cursor(const Cursor &) = delete;
+            Cursor &operator=(const Cursor &) = delete;
+
+            /**
+             * Positions the cursor on the first entry within the bounds.
+             */
+            bool first();
+
+            /**
+             * Positions the cursor on the last entry within the bounds.
+             */
+            bool last();
+
+            /**
+             * Positions the cursor on the first entry with a key that is equal or greater than @param key.
+             *
+             * Keys below the lower bound position the cursor on the first entry.
+             */
+            bool seek(const QByteArray &key);
+            bool seek(size_t key);
+
+            bool next();
+            bool prev();
+
+            bool isValid() const;
+            Entry current() const;
+
+            /**
+             * Positions the cursor on the first entry and iterates until the bounds are left.
+             */
+            iterator begin();
+            iterator end();
+
+        private:
+            friend NamedDatabase;
+            class Private;
+            Cursor(Private *);
+            Private *d;
+        };
+
+        /**
+         * Returns a cursor over all entries.
+         */
+        Cursor cursor(const std::function<void(const DataStore::Error &error)> &errorHandler = {}) const;
+
+        /**
+         * Returns a cursor over all entries with exactly @param key.
+         *
+         * If duplicates are existing all values are returned.
+         */
+        Cursor find(const QByteArray &key, const std::function<void(const DataStore::Error &error)> &errorHandler = {}) const;
+        Cursor find(size_t key, const std::function<void(const DataStore::Error &error)> &errorHandler = {}) const;
+
+        /**
+         * Returns a cursor over all entries with a key starting with @param prefix.
+         */
+        Cursor prefix(const QByteArray &prefix, const std::function<void(const DataStore::Error &error)> &errorHandler = {}) const;
+
+        /**
+         * Returns a cursor over all entries whose keys are in a given range (inclusive).
+         */
+        Cursor range(const QByteArray &lowerBound, const QByteArray &upperBound, const std::function<void(const DataStore::Error &error)> &errorHandler = {}) const;
+        Cursor range(size_t lowerBound, size_t upperBound, const std::function<void(const DataStore::Error &error)> &errorHandler = {}) const;
+
         /**
          * Returns true if the database contains the substring key.
          */
@@ -179,6 +402,7 @@ public:
         friend Transaction;
         NamedDatabase(NamedDatabase &other);
         NamedDatabase &operator=(NamedDatabase &other);
+        Cursor openCursor(int bounds, const QByteArray &lowerBound, const QByteArray &upperBound, const std::function<void(const DataStore::Error &error)> &errorHandler) const;
         class Private;
         NamedDatabase(Private *);
         Private *d;
@@ -190,6 +414,15 @@ public:
         Transaction();
         ~Transaction();
         bool commit(const std::function<void(const DataStore::Error &error)> &errorHandler = {});
+
+        /**
+         * Commits the transaction without waiting for it to be flushed to disk.
+         *
+         * The changes are visible to new transactions right away, and the returned job completes once they are durable.
+         * The flushes of all commits that happen meanwhile, also in other environments, are merged.
+         * Errors during the commit are reported to the error handler, like with commit(), and fail the job.
+         */
+        KAsync::Job<void> commitAsync(const std::function<void(const DataStore::Error &error)> &errorHandler = {});
         void abort();
 
         QList<QByteArray> getDatabaseNames() const;
@@ -198,6 +431,12 @@ public:
             const std::function<void(const DataStore::Error &error)> &errorHandler = {},
             int flags = 0) const;
 
+        /**
+         * Opens a database via a handle, and resolves the handle for future use.
+         */
+        NamedDatabase openDatabase(DatabaseHandle &handle,
+            const std::function<void(const DataStore::Error &error)> &errorHandler = {}) const;
+
         Transaction(Transaction &&other);
         Transaction &operator=(Transaction &&other);
 
@@ -243,6 +482,21 @@ public:
     qint64 diskUsage() const;
     void removeFromDisk() const;
 
+    /**
+     * Replaces the environment with a compacted copy, which reclaims the space of free pages.
+     *
+     * Transactions of the old environment remain valid, new transactions use the compacted environment.
+     * Other processes pick up the compacted environment with the next DataStore they open.
+     * No transaction can be started in this process while the copy is being written,
+     * so this should only be called by the process that writes to the environment, at a quiet point.
+     */
+    bool compact();
+
+    /**
+     * Compacts the environment if more than maxFreeRatio of its pages are free.
+     */
+    bool compactIfRequired(double maxFreeRatio = 0.5);
+
     /**
      * Clears all cached environments.
      *
@@ -0,0 +1,123 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "storage.h"
+
+#include <memory>
+
+namespace Sink {
+namespace Storage {
+
+/**
+ * The interface of storage engines other than the built-in LMDB engine.
+ *
+ * DataStore, Transaction and NamedDatabase forward to these if the store was opened with such a backend
+ * (see setStorageBackend), so everything built on top of the storage layer works unchanged.
+ * Implementations must keep the semantics of the LMDB engine, including duplicate sorted databases,
+ * integer keys, the error codes that are reported and read-only transactions that see a snapshot.
+ */
+namespace Backend {
+
+typedef std::function<void(const DataStore::Error &error)> ErrorHandler;
+
+class Cursor
+{
+public:
+    virtual ~Cursor() = default;
+
+    virtual bool first() = 0;
+    virtual bool last() = 0;
+    virtual bool seek(const QByteArray &key) = 0;
+    virtual bool next() = 0;
+    virtual bool prev() = 0;
+    virtual bool isValid() const = 0;
+    virtual DataStore::NamedDatabase::Cursor::Entry current() const = 0;
+};
+
+class Database
+{
+public:
+    // Same order as the bounds of DataStore::NamedDatabase::Cursor::Private
+    enum Bounds {
+        Unbounded,
+        Exact,
+        Prefix,
+        Range
+    };
+
+    virtual ~Database() = default;
+
+    virtual bool write(const QByteArray &key, const QByteArray &value, const ErrorHandler &errorHandler) = 0;
+    virtual bool append(const QByteArray &key, const QByteArray &value, const ErrorHandler &errorHandler) = 0;
+    // An empty value removes all values of the key
+    virtual void remove(const QByteArray &key, const QByteArray &value, const ErrorHandler &errorHandler) = 0;
+    // Removes all entries, but keeps the database
+    virtual void clear(const ErrorHandler &errorHandler) = 0;
+
+    virtual int scan(const QByteArray &key, const std::function<bool(const QByteArray &key, const QByteArray &value)> &resultHandler,
+        const ErrorHandler &errorHandler, bool findSubstringKeys) const = 0;
+    virtual void findLatest(const QByteArray &key, const std::function<void(const QByteArray &key, const QByteArray &value)> &resultHandler,
+        const ErrorHandler &errorHandler) const = 0;
+    virtual void findLast(const QByteArray &key, const std::function<void(const QByteArray &key, const QByteArray &value)> &resultHandler,
+        const ErrorHandler &errorHandler) const = 0;
+    virtual int findAllInRange(const QByteArray &lowerBound, const QByteArray &upperBound,
+        const std::function<void(const QByteArray &key, const QByteArray &value)> &resultHandler, const ErrorHandler &errorHandler) const = 0;
+
+    virtual std::unique_ptr<Cursor> openCursor(Bounds bounds, const QByteArray &lowerBound, const QByteArray &upperBound, const ErrorHandler &errorHandler) const = 0;
+
+    virtual qint64 size() const = 0;
+    virtual DataStore::NamedDatabase::Stat stat() const = 0;
+    virtual bool allowsDuplicates() const = 0;
+};
+
+class Transaction
+{
+public:
+    virtual ~Transaction() = default;
+
+    virtual bool commit(const ErrorHandler &errorHandler) = 0;
+    virtual void abort() = 0;
+
+    /**
+     * Opens the database, or creates it with @param flags in a write transaction.
+     *
+     * Returns nullptr if the database doesn't exist in a read-only transaction.
+     */
+    virtual std::unique_ptr<Database> openDatabase(const QByteArray &name, int flags, const ErrorHandler &errorHandler) = 0;
+    virtual QList<QByteArray> databaseNames() const = 0;
+    virtual DataStore::Transaction::Stat stat() const = 0;
+};
+
+class Environment
+{
+public:
+    virtual ~Environment() = default;
+
+    virtual std::unique_ptr<Transaction> createTransaction(bool readOnly, const ErrorHandler &errorHandler) = 0;
+    virtual bool exists() const = 0;
+    virtual qint64 diskUsage() const = 0;
+    virtual void remove() = 0;
+    virtual bool compact() = 0;
+};
+
+}
+
+}
+}
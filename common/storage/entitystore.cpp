@@ -21,6 +21,7 @@
 
 #include <QDir>
 #include <QFile>
+#include <limits>
 
 #include "entitybuffer.h"
 #include "log.h"
@@ -28,9 +29,12 @@
 #include "definitions.h"
 #include "resourcecontext.h"
 #include "index.h"
+#include "fulltextindex.h"
 #include "bufferutils.h"
 #include "entity_generated.h"
 #include "typeimplementations.h"
+#include "bufferadaptor.h"
+#include "projection.h"
 
 using namespace Sink;
 using namespace Sink::Storage;
@@ -80,7 +84,10 @@ static Sink::Storage::DbLayout dbLayout(const QByteArray &instanceId)
         mergeImpl(map, ApplicationDomain::TypeImplementation<ApplicationDomain::Todo>::typeDatabases());
         return merge(Storage::DataStore::baseDbs(), map);
     }();
-    return {instanceId, databases};
+    //Index lookups are random access, so readahead only pollutes the page cache.
+    Storage::StorageProfile profile;
+    profile.noReadAhead = true;
+    return {instanceId, databases, profile};
 }
 
 
@@ -94,6 +101,8 @@ public:
     DataStore::Transaction transaction;
     QHash<QByteArray, QSharedPointer<TypeIndex> > indexByType;
     Sink::Log::Context logCtx;
+    //<Type, last revision the property index rebuild processed>, cached for the duration of the transaction
+    QHash<QByteArray, qint64> rebuildProgress;
 
     bool exists()
     {
@@ -108,9 +117,59 @@ public:
 
         DataStore store(Sink::storageLocation(), dbLayout(resourceContext.instanceId()), DataStore::ReadOnly);
         transaction = store.createTransaction(DataStore::ReadOnly);
+        rebuildProgress.clear();
         return transaction;
     }
 
+    static QByteArray rebuildProgressKey(const QByteArray &type)
+    {
+        return "propertyIndexRebuild." + type;
+    }
+
+    /**
+     * The last revision the rebuild of the property indexes of @param type processed, or -1 if they are complete.
+     */
+    qint64 rebuiltUntil(const QByteArray &type)
+    {
+        auto it = rebuildProgress.constFind(type);
+        if (it != rebuildProgress.constEnd()) {
+            return *it;
+        }
+        qint64 revision = -1;
+        getTransaction().openDatabase("__metadata").scan(rebuildProgressKey(type),
+            [&](const QByteArray &, const QByteArray &value) -> bool {
+                revision = value.toLongLong();
+                return false;
+            },
+            [&](const DataStore::Error &error) {
+                if (error.code != DataStore::NotFound) {
+                    SinkWarningCtx(logCtx) << "Failed to read the index rebuild progress: " << error.message;
+                }
+            });
+        rebuildProgress.insert(type, revision);
+        return revision;
+    }
+
+    void setRebuiltUntil(const QByteArray &type, qint64 revision)
+    {
+        auto db = transaction.openDatabase("__metadata");
+        if (revision < 0) {
+            db.remove(rebuildProgressKey(type), [](const DataStore::Error &) {});
+        } else {
+            db.write(rebuildProgressKey(type), QByteArray::number(revision));
+        }
+        rebuildProgress.insert(type, revision);
+    }
+
+    /**
+     * Whether the current revision of @param identifier is in the property indexes, which is only not the case while they are rebuilt.
+     */
+    bool isInPropertyIndexes(const QByteArray &type, const Identifier &identifier)
+    {
+        const auto until = rebuiltUntil(type);
+        return until < 0 || qint64(DataStore::getLatestRevisionFromUid(transaction, identifier)) <= until;
+    }
+
     template <class T>
     struct ConfigureHelper {
         void operator()(TypeIndex &arg) const {
@@ -137,6 +196,13 @@ public:
         return index;
     }
 
+    TypeIndex &lookupIndex(const QByteArray &type)
+    {
+        auto &index = typeIndex(type);
+        index.mPropertyIndexesAvailable = rebuiltUntil(type) < 0;
+        return index;
+    }
+
     ApplicationDomainType createApplicationDomainType(const QByteArray &type, const QByteArray &uid, qint64 revision, const EntityBuffer &buffer)
     {
         auto adaptor = resourceContext.adaptorFactory(type).createAdaptor(buffer.entity(), &typeIndex(type));
@@ -174,6 +240,7 @@ void EntityStore::startTransaction(DataStore::AccessMode accessMode)
     SinkTraceCtx(d->logCtx) << "Starting transaction: " << accessMode;
     Q_ASSERT(!d->transaction);
     d->transaction = DataStore(Sink::storageLocation(), dbLayout(d->resourceContext.instanceId()), accessMode).createTransaction(accessMode);
+    d->rebuildProgress.clear();
 }
 
 void EntityStore::commitTransaction()
@@ -187,13 +254,35 @@ void EntityStore::commitTransaction()
     Q_ASSERT(d->transaction);
     d->transaction.commit();
     d->transaction = {};
+    d->rebuildProgress.clear();
+}
+
+KAsync::Job<void> EntityStore::commitTransactionAsync()
+{
+    SinkTraceCtx(d->logCtx) << "Committing transaction without waiting for the disk";
+
+    for (const auto &type : d->indexByType.keys()) {
+        d->typeIndex(type).commitTransaction();
+    }
+
+    Q_ASSERT(d->transaction);
+    auto durable = d->transaction.commitAsync();
+    d->transaction = {};
+    d->rebuildProgress.clear();
+    return durable;
 }
 
 void EntityStore::abortTransaction()
 {
     SinkTraceCtx(d->logCtx) << "Aborting transaction";
+
+    for (const auto &type : d->indexByType.keys()) {
+        d->typeIndex(type).abortTransaction();
+    }
+
     d->transaction.abort();
     d->transaction = {};
+    d->rebuildProgress.clear();
 }
 
 bool EntityStore::hasTransaction() const
@@ -212,7 +301,8 @@ bool EntityStore::add(const QByteArray &type, ApplicationDomainType entity, bool
 
     const auto identifier = Identifier::fromDisplayByteArray(entity.identifier());
 
-    d->typeIndex(type).add(identifier, entity, d->transaction, d->resourceContext.instanceId());
+    //New revisions are picked up by a running rebuild of the property indexes
+    d->typeIndex(type).add(identifier, entity, d->transaction, d->resourceContext.instanceId(), d->rebuiltUntil(type) < 0);
 
     //The maxRevision may have changed meanwhile if the entity created sub-entities
     const qint64 newRevision = maxRevision() + 1;
@@ -232,7 +322,7 @@ bool EntityStore::add(const QByteArray &type, ApplicationDomainType entity, bool
     const auto key = Key(identifier, newRevision);
 
     DataStore::mainDatabase(d->transaction, type)
-        .write(newRevision, BufferUtils::extractBuffer(fbb),
+        .append(newRevision, BufferUtils::extractBuffer(fbb),
             [&](const DataStore::Error &error) { SinkWarningCtx(d->logCtx) << "Failed to write entity" << entity.identifier() << newRevision; });
 
     DataStore::setMaxRevision(d->transaction, newRevision);
@@ -288,7 +378,7 @@ bool EntityStore::modify(const QByteArray &type, const ApplicationDomainType &cu
     }
 
     const auto identifier = Identifier::fromDisplayByteArray(newEntity.identifier());
-    d->typeIndex(type).modify(identifier, current, newEntity, d->transaction, d->resourceContext.instanceId());
+    d->typeIndex(type).modify(identifier, current, newEntity, d->transaction, d->resourceContext.instanceId(), d->isInPropertyIndexes(type, identifier), d->rebuiltUntil(type) < 0);
 
     const qint64 newRevision = DataStore::maxRevision(d->transaction) + 1;
 
@@ -313,7 +403,7 @@ bool EntityStore::modify(const QByteArray &type, const ApplicationDomainType &cu
     d->resourceContext.adaptorFactory(type).createBuffer(newEntity, fbb, metadataFbb.GetBufferPointer(), metadataFbb.GetSize());
 
     DataStore::mainDatabase(d->transaction, type)
-        .write(newRevision, BufferUtils::extractBuffer(fbb),
+        .append(newRevision, BufferUtils::extractBuffer(fbb),
             [&](const DataStore::Error &error) { SinkWarningCtx(d->logCtx) << "Failed to write entity" << newEntity.identifier() << newRevision; });
 
     DataStore::setMaxRevision(d->transaction, newRevision);
@@ -330,7 +420,7 @@ bool EntityStore::remove(const QByteArray &type, const ApplicationDomainType &cu
         return false;
     }
     const auto identifier = Identifier::fromDisplayByteArray(uid);
-    d->typeIndex(type).remove(identifier, current, d->transaction, d->resourceContext.instanceId());
+    d->typeIndex(type).remove(identifier, current, d->transaction, d->resourceContext.instanceId(), d->isInPropertyIndexes(type, identifier));
 
     SinkTraceCtx(d->logCtx) << "Removed entity " << current;
 
@@ -349,7 +439,7 @@ bool EntityStore::remove(const QByteArray &type, const ApplicationDomainType &cu
     EntityBuffer::assembleEntityBuffer(fbb, metadataFbb.GetBufferPointer(), metadataFbb.GetSize(), 0, 0, 0, 0);
 
     DataStore::mainDatabase(d->transaction, type)
-        .write(newRevision, BufferUtils::extractBuffer(fbb),
+        .append(newRevision, BufferUtils::extractBuffer(fbb),
             [&](const DataStore::Error &error) { SinkWarningCtx(d->logCtx) << "Failed to write entity" << uid << newRevision; });
 
     DataStore::setMaxRevision(d->transaction, newRevision);
@@ -397,6 +487,15 @@ void EntityStore::cleanupEntityRevisionsUntil(qint64 revision)
     DataStore::setCleanedUpRevision(d->transaction, revision);
 }
 
+bool EntityStore::compactIfRequired()
+{
+    //We'd block on our own write transaction
+    if (d->transaction) {
+        return false;
+    }
+    return DataStore(Sink::storageLocation(), dbLayout(d->resourceContext.instanceId()), DataStore::ReadWrite).compactIfRequired();
+}
+
 bool EntityStore::cleanupRevisions(qint64 revision)
 {
     Q_ASSERT(d->exists());
@@ -440,6 +539,87 @@ qint64 EntityStore::lastCleanRevision()
 }
 
 
+void EntityStore::rebuildPropertyIndexes()
+{
+    startPropertyIndexRebuild();
+    qint64 progress = 0;
+    qint64 total = 0;
+    //Each call completes at most one type, even without a batch limit
+    while (true) {
+        const auto type = continuePropertyIndexRebuild(std::numeric_limits<qint64>::max(), progress, total);
+        if (type.isEmpty()) {
+            break;
+        }
+        SinkTraceCtx(d->logCtx) << "Rebuilt the property indexes of " << type << ": " << progress << "/" << total;
+    }
+}
+
+void EntityStore::startPropertyIndexRebuild(const QByteArrayList &types)
+{
+    Q_ASSERT(d->transaction);
+    for (const auto &type : types.isEmpty() ? d->resourceContext.adaptorFactories.keys() : types) {
+        if (!d->resourceContext.adaptorFactories.contains(type)) {
+            continue;
+        }
+        d->typeIndex(type).clearPropertyIndexes(d->transaction);
+        d->setRebuiltUntil(type, 0);
+        SinkLogCtx(d->logCtx) << "Scheduled the rebuild of the property indexes of type " << type;
+    }
+}
+
+bool EntityStore::isRebuildingPropertyIndexes(const QByteArray &type)
+{
+    return d->rebuiltUntil(type) >= 0;
+}
+
+QByteArray EntityStore::continuePropertyIndexRebuild(qint64 batchSize, qint64 &progress, qint64 &total)
+{
+    Q_ASSERT(d->transaction);
+    for (const auto &type : d->resourceContext.adaptorFactories.keys()) {
+        const auto rebuiltUntil = d->rebuiltUntil(type);
+        if (rebuiltUntil < 0) {
+            continue;
+        }
+        auto &index = d->typeIndex(type);
+        auto revision = rebuiltUntil;
+        qint64 processed = 0;
+        bool complete = true;
+        //The main database is keyed by revision, so we can continue where we left off.
+        //Revisions written since the rebuild started are processed as well, the pipeline leaves them to us.
+        auto cursor = DataStore::mainDatabase(d->transaction, type).cursor();
+        for (bool valid = cursor.seek(size_t(rebuiltUntil + 1)); valid; valid = cursor.next()) {
+            if (processed >= batchSize) {
+                complete = false;
+                break;
+            }
+            const auto entry = cursor.current();
+            revision = entry.integerKey();
+            processed++;
+            const auto id = DataStore::getUidFromRevision(d->transaction, revision);
+            if (qint64(DataStore::getLatestRevisionFromUid(d->transaction, id)) != revision) {
+                //Only the latest revision is indexed
+                continue;
+            }
+            const Sink::EntityBuffer buffer{entry.value.data(), int(entry.value.size())};
+            if (buffer.operation() == Operation_Removal) {
+                continue;
+            }
+            index.addToPropertyIndexes(id, d->createApplicationDomainType(type, id.toDisplayByteArray(), revision, buffer), d->transaction);
+        }
+        //The revisions of the type are interleaved with those of other types, so the progress is reported within its own
+        const auto firstRevision = cursor.first() ? qint64(cursor.current().integerKey()) : 0;
+        const auto lastRevision = cursor.last() ? qint64(cursor.current().integerKey()) : 0;
+        total = lastRevision > 0 ? lastRevision - firstRevision + 1 : 0;
+        progress = complete ? total : qBound(qint64{0}, revision - firstRevision + 1, total);
+        d->setRebuiltUntil(type, complete ? -1 : revision);
+        if (complete) {
+            SinkLogCtx(d->logCtx) << "Rebuilt the property indexes of type " << type;
+        }
+        return type;
+    }
+    return {};
+}
+
 QVector<Identifier> EntityStore::fullScan(const QByteArray &type)
 {
     SinkTraceCtx(d->logCtx) << "Looking for : " << type;
@@ -458,13 +638,23 @@ QVector<Identifier> EntityStore::fullScan(const QByteArray &type)
     return keys.toList().toVector();
 }
 
-QVector<Identifier> EntityStore::indexLookup(const QByteArray &type, const QueryBase &query, QSet<QByteArrayList> &appliedFilters, QByteArray &appliedSorting)
+QVector<Identifier> EntityStore::indexLookup(const QByteArray &type, const QueryBase &query, QSet<QByteArrayList> &appliedFilters, QByteArray &appliedSorting, QByteArray *continuation)
 {
     if (!d->exists()) {
         SinkTraceCtx(d->logCtx) << "Database is not existing: " << type;
         return {};
     }
-    return d->typeIndex(type).query(query, appliedFilters, appliedSorting, d->getTransaction(), d->resourceContext.instanceId());
+    return d->lookupIndex(type).query(query, appliedFilters, appliedSorting, d->getTransaction(), d->resourceContext.instanceId(), continuation);
+}
+
+QVector<Identifier> EntityStore::indexLookupMore(const QByteArray &type, QByteArray &continuation, int limit)
+{
+    if (!d->exists()) {
+        SinkTraceCtx(d->logCtx) << "Database is not existing: " << type;
+        continuation.clear();
+        return {};
+    }
+    return d->lookupIndex(type).queryMore(continuation, limit, d->getTransaction(), d->resourceContext.instanceId());
 }
 
 QVector<Identifier> EntityStore::indexLookup(const QByteArray &type, const QByteArray &property, const QVariant &value, const QVector<Sink::Storage::Identifier> &filter)
@@ -473,7 +663,47 @@ QVector<Identifier> EntityStore::indexLookup(const QByteArray &type, const QByte
         SinkTraceCtx(d->logCtx) << "Database is not existing: " << type;
         return {};
     }
-    return d->typeIndex(type).lookup(property, value, d->getTransaction(), d->resourceContext.instanceId(), filter);
+    auto &index = d->lookupIndex(type);
+    if (!index.mPropertyIndexesAvailable && index.mProperties.contains(property)) {
+        //The index is incomplete while it is rebuilt, so we have to look at the entities instead
+        SinkTraceCtx(d->logCtx) << "Scanning for " << property << " while the property indexes are rebuilt";
+        const auto encoder = index.keyEncoder(property);
+        const auto key = encoder(value);
+        QVector<Identifier> ids;
+        DataStore::getUids(type, d->getTransaction(), [&](const Identifier &id) {
+            readLatest(type, id, [&](const ApplicationDomainType &entity, Sink::Operation operation) {
+                if (operation != Operation_Removal && encoder(entity.getProperty(property)) == key) {
+                    ids << id;
+                }
+            });
+        });
+        return ids;
+    }
+    return index.lookup(property, value, d->getTransaction(), d->resourceContext.instanceId(), filter);
+}
+
+bool EntityStore::coveringLookup(const QByteArray &type, const QueryBase &query, QVector<Identifier> &ids, QVector<QByteArray> &projections, QByteArray &appliedSorting)
+{
+    if (!d->exists()) {
+        SinkTraceCtx(d->logCtx) << "Database is not existing: " << type;
+        return false;
+    }
+    return d->lookupIndex(type).coveringLookup(query, ids, projections, appliedSorting, d->getTransaction());
+}
+
+ApplicationDomainType EntityStore::createCoveredEntity(const Identifier &id, const QByteArray &projection)
+{
+    auto adaptor = QSharedPointer<ApplicationDomain::MemoryBufferAdaptor>::create();
+    Projection::decode(projection, *adaptor);
+    adaptor->resetChangedProperties();
+    //The revision is the only thing we have to look up, which doesn't require reading the entity
+    const auto revision = DataStore::getLatestRevisionFromUid(d->getTransaction(), id);
+    return ApplicationDomainType{d->resourceContext.instanceId(), id.toDisplayByteArray(), qint64(revision), adaptor};
+}
+
+bool EntityStore::occursIn(const QByteArray &type, const QByteArrayList &properties, const QueryBase::Comparator &filter, const ApplicationDomainType &entity)
+{
+    return d->cachedIndex(type).occursIn(properties, filter, entity);
 }
 
 void EntityStore::indexLookup(const QByteArray &type, const QByteArray &property, const QVariant &value, const std::function<void(const QByteArray &uid)> &callback)
@@ -504,13 +734,14 @@ void EntityStore::readLatest(const QByteArray &type, const Identifier &id, const
         SinkTraceCtx(d->logCtx) << "Failed to readLatest: " << type << id;
         return;
     }
-    auto db = DataStore::mainDatabase(d->getTransaction(), type);
-    db.scan(revision,
-        [=](size_t, const QByteArray &value) {
-            callback(id.toDisplayByteArray(), Sink::EntityBuffer(value.data(), value.size()));
-            return false;
-        },
-        [&](const DataStore::Error &error) { SinkWarningCtx(d->logCtx) << "Error during readLatest query: " << error.message << id; });
+    auto cursor = DataStore::mainDatabase(d->getTransaction(), type)
+        .find(revision, [&](const DataStore::Error &error) { SinkWarningCtx(d->logCtx) << "Error during readLatest query: " << error.message << id; });
+    if (!cursor.first()) {
+        SinkWarningCtx(d->logCtx) << "Failed to find the latest revision: " << type << id << revision;
+        return;
+    }
+    const auto value = cursor.current().value;
+    callback(id.toDisplayByteArray(), Sink::EntityBuffer(value.data(), value.size()));
 }
 
 void EntityStore::readLatest(const QByteArray &type, const QByteArray &uid, const std::function<void(const QByteArray &uid, const EntityBuffer &entity)> &callback)
@@ -590,10 +821,10 @@ void EntityStore::readAll(const QByteArray &type, const std::function<void(const
     });
 }
 
-void EntityStore::readRevisions(qint64 baseRevision, const QByteArray &expectedType, const std::function<void(const Key &key)> &callback)
+void EntityStore::readRevisions(qint64 baseRevision, qint64 topRevision, const QByteArray &expectedType, const std::function<void(const Key &key)> &callback)
 {
     qint64 revisionCounter = baseRevision;
-    const qint64 topRevision = DataStore::maxRevision(d->getTransaction());
+    topRevision = qMin(topRevision, DataStore::maxRevision(d->getTransaction()));
     // Spit out the revision keys one by one.
     while (revisionCounter <= topRevision) {
         const auto uid = DataStore::getUidFromRevision(d->getTransaction(), revisionCounter);
@@ -713,6 +944,14 @@ qint64 EntityStore::maxRevision()
     return DataStore::maxRevision(d->getTransaction());
 }
 
+qint64 EntityStore::fulltextIndexedRevision()
+{
+    if (!d->exists()) {
+        return 0;
+    }
+    return FulltextIndex::indexedRevision(d->getTransaction());
+}
+
 Sink::Log::Context EntityStore::logContext() const
 {
     return d->logCtx;
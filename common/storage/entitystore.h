@@ -51,16 +51,67 @@ public:
     bool remove(const QByteArray &type, const ApplicationDomainType &current, bool replayToSource);
     bool cleanupRevisions(qint64 revision);
     qint64 lastCleanRevision();
+    /**
+     * Reclaims the space of free pages if it is worth it.
+     *
+     * Requires that there is no ongoing transaction.
+     */
+    bool compactIfRequired();
     ApplicationDomainType applyDiff(const QByteArray &type, const ApplicationDomainType &current, const ApplicationDomainType &diff, const QByteArrayList &deletions, const QSet<QByteArray> &excludeProperties = {}) const;
 
     void startTransaction(Sink::Storage::DataStore::AccessMode);
     void commitTransaction();
+    /**
+     * Commits without waiting for the disk. The job completes once the transaction is durable.
+     */
+    KAsync::Job<void> commitTransactionAsync();
     void abortTransaction();
     bool hasTransaction() const;
 
+    /**
+     * Rebuilds the value, sorted and covering indexes of all entities in the current write transaction.
+     */
+    void rebuildPropertyIndexes();
+
+    /**
+     * Clears the value, sorted and covering indexes of @param types, or of all types if empty, so they can be rebuilt in the background.
+     *
+     * Used during upgrades that change the encoding of the index keys, or add indexes.
+     * Until the rebuild of a type is complete its property indexes are not used, and queries fall back to scanning the entities.
+     */
+    void startPropertyIndexRebuild(const QByteArrayList &types = {});
+
+    /**
+     * Continues the rebuild of the property indexes with up to @param batchSize revisions of the first type that is being rebuilt.
+     *
+     * Each batch is meant to be committed in its own transaction, so the rebuild doesn't block the pipeline.
+     * Returns the type, or an empty type if there is nothing left to rebuild.
+     * @param progress and @param total are set to the processed and all revisions of the type, counted from its first revision.
+     */
+    QByteArray continuePropertyIndexRebuild(qint64 batchSize, qint64 &progress, qint64 &total);
+    bool isRebuildingPropertyIndexes(const QByteArray &type);
+
     QVector<Sink::Storage::Identifier> fullScan(const QByteArray &type);
-    QVector<Sink::Storage::Identifier> indexLookup(const QByteArray &type, const QueryBase &query, QSet<QByteArrayList> &appliedFilters, QByteArray &appliedSorting);
+    /**
+     * See TypeIndex::query and TypeIndex::queryMore for the @param continuation of sorted lookups.
+     */
+    QVector<Sink::Storage::Identifier> indexLookup(const QByteArray &type, const QueryBase &query, QSet<QByteArrayList> &appliedFilters, QByteArray &appliedSorting, QByteArray *continuation = nullptr);
+    QVector<Sink::Storage::Identifier> indexLookupMore(const QByteArray &type, QByteArray &continuation, int limit);
     QVector<Sink::Storage::Identifier> indexLookup(const QByteArray &type, const QByteArray &property, const QVariant &value, const QVector<Sink::Storage::Identifier> &filter);
+    /**
+     * Looks up the entities of @param query in a covering index, if there is one that stores all filtered and requested properties.
+     *
+     * Use createCoveredEntity to create the entities from the returned @param projections, without reading them.
+     */
+    bool coveringLookup(const QByteArray &type, const QueryBase &query, QVector<Sink::Storage::Identifier> &ids, QVector<QByteArray> &projections, QByteArray &appliedSorting);
+    /**
+     * Creates an entity that only carries the properties stored in @param projection.
+     */
+    ApplicationDomainType createCoveredEntity(const Identifier &id, const QByteArray &projection);
+    /**
+     * See TypeIndex::occursIn.
+     */
+    bool occursIn(const QByteArray &type, const QByteArrayList &properties, const QueryBase::Comparator &filter, const ApplicationDomainType &entity);
     void indexLookup(const QByteArray &type, const QByteArray &property, const QVariant &value, const std::function<void(const QByteArray &uid)> &callback);
     template<typename EntityType, typename PropertyType>
     void indexLookup(const QVariant &value, const std::function<void(const QByteArray &uid)> &callback) {
@@ -119,7 +170,8 @@ public:
         });
     }
 
-    void readRevisions(qint64 baseRevision, const QByteArray &type, const std::function<void(const Key &key)> &callback);
+    ///Reads the keys of all revisions of @param type from @param baseRevision until @param topRevision (inclusive)
+    void readRevisions(qint64 baseRevision, qint64 topRevision, const QByteArray &type, const std::function<void(const Key &key)> &callback);
 
     ///Db contains entity (but may already be marked as removed
     bool contains(const QByteArray &type, const QByteArray &uid);
@@ -131,6 +183,11 @@ public:
 
     qint64 maxRevision();
 
+    /**
+     * The revision up to which all changes are in the fulltext index, which is behind maxRevision while it is being indexed.
+     */
+    qint64 fulltextIndexedRevision();
+
     Sink::Log::Context logContext() const;
 
 private:
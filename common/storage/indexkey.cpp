@@ -0,0 +1,143 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "indexkey.h"
+
+#include "applicationdomaintype.h"
+
+#include <QtEndian>
+
+using namespace Sink::Storage;
+
+static const char NullTag = 0x00;
+static const char ValueTag = 0x01;
+static const char FalseTag = 0x01;
+static const char TrueTag = 0x02;
+
+static void applyOrder(QByteArray &key, int from, IndexKey::Order order)
+{
+    if (order == IndexKey::Ascending) {
+        return;
+    }
+    auto data = key.data();
+    for (int i = from; i < key.size(); i++) {
+        data[i] = ~data[i];
+    }
+}
+
+void IndexKey::appendNull(QByteArray &key, Order order)
+{
+    key.append(order == Descending ? char(~NullTag) : NullTag);
+}
+
+void IndexKey::appendBool(QByteArray &key, bool value, Order order)
+{
+    const char tag = value ? TrueTag : FalseTag;
+    key.append(order == Descending ? char(~tag) : tag);
+}
+
+void IndexKey::appendInteger(QByteArray &key, qint64 value, Order order)
+{
+    const auto from = key.size();
+    char buffer[1 + sizeof(quint64)];
+    buffer[0] = ValueTag;
+    //Flipping the sign bit sorts negative numbers before positive ones
+    qToBigEndian<quint64>(quint64(value) ^ (quint64(1) << 63), buffer + 1);
+    key.append(buffer, sizeof(buffer));
+    applyOrder(key, from, order);
+}
+
+void IndexKey::appendDateTime(QByteArray &key, const QDateTime &value, Order order)
+{
+    if (!value.isValid()) {
+        appendNull(key, order);
+        return;
+    }
+    appendInteger(key, value.toMSecsSinceEpoch(), order);
+}
+
+void IndexKey::appendString(QByteArray &key, const QByteArray &value, Order order)
+{
+    if (value.isEmpty()) {
+        appendNull(key, order);
+        return;
+    }
+    const auto from = key.size();
+    key.reserve(from + value.size() + 3);
+    key.append(ValueTag);
+    if (!value.contains('\0')) {
+        key.append(value);
+    } else {
+        for (const char c : value) {
+            key.append(c);
+            if (c == '\0') {
+                key.append(char(0xFF));
+            }
+        }
+    }
+    //The terminator sorts before any escaped or regular byte, so shorter strings sort first
+    key.append(NullTag);
+    key.append(NullTag);
+    applyOrder(key, from, order);
+}
+
+void IndexKey::appendVariant(QByteArray &key, const QVariant &value, int type, Order order)
+{
+    if (!value.isValid()) {
+        appendNull(key, order);
+        return;
+    }
+    if (type == QMetaType::UnknownType) {
+        type = value.userType();
+    }
+    switch (type) {
+        case QMetaType::Bool:
+            appendBool(key, value.toBool(), order);
+            return;
+        case QMetaType::Short:
+        case QMetaType::UShort:
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::Long:
+        case QMetaType::ULong:
+        case QMetaType::LongLong:
+        case QMetaType::ULongLong:
+            appendInteger(key, value.toLongLong(), order);
+            return;
+        case QMetaType::QDateTime:
+            appendDateTime(key, value.toDateTime(), order);
+            return;
+        case QMetaType::QString:
+            appendString(key, value.toString().toUtf8(), order);
+            return;
+        default:
+            break;
+    }
+    if (value.userType() == qMetaTypeId<Sink::ApplicationDomain::Reference>()) {
+        appendString(key, value.value<Sink::ApplicationDomain::Reference>().value, order);
+        return;
+    }
+    appendString(key, value.toByteArray(), order);
+}
+
+QByteArray IndexKey::encode(const QVariant &value, int type, Order order)
+{
+    QByteArray key;
+    appendVariant(key, value, type, order);
+    return key;
+}
@@ -0,0 +1,72 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "sink_export.h"
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QVariant>
+
+namespace Sink {
+namespace Storage {
+
+/**
+ * The binary encoding of index keys.
+ *
+ * Encoded keys compare bytewise (as LMDB compares keys) in the same order as the values they encode,
+ * so range lookups work for every type. Each component delimits itself, so composite keys are formed by
+ * appending components, and sort by their first component first.
+ * Looking up an encoded key as prefix thus finds exactly the entries that start with that value.
+ *
+ * Each component starts with a tag byte:
+ * * 0x00 for null (invalid values and empty strings), which sorts before everything else.
+ * * 0x01 for false and 0x02 for true.
+ * * 0x01 followed by 8 bytes for integers and dates (milliseconds since the epoch), big endian with the sign bit flipped.
+ * * 0x01 followed by the bytes of a string, with 0x00 escaped as 0x00 0xFF, terminated by 0x00 0x00.
+ *
+ * Descending components are stored with all bits inverted.
+ */
+namespace IndexKey {
+
+enum Order {
+    Ascending,
+    Descending
+};
+
+void SINK_EXPORT appendNull(QByteArray &key, Order order = Ascending);
+void SINK_EXPORT appendBool(QByteArray &key, bool value, Order order = Ascending);
+void SINK_EXPORT appendInteger(QByteArray &key, qint64 value, Order order = Ascending);
+void SINK_EXPORT appendDateTime(QByteArray &key, const QDateTime &value, Order order = Ascending);
+void SINK_EXPORT appendString(QByteArray &key, const QByteArray &value, Order order = Ascending);
+
+/**
+ * Appends @param value as the QMetaType @param type.
+ *
+ * Strings are encoded as UTF-8, references as their value, and any other type is converted to a QByteArray.
+ * If @param type is unknown the type of the variant is used instead.
+ */
+void SINK_EXPORT appendVariant(QByteArray &key, const QVariant &value, int type, Order order = Ascending);
+
+QByteArray SINK_EXPORT encode(const QVariant &value, int type, Order order = Ascending);
+
+}
+
+}
+}
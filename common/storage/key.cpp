@@ -23,14 +23,117 @@
 
 #include "common/utils.h"
 
+#include <QUuid>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SINK_HEX_SSE2
+#include <emmintrin.h>
+#endif
+
 using Sink::Storage::Identifier;
 using Sink::Storage::Key;
 using Sink::Storage::Revision;
 
+/*
+ * A hex codec for the 16 bytes of an identifier.
+ *
+ * With SSE2 (which every x86-64 cpu has) a single 128 bit pass converts all of them,
+ * so wider vectors wouldn't gain anything.
+ */
+namespace {
+
+#ifdef SINK_HEX_SSE2
+
+inline __m128i nibblesToHex(__m128i nibbles)
+{
+    const auto letters = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), _mm_and_si128(letters, _mm_set1_epi8('a' - '0' - 10)));
+}
+
+void encodeHex(const unsigned char *in, char *out)
+{
+    const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+    const auto mask = _mm_set1_epi8(0x0f);
+    const auto high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+    const auto low = _mm_and_si128(bytes, mask);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), nibblesToHex(_mm_unpacklo_epi8(high, low)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16), nibblesToHex(_mm_unpackhi_epi8(high, low)));
+}
+
+/*
+ * Converts 16 hex characters to their values, in the low byte of each 16 bit lane.
+ * Sets valid to false if any of them is not a hex digit.
+ */
+inline __m128i hexToBytes(__m128i chars, bool &valid)
+{
+    //Signed comparisons are fine, since everything above 0x7f is negative and thus invalid.
+    const auto isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+    const auto lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    const auto isLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    valid = valid && _mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) == 0xffff;
+    const auto nibbles = _mm_or_si128(
+        _mm_and_si128(isDigit, _mm_sub_epi8(chars, _mm_set1_epi8('0'))),
+        _mm_and_si128(isLetter, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    //Each lane holds the high nibble in its low byte and the low nibble in its high byte
+    const auto high = _mm_and_si128(_mm_slli_epi16(nibbles, 4), _mm_set1_epi16(0x00f0));
+    const auto low = _mm_srli_epi16(nibbles, 8);
+    return _mm_or_si128(high, low);
+}
+
+bool decodeHex(const char *in, unsigned char *out)
+{
+    bool valid = true;
+    const auto first = hexToBytes(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in)), valid);
+    const auto second = hexToBytes(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16)), valid);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(first, second));
+    return valid;
+}
+
+#else
+
+void encodeHex(const unsigned char *in, char *out)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < Identifier::INTERNAL_REPR_SIZE; i++) {
+        out[2 * i] = digits[in[i] >> 4];
+        out[2 * i + 1] = digits[in[i] & 0x0f];
+    }
+}
+
+inline int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    const char lower = c | 0x20;
+    if (lower >= 'a' && lower <= 'f') {
+        return lower - 'a' + 10;
+    }
+    return -1;
+}
 
-uint Sink::Storage::qHash(const Sink::Storage::Identifier &identifier)
+bool decodeHex(const char *in, unsigned char *out)
 {
-    return qHash(identifier.toInternalByteArray());
+    for (size_t i = 0; i < Identifier::INTERNAL_REPR_SIZE; i++) {
+        const int high = hexValue(in[2 * i]);
+        const int low = hexValue(in[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        out[i] = static_cast<unsigned char>((high << 4) | low);
+    }
+    return true;
+}
+
+#endif
+
+// The groups of hex digits in the text form: {xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}
+const struct {
+    int hexOffset;
+    int textOffset;
+    int size;
+} sGroups[] = {{0, 1, 8}, {8, 10, 4}, {12, 15, 4}, {16, 20, 4}, {20, 25, 12}};
+
 }
 
 QDebug &operator<<(QDebug &dbg, const Identifier &id)
@@ -55,50 +158,105 @@ QDebug &operator<<(QDebug &dbg, const Key &key)
 
 Identifier Identifier::createIdentifier()
 {
-    return Identifier(QUuid::createUuid());
+    const auto uuid = QUuid::createUuid();
+    Identifier id;
+    auto out = id.uid.data();
+    for (int i = 3; i >= 0; i--) {
+        *out++ = uchar(uuid.data1 >> (8 * i));
+    }
+    *out++ = uchar(uuid.data2 >> 8);
+    *out++ = uchar(uuid.data2);
+    *out++ = uchar(uuid.data3 >> 8);
+    *out++ = uchar(uuid.data3);
+    memcpy(out, uuid.data4, sizeof(uuid.data4));
+    return id;
 }
 
 QByteArray Identifier::toInternalByteArray() const
 {
-    Q_ASSERT(!uid.isNull());
-    return uid.toRfc4122();
+    Q_ASSERT(!isNull());
+    return QByteArray(reinterpret_cast<const char *>(uid.data()), INTERNAL_REPR_SIZE);
 }
 
 Identifier Identifier::fromInternalByteArray(const QByteArray &bytes)
 {
     Q_ASSERT(bytes.size() == INTERNAL_REPR_SIZE);
-    return Identifier(QUuid::fromRfc4122(bytes));
+    return readInternal(bytes.constData());
 }
 
 QString Identifier::toDisplayString() const
 {
-    return uid.toString();
+    char text[DISPLAY_REPR_SIZE];
+    writeDisplay(text);
+    return QString::fromLatin1(text, DISPLAY_REPR_SIZE);
 }
 
 QByteArray Identifier::toDisplayByteArray() const
 {
-    return uid.toByteArray();
+    QByteArray text(DISPLAY_REPR_SIZE, Qt::Uninitialized);
+    writeDisplay(text.data());
+    return text;
 }
 
 Identifier Identifier::fromDisplayByteArray(const QByteArray &bytes)
 {
     Q_ASSERT(bytes.size() == DISPLAY_REPR_SIZE);
-    return Identifier(QUuid(bytes));
+    return readDisplay(bytes.constData());
+}
+
+void Identifier::writeInternal(char *out) const
+{
+    memcpy(out, uid.data(), INTERNAL_REPR_SIZE);
+}
+
+Identifier Identifier::readInternal(const char *in)
+{
+    Identifier id;
+    memcpy(id.uid.data(), in, INTERNAL_REPR_SIZE);
+    return id;
+}
+
+void Identifier::writeDisplay(char *out) const
+{
+    char hex[2 * INTERNAL_REPR_SIZE];
+    encodeHex(uid.data(), hex);
+    out[0] = '{';
+    for (const auto &group : sGroups) {
+        memcpy(out + group.textOffset, hex + group.hexOffset, group.size);
+    }
+    out[9] = out[14] = out[19] = out[24] = '-';
+    out[DISPLAY_REPR_SIZE - 1] = '}';
+}
+
+Identifier Identifier::readDisplay(const char *in)
+{
+    if (in[0] != '{' || in[9] != '-' || in[14] != '-' || in[19] != '-' || in[24] != '-' || in[DISPLAY_REPR_SIZE - 1] != '}') {
+        return {};
+    }
+    char hex[2 * INTERNAL_REPR_SIZE];
+    for (const auto &group : sGroups) {
+        memcpy(hex + group.hexOffset, in + group.textOffset, group.size);
+    }
+    Identifier id;
+    if (!decodeHex(hex, id.uid.data())) {
+        return {};
+    }
+    return id;
 }
 
 bool Identifier::isNull() const
 {
-    return uid.isNull();
+    return *this == Identifier{};
 }
 
 bool Identifier::isValidInternal(const QByteArray &bytes)
 {
-    return !QUuid::fromRfc4122(bytes).isNull();
+    return bytes.size() == INTERNAL_REPR_SIZE && !readInternal(bytes.constData()).isNull();
 }
 
 bool Identifier::isValidDisplay(const QByteArray &bytes)
 {
-    return !QUuid(bytes).isNull();
+    return bytes.size() == DISPLAY_REPR_SIZE && !readDisplay(bytes.constData()).isNull();
 }
 
 bool Identifier::isValid(const QByteArray &bytes)
@@ -112,16 +270,6 @@ bool Identifier::isValid(const QByteArray &bytes)
     return false;
 }
 
-bool Identifier::operator==(const Identifier &other) const
-{
-    return uid == other.uid;
-}
-
-bool Identifier::operator!=(const Identifier &other) const
-{
-    return !(*this == other);
-}
-
 // Revision
 
 QByteArray Revision::toInternalByteArray() const
@@ -142,7 +290,19 @@ QString Revision::toDisplayString() const
 
 QByteArray Revision::toDisplayByteArray() const
 {
-    return Sink::padNumber(rev);
+    QByteArray text(DISPLAY_REPR_SIZE, Qt::Uninitialized);
+    writeDisplay(text.data());
+    return text;
+}
+
+void Revision::writeDisplay(char *out) const
+{
+    //Zero padded like padNumber
+    auto value = rev;
+    for (int i = DISPLAY_REPR_SIZE - 1; i >= 0; i--) {
+        out[i] = char('0' + value % 10);
+        value /= 10;
+    }
 }
 
 Revision Revision::fromDisplayByteArray(const QByteArray &bytes)
@@ -198,33 +358,57 @@ bool Revision::operator!=(const Revision &other) const
 
 QByteArray Key::toInternalByteArray() const
 {
-    return id.toInternalByteArray() + rev.toInternalByteArray();
+    Q_ASSERT(!isNull());
+    QByteArray bytes(INTERNAL_REPR_SIZE, Qt::Uninitialized);
+    writeInternal(bytes.data());
+    return bytes;
 }
 
 Key Key::fromInternalByteArray(const QByteArray &bytes)
 {
     Q_ASSERT(bytes.size() == INTERNAL_REPR_SIZE);
-    auto idBytes = bytes.mid(0, Identifier::INTERNAL_REPR_SIZE);
-    auto revBytes = bytes.mid(Identifier::INTERNAL_REPR_SIZE);
-    return Key(Identifier::fromInternalByteArray(idBytes), Revision::fromInternalByteArray(revBytes));
+    return readInternal(bytes.constData());
 }
 
 QString Key::toDisplayString() const
 {
-    return id.toDisplayString() + rev.toDisplayString();
+    char text[DISPLAY_REPR_SIZE];
+    writeDisplay(text);
+    return QString::fromLatin1(text, DISPLAY_REPR_SIZE);
 }
 
 QByteArray Key::toDisplayByteArray() const
 {
-    return id.toDisplayByteArray() + rev.toDisplayByteArray();
+    QByteArray text(DISPLAY_REPR_SIZE, Qt::Uninitialized);
+    writeDisplay(text.data());
+    return text;
+}
+
+void Key::writeInternal(char *out) const
+{
+    id.writeInternal(out);
+    const size_t revision = rev.toSizeT();
+    memcpy(out + Identifier::INTERNAL_REPR_SIZE, &revision, Revision::INTERNAL_REPR_SIZE);
+}
+
+Key Key::readInternal(const char *in)
+{
+    size_t revision;
+    memcpy(&revision, in + Identifier::INTERNAL_REPR_SIZE, Revision::INTERNAL_REPR_SIZE);
+    return Key(Identifier::readInternal(in), Revision(revision));
+}
+
+void Key::writeDisplay(char *out) const
+{
+    id.writeDisplay(out);
+    rev.writeDisplay(out + Identifier::DISPLAY_REPR_SIZE);
 }
 
 Key Key::fromDisplayByteArray(const QByteArray &bytes)
 {
     Q_ASSERT(bytes.size() == DISPLAY_REPR_SIZE);
-    auto idBytes = bytes.mid(0, Identifier::DISPLAY_REPR_SIZE);
-    auto revBytes = bytes.mid(Identifier::DISPLAY_REPR_SIZE);
-    return Key(Identifier::fromDisplayByteArray(idBytes), Revision::fromDisplayByteArray(revBytes));
+    const auto revBytes = QByteArray::fromRawData(bytes.constData() + Identifier::DISPLAY_REPR_SIZE, Revision::DISPLAY_REPR_SIZE);
+    return Key(Identifier::readDisplay(bytes.constData()), Revision::fromDisplayByteArray(revBytes));
 }
 
 const Identifier &Key::identifier() const
@@ -266,7 +450,7 @@ bool Key::isValidDisplay(const QByteArray &bytes)
 
     auto idBytes = bytes.mid(0, Identifier::DISPLAY_REPR_SIZE);
     auto revBytes = bytes.mid(Identifier::DISPLAY_REPR_SIZE);
-    return Key::isValidDisplay(idBytes) && Revision::isValidDisplay(revBytes);
+    return Identifier::isValidDisplay(idBytes) && Revision::isValidDisplay(revBytes);
 }
 
 bool Key::isValid(const QByteArray &bytes)
@@ -25,11 +25,19 @@
 
 #include <QByteArray>
 #include <QDebug>
-#include <QUuid>
+#include <array>
+#include <cstring>
+#include <type_traits>
 
 namespace Sink {
 namespace Storage {
 
+/**
+ * A UUID, stored as its 16 bytes in RFC 4122 order.
+ *
+ * The display representation is the braced, lowercase UUID text form (as produced by QUuid).
+ * The write and read functions convert without allocating, while the QByteArray variants allocate the result only.
+ */
 class SINK_EXPORT Identifier
 {
 public:
@@ -46,18 +54,48 @@ public:
     QByteArray toDisplayByteArray() const;
     static Identifier fromDisplayByteArray(const QByteArray &bytes);
 
+    // Writes INTERNAL_REPR_SIZE bytes
+    void writeInternal(char *out) const;
+    // Reads INTERNAL_REPR_SIZE bytes
+    static Identifier readInternal(const char *in);
+    // Writes DISPLAY_REPR_SIZE bytes
+    void writeDisplay(char *out) const;
+    // Reads DISPLAY_REPR_SIZE bytes, and returns a null identifier if they are not a valid UUID
+    static Identifier readDisplay(const char *in);
+
     bool isNull() const;
 
     static bool isValidInternal(const QByteArray &);
     static bool isValidDisplay(const QByteArray &);
     static bool isValid(const QByteArray &);
 
-    bool operator==(const Identifier &other) const;
-    bool operator!=(const Identifier &other) const;
+    bool operator==(const Identifier &other) const
+    {
+        return memcmp(uid.data(), other.uid.data(), INTERNAL_REPR_SIZE) == 0;
+    }
+
+    bool operator!=(const Identifier &other) const
+    {
+        return !(*this == other);
+    }
+
+    // The order of the internal representation
+    bool operator<(const Identifier &other) const
+    {
+        return memcmp(uid.data(), other.uid.data(), INTERNAL_REPR_SIZE) < 0;
+    }
+
+    // Random UUIDs are uniformly distributed, so folding the bits is as good as any hash function
+    friend uint qHash(const Identifier &identifier, uint seed = 0) noexcept
+    {
+        quint64 halves[2];
+        memcpy(halves, identifier.uid.data(), INTERNAL_REPR_SIZE);
+        const auto folded = halves[0] ^ halves[1];
+        return uint(folded ^ (folded >> 32)) ^ seed;
+    }
 
 private:
-    explicit Identifier(const QUuid &uid) : uid(uid) {}
-    QUuid uid;
+    alignas(8) std::array<unsigned char, INTERNAL_REPR_SIZE> uid{};
 };
 
 class SINK_EXPORT Revision
@@ -69,6 +107,9 @@ public:
 
     Revision(size_t rev) : rev(rev) {}
 
+    // Writes DISPLAY_REPR_SIZE bytes
+    void writeDisplay(char *out) const;
+
     QByteArray toInternalByteArray() const;
     static Revision fromInternalByteArray(const QByteArray &bytes);
     QString toDisplayString() const;
@@ -102,6 +143,14 @@ public:
     QString toDisplayString() const;
     QByteArray toDisplayByteArray() const;
     static Key fromDisplayByteArray(const QByteArray &bytes);
+
+    // Writes INTERNAL_REPR_SIZE bytes
+    void writeInternal(char *out) const;
+    // Reads INTERNAL_REPR_SIZE bytes
+    static Key readInternal(const char *in);
+    // Writes DISPLAY_REPR_SIZE bytes
+    void writeDisplay(char *out) const;
+
     const Identifier &identifier() const;
     const Revision &revision() const;
     void setRevision(const Revision &newRev);
@@ -120,7 +169,8 @@ private:
     Revision rev;
 };
 
-SINK_EXPORT uint qHash(const Sink::Storage::Identifier &);
+static_assert(std::is_trivially_copyable<Identifier>::value && sizeof(Identifier) == Identifier::INTERNAL_REPR_SIZE, "Identifiers are plain bytes");
+static_assert(std::is_trivially_copyable<Key>::value && sizeof(Key) == Key::INTERNAL_REPR_SIZE, "Keys are plain bytes");
 
 } // namespace Storage
 } // namespace Sink
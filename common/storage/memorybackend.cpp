@@ -0,0 +1,785 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "memorybackend.h"
+
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "log.h"
+
+using namespace Sink::Storage;
+
+namespace {
+
+int compareBytes(const QByteArray &lhs, const QByteArray &rhs)
+{
+    if (const int result = memcmp(lhs.constData(), rhs.constData(), qMin(lhs.size(), rhs.size()))) {
+        return result;
+    }
+    return lhs.size() - rhs.size();
+}
+
+// Integers are stored as native size_t, which is also how LMDB compares them.
+int compareIntegers(const QByteArray &lhs, const QByteArray &rhs)
+{
+    if (lhs.size() != sizeof(size_t) || rhs.size() != sizeof(size_t)) {
+        return compareBytes(lhs, rhs);
+    }
+    size_t l;
+    size_t r;
+    memcpy(&l, lhs.constData(), sizeof(size_t));
+    memcpy(&r, rhs.constData(), sizeof(size_t));
+    return l < r ? -1 : (l > r ? 1 : 0);
+}
+
+struct Less {
+    bool integers = false;
+
+    int compare(const QByteArray &lhs, const QByteArray &rhs) const
+    {
+        return integers ? compareIntegers(lhs, rhs) : compareBytes(lhs, rhs);
+    }
+
+    bool operator()(const QByteArray &lhs, const QByteArray &rhs) const
+    {
+        return compare(lhs, rhs) < 0;
+    }
+};
+
+/*
+ * Keys map to their values, which are kept sorted for databases with duplicates.
+ *
+ * Once published by a commit a database is never modified again, a write transaction modifies a copy.
+ */
+struct Database {
+    typedef std::map<QByteArray, std::vector<QByteArray>, Less> Entries;
+
+    explicit Database(int flags_)
+        : flags(flags_),
+        keyLess{bool(flags_ & IntegerKeys)},
+        valueLess{bool(flags_ & IntegerValues)},
+        entries(keyLess)
+    {
+    }
+
+    bool duplicates() const
+    {
+        return flags & AllowDuplicates;
+    }
+
+    int flags;
+    Less keyLess;
+    Less valueLess;
+    Entries entries;
+    size_t count = 0;
+    qint64 bytes = 0;
+};
+
+typedef QMap<QByteArray, std::shared_ptr<Database>> Databases;
+
+struct EnvironmentData {
+    //Held for the lifetime of a write transaction
+    QMutex writeLock;
+    QMutex snapshotLock;
+    Databases snapshot;
+
+    Databases currentSnapshot()
+    {
+        QMutexLocker locker(&snapshotLock);
+        return snapshot;
+    }
+
+    void publish(const Databases &databases)
+    {
+        QMutexLocker locker(&snapshotLock);
+        snapshot = databases;
+    }
+};
+
+static QMutex sEnvironmentsLock;
+static QHash<QString, std::shared_ptr<EnvironmentData>> sEnvironments;
+
+static std::shared_ptr<EnvironmentData> lookupEnvironment(const QString &path, bool create)
+{
+    QMutexLocker locker(&sEnvironmentsLock);
+    auto &data = sEnvironments[path];
+    if (!data) {
+        if (!create) {
+            sEnvironments.remove(path);
+            return {};
+        }
+        data = std::make_shared<EnvironmentData>();
+    }
+    return data;
+}
+
+static QByteArray prefixSuccessor(QByteArray prefix)
+{
+    while (!prefix.isEmpty()) {
+        const auto last = static_cast<unsigned char>(prefix.at(prefix.size() - 1));
+        if (last < 0xFF) {
+            prefix[prefix.size() - 1] = static_cast<char>(last + 1);
+            return prefix;
+        }
+        prefix.chop(1);
+    }
+    return {};
+}
+
+class MemoryTransaction;
+
+class MemoryCursor : public Backend::Cursor
+{
+public:
+    MemoryCursor(const std::shared_ptr<Database> &db, Backend::Database::Bounds bounds, const QByteArray &lowerBound, const QByteArray &upperBound)
+        : mDb(db),
+        mBounds(bounds),
+        mLowerBound(lowerBound),
+        mUpperBound(upperBound),
+        mKey(db->entries.end())
+    {
+    }
+
+    bool first() override
+    {
+        switch (mBounds) {
+            case Backend::Database::Unbounded:
+                return settle(positionFirst());
+            case Backend::Database::Exact:
+                mKey = mDb->entries.find(mLowerBound);
+                mValue = 0;
+                return settle(mKey != mDb->entries.end());
+            case Backend::Database::Prefix:
+            case Backend::Database::Range:
+                if (mLowerBound.isEmpty()) {
+                    return settle(positionFirst());
+                }
+                return settle(positionAtOrAfter(mLowerBound));
+        }
+        return false;
+    }
+
+    bool last() override
+    {
+        switch (mBounds) {
+            case Backend::Database::Unbounded:
+                return settle(positionLast());
+            case Backend::Database::Exact:
+                return seekBefore(mLowerBound, true);
+            case Backend::Database::Prefix:
+                return seekBefore(prefixSuccessor(mLowerBound), false);
+            case Backend::Database::Range:
+                return seekBefore(mUpperBound, true);
+        }
+        return false;
+    }
+
+    bool seek(const QByteArray &key) override
+    {
+        if (key.isEmpty()) {
+            return first();
+        }
+        if (mBounds != Backend::Database::Unbounded && !mLowerBound.isEmpty() && mDb->keyLess(key, mLowerBound)) {
+            return first();
+        }
+        return settle(positionAtOrAfter(key));
+    }
+
+    bool next() override
+    {
+        if (!mValid) {
+            return false;
+        }
+        if (mBounds == Backend::Database::Exact) {
+            //Only the duplicates of the key are within the bounds
+            return settle(mDb->duplicates() && ++mValue < mKey->second.size());
+        }
+        if (++mValue < mKey->second.size()) {
+            return settle(true);
+        }
+        ++mKey;
+        mValue = 0;
+        return settle(mKey != mDb->entries.end());
+    }
+
+    bool prev() override
+    {
+        if (!mValid) {
+            return false;
+        }
+        if (mBounds == Backend::Database::Exact) {
+            if (!mDb->duplicates() || mValue == 0) {
+                return settle(false);
+            }
+            mValue--;
+            return settle(true);
+        }
+        return settle(stepBack());
+    }
+
+    bool isValid() const override
+    {
+        return mValid;
+    }
+
+    DataStore::NamedDatabase::Cursor::Entry current() const override
+    {
+        if (!mValid) {
+            return {};
+        }
+        const auto &value = mKey->second[mValue];
+        return {{mKey->first.constData(), size_t(mKey->first.size())}, {value.constData(), size_t(value.size())}};
+    }
+
+private:
+    bool positionFirst()
+    {
+        mKey = mDb->entries.begin();
+        mValue = 0;
+        return mKey != mDb->entries.end();
+    }
+
+    bool positionLast()
+    {
+        if (mDb->entries.empty()) {
+            return false;
+        }
+        mKey = std::prev(mDb->entries.end());
+        mValue = mKey->second.size() - 1;
+        return true;
+    }
+
+    bool positionAtOrAfter(const QByteArray &key)
+    {
+        mKey = mDb->entries.lower_bound(key);
+        mValue = 0;
+        return mKey != mDb->entries.end();
+    }
+
+    bool stepBack()
+    {
+        if (mValue > 0) {
+            mValue--;
+            return true;
+        }
+        if (mKey == mDb->entries.begin()) {
+            return false;
+        }
+        --mKey;
+        mValue = mKey->second.size() - 1;
+        return true;
+    }
+
+    /*
+     * Positions the cursor on the last entry with a key smaller than the bound,
+     * or equal to the bound if inclusive.
+     */
+    bool seekBefore(const QByteArray &bound, bool inclusive)
+    {
+        if (bound.isEmpty() || !positionAtOrAfter(bound)) {
+            return settle(positionLast());
+        }
+        if (inclusive && mDb->keyLess.compare(mKey->first, bound) == 0) {
+            mValue = mKey->second.size() - 1;
+            return settle(true);
+        }
+        return settle(stepBack());
+    }
+
+    bool withinBounds() const
+    {
+        const auto &key = mKey->first;
+        switch (mBounds) {
+            case Backend::Database::Unbounded:
+                return true;
+            case Backend::Database::Exact:
+                return mDb->keyLess.compare(key, mLowerBound) == 0;
+            case Backend::Database::Prefix:
+                return key.startsWith(mLowerBound);
+            case Backend::Database::Range:
+                return (mLowerBound.isEmpty() || mDb->keyLess.compare(key, mLowerBound) >= 0) && (mUpperBound.isEmpty() || mDb->keyLess.compare(key, mUpperBound) <= 0);
+        }
+        return false;
+    }
+
+    bool settle(bool positioned)
+    {
+        mValid = positioned && withinBounds();
+        return mValid;
+    }
+
+    //Keeps the database alive, even if the transaction moves on to a copy
+    std::shared_ptr<Database> mDb;
+    Backend::Database::Bounds mBounds;
+    QByteArray mLowerBound;
+    QByteArray mUpperBound;
+    Database::Entries::const_iterator mKey;
+    size_t mValue = 0;
+    bool mValid = false;
+};
+
+class MemoryTransaction : public Backend::Transaction
+{
+public:
+    MemoryTransaction(const std::shared_ptr<EnvironmentData> &environment, const QByteArray &name, bool readOnly)
+        : mEnvironment(environment),
+        mName(name),
+        mReadOnly(readOnly)
+    {
+        if (!mReadOnly) {
+            mEnvironment->writeLock.lock();
+        }
+        mDatabases = mEnvironment->currentSnapshot();
+    }
+
+    ~MemoryTransaction() override
+    {
+        abort();
+    }
+
+    bool commit(const Backend::ErrorHandler &) override
+    {
+        if (mEnded) {
+            return false;
+        }
+        if (!mReadOnly) {
+            mEnvironment->publish(mDatabases);
+        }
+        end();
+        return true;
+    }
+
+    void abort() override
+    {
+        if (!mEnded) {
+            end();
+        }
+    }
+
+    std::unique_ptr<Backend::Database> openDatabase(const QByteArray &name, int flags, const Backend::ErrorHandler &errorHandler) override;
+
+    QList<QByteArray> databaseNames() const override
+    {
+        return mDatabases.keys();
+    }
+
+    DataStore::Transaction::Stat stat() const override
+    {
+        return {};
+    }
+
+    bool readOnly() const
+    {
+        return mReadOnly;
+    }
+
+    QByteArray name() const
+    {
+        return mName;
+    }
+
+    std::shared_ptr<Database> database(const QByteArray &name) const
+    {
+        return mDatabases.value(name);
+    }
+
+    /*
+     * The database to write to, which is copied if it is shared.
+     *
+     * Databases are shared with the published snapshot until their first modification in this transaction,
+     * and with the cursors that were opened on them, so only those are copied.
+     */
+    Database &writableDatabase(const QByteArray &name)
+    {
+        Q_ASSERT(!mReadOnly);
+        auto &db = mDatabases[name];
+        if (db.use_count() > 1) {
+            db = std::make_shared<Database>(*db);
+        }
+        return *db;
+    }
+
+    /*
+     * Replaces the database with an empty one, so the entries are not copied if they are shared.
+     */
+    void clearDatabase(const QByteArray &name)
+    {
+        Q_ASSERT(!mReadOnly);
+        auto &db = mDatabases[name];
+        db = std::make_shared<Database>(db->flags);
+    }
+
+private:
+    void end()
+    {
+        mEnded = true;
+        mDatabases.clear();
+        if (!mReadOnly) {
+            mEnvironment->writeLock.unlock();
+        }
+    }
+
+    std::shared_ptr<EnvironmentData> mEnvironment;
+    QByteArray mName;
+    bool mReadOnly;
+    bool mEnded = false;
+    Databases mDatabases;
+};
+
+class MemoryDatabase : public Backend::Database
+{
+public:
+    MemoryDatabase(MemoryTransaction *transaction, const QByteArray &db)
+        : mTransaction(transaction),
+        mDb(db),
+        mStore(transaction->name() + db)
+    {
+    }
+
+    bool write(const QByteArray &key, const QByteArray &value, const Backend::ErrorHandler &errorHandler) override
+    {
+        if (key.isEmpty()) {
+            errorHandler(DataStore::Error(mStore, DataStore::GenericError, "Tried to write empty key."));
+            return false;
+        }
+        if (mTransaction->readOnly()) {
+            errorHandler(DataStore::Error(mStore, DataStore::ReadOnlyError, "Tried to write in a read-only transaction. Key: " + key));
+            return false;
+        }
+        auto &db = mTransaction->writableDatabase(mDb);
+        auto &values = db.entries[key];
+        if (!db.duplicates()) {
+            if (values.empty()) {
+                values.push_back(value);
+                db.count++;
+                db.bytes += key.size() + value.size();
+            } else {
+                db.bytes += value.size() - values.front().size();
+                values.front() = value;
+            }
+            return true;
+        }
+        auto it = std::lower_bound(values.begin(), values.end(), value, db.valueLess);
+        //The same key value pair is only stored once
+        if (it == values.end() || db.valueLess.compare(*it, value) != 0) {
+            values.insert(it, value);
+            db.count++;
+            db.bytes += key.size() + value.size();
+        }
+        return true;
+    }
+
+    bool append(const QByteArray &key, const QByteArray &value, const Backend::ErrorHandler &errorHandler) override
+    {
+        //There is no tree to skip, so appending is the same as a regular write.
+        return write(key, value, errorHandler);
+    }
+
+    void remove(const QByteArray &key, const QByteArray &value, const Backend::ErrorHandler &errorHandler) override
+    {
+        if (mTransaction->readOnly()) {
+            errorHandler(DataStore::Error(mStore, DataStore::ReadOnlyError, "Tried to remove in a read-only transaction. Key: " + key));
+            return;
+        }
+        auto notFound = [&] {
+            errorHandler(DataStore::Error(mStore, DataStore::NotFound, "Error on remove: No matching key/data pair found. Key: " + key));
+        };
+        if (!database()->entries.count(key)) {
+            notFound();
+            return;
+        }
+        auto &db = mTransaction->writableDatabase(mDb);
+        auto entry = db.entries.find(key);
+        auto &values = entry->second;
+        //Values only identify the entry in databases with duplicates
+        if (value.isEmpty() || !db.duplicates()) {
+            for (const auto &v : values) {
+                db.bytes -= key.size() + v.size();
+            }
+            db.count -= values.size();
+            db.entries.erase(entry);
+            return;
+        }
+        auto it = std::lower_bound(values.begin(), values.end(), value, db.valueLess);
+        if (it == values.end() || db.valueLess.compare(*it, value) != 0) {
+            notFound();
+            return;
+        }
+        db.bytes -= key.size() + it->size();
+        db.count--;
+        values.erase(it);
+        if (values.empty()) {
+            db.entries.erase(entry);
+        }
+    }
+
+    void clear(const Backend::ErrorHandler &errorHandler) override
+    {
+        if (mTransaction->readOnly()) {
+            errorHandler(DataStore::Error(mStore, DataStore::ReadOnlyError, "Tried to clear the database in a read-only transaction."));
+            return;
+        }
+        mTransaction->clearDatabase(mDb);
+    }
+
+    int scan(const QByteArray &k, const std::function<bool(const QByteArray &key, const QByteArray &value)> &resultHandler,
+        const Backend::ErrorHandler &errorHandler, bool findSubstringKeys) const override
+    {
+        //Keeps the entries alive if the result handler writes to the database
+        const auto db = database();
+        const auto &entries = db->entries;
+        const bool emptyKey = k.isEmpty();
+        int numberOfRetrievedValues = 0;
+        if (emptyKey || db->duplicates() || findSubstringKeys) {
+            auto it = [&] {
+                if (emptyKey) {
+                    return entries.begin();
+                }
+                if (findSubstringKeys) {
+                    return entries.lower_bound(k);
+                }
+                return entries.find(k);
+            }();
+            //Like with LMDB, we stop right away if the first key doesn't match
+            if (it == entries.end() || !it->first.startsWith(k)) {
+                return 0;
+            }
+            const bool exactKey = !emptyKey && !findSubstringKeys;
+            for (; it != entries.end(); ++it) {
+                if (!it->first.startsWith(k)) {
+                    continue;
+                }
+                for (const auto &value : it->second) {
+                    numberOfRetrievedValues++;
+                    if (!resultHandler(it->first, value)) {
+                        return numberOfRetrievedValues;
+                    }
+                }
+                if (exactKey) {
+                    break;
+                }
+            }
+            return numberOfRetrievedValues;
+        }
+        const auto it = entries.find(k);
+        if (it == entries.end()) {
+            errorHandler(DataStore::Error(mStore, DataStore::NotFound, "Error during scan. Key: " + k + " : No matching key/data pair found"));
+            return 0;
+        }
+        resultHandler(it->first, it->second.front());
+        return 1;
+    }
+
+    void findLatest(const QByteArray &k, const std::function<void(const QByteArray &key, const QByteArray &value)> &resultHandler,
+        const Backend::ErrorHandler &errorHandler) const override
+    {
+        if (k.isEmpty()) {
+            errorHandler(DataStore::Error(mStore, DataStore::GenericError, "Can't use findLatest with empty key."));
+            return;
+        }
+        const auto db = database();
+        auto it = db->entries.lower_bound(k);
+        if (it == db->entries.end() || !it->first.startsWith(k)) {
+            errorHandler(DataStore::Error(mTransaction->name(), 1, "Error during find latest. Key: " + k + " : No value found"));
+            return;
+        }
+        auto latest = it;
+        for (; it != db->entries.end() && it->first.startsWith(k); ++it) {
+            latest = it;
+        }
+        resultHandler(latest->first, latest->second.back());
+    }
+
+    void findLast(const QByteArray &k, const std::function<void(const QByteArray &key, const QByteArray &value)> &resultHandler,
+        const Backend::ErrorHandler &errorHandler) const override
+    {
+        if (k.isEmpty()) {
+            errorHandler(DataStore::Error(mStore, DataStore::GenericError, "Can't use findLatest with empty key."));
+            return;
+        }
+        const auto db = database();
+        const auto it = db->entries.find(k);
+        if (it == db->entries.end()) {
+            errorHandler(DataStore::Error(mTransaction->name(), DataStore::NotFound, "Error during find latest. Key: " + k + " : No matching key/data pair found"));
+            return;
+        }
+        resultHandler(it->first, it->second.back());
+    }
+
+    int findAllInRange(const QByteArray &lowerBound, const QByteArray &upperBound,
+        const std::function<void(const QByteArray &key, const QByteArray &value)> &resultHandler, const Backend::ErrorHandler &) const override
+    {
+        const auto db = database();
+        int count = 0;
+        for (auto it = db->entries.lower_bound(lowerBound); it != db->entries.end() && db->keyLess.compare(it->first, upperBound) <= 0; ++it) {
+            for (const auto &value : it->second) {
+                resultHandler(it->first, value);
+                count++;
+            }
+        }
+        return count;
+    }
+
+    std::unique_ptr<Backend::Cursor> openCursor(Bounds bounds, const QByteArray &lowerBound, const QByteArray &upperBound, const Backend::ErrorHandler &) const override
+    {
+        return std::unique_ptr<Backend::Cursor>{new MemoryCursor(database(), bounds, lowerBound, upperBound)};
+    }
+
+    qint64 size() const override
+    {
+        return database()->bytes;
+    }
+
+    DataStore::NamedDatabase::Stat stat() const override
+    {
+        return {0, 0, 0, database()->count};
+    }
+
+    bool allowsDuplicates() const override
+    {
+        return database()->duplicates();
+    }
+
+private:
+    std::shared_ptr<Database> database() const
+    {
+        return mTransaction->database(mDb);
+    }
+
+    MemoryTransaction *mTransaction;
+    QByteArray mDb;
+    QByteArray mStore;
+};
+
+std::unique_ptr<Backend::Database> MemoryTransaction::openDatabase(const QByteArray &name, int flags, const Backend::ErrorHandler &errorHandler)
+{
+    if (mEnded) {
+        errorHandler(DataStore::Error(mName, DataStore::NotOpen, "Tried to open a database in a finished transaction: " + name));
+        return {};
+    }
+    if (!mDatabases.contains(name)) {
+        if (mReadOnly) {
+            return {};
+        }
+        SinkTrace() << "Creating database: " << mName << name;
+        mDatabases.insert(name, std::make_shared<Database>(flags));
+    }
+    return std::unique_ptr<Backend::Database>{new MemoryDatabase(this, name)};
+}
+
+class MemoryEnvironment : public Backend::Environment
+{
+public:
+    MemoryEnvironment(const QString &path, const QByteArray &name)
+        : mPath(path),
+        mName(name)
+    {
+    }
+
+    std::unique_ptr<Backend::Transaction> createTransaction(bool readOnly, const Backend::ErrorHandler &errorHandler) override
+    {
+        //Looked up every time, so we follow the environment if it is removed and recreated meanwhile.
+        auto data = lookupEnvironment(mPath, false);
+        if (!data) {
+            errorHandler(DataStore::Error(mName, DataStore::GenericError, "Failed to create transaction: Missing database environment"));
+            return {};
+        }
+        return std::unique_ptr<Backend::Transaction>{new MemoryTransaction(data, mName, readOnly)};
+    }
+
+    bool exists() const override
+    {
+        return MemoryBackend::exists(mPath);
+    }
+
+    qint64 diskUsage() const override
+    {
+        auto data = lookupEnvironment(mPath, false);
+        if (!data) {
+            return 0;
+        }
+        qint64 size = 0;
+        for (const auto &db : data->currentSnapshot()) {
+            size += db->bytes;
+        }
+        return size;
+    }
+
+    void remove() override
+    {
+        std::shared_ptr<EnvironmentData> data;
+        {
+            QMutexLocker locker(&sEnvironmentsLock);
+            data = sEnvironments.take(mPath);
+        }
+        //Whoever still holds on to the environment will find it empty
+        if (data) {
+            data->publish({});
+        }
+    }
+
+    bool compact() override
+    {
+        //There are no free pages to reclaim
+        return true;
+    }
+
+private:
+    QString mPath;
+    QByteArray mName;
+};
+
+}
+
+std::unique_ptr<Backend::Environment> MemoryBackend::open(const QString &path, const QByteArray &name, DataStore::AccessMode mode, const DbLayout &layout)
+{
+    if (mode == DataStore::ReadWrite) {
+        auto data = lookupEnvironment(path, true);
+        //Create the databases of the layout that don't exist yet
+        MemoryTransaction transaction(data, name, false);
+        for (auto it = layout.tables.constBegin(); it != layout.tables.constEnd(); it++) {
+            transaction.openDatabase(it.key(), it.value(), [](const DataStore::Error &) {});
+        }
+        transaction.commit({});
+    }
+    return std::unique_ptr<Backend::Environment>{new MemoryEnvironment(path, name)};
+}
+
+bool MemoryBackend::exists(const QString &path)
+{
+    QMutexLocker locker(&sEnvironmentsLock);
+    return sEnvironments.contains(path);
+}
+
+void MemoryBackend::removeAll()
+{
+    QHash<QString, std::shared_ptr<EnvironmentData>> environments;
+    {
+        QMutexLocker locker(&sEnvironmentsLock);
+        environments.swap(sEnvironments);
+    }
+    for (const auto &data : environments) {
+        data->publish({});
+    }
+}
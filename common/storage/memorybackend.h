@@ -0,0 +1,45 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "backend.h"
+
+namespace Sink {
+namespace Storage {
+
+/**
+ * An ordered in-memory storage engine.
+ *
+ * All DataStores of the process that open the same path share the environment, until it is removed.
+ * Write transactions are serialized, and read-only transactions see the snapshot of the last commit before they started.
+ * Nothing is ever written to disk.
+ */
+namespace MemoryBackend {
+
+std::unique_ptr<Backend::Environment> SINK_EXPORT open(const QString &path, const QByteArray &name, DataStore::AccessMode mode, const DbLayout &layout);
+bool SINK_EXPORT exists(const QString &path);
+/**
+ * Removes all environments, like removing the storage directory does for the LMDB engine.
+ */
+void SINK_EXPORT removeAll();
+
+}
+
+}
+}
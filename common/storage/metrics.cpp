@@ -0,0 +1,192 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+using namespace Sink::Storage;
+
+static QMutex sMetricsLock;
+static QHash<QByteArray, OperationMetrics *> sMetrics;
+
+static int shard()
+{
+    static std::atomic<int> sNextShard{0};
+    //Threads are assigned to shards round robin, so the first few threads never share one.
+    thread_local const int shard = sNextShard.fetch_add(1, std::memory_order_relaxed);
+    return shard;
+}
+
+static int latencyBucket(quint64 nsecs)
+{
+    int bucket = 0;
+    for (quint64 usecs = nsecs / 1000; usecs && bucket < OperationMetrics::LatencyBuckets - 1; usecs >>= 1) {
+        bucket++;
+    }
+    return bucket;
+}
+
+OperationMetrics::Counters OperationMetrics::Counters::operator-(const Counters &other) const
+{
+    Counters result;
+    result.count = count - other.count;
+    result.bytes = bytes - other.bytes;
+    result.nsecs = nsecs - other.nsecs;
+    for (int i = 0; i < LatencyBuckets; i++) {
+        result.latency[i] = latency[i] - other.latency[i];
+    }
+    return result;
+}
+
+quint64 OperationMetrics::Counters::latencyPercentile(double percentile) const
+{
+    quint64 total = 0;
+    for (const auto c : latency) {
+        total += c;
+    }
+    if (!total) {
+        return 0;
+    }
+    const quint64 threshold = quint64(percentile * total);
+    quint64 seen = 0;
+    for (int i = 0; i < LatencyBuckets; i++) {
+        seen += latency[i];
+        if (seen >= threshold) {
+            return quint64(1) << i;
+        }
+    }
+    return quint64(1) << (LatencyBuckets - 1);
+}
+
+const char *OperationMetrics::operationName(Operation operation)
+{
+    switch (operation) {
+        case Read:
+            return "read";
+        case Write:
+            return "write";
+        case Remove:
+            return "remove";
+        case Scan:
+            return "scan";
+        case Commit:
+            return "commit";
+        case OperationCount:
+            break;
+    }
+    return "";
+}
+
+OperationMetrics *OperationMetrics::get(const QByteArray &name)
+{
+    QMutexLocker locker(&sMetricsLock);
+    auto &metrics = sMetrics[name];
+    if (!metrics) {
+        metrics = new OperationMetrics();
+    }
+    return metrics;
+}
+
+void OperationMetrics::record(Operation operation, quint64 bytes, quint64 nsecs)
+{
+    auto &s = mShards[shard() % Shards];
+    s.count[operation].fetch_add(1, std::memory_order_relaxed);
+    s.bytes[operation].fetch_add(bytes, std::memory_order_relaxed);
+    s.nsecs[operation].fetch_add(nsecs, std::memory_order_relaxed);
+    s.latency[operation][latencyBucket(nsecs)].fetch_add(1, std::memory_order_relaxed);
+}
+
+QVector<OperationMetrics::Snapshot> OperationMetrics::snapshot()
+{
+    QMutexLocker locker(&sMetricsLock);
+    QVector<Snapshot> result;
+    result.reserve(sMetrics.size());
+    for (auto it = sMetrics.constBegin(); it != sMetrics.constEnd(); it++) {
+        Snapshot snapshot;
+        snapshot.name = it.key();
+        for (const auto &s : it.value()->mShards) {
+            for (int op = 0; op < OperationCount; op++) {
+                auto &counters = snapshot.operations[op];
+                counters.count += s.count[op].load(std::memory_order_relaxed);
+                counters.bytes += s.bytes[op].load(std::memory_order_relaxed);
+                counters.nsecs += s.nsecs[op].load(std::memory_order_relaxed);
+                for (int i = 0; i < LatencyBuckets; i++) {
+                    counters.latency[i] += s.latency[op][i].load(std::memory_order_relaxed);
+                }
+            }
+        }
+        result << snapshot;
+    }
+    return result;
+}
+
+QByteArray OperationMetrics::Snapshot::toJson(const QVector<Snapshot> &snapshots)
+{
+    QJsonArray array;
+    for (const auto &snapshot : snapshots) {
+        QJsonObject object;
+        object.insert("name", QString::fromUtf8(snapshot.name));
+        for (int op = 0; op < OperationCount; op++) {
+            const auto &counters = snapshot.operations[op];
+            if (!counters.count) {
+                continue;
+            }
+            QJsonArray latency;
+            for (const auto c : counters.latency) {
+                latency.append(double(c));
+            }
+            object.insert(operationName(Operation(op)), QJsonObject{
+                {"count", double(counters.count)},
+                {"bytes", double(counters.bytes)},
+                {"nsecs", double(counters.nsecs)},
+                {"latency", latency}
+            });
+        }
+        array.append(object);
+    }
+    return QJsonDocument(array).toJson(QJsonDocument::Compact);
+}
+
+QVector<OperationMetrics::Snapshot> OperationMetrics::Snapshot::fromJson(const QByteArray &json)
+{
+    QVector<Snapshot> result;
+    for (const auto &value : QJsonDocument::fromJson(json).array()) {
+        const auto object = value.toObject();
+        Snapshot snapshot;
+        snapshot.name = object.value("name").toString().toUtf8();
+        for (int op = 0; op < OperationCount; op++) {
+            const auto counterObject = object.value(operationName(Operation(op))).toObject();
+            auto &counters = snapshot.operations[op];
+            counters.count = quint64(counterObject.value("count").toDouble());
+            counters.bytes = quint64(counterObject.value("bytes").toDouble());
+            counters.nsecs = quint64(counterObject.value("nsecs").toDouble());
+            const auto latency = counterObject.value("latency").toArray();
+            for (int i = 0; i < LatencyBuckets && i < latency.size(); i++) {
+                counters.latency[i] = quint64(latency.at(i).toDouble());
+            }
+        }
+        result << snapshot;
+    }
+    return result;
+}
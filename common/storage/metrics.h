@@ -0,0 +1,102 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "sink_export.h"
+
+#include <QByteArray>
+#include <QVector>
+#include <array>
+#include <atomic>
+
+namespace Sink {
+namespace Storage {
+
+/**
+ * Operation counters of a named database, or of the transactions of an environment.
+ *
+ * Meant to stay enabled in production: every thread records into its own shard with relaxed atomics,
+ * so threads don't contend on the same cache line. The shards are only summed up for a snapshot.
+ */
+class SINK_EXPORT OperationMetrics
+{
+public:
+    enum Operation {
+        Read,
+        Write,
+        Remove,
+        Scan,
+        Commit,
+        OperationCount
+    };
+
+    // Bucket i counts operations that took less than 2^i microseconds, the last one everything slower.
+    static const constexpr int LatencyBuckets = 24;
+
+    struct SINK_EXPORT Counters {
+        quint64 count = 0;
+        quint64 bytes = 0;
+        quint64 nsecs = 0;
+        std::array<quint64, LatencyBuckets> latency{};
+
+        Counters operator-(const Counters &other) const;
+
+        /**
+         * The upper bound of the latency in microseconds that @param percentile of the operations stayed below.
+         */
+        quint64 latencyPercentile(double percentile) const;
+    };
+
+    struct SINK_EXPORT Snapshot {
+        QByteArray name;
+        std::array<Counters, OperationCount> operations;
+
+        static QByteArray toJson(const QVector<Snapshot> &);
+        static QVector<Snapshot> fromJson(const QByteArray &);
+    };
+
+    static const char *operationName(Operation);
+
+    /**
+     * The metrics registered with @param name, which remain valid until the process exits.
+     */
+    static OperationMetrics *get(const QByteArray &name);
+
+    /**
+     * Snapshots of all metrics of this process.
+     */
+    static QVector<Snapshot> snapshot();
+
+    void record(Operation operation, quint64 bytes, quint64 nsecs);
+
+private:
+    OperationMetrics() = default;
+
+    static const constexpr int Shards = 4;
+    struct alignas(64) Shard {
+        std::atomic<quint64> count[OperationCount];
+        std::atomic<quint64> bytes[OperationCount];
+        std::atomic<quint64> nsecs[OperationCount];
+        std::atomic<quint64> latency[OperationCount][LatencyBuckets];
+    };
+    std::array<Shard, Shards> mShards{};
+};
+
+}
+}
@@ -0,0 +1,132 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "projection.h"
+
+#include "applicationdomaintype.h"
+#include "bufferadaptor.h"
+#include "log.h"
+
+#include <QDataStream>
+
+using namespace Sink::Storage;
+using Sink::ApplicationDomain::Mail;
+using Sink::ApplicationDomain::Reference;
+
+enum ValueTag : quint8 {
+    InvalidTag,
+    VariantTag,
+    ReferenceTag,
+    ContactTag,
+    ContactListTag
+};
+
+//The projections are persisted, so the encoding must not change with the Qt version
+static const auto sStreamVersion = QDataStream::Qt_5_6;
+
+static void writeValue(QDataStream &stream, const QVariant &value)
+{
+    if (!value.isValid()) {
+        stream << quint8{InvalidTag};
+    } else if (value.userType() == qMetaTypeId<Reference>()) {
+        stream << quint8{ReferenceTag} << value.value<Reference>().value;
+    } else if (value.userType() == qMetaTypeId<Mail::Contact>()) {
+        const auto contact = value.value<Mail::Contact>();
+        stream << quint8{ContactTag} << contact.name << contact.emailAddress;
+    } else if (value.userType() == qMetaTypeId<QList<Mail::Contact>>()) {
+        const auto contacts = value.value<QList<Mail::Contact>>();
+        stream << quint8{ContactListTag} << quint32(contacts.size());
+        for (const auto &contact : contacts) {
+            stream << contact.name << contact.emailAddress;
+        }
+    } else {
+        stream << quint8{VariantTag} << value;
+    }
+}
+
+static QVariant readValue(QDataStream &stream)
+{
+    quint8 tag;
+    stream >> tag;
+    switch (tag) {
+        case InvalidTag:
+            return {};
+        case VariantTag: {
+            QVariant value;
+            stream >> value;
+            return value;
+        }
+        case ReferenceTag: {
+            QByteArray value;
+            stream >> value;
+            return QVariant::fromValue(Reference{value});
+        }
+        case ContactTag: {
+            Mail::Contact contact;
+            stream >> contact.name >> contact.emailAddress;
+            return QVariant::fromValue(contact);
+        }
+        case ContactListTag: {
+            quint32 size;
+            stream >> size;
+            QList<Mail::Contact> contacts;
+            for (quint32 i = 0; i < size && stream.status() == QDataStream::Ok; i++) {
+                Mail::Contact contact;
+                stream >> contact.name >> contact.emailAddress;
+                contacts << contact;
+            }
+            return QVariant::fromValue(contacts);
+        }
+        default:
+            stream.setStatus(QDataStream::ReadCorruptData);
+            return {};
+    }
+}
+
+QByteArray Projection::encode(const Sink::ApplicationDomain::ApplicationDomainType &entity, const QByteArrayList &properties)
+{
+    QByteArray projection;
+    QDataStream stream(&projection, QIODevice::WriteOnly);
+    stream.setVersion(sStreamVersion);
+    stream << quint32(properties.size());
+    for (const auto &property : properties) {
+        stream << property;
+        writeValue(stream, entity.getProperty(property));
+    }
+    return projection;
+}
+
+void Projection::decode(const QByteArray &projection, Sink::ApplicationDomain::BufferAdaptor &adaptor)
+{
+    QDataStream stream(projection);
+    stream.setVersion(sStreamVersion);
+    quint32 size;
+    stream >> size;
+    for (quint32 i = 0; i < size && stream.status() == QDataStream::Ok; i++) {
+        QByteArray property;
+        stream >> property;
+        const auto value = readValue(stream);
+        if (stream.status() != QDataStream::Ok) {
+            break;
+        }
+        adaptor.setProperty(property, value);
+    }
+    if (stream.status() != QDataStream::Ok) {
+        SinkWarning() << "Failed to decode the projection of a covering index.";
+    }
+}
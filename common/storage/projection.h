@@ -0,0 +1,52 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "sink_export.h"
+
+#include <QByteArray>
+#include <QByteArrayList>
+
+namespace Sink {
+namespace ApplicationDomain {
+class ApplicationDomainType;
+class BufferAdaptor;
+}
+
+namespace Storage {
+
+/**
+ * The encoding of the property values that covering indexes store next to the entity id.
+ *
+ * A projection is self describing, it contains the names of the properties with their values.
+ * Besides the types QDataStream supports, references and mail contacts can be stored.
+ */
+namespace Projection {
+
+QByteArray SINK_EXPORT encode(const Sink::ApplicationDomain::ApplicationDomainType &entity, const QByteArrayList &properties);
+
+/**
+ * Sets the properties stored in @param projection on @param adaptor.
+ */
+void SINK_EXPORT decode(const QByteArray &projection, Sink::ApplicationDomain::BufferAdaptor &adaptor);
+
+}
+
+}
+}
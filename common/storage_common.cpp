@@ -24,6 +24,8 @@
 #include "log.h"
 #include "utils.h"
 
+#include <atomic>
+
 QDebug& operator<<(QDebug &dbg, const Sink::Storage::DataStore::Error &error)
 {
     dbg << error.message << "Code: " << error.code << "Db: " << error.store;
@@ -55,6 +57,43 @@ DbLayout::DbLayout(const QByteArray &n, const Databases &t)
 
 }
 
+DbLayout::DbLayout(const QByteArray &n, const Databases &t, const StorageProfile &p)
+    : name(n),
+    tables(t),
+    profile(p)
+{
+
+}
+
+StorageProfile StorageProfile::disposable()
+{
+    StorageProfile profile;
+    profile.durability = NoSync;
+    profile.writeMap = true;
+    //With a writable map the file is as large as the map, so start small and grow as required.
+    profile.initialMapSize = (size_t)1048576 * (size_t)64; // 1MB * 64
+    return profile;
+}
+
+StorageProfile StorageProfile::relaxed()
+{
+    StorageProfile profile;
+    profile.durability = NoMetaSync;
+    return profile;
+}
+
+static std::atomic<StorageBackend> sStorageBackend{StorageBackend::Lmdb};
+
+void setStorageBackend(StorageBackend backend)
+{
+    sStorageBackend = backend;
+}
+
+StorageBackend storageBackend()
+{
+    return sStorageBackend;
+}
+
 void errorHandler(const DataStore::Error &error)
 {
     if (error.code == DataStore::TransactionError) {
@@ -200,14 +239,15 @@ void DataStore::recordRevision(DataStore::Transaction &transaction, size_t revis
     const Identifier &uid, const QByteArray &type)
 {
     const auto uidBa = uid.toInternalByteArray();
+    //Revisions are monotonically increasing, so we can append to all tables.
     transaction
         .openDatabase("revisions", /* errorHandler = */ {}, IntegerKeys)
-        .write(revision, uidBa);
+        .append(revision, uidBa);
     transaction.openDatabase("uidsToRevisions", /* errorHandler = */ {}, AllowDuplicates | IntegerValues)
-        .write(uidBa, sizeTToByteArray(revision));
+        .append(uidBa, sizeTToByteArray(revision));
     transaction
         .openDatabase("revisionType", /* errorHandler = */ {}, IntegerKeys)
-        .write(revision, type);
+        .append(revision, type);
 }
 
 void DataStore::removeRevision(DataStore::Transaction &transaction, size_t revision)
@@ -20,8 +20,18 @@
  */
 
 #include "storage.h"
+#include "storage/backend.h"
+#include "storage/memorybackend.h"
+#include "storage/metrics.h"
 
 #include <iostream>
+#include <cstring>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include <QDebug>
 #include <QDir>
@@ -29,24 +39,610 @@
 #include <QMutex>
 #include <QMutexLocker>
 #include <QString>
+#include <QSet>
+#include <QVector>
 #include <QTime>
+#include <QElapsedTimer>
+#include <QDateTime>
 #include <valgrind.h>
 #include <lmdb.h>
 #include "log.h"
+#include "threadboundary.h"
 
 #ifdef Q_OS_WIN
 #include <BaseTsd.h>
 typedef SSIZE_T ssize_t;
+#else
+#include <sys/stat.h>
 #endif
 
 namespace Sink {
 namespace Storage {
 
-static QReadWriteLock sDbisLock;
 static QReadWriteLock sEnvironmentsLock;
 static QMutex sCreateDbiLock;
 static QHash<QString, MDB_env *> sEnvironments;
-static QHash<QString, MDB_dbi> sDbis;
+//For constant time validity checks of environments. Maps to the id of the environment's dbi table.
+static QHash<MDB_env *, quint64> sOpenEnvironments;
+//Environments that have been replaced by a compacted copy, but still have transactions.
+static QSet<MDB_env *> sRetiredEnvironments;
+//The ids of environments that have been replaced by a compacted copy.
+static QSet<quint64> sCompactedEnvironments;
+
+/*
+ * The dbis that have been opened in an environment.
+ *
+ * Every environment has its own table (see EnvironmentData).
+ * Dbis are only ever added (until the environment is closed), so entries are published with an atomic counter
+ * and can be read without taking a lock. Insertions are serialized by sCreateDbiLock.
+ */
+class DbiTable
+{
+public:
+    // Must accomodate all named databases (mdb_env_set_maxdbs)
+    static const constexpr int maxDbis = 64;
+
+    /*
+     * Identifies the table (and thus the environment) for DatabaseHandles.
+     * Unlike the environment pointer this is never reused once an environment is closed.
+     */
+    quint64 id() const
+    {
+        return mId;
+    }
+
+    static DbiTable *get(MDB_env *env);
+    static DbiTable *get(MDB_txn *transaction);
+
+    int indexOf(const QByteArray &db) const
+    {
+        const int count = mCount.load(std::memory_order_acquire);
+        for (int i = 0; i < count; i++) {
+            if (mEntries[i].name == db) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    bool isValidIndex(int index) const
+    {
+        return index >= 0 && index < mCount.load(std::memory_order_acquire);
+    }
+
+    MDB_dbi dbi(int index) const
+    {
+        return mEntries[index].dbi;
+    }
+
+    OperationMetrics *metrics(int index) const
+    {
+        return mEntries[index].metrics;
+    }
+
+    // Must be set before the first insert, the metrics of the dbis are registered by the name of the environment.
+    void setName(const QByteArray &name)
+    {
+        mName = name;
+    }
+
+    OperationMetrics *metricsFor(const QByteArray &db) const
+    {
+        return OperationMetrics::get(mName + '/' + db);
+    }
+
+    // Must only be called while holding sCreateDbiLock, or while nobody else has access to the environment.
+    int insert(const QByteArray &db, MDB_dbi dbi)
+    {
+        if (const int existing = indexOf(db); existing >= 0) {
+            return existing;
+        }
+        const int count = mCount.load(std::memory_order_relaxed);
+        if (count >= maxDbis) {
+            SinkError() << "Exceeded the maximum number of dbis: " << db;
+            Q_ASSERT(false);
+            return -1;
+        }
+        //Deep copy, the name may refer to raw data
+        mEntries[count] = {QByteArray{db.constData(), db.size()}, dbi, metricsFor(db)};
+        mCount.store(count + 1, std::memory_order_release);
+        return count;
+    }
+
+private:
+    struct Entry {
+        QByteArray name;
+        MDB_dbi dbi = 0;
+        OperationMetrics *metrics = nullptr;
+    };
+    std::array<Entry, maxDbis> mEntries;
+    QByteArray mName;
+    std::atomic<int> mCount{0};
+    const quint64 mId = nextId();
+
+    static quint64 nextId()
+    {
+        static std::atomic<quint64> sNextId{1};
+        return sNextId++;
+    }
+};
+
+/*
+ * A pool of reset read-only transactions.
+ *
+ * Renewing a reset transaction is considerably cheaper than beginning a new one,
+ * which matters for the many short-lived read-only transactions of queries.
+ * Because we use MDB_NOTLS, read-only transactions are not bound to the thread that created them,
+ * so a transaction can be handed out to whichever thread asks next.
+ */
+class ReadTransactionPool
+{
+public:
+    static const constexpr int maxSize = 16;
+
+    MDB_txn *take()
+    {
+        QMutexLocker locker(&mMutex);
+        if (mTransactions.isEmpty()) {
+            return nullptr;
+        }
+        return mTransactions.takeLast();
+    }
+
+    /*
+     * Takes ownership of a reset transaction, or aborts it if the pool is full.
+     */
+    void put(MDB_txn *transaction)
+    {
+        {
+            QMutexLocker locker(&mMutex);
+            if (mTransactions.size() < maxSize) {
+                mTransactions.append(transaction);
+                return;
+            }
+        }
+        mdb_txn_abort(transaction);
+    }
+
+    void clear()
+    {
+        QMutexLocker locker(&mMutex);
+        for (const auto transaction : mTransactions) {
+            mdb_txn_abort(transaction);
+        }
+        mTransactions.clear();
+    }
+
+private:
+    QMutex mMutex;
+    QVector<MDB_txn *> mTransactions;
+};
+
+/*
+ * The state we keep per environment.
+ *
+ * It is attached to the environment via mdb_env_set_userctx,
+ * so we can get to it from any transaction without a global lookup.
+ */
+struct EnvironmentData {
+    DbiTable dbis;
+    ReadTransactionPool readTransactions;
+
+    //Only set for environments that are not flushed on every commit (see Flusher)
+    int checkpointInterval = 0;
+    QElapsedTimer sinceCheckpoint;
+    std::atomic<bool> dirty{false};
+    //Held while committing, so syncing can be disabled for a single commit (see Transaction::commitAsync)
+    QMutex commitLock;
+
+    //The profile and data file the environment was opened with
+    StorageProfile profile;
+    QPair<quint64, quint64> fileId;
+    //When we last checked whether the data file has been replaced, in milliseconds since the epoch
+    std::atomic<qint64> lastReplacementCheck{0};
+
+    //Commits of write transactions
+    OperationMetrics *transactionMetrics = nullptr;
+
+    //Transactions that have been started and not yet ended
+    std::atomic<int> transactions{0};
+    //Set once the environment has been replaced by a compacted copy. It is closed once the last transaction ended.
+    bool retired = false;
+
+    //Only environments with an initial map size grow their map.
+    bool growable = false;
+    //Transactions of growable environments hold this for reading,
+    //because the map may only be resized while no transaction is active in the process.
+    QReadWriteLock mapLock;
+    std::atomic<bool> growRequested{false};
+    //The write transaction that ran out of space. It can't be committed anymore, but can be retried once the map has grown.
+    std::atomic<MDB_txn *> mapFullTransaction{nullptr};
+
+    static EnvironmentData *get(MDB_env *env)
+    {
+        return env ? static_cast<EnvironmentData *>(mdb_env_get_userctx(env)) : nullptr;
+    }
+};
+
+/*
+ * Doubles the map if it is getting full, or if a write ran out of space.
+ *
+ * We grow early because a write transaction can't be retried once it ran out of space.
+ * If any transaction is active in the process we try again with the next write transaction.
+ */
+static void growMapIfRequired(MDB_env *env, EnvironmentData &data)
+{
+    MDB_envinfo info;
+    mdb_env_info(env, &info);
+    MDB_stat stat;
+    mdb_env_stat(env, &stat);
+    const size_t used = (info.me_last_pgno + 1) * stat.ms_psize;
+    if (!data.growRequested && used < info.me_mapsize / 2) {
+        return;
+    }
+    if (!data.mapLock.tryLockForWrite()) {
+        return;
+    }
+    const size_t newSize = info.me_mapsize * 2;
+    if (const int rc = mdb_env_set_mapsize(env, newSize)) {
+        SinkWarning() << "Failed to grow the map to " << newSize << ": " << QByteArray(mdb_strerror(rc));
+    } else {
+        SinkTrace() << "Grew the map to " << newSize;
+        data.growRequested = false;
+    }
+    data.mapLock.unlock();
+}
+
+/*
+ * Adopts the map size after another process grew the map.
+ */
+static bool adoptMapSize(MDB_env *env, EnvironmentData &data)
+{
+    if (!data.mapLock.tryLockForWrite()) {
+        return false;
+    }
+    const int rc = mdb_env_set_mapsize(env, 0);
+    data.mapLock.unlock();
+    return !rc;
+}
+
+static void requestMapGrowth(MDB_txn *transaction)
+{
+    if (auto data = EnvironmentData::get(mdb_txn_env(transaction))) {
+        data->growRequested = true;
+        data->mapFullTransaction = transaction;
+    }
+}
+
+/*
+ * Records the duration of an operation once it goes out of scope.
+ */
+class MetricsRecorder
+{
+public:
+    MetricsRecorder(OperationMetrics *metrics, OperationMetrics::Operation operation)
+        : mMetrics(metrics),
+          mOperation(operation),
+          mStart(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~MetricsRecorder()
+    {
+        if (mMetrics) {
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - mStart);
+            mMetrics->record(mOperation, bytes, elapsed.count());
+        }
+    }
+
+    void add(const MDB_val &key, const MDB_val &value)
+    {
+        bytes += key.mv_size + value.mv_size;
+    }
+
+    quint64 bytes = 0;
+
+private:
+    OperationMetrics *mMetrics;
+    OperationMetrics::Operation mOperation;
+    std::chrono::steady_clock::time_point mStart;
+};
+
+DbiTable *DbiTable::get(MDB_env *env)
+{
+    auto data = EnvironmentData::get(env);
+    return data ? &data->dbis : nullptr;
+}
+
+DbiTable *DbiTable::get(MDB_txn *transaction)
+{
+    return transaction ? get(mdb_txn_env(transaction)) : nullptr;
+}
+
+/*
+ * A request to flush an environment, which completes once everything committed before it is on disk.
+ */
+class FlushRequest
+{
+public:
+    void complete(bool success)
+    {
+        std::function<void(bool)> callback;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mDone = true;
+            mSuccess = success;
+            callback = std::move(mCallback);
+        }
+        if (callback) {
+            callback(success);
+        }
+    }
+
+    /*
+     * Calls the handler in the calling thread once the request completed.
+     */
+    void onComplete(const std::function<void(bool)> &handler)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mDone) {
+                auto boundary = new async::ThreadBoundary;
+                mCallback = [boundary, handler](bool success) {
+                    boundary->callInMainThread([boundary, handler, success] {
+                        handler(success);
+                        boundary->deleteLater();
+                    });
+                };
+                return;
+            }
+        }
+        handler(mSuccess);
+    }
+
+private:
+    std::mutex mMutex;
+    bool mDone = false;
+    bool mSuccess = false;
+    std::function<void(bool)> mCallback;
+};
+
+/*
+ * Flushes environments to disk in a dedicated thread.
+ *
+ * Commits that don't wait for the disk hand their environment to the flusher, which syncs every environment
+ * with pending requests once, no matter how many commits happened meanwhile.
+ * Environments that are not flushed on every commit are additionally flushed periodically, which bounds
+ * how much a system crash can lose, and the environments are flushed one last time on shutdown.
+ */
+class Flusher
+{
+public:
+    static Flusher &instance()
+    {
+        static Flusher flusher;
+        return flusher;
+    }
+
+    ~Flusher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mCondition.notify_all();
+        if (mThread.joinable()) {
+            mThread.join();
+        }
+    }
+
+    /*
+     * Starts the thread if it isn't running yet, and ensures we checkpoint at least every interval.
+     */
+    void start(int interval)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        startThread(interval);
+    }
+
+    std::shared_ptr<FlushRequest> flush(MDB_env *env)
+    {
+        auto request = std::make_shared<FlushRequest>();
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mRequests.append({env, request});
+            startThread(mInterval);
+        }
+        mCondition.notify_all();
+        return request;
+    }
+
+private:
+    Flusher() = default;
+
+    void startThread(int interval)
+    {
+        if (mThread.joinable()) {
+            mInterval = std::min(mInterval, interval);
+        } else {
+            mInterval = interval;
+            mThread = std::thread([this] { run(); });
+        }
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStop) {
+            mCondition.wait_for(lock, std::chrono::milliseconds(mInterval), [this] { return mStop || !mRequests.isEmpty(); });
+            const bool stopping = mStop;
+            const auto requests = std::move(mRequests);
+            mRequests.clear();
+            lock.unlock();
+            flush(requests);
+            checkpoint(stopping);
+            lock.lock();
+        }
+        //Nobody is going to wait for those anymore, but they should still end up on disk
+        const auto requests = std::move(mRequests);
+        lock.unlock();
+        flush(requests);
+    }
+
+    typedef QVector<QPair<MDB_env *, std::shared_ptr<FlushRequest>>> Requests;
+
+    static void flush(const Requests &requests)
+    {
+        if (requests.isEmpty()) {
+            return;
+        }
+        QHash<MDB_env *, bool> flushed;
+        {
+            //Environments are only closed while holding the write lock
+            QReadLocker locker(&sEnvironmentsLock);
+            for (const auto &request : requests) {
+                const auto env = request.first;
+                if (flushed.contains(env)) {
+                    continue;
+                }
+                //Removed environments have nothing left to flush, and the content of replaced ones has been copied already
+                if (!sOpenEnvironments.contains(env) && !sRetiredEnvironments.contains(env)) {
+                    flushed.insert(env, true);
+                    continue;
+                }
+                const int rc = mdb_env_sync(env, 1);
+                if (rc) {
+                    SinkWarning() << "Failed to flush the environment: " << QByteArray(mdb_strerror(rc));
+                }
+                flushed.insert(env, !rc);
+            }
+        }
+        for (const auto &request : requests) {
+            request.second->complete(flushed.value(request.first));
+        }
+    }
+
+    static void checkpoint(bool all)
+    {
+        //Environments are only closed while holding the write lock
+        QReadLocker locker(&sEnvironmentsLock);
+        for (auto it = sOpenEnvironments.constBegin(); it != sOpenEnvironments.constEnd(); it++) {
+            const auto env = it.key();
+            auto data = EnvironmentData::get(env);
+            if (!data->checkpointInterval || !data->dirty) {
+                continue;
+            }
+            if (!all && !data->sinceCheckpoint.hasExpired(data->checkpointInterval)) {
+                continue;
+            }
+            data->dirty = false;
+            data->sinceCheckpoint.restart();
+            if (const int rc = mdb_env_sync(env, 1)) {
+                SinkWarning() << "Failed to flush the environment: " << QByteArray(mdb_strerror(rc));
+            }
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::thread mThread;
+    int mInterval = 1000;
+    bool mStop = false;
+    Requests mRequests;
+};
+
+static void closeEnvironment(MDB_env *env)
+{
+    if (!env) {
+        return;
+    }
+    sOpenEnvironments.remove(env);
+    auto data = EnvironmentData::get(env);
+    //Pooled transactions must be gone before the environment is closed
+    if (data) {
+        data->readTransactions.clear();
+    }
+    mdb_env_close(env);
+    delete data;
+}
+
+/*
+ * Identifies the data file, so we notice when another process replaced it with a compacted copy.
+ */
+static QPair<quint64, quint64> fileIdentity(const QString &fullPath)
+{
+#ifdef Q_OS_WIN
+    Q_UNUSED(fullPath);
+    return {};
+#else
+    struct stat info;
+    if (::stat(QFile::encodeName(fullPath + "/data.mdb").constData(), &info)) {
+        return {};
+    }
+    return {quint64(info.st_dev), quint64(info.st_ino)};
+#endif
+}
+
+//Environments are looked up for every query, so we only stat() the data file once in a while
+static const qint64 sReplacementCheckInterval = 1000;
+
+/*
+ * Returns true if another process replaced the data file since we opened it.
+ *
+ * Only checks once per sReplacementCheckInterval, so a replacement is noticed with a short delay.
+ */
+static bool isReplaced(MDB_env *env, const QString &fullPath)
+{
+    auto data = EnvironmentData::get(env);
+    const auto now = QDateTime::currentMSecsSinceEpoch();
+    auto lastCheck = data->lastReplacementCheck.load();
+    if (now - lastCheck < sReplacementCheckInterval || !data->lastReplacementCheck.compare_exchange_strong(lastCheck, now)) {
+        return false;
+    }
+    const auto id = fileIdentity(fullPath);
+    //A missing file means the database has been removed, not replaced.
+    return id != QPair<quint64, quint64>{} && id != EnvironmentData::get(env)->fileId;
+}
+
+/*
+ * Removes a replaced environment from the registry.
+ *
+ * Transactions of the environment remain valid, and the environment is closed once the last one ended.
+ * Must be called with sEnvironmentsLock locked for writing, so no transaction can start or end meanwhile.
+ */
+static void retireEnvironment(const QString &fullPath, MDB_env *env)
+{
+    auto data = EnvironmentData::get(env);
+    sEnvironments.remove(fullPath);
+    sCompactedEnvironments.insert(data->dbis.id());
+    if (data->transactions) {
+        data->retired = true;
+        sRetiredEnvironments.insert(env);
+    } else {
+        closeEnvironment(env);
+    }
+}
+
+/*
+ * Ends a use of the environment that was counted as a transaction, and closes it if it has been retired meanwhile.
+ */
+static void releaseEnvironmentUse(MDB_env *env)
+{
+    QReadLocker locker(&sEnvironmentsLock);
+    //The environment has been removed meanwhile
+    if (!sOpenEnvironments.contains(env)) {
+        return;
+    }
+    if (--EnvironmentData::get(env)->transactions == 0 && EnvironmentData::get(env)->retired) {
+        locker.unlock();
+        QWriteLocker writeLocker(&sEnvironmentsLock);
+        //Unless somebody else closed it meanwhile
+        if (sRetiredEnvironments.contains(env) && !EnvironmentData::get(env)->transactions) {
+            sRetiredEnvironments.remove(env);
+            closeEnvironment(env);
+        }
+    }
+}
 
 int AllowDuplicates = MDB_DUPSORT;
 int IntegerKeys = MDB_INTEGERKEY;
@@ -186,6 +782,17 @@ static bool createDbi(MDB_txn *transaction, const QByteArray &db, bool readOnly,
     return true;
 }
 
+static MDB_val toMdbVal(const QByteArray &ba)
+{
+    return {static_cast<size_t>(ba.size()), const_cast<char *>(ba.constData())};
+}
+
+static QByteArray integerKeyToByteArray(size_t key)
+{
+    //Deep copy, the cursor keeps the bound around.
+    return QByteArray(reinterpret_cast<const char *>(&key), sizeof(size_t));
+}
+
 class DataStore::NamedDatabase::Private
 {
 public:
@@ -209,11 +816,15 @@ public:
     std::function<void(const DataStore::Error &error)> defaultErrorHandler;
     QString name;
     bool createdNewDbi = false;
-    QString createdNewDbiName;
+    //The index in the dbi table, if the dbi is already available to all transactions
+    int index = -1;
+    OperationMetrics *metrics = nullptr;
+    //Set instead of the transaction if the store uses another storage backend
+    std::unique_ptr<Backend::Database> backend;
 
     bool dbiValidForTransaction(MDB_dbi dbi, MDB_txn *transaction)
     {
-        //sDbis can contain dbi's that are not available to this transaction.
+        //The dbi table can contain dbi's that are not available to this transaction.
         //We use mdb_dbi_flags to check if the dbi is valid for this transaction.
         uint f;
         if (mdb_dbi_flags(transaction, dbi, &f) == EINVAL) {
@@ -222,32 +833,51 @@ public:
         return true;
     }
 
-    bool openDatabase(bool readOnly, std::function<void(const DataStore::Error &error)> errorHandler)
+    bool useDbi(MDB_dbi existingDbi, bool readOnly)
     {
-        const auto dbiName = name + db;
-        //Never access sDbis while anything is writing to it.
-        QReadLocker dbiLocker{&sDbisLock};
-        if (sDbis.contains(dbiName)) {
-            dbi = sDbis.value(dbiName);
-            //sDbis can potentially contain a dbi that is not valid for this transaction, if this transaction was created before the dbi was created.
-            if (dbiValidForTransaction(dbi, transaction)) {
-                return true;
-            } else {
-                SinkTrace() << "Found dbi that is not available for the current transaction.";
-                if (readOnly) {
-                    //Recovery for read-only transactions. Abort and renew.
-                    mdb_txn_reset(transaction);
-                    mdb_txn_renew(transaction);
-                    Q_ASSERT(dbiValidForTransaction(dbi, transaction));
-                    return true;
-                }
-                //There is no recover path for non-read-only transactions.
-            }
-            //Nothing in the code deals well with non-existing databases.
-            Q_ASSERT(false);
+        dbi = existingDbi;
+        //The table can potentially contain a dbi that is not valid for this transaction, if this transaction was created before the dbi was created.
+        if (dbiValidForTransaction(dbi, transaction)) {
+            return true;
+        }
+        SinkTrace() << "Found dbi that is not available for the current transaction.";
+        if (readOnly) {
+            //Recovery for read-only transactions. Abort and renew.
+            mdb_txn_reset(transaction);
+            mdb_txn_renew(transaction);
+            Q_ASSERT(dbiValidForTransaction(dbi, transaction));
+            return true;
+        }
+        //There is no recover path for non-read-only transactions.
+        //Nothing in the code deals well with non-existing databases.
+        Q_ASSERT(false);
+        return false;
+    }
+
+    /*
+     * Opens a dbi that has already been resolved to an index in the dbi table.
+     */
+    bool openDatabase(int resolvedIndex, bool readOnly)
+    {
+        auto table = DbiTable::get(transaction);
+        if (!table || !table->isValidIndex(resolvedIndex)) {
             return false;
         }
+        index = resolvedIndex;
+        metrics = table->metrics(index);
+        return useDbi(table->dbi(index), readOnly);
+    }
 
+    bool openDatabase(bool readOnly, std::function<void(const DataStore::Error &error)> errorHandler)
+    {
+        auto table = DbiTable::get(transaction);
+        Q_ASSERT(table);
+        //Lock-free lookup of the existing dbis.
+        index = table->indexOf(db);
+        if (index >= 0) {
+            metrics = table->metrics(index);
+            return useDbi(table->dbi(index), readOnly);
+        }
 
         /*
         * Dynamic creation of databases.
@@ -269,42 +899,17 @@ public:
         * this is ok though because the same dbi will be returned by mdb_dbi_open (We could also start to do a lookup in
         * Transaction::Private::createdDbs first).
         */
-        SinkTrace() << "Creating database dynamically: " << dbiName << readOnly;
+        SinkTrace() << "Creating database dynamically: " << name << db << readOnly;
         //Only one transaction may ever create dbis at a time.
-        while (!sCreateDbiLock.tryLock(10)) {
-            //Allow another thread that has already acquired sCreateDbiLock to continue below.
-            //Otherwise we risk a dead-lock if another thread already acquired sCreateDbiLock, but then lost the sDbisLock while upgrading it to a
-            //write lock below
-            dbiLocker.unlock();
-            dbiLocker.relock();
-        }
+        QMutexLocker createDbiLocker(&sCreateDbiLock);
         //Double checked locking
-        if (sDbis.contains(dbiName)) {
-            dbi = sDbis.value(dbiName);
-            //sDbis can potentially contain a dbi that is not valid for this transaction, if this transaction was created before the dbi was created.
-            sCreateDbiLock.unlock();
-            if (dbiValidForTransaction(dbi, transaction)) {
-                return true;
-            } else {
-                SinkTrace() << "Found dbi that is not available for the current transaction.";
-                if (readOnly) {
-                    //Recovery for read-only transactions. Abort and renew.
-                    mdb_txn_reset(transaction);
-                    mdb_txn_renew(transaction);
-                    Q_ASSERT(dbiValidForTransaction(dbi, transaction));
-                    return true;
-                }
-                //There is no recover path for non-read-only transactions.
-                Q_ASSERT(false);
-                return false;
-            }
+        index = table->indexOf(db);
+        if (index >= 0) {
+            createDbiLocker.unlock();
+            metrics = table->metrics(index);
+            return useDbi(table->dbi(index), readOnly);
         }
 
-        //Ensure nobody reads sDbis either
-        dbiLocker.unlock();
-        //We risk loosing the lock in here. That's why we tryLock above in the while loop
-        QWriteLocker dbiWriteLocker(&sDbisLock);
-
         //Create a transaction to open the dbi
         MDB_txn *dbiTransaction;
         if (readOnly) {
@@ -313,7 +918,6 @@ public:
             mdb_txn_reset(transaction);
             if (const int rc = mdb_txn_begin(env, nullptr, MDB_RDONLY, &dbiTransaction)) {
                 SinkError() << "Failed to open transaction: " << QByteArray(mdb_strerror(rc)) << readOnly << transaction;
-                sCreateDbiLock.unlock();
                 return false;
             }
         } else {
@@ -322,14 +926,13 @@ public:
         if (createDbi(dbiTransaction, db, readOnly, flags, dbi)) {
             if (readOnly) {
                 mdb_txn_commit(dbiTransaction);
-                Q_ASSERT(!sDbis.contains(dbiName));
-                sDbis.insert(dbiName, dbi);
+                index = table->insert(db, dbi);
                 //We reopen the read-only transaction so the dbi becomes available in it.
                 mdb_txn_renew(transaction);
             } else {
                 createdNewDbi = true;
-                createdNewDbiName = dbiName;
             }
+            metrics = table->metricsFor(db);
             //Ensure the dbi is valid for the parent transaction
             Q_ASSERT(dbiValidForTransaction(dbi, transaction));
         } else {
@@ -337,14 +940,12 @@ public:
                 mdb_txn_abort(dbiTransaction);
                 mdb_txn_renew(transaction);
             } else {
-                SinkWarning() << "Failed to create the dbi: " << dbiName;
+                SinkWarning() << "Failed to create the dbi: " << name << db;
             }
             dbi = 0;
             transaction = 0;
-            sCreateDbiLock.unlock();
             return false;
         }
-        sCreateDbiLock.unlock();
         return true;
     }
 };
@@ -385,6 +986,9 @@ bool DataStore::NamedDatabase::write(const size_t key, const QByteArray &value,
 
 bool DataStore::NamedDatabase::write(const QByteArray &sKey, const QByteArray &sValue, const std::function<void(const DataStore::Error &error)> &errorHandler)
 {
+    if (d && d->backend) {
+        return d->backend->write(sKey, sValue, errorHandler ? errorHandler : d->defaultErrorHandler);
+    }
     if (!d || !d->transaction) {
         Error error("", ErrorCodes::GenericError, "Not open");
         if (d) {
@@ -403,6 +1007,7 @@ bool DataStore::NamedDatabase::write(const QByteArray &sKey, const QByteArray &s
         return false;
     }
 
+    MetricsRecorder recorder{d->metrics, OperationMetrics::Write};
     int rc;
     MDB_val key, data;
     key.mv_size = keySize;
@@ -410,8 +1015,59 @@ bool DataStore::NamedDatabase::write(const QByteArray &sKey, const QByteArray &s
     data.mv_size = valueSize;
     data.mv_data = const_cast<void *>(valuePtr);
     rc = mdb_put(d->transaction, d->dbi, &key, &data, 0);
+    recorder.add(key, data);
 
     if (rc) {
+        if (rc == MDB_MAP_FULL) {
+            requestMapGrowth(d->transaction);
+        }
+        Error error(d->name.toLatin1() + d->db, ErrorCodes::GenericError, "mdb_put: " + QByteArray(mdb_strerror(rc)) + " Key: " + sKey + " Value: " + sValue);
+        errorHandler ? errorHandler(error) : d->defaultErrorHandler(error);
+    }
+
+    return !rc;
+}
+
+bool DataStore::NamedDatabase::append(const size_t key, const QByteArray &value,
+    const std::function<void(const DataStore::Error &error)> &errorHandler)
+{
+    return append(sizeTToByteArray(key), value, errorHandler);
+}
+
+bool DataStore::NamedDatabase::append(const QByteArray &sKey, const QByteArray &sValue, const std::function<void(const DataStore::Error &error)> &errorHandler)
+{
+    if (d && d->backend) {
+        return d->backend->append(sKey, sValue, errorHandler ? errorHandler : d->defaultErrorHandler);
+    }
+    if (!d || !d->transaction) {
+        Error error("", ErrorCodes::GenericError, "Not open");
+        if (d) {
+            errorHandler ? errorHandler(error) : d->defaultErrorHandler(error);
+        }
+        return false;
+    }
+    if (sKey.isEmpty()) {
+        Error error(d->name.toLatin1() + d->db, ErrorCodes::GenericError, "Tried to write empty key.");
+        errorHandler ? errorHandler(error) : d->defaultErrorHandler(error);
+        return false;
+    }
+
+    MetricsRecorder recorder{d->metrics, OperationMetrics::Write};
+    MDB_val key = toMdbVal(sKey);
+    MDB_val data = toMdbVal(sValue);
+    recorder.add(key, data);
+    //With duplicates we append to the values of the key, otherwise to the end of the database.
+    int rc = mdb_put(d->transaction, d->dbi, &key, &data, (d->flags & AllowDuplicates) ? MDB_APPENDDUP : MDB_APPEND);
+    if (rc == MDB_KEYEXIST) {
+        //The ordering was violated, so we fall back to a regular write.
+        SinkTrace() << "Falling back to a regular write in " << d->db;
+        rc = mdb_put(d->transaction, d->dbi, &key, &data, 0);
+    }
+
+    if (rc) {
+        if (rc == MDB_MAP_FULL) {
+            requestMapGrowth(d->transaction);
+        }
         Error error(d->name.toLatin1() + d->db, ErrorCodes::GenericError, "mdb_put: " + QByteArray(mdb_strerror(rc)) + " Key: " + sKey + " Value: " + sValue);
         errorHandler ? errorHandler(error) : d->defaultErrorHandler(error);
     }
@@ -438,6 +1094,10 @@ void DataStore::NamedDatabase::remove(const size_t key, const QByteArray &value,
 
 void DataStore::NamedDatabase::remove(const QByteArray &k, const QByteArray &value, const std::function<void(const DataStore::Error &error)> &errorHandler)
 {
+    if (d && d->backend) {
+        d->backend->remove(k, value, errorHandler ? errorHandler : d->defaultErrorHandler);
+        return;
+    }
     if (!d || !d->transaction) {
         if (d) {
             Error error(d->name.toLatin1() + d->db, ErrorCodes::GenericError, "Not open");
@@ -446,6 +1106,7 @@ void DataStore::NamedDatabase::remove(const QByteArray &k, const QByteArray &val
         return;
     }
 
+    MetricsRecorder recorder{d->metrics, OperationMetrics::Remove};
     int rc;
     MDB_val key;
     key.mv_size = k.size();
@@ -469,6 +1130,29 @@ void DataStore::NamedDatabase::remove(const QByteArray &k, const QByteArray &val
     }
 }
 
+void DataStore::NamedDatabase::clear(const std::function<void(const DataStore::Error &error)> &errorHandler)
+{
+    if (d && d->backend) {
+        d->backend->clear(errorHandler ? errorHandler : d->defaultErrorHandler);
+        return;
+    }
+    if (!d || !d->transaction) {
+        if (d) {
+            Error error(d->name.toLatin1() + d->db, ErrorCodes::GenericError, "Not open");
+            errorHandler ? errorHandler(error) : d->defaultErrorHandler(error);
+        }
+        return;
+    }
+
+    MetricsRecorder recorder{d->metrics, OperationMetrics::Remove};
+    //Only empties the database, the dbi remains valid for everyone that has it cached
+    const int rc = mdb_drop(d->transaction, d->dbi, 0);
+    if (rc) {
+        Error error(d->name.toLatin1() + d->db, ErrorCodes::GenericError, QString("Error on mdb_drop: %1 %2").arg(rc).arg(mdb_strerror(rc)).toLatin1());
+        errorHandler ? errorHandler(error) : d->defaultErrorHandler(error);
+    }
+}
+
 int DataStore::NamedDatabase::scan(const size_t key,
     const std::function<bool(size_t key, const QByteArray &value)> &resultHandler,
     const std::function<void(const DataStore::Error &error)> &errorHandler) const
@@ -483,11 +1167,15 @@ int DataStore::NamedDatabase::scan(const size_t key,
 int DataStore::NamedDatabase::scan(const QByteArray &k, const std::function<bool(const QByteArray &key, const QByteArray &value)> &resultHandler,
     const std::function<void(const DataStore::Error &error)> &errorHandler, bool findSubstringKeys) const
 {
+    if (d && d->backend) {
+        return d->backend->scan(k, resultHandler, errorHandler ? errorHandler : d->defaultErrorHandler, findSubstringKeys);
+    }
     if (!d || !d->transaction) {
         // Not an error. We rely on this to read nothing from non-existing databases.
         return 0;
     }
 
+    MetricsRecorder recorder{d->metrics, OperationMetrics::Scan};
     int rc;
     MDB_val key;
     MDB_val data;
@@ -526,6 +1214,7 @@ int DataStore::NamedDatabase::scan(const QByteArray &k, const std::function<bool
             // The first lookup will find a key that is equal or greather than our key
             if (current.startsWith(k)) {
                 numberOfRetrievedValues++;
+                recorder.add(key, data);
                 if (resultHandler(current, QByteArray::fromRawData((char *)data.mv_data, data.mv_size))) {
                     if (findSubstringKeys) {
                         // Reset the key to what we search for
@@ -537,6 +1226,7 @@ int DataStore::NamedDatabase::scan(const QByteArray &k, const std::function<bool
                         // Every consequitive lookup simply iterates through the list
                         if (current.startsWith(k)) {
                             numberOfRetrievedValues++;
+                            recorder.add(key, data);
                             if (!resultHandler(current, QByteArray::fromRawData((char *)data.mv_data, data.mv_size))) {
                                 break;
                             }
@@ -553,6 +1243,7 @@ int DataStore::NamedDatabase::scan(const QByteArray &k, const std::function<bool
     } else {
         if ((rc = mdb_cursor_get(cursor, &key, &data, MDB_SET)) == 0) {
             numberOfRetrievedValues++;
+            recorder.add(key, data);
             resultHandler(QByteArray::fromRawData((char *)key.mv_data, key.mv_size), QByteArray::fromRawData((char *)data.mv_data, data.mv_size));
         }
     }
@@ -582,6 +1273,10 @@ void DataStore::NamedDatabase::findLatest(size_t key,
 void DataStore::NamedDatabase::findLatest(const QByteArray &k, const std::function<void(const QByteArray &key, const QByteArray &value)> &resultHandler,
     const std::function<void(const DataStore::Error &error)> &errorHandler) const
 {
+    if (d && d->backend) {
+        d->backend->findLatest(k, resultHandler, errorHandler ? errorHandler : d->defaultErrorHandler);
+        return;
+    }
     if (!d || !d->transaction) {
         // Not an error. We rely on this to read nothing from non-existing databases.
         return;
@@ -592,6 +1287,7 @@ void DataStore::NamedDatabase::findLatest(const QByteArray &k, const std::functi
         return;
     }
 
+    MetricsRecorder recorder{d->metrics, OperationMetrics::Read};
     int rc;
     MDB_val key;
     MDB_val data;
@@ -629,6 +1325,7 @@ void DataStore::NamedDatabase::findLatest(const QByteArray &k, const std::functi
             rc = mdb_cursor_get(cursor, &key, &data, prefOp);
             if (!rc) {
                 foundValue = true;
+                recorder.add(key, data);
                 resultHandler(QByteArray::fromRawData((char *)key.mv_data, key.mv_size), QByteArray::fromRawData((char *)data.mv_data, data.mv_size));
             }
         }
@@ -655,6 +1352,10 @@ void DataStore::NamedDatabase::findLatest(const QByteArray &k, const std::functi
 void DataStore::NamedDatabase::findLast(const QByteArray &k, const std::function<void(const QByteArray &key, const QByteArray &value)> &resultHandler,
     const std::function<void(const DataStore::Error &error)> &errorHandler) const
 {
+    if (d && d->backend) {
+        d->backend->findLast(k, resultHandler, errorHandler ? errorHandler : d->defaultErrorHandler);
+        return;
+    }
     if (!d || !d->transaction) {
         // Not an error. We rely on this to read nothing from non-existing databases.
         return;
@@ -665,6 +1366,7 @@ void DataStore::NamedDatabase::findLast(const QByteArray &k, const std::function
         return;
     }
 
+    MetricsRecorder recorder{d->metrics, OperationMetrics::Read};
     int rc;
     MDB_val key;
     MDB_val data;
@@ -684,6 +1386,7 @@ void DataStore::NamedDatabase::findLast(const QByteArray &k, const std::function
     if ((rc = mdb_cursor_get(cursor, &key, &data, MDB_SET)) == 0) {
         if ((rc = mdb_cursor_get(cursor, &key, &data, MDB_LAST_DUP)) == 0) {
             foundValue = true;
+            recorder.add(key, data);
             resultHandler(QByteArray::fromRawData((char *)key.mv_data, key.mv_size), QByteArray::fromRawData((char *)data.mv_data, data.mv_size));
         }
     }
@@ -712,105 +1415,517 @@ int DataStore::NamedDatabase::findAllInRange(const size_t lowerBound, const size
         errorHandler);
 }
 
-int DataStore::NamedDatabase::findAllInRange(const QByteArray &lowerBound, const QByteArray &upperBound,
-    const std::function<void(const QByteArray &key, const QByteArray &value)> &resultHandler,
+int DataStore::NamedDatabase::findAllInRange(const QByteArray &lowerBound, const QByteArray &upperBound,
+    const std::function<void(const QByteArray &key, const QByteArray &value)> &resultHandler,
+    const std::function<void(const DataStore::Error &error)> &errorHandler) const
+{
+    if (d && d->backend) {
+        return d->backend->findAllInRange(lowerBound, upperBound, resultHandler, errorHandler ? errorHandler : d->defaultErrorHandler);
+    }
+    if (!d || !d->transaction) {
+        // Not an error. We rely on this to read nothing from non-existing databases.
+        return 0;
+    }
+
+    MetricsRecorder recorder{d->metrics, OperationMetrics::Scan};
+    MDB_cursor *cursor;
+    if (int rc = mdb_cursor_open(d->transaction, d->dbi, &cursor)) {
+        // Invalid arguments can mean that the transaction doesn't contain the db dbi
+        Error error(d->name.toLatin1() + d->db, getErrorCode(rc),
+            QByteArray("Error during mdb_cursor_open: ") + QByteArray(mdb_strerror(rc)) +
+                ". Lower bound: " + lowerBound + " Upper bound: " + upperBound);
+        errorHandler ? errorHandler(error) : d->defaultErrorHandler(error);
+        return 0;
+    }
+
+    MDB_val firstKey = {(size_t)lowerBound.size(), (void *)lowerBound.constData()};
+    MDB_val idealLastKey = {(size_t)upperBound.size(), (void *)upperBound.constData()};
+    MDB_val currentKey;
+    MDB_val data;
+
+    // Find the first key in the range
+    int rc = mdb_cursor_get(cursor, &firstKey, &data, MDB_SET_RANGE);
+
+    if (rc != MDB_SUCCESS) {
+        // Nothing is greater or equal than the lower bound, meaning no result
+        mdb_cursor_close(cursor);
+        return 0;
+    }
+
+    currentKey = firstKey;
+
+    // If already bigger than the upper bound
+    if (mdb_cmp(d->transaction, d->dbi, &currentKey, &idealLastKey) > 0) {
+        mdb_cursor_close(cursor);
+        return 0;
+    }
+
+    int count = 0;
+    do {
+        const auto currentBAKey = QByteArray::fromRawData((char *)currentKey.mv_data, currentKey.mv_size);
+        const auto currentBAValue = QByteArray::fromRawData((char *)data.mv_data, data.mv_size);
+        recorder.add(currentKey, data);
+        resultHandler(currentBAKey, currentBAValue);
+        count++;
+    } while (mdb_cursor_get(cursor, &currentKey, &data, MDB_NEXT) == MDB_SUCCESS &&
+             mdb_cmp(d->transaction, d->dbi, &currentKey, &idealLastKey) <= 0);
+
+    mdb_cursor_close(cursor);
+    return count;
+}
+
+qint64 DataStore::NamedDatabase::getSize()
+{
+    if (d && d->backend) {
+        return d->backend->size();
+    }
+    if (!d || !d->transaction) {
+        return -1;
+    }
+
+    int rc;
+    MDB_stat stat;
+    rc = mdb_stat(d->transaction, d->dbi, &stat);
+    if (rc) {
+        SinkWarning() << "Something went wrong " << QByteArray(mdb_strerror(rc));
+    }
+    return stat.ms_psize * (stat.ms_leaf_pages + stat.ms_branch_pages + stat.ms_overflow_pages);
+}
+
+DataStore::NamedDatabase::Stat DataStore::NamedDatabase::stat()
+{
+    if (d && d->backend) {
+        return d->backend->stat();
+    }
+    if (!d || !d->transaction) {
+        return {};
+    }
+
+    int rc;
+    MDB_stat stat;
+    rc = mdb_stat(d->transaction, d->dbi, &stat);
+    if (rc) {
+        SinkWarning() << "Something went wrong " << QByteArray(mdb_strerror(rc));
+        return {};
+    }
+    return {stat.ms_branch_pages,
+            stat.ms_leaf_pages,
+            stat.ms_overflow_pages,
+            stat.ms_entries};
+    // std::cout << "page size: " << stat.ms_psize << std::endl;
+    // std::cout << "leaf_pages: " << stat.ms_leaf_pages << std::endl;
+    // std::cout << "branch_pages: " << stat.ms_branch_pages << std::endl;
+    // std::cout << "overflow_pages: " << stat.ms_overflow_pages << std::endl;
+    // std::cout << "depth: " << stat.ms_depth << std::endl;
+    // std::cout << "entries: " << stat.ms_entries << std::endl;
+}
+
+bool DataStore::NamedDatabase::allowsDuplicates() const
+{
+    if (d->backend) {
+        return d->backend->allowsDuplicates();
+    }
+    unsigned int flags;
+    mdb_dbi_flags(d->transaction, d->dbi, &flags);
+    return flags & MDB_DUPSORT;
+}
+
+class DataStore::NamedDatabase::Cursor::Private
+{
+public:
+    enum Bounds {
+        Unbounded,
+        Exact,
+        Prefix,
+        Range
+    };
+
+    Private(MDB_txn *_txn, MDB_dbi _dbi, MDB_cursor *_cursor, Bounds _bounds, const QByteArray &_lowerBound, const QByteArray &_upperBound,
+        const QByteArray &_store, const std::function<void(const DataStore::Error &error)> &_errorHandler, OperationMetrics *_metrics)
+        : recorder(_metrics, OperationMetrics::Scan),
+          transaction(_txn),
+          dbi(_dbi),
+          cursor(_cursor),
+          bounds(_bounds),
+          lowerBound(_lowerBound),
+          upperBound(_upperBound),
+          store(_store),
+          errorHandler(_errorHandler)
+    {
+        unsigned int flags = 0;
+        mdb_dbi_flags(transaction, dbi, &flags);
+        allowDuplicates = flags & MDB_DUPSORT;
+    }
+
+    Private(std::unique_ptr<Backend::Cursor> _backend, Bounds _bounds)
+        : recorder(nullptr, OperationMetrics::Scan),
+          transaction(nullptr),
+          dbi(0),
+          cursor(nullptr),
+          bounds(_bounds),
+          backend(std::move(_backend))
+    {
+    }
+
+    ~Private()
+    {
+        if (cursor) {
+            mdb_cursor_close(cursor);
+        }
+    }
+
+    //A cursor is recorded as a single scan over its lifetime
+    MetricsRecorder recorder;
+    MDB_txn *transaction;
+    MDB_dbi dbi;
+    MDB_cursor *cursor;
+    Bounds bounds;
+    QByteArray lowerBound;
+    QByteArray upperBound;
+    QByteArray store;
+    std::function<void(const DataStore::Error &error)> errorHandler;
+    bool allowDuplicates = false;
+    bool valid = false;
+    MDB_val key{0, nullptr};
+    MDB_val data{0, nullptr};
+    std::unique_ptr<Backend::Cursor> backend;
+
+    int compare(const QByteArray &bound)
+    {
+        auto boundVal = toMdbVal(bound);
+        return mdb_cmp(transaction, dbi, &key, &boundVal);
+    }
+
+    bool withinBounds()
+    {
+        switch (bounds) {
+            case Unbounded:
+                return true;
+            case Exact:
+                return compare(lowerBound) == 0;
+            case Prefix:
+                return key.mv_size >= static_cast<size_t>(lowerBound.size()) && memcmp(key.mv_data, lowerBound.constData(), lowerBound.size()) == 0;
+            case Range:
+                //An empty bound leaves the range open on that side
+                return (lowerBound.isEmpty() || compare(lowerBound) >= 0) && (upperBound.isEmpty() || compare(upperBound) <= 0);
+        }
+        return false;
+    }
+
+    void reportError(int rc)
+    {
+        Error error(store, getErrorCode(rc), QByteArray("Error during cursor operation: ") + QByteArray(mdb_strerror(rc)));
+        errorHandler(error);
+    }
+
+    bool get(MDB_cursor_op op)
+    {
+        if (const int rc = mdb_cursor_get(cursor, &key, &data, op)) {
+            //Running out of entries is not an error
+            if (rc != MDB_NOTFOUND) {
+                reportError(rc);
+            }
+            valid = false;
+            return false;
+        }
+        valid = withinBounds();
+        if (valid) {
+            recorder.add(key, data);
+        }
+        return valid;
+    }
+
+    bool get(MDB_cursor_op op, const QByteArray &k)
+    {
+        key = toMdbVal(k);
+        return get(op);
+    }
+
+    /*
+     * Positions the cursor on the last entry with a key smaller than the bound,
+     * or equal to the bound if inclusive.
+     */
+    bool seekBefore(const QByteArray &bound, bool inclusive)
+    {
+        if (bound.isEmpty()) {
+            return get(MDB_LAST);
+        }
+        key = toMdbVal(bound);
+        if (const int rc = mdb_cursor_get(cursor, &key, &data, MDB_SET_RANGE)) {
+            if (rc == MDB_NOTFOUND) {
+                //Everything is smaller than the bound
+                return get(MDB_LAST);
+            }
+            reportError(rc);
+            valid = false;
+            return false;
+        }
+        if (inclusive && compare(bound) == 0) {
+            if (allowDuplicates) {
+                return get(MDB_LAST_DUP);
+            }
+            valid = withinBounds();
+            if (valid) {
+                recorder.add(key, data);
+            }
+            return valid;
+        }
+        return get(MDB_PREV);
+    }
+
+    /*
+     * Returns the smallest key that is greater than all keys starting with the prefix,
+     * or an empty array if there is none.
+     */
+    static QByteArray prefixSuccessor(QByteArray prefix)
+    {
+        while (!prefix.isEmpty()) {
+            const auto last = static_cast<unsigned char>(prefix.at(prefix.size() - 1));
+            if (last < 0xFF) {
+                prefix[prefix.size() - 1] = static_cast<char>(last + 1);
+                return prefix;
+            }
+            prefix.chop(1);
+        }
+        return {};
+    }
+};
+
+size_t DataStore::NamedDatabase::Cursor::Entry::integerKey() const
+{
+    Q_ASSERT(key.size() == sizeof(size_t));
+    size_t result;
+    memcpy(&result, key.data(), sizeof(size_t));
+    return result;
+}
+
+DataStore::NamedDatabase::Cursor::Cursor() : d(nullptr)
+{
+}
+
+DataStore::NamedDatabase::Cursor::Cursor(Cursor::Private *prv) : d(prv)
+{
+}
+
+DataStore::NamedDatabase::Cursor::Cursor(Cursor &&other) : d(nullptr)
+{
+    *this = std::move(other);
+}
+
+DataStore::NamedDatabase::Cursor &DataStore::NamedDatabase::Cursor::operator=(DataStore::NamedDatabase::Cursor &&other)
+{
+    if (&other != this) {
+        delete d;
+        d = other.d;
+        other.d = nullptr;
+    }
+    return *this;
+}
+
+DataStore::NamedDatabase::Cursor::~Cursor()
+{
+    delete d;
+}
+
+bool DataStore::NamedDatabase::Cursor::first()
+{
+    if (d && d->backend) {
+        return d->backend->first();
+    }
+    if (!d) {
+        return false;
+    }
+    switch (d->bounds) {
+        case Private::Unbounded:
+            return d->get(MDB_FIRST);
+        case Private::Exact:
+            return d->get(MDB_SET_KEY, d->lowerBound);
+        case Private::Prefix:
+        case Private::Range:
+            if (d->lowerBound.isEmpty()) {
+                return d->get(MDB_FIRST);
+            }
+            return d->get(MDB_SET_RANGE, d->lowerBound);
+    }
+    return false;
+}
+
+bool DataStore::NamedDatabase::Cursor::last()
+{
+    if (d && d->backend) {
+        return d->backend->last();
+    }
+    if (!d) {
+        return false;
+    }
+    switch (d->bounds) {
+        case Private::Unbounded:
+            return d->get(MDB_LAST);
+        case Private::Exact:
+            return d->seekBefore(d->lowerBound, true);
+        case Private::Prefix:
+            return d->seekBefore(Private::prefixSuccessor(d->lowerBound), false);
+        case Private::Range:
+            return d->seekBefore(d->upperBound, true);
+    }
+    return false;
+}
+
+bool DataStore::NamedDatabase::Cursor::seek(const QByteArray &key)
+{
+    if (d && d->backend) {
+        return d->backend->seek(key);
+    }
+    if (!d) {
+        return false;
+    }
+    if (key.isEmpty()) {
+        return first();
+    }
+    if (d->bounds != Private::Unbounded && !d->lowerBound.isEmpty()) {
+        const auto keyVal = toMdbVal(key);
+        const auto lowerBoundVal = toMdbVal(d->lowerBound);
+        if (mdb_cmp(d->transaction, d->dbi, &keyVal, &lowerBoundVal) < 0) {
+            return first();
+        }
+    }
+    return d->get(MDB_SET_RANGE, key);
+}
+
+bool DataStore::NamedDatabase::Cursor::seek(size_t key)
+{
+    return seek(integerKeyToByteArray(key));
+}
+
+bool DataStore::NamedDatabase::Cursor::next()
+{
+    if (d && d->backend) {
+        return d->backend->next();
+    }
+    if (!d || !d->valid) {
+        return false;
+    }
+    if (d->bounds == Private::Exact) {
+        if (!d->allowDuplicates) {
+            d->valid = false;
+            return false;
+        }
+        return d->get(MDB_NEXT_DUP);
+    }
+    return d->get(MDB_NEXT);
+}
+
+bool DataStore::NamedDatabase::Cursor::prev()
+{
+    if (d && d->backend) {
+        return d->backend->prev();
+    }
+    if (!d || !d->valid) {
+        return false;
+    }
+    if (d->bounds == Private::Exact) {
+        if (!d->allowDuplicates) {
+            d->valid = false;
+            return false;
+        }
+        return d->get(MDB_PREV_DUP);
+    }
+    return d->get(MDB_PREV);
+}
+
+bool DataStore::NamedDatabase::Cursor::isValid() const
+{
+    if (d && d->backend) {
+        return d->backend->isValid();
+    }
+    return d && d->valid;
+}
+
+DataStore::NamedDatabase::Cursor::Entry DataStore::NamedDatabase::Cursor::current() const
+{
+    if (d && d->backend) {
+        return d->backend->current();
+    }
+    if (!isValid()) {
+        return {};
+    }
+    return {{static_cast<const char *>(d->key.mv_data), d->key.mv_size}, {static_cast<const char *>(d->data.mv_data), d->data.mv_size}};
+}
+
+DataStore::NamedDatabase::Cursor::iterator DataStore::NamedDatabase::Cursor::begin()
+{
+    if (first()) {
+        return iterator{this};
+    }
+    return {};
+}
+
+DataStore::NamedDatabase::Cursor::iterator DataStore::NamedDatabase::Cursor::end()
+{
+    return {};
+}
+
+DataStore::NamedDatabase::Cursor DataStore::NamedDatabase::openCursor(int bounds, const QByteArray &lowerBound, const QByteArray &upperBound,
     const std::function<void(const DataStore::Error &error)> &errorHandler) const
 {
+    static_assert(int(Cursor::Private::Range) == int(Backend::Database::Range), "The bounds of the storage backends must match");
+    if (d && d->backend) {
+        auto cursor = d->backend->openCursor(static_cast<Backend::Database::Bounds>(bounds), lowerBound, upperBound, errorHandler ? errorHandler : d->defaultErrorHandler);
+        if (!cursor) {
+            return {};
+        }
+        return Cursor{new Cursor::Private(std::move(cursor), static_cast<Cursor::Private::Bounds>(bounds))};
+    }
     if (!d || !d->transaction) {
         // Not an error. We rely on this to read nothing from non-existing databases.
-        return 0;
+        return {};
     }
-
     MDB_cursor *cursor;
-    if (int rc = mdb_cursor_open(d->transaction, d->dbi, &cursor)) {
-        // Invalid arguments can mean that the transaction doesn't contain the db dbi
-        Error error(d->name.toLatin1() + d->db, getErrorCode(rc),
-            QByteArray("Error during mdb_cursor_open: ") + QByteArray(mdb_strerror(rc)) +
-                ". Lower bound: " + lowerBound + " Upper bound: " + upperBound);
+    if (const int rc = mdb_cursor_open(d->transaction, d->dbi, &cursor)) {
+        //Invalid arguments can mean that the transaction doesn't contain the db dbi
+        Error error(d->name.toLatin1() + d->db, getErrorCode(rc), QByteArray("Error during mdb_cursor_open: ") + QByteArray(mdb_strerror(rc)));
         errorHandler ? errorHandler(error) : d->defaultErrorHandler(error);
-        return 0;
-    }
-
-    MDB_val firstKey = {(size_t)lowerBound.size(), (void *)lowerBound.constData()};
-    MDB_val idealLastKey = {(size_t)upperBound.size(), (void *)upperBound.constData()};
-    MDB_val currentKey;
-    MDB_val data;
-
-    // Find the first key in the range
-    int rc = mdb_cursor_get(cursor, &firstKey, &data, MDB_SET_RANGE);
-
-    if (rc != MDB_SUCCESS) {
-        // Nothing is greater or equal than the lower bound, meaning no result
-        mdb_cursor_close(cursor);
-        return 0;
-    }
-
-    currentKey = firstKey;
-
-    // If already bigger than the upper bound
-    if (mdb_cmp(d->transaction, d->dbi, &currentKey, &idealLastKey) > 0) {
-        mdb_cursor_close(cursor);
-        return 0;
+        return {};
     }
+    return Cursor{new Cursor::Private(d->transaction, d->dbi, cursor, static_cast<Cursor::Private::Bounds>(bounds), lowerBound, upperBound,
+        d->name.toLatin1() + d->db, errorHandler ? errorHandler : d->defaultErrorHandler, d->metrics)};
+}
 
-    int count = 0;
-    do {
-        const auto currentBAKey = QByteArray::fromRawData((char *)currentKey.mv_data, currentKey.mv_size);
-        const auto currentBAValue = QByteArray::fromRawData((char *)data.mv_data, data.mv_size);
-        resultHandler(currentBAKey, currentBAValue);
-        count++;
-    } while (mdb_cursor_get(cursor, &currentKey, &data, MDB_NEXT) == MDB_SUCCESS &&
-             mdb_cmp(d->transaction, d->dbi, &currentKey, &idealLastKey) <= 0);
-
-    mdb_cursor_close(cursor);
-    return count;
+DataStore::NamedDatabase::Cursor DataStore::NamedDatabase::cursor(const std::function<void(const DataStore::Error &error)> &errorHandler) const
+{
+    return openCursor(Cursor::Private::Unbounded, {}, {}, errorHandler);
 }
 
-qint64 DataStore::NamedDatabase::getSize()
+DataStore::NamedDatabase::Cursor DataStore::NamedDatabase::find(const QByteArray &key, const std::function<void(const DataStore::Error &error)> &errorHandler) const
 {
-    if (!d || !d->transaction) {
-        return -1;
+    if (key.isEmpty()) {
+        if (d) {
+            Error error(d->name.toLatin1() + d->db, GenericError, QByteArray("Can't use find with empty key."));
+            errorHandler ? errorHandler(error) : d->defaultErrorHandler(error);
+        }
+        return {};
     }
+    return openCursor(Cursor::Private::Exact, key, {}, errorHandler);
+}
 
-    int rc;
-    MDB_stat stat;
-    rc = mdb_stat(d->transaction, d->dbi, &stat);
-    if (rc) {
-        SinkWarning() << "Something went wrong " << QByteArray(mdb_strerror(rc));
-    }
-    return stat.ms_psize * (stat.ms_leaf_pages + stat.ms_branch_pages + stat.ms_overflow_pages);
+DataStore::NamedDatabase::Cursor DataStore::NamedDatabase::find(size_t key, const std::function<void(const DataStore::Error &error)> &errorHandler) const
+{
+    return find(integerKeyToByteArray(key), errorHandler);
 }
 
-DataStore::NamedDatabase::Stat DataStore::NamedDatabase::stat()
+DataStore::NamedDatabase::Cursor DataStore::NamedDatabase::prefix(const QByteArray &prefix, const std::function<void(const DataStore::Error &error)> &errorHandler) const
 {
-    if (!d || !d->transaction) {
-        return {};
-    }
+    return openCursor(Cursor::Private::Prefix, prefix, {}, errorHandler);
+}
 
-    int rc;
-    MDB_stat stat;
-    rc = mdb_stat(d->transaction, d->dbi, &stat);
-    if (rc) {
-        SinkWarning() << "Something went wrong " << QByteArray(mdb_strerror(rc));
-        return {};
-    }
-    return {stat.ms_branch_pages,
-            stat.ms_leaf_pages,
-            stat.ms_overflow_pages,
-            stat.ms_entries};
-    // std::cout << "page size: " << stat.ms_psize << std::endl;
-    // std::cout << "leaf_pages: " << stat.ms_leaf_pages << std::endl;
-    // std::cout << "branch_pages: " << stat.ms_branch_pages << std::endl;
-    // std::cout << "overflow_pages: " << stat.ms_overflow_pages << std::endl;
-    // std::cout << "depth: " << stat.ms_depth << std::endl;
-    // std::cout << "entries: " << stat.ms_entries << std::endl;
+DataStore::NamedDatabase::Cursor DataStore::NamedDatabase::range(const QByteArray &lowerBound, const QByteArray &upperBound, const std::function<void(const DataStore::Error &error)> &errorHandler) const
+{
+    return openCursor(Cursor::Private::Range, lowerBound, upperBound, errorHandler);
 }
 
-bool DataStore::NamedDatabase::allowsDuplicates() const
+DataStore::NamedDatabase::Cursor DataStore::NamedDatabase::range(size_t lowerBound, size_t upperBound, const std::function<void(const DataStore::Error &error)> &errorHandler) const
 {
-    unsigned int flags;
-    mdb_dbi_flags(d->transaction, d->dbi, &flags);
-    return flags & MDB_DUPSORT;
+    return range(integerKeyToByteArray(lowerBound), integerKeyToByteArray(upperBound), errorHandler);
 }
 
 
@@ -821,6 +1936,10 @@ public:
         : env(_env), transaction(nullptr), requestedRead(_requestRead), defaultErrorHandler(_defaultErrorHandler), name(_name), implicitCommit(false), error(false)
     {
     }
+    Private(std::unique_ptr<Backend::Transaction> _backend, bool _requestRead, const std::function<void(const DataStore::Error &error)> &_defaultErrorHandler, const QString &_name)
+        : env(nullptr), transaction(nullptr), requestedRead(_requestRead), defaultErrorHandler(_defaultErrorHandler), name(_name), implicitCommit(false), error(false), backend(std::move(_backend))
+    {
+    }
     ~Private()
     {
     }
@@ -832,12 +1951,21 @@ public:
     QString name;
     bool implicitCommit;
     bool error;
-    QMap<QString, MDB_dbi> createdDbs;
+    QMap<QByteArray, MDB_dbi> createdDbs;
+    bool holdsMapLock = false;
+    //The commit leaves flushing to the Flusher
+    bool deferSync = false;
+    //Set instead of the transaction if the store uses another storage backend
+    std::unique_ptr<Backend::Transaction> backend;
 
     bool startTransaction()
     {
+        if (env == nullptr) {
+            //The backend has already started the transaction
+            return bool(backend);
+        }
         Q_ASSERT(!transaction);
-        Q_ASSERT(sEnvironments.values().contains(env));
+        Q_ASSERT(sOpenEnvironments.contains(env));
         Q_ASSERT(env);
         // auto f = [](const char *msg, void *ctx) -> int {
         //     qDebug() << msg;
@@ -845,9 +1973,30 @@ public:
         // };
         // mdb_reader_list(env, f, nullptr);
         // Trace_area("storage." + name.toLatin1()) << "Opening transaction " << requestedRead;
-        const int rc = mdb_txn_begin(env, NULL, requestedRead ? MDB_RDONLY : 0, &transaction);
+        auto data = EnvironmentData::get(env);
+        if (data->growable) {
+            if (!requestedRead) {
+                growMapIfRequired(env, *data);
+            }
+            data->mapLock.lockForRead();
+            holdsMapLock = true;
+        }
+        if (requestedRead && renewPooledTransaction()) {
+            data->transactions++;
+            return true;
+        }
+        int rc = mdb_txn_begin(env, NULL, requestedRead ? MDB_RDONLY : 0, &transaction);
+        if (rc == MDB_MAP_RESIZED && data->growable) {
+            //Another process grew the map
+            data->mapLock.unlock();
+            adoptMapSize(env, *data);
+            data->mapLock.lockForRead();
+            rc = mdb_txn_begin(env, NULL, requestedRead ? MDB_RDONLY : 0, &transaction);
+        }
         // Trace_area("storage." + name.toLatin1()) << "Started transaction " << mdb_txn_id(transaction) << transaction;
         if (rc) {
+            transaction = nullptr;
+            releaseMapLock();
             unsigned int flags;
             mdb_env_get_flags(env, &flags);
             if (flags & MDB_RDONLY && !requestedRead) {
@@ -856,8 +2005,55 @@ public:
             defaultErrorHandler(Error(name.toLatin1(), ErrorCodes::GenericError, "Error while opening transaction: " + QByteArray(mdb_strerror(rc))));
             return false;
         }
+        data->transactions++;
         return true;
     }
+
+    bool renewPooledTransaction()
+    {
+        auto &pool = EnvironmentData::get(env)->readTransactions;
+        while (auto pooled = pool.take()) {
+            if (const int rc = mdb_txn_renew(pooled)) {
+                SinkWarning() << "Failed to renew a pooled read transaction: " << QByteArray(mdb_strerror(rc));
+                mdb_txn_abort(pooled);
+                continue;
+            }
+            transaction = pooled;
+            return true;
+        }
+        return false;
+    }
+
+    /*
+     * Ends a read-only transaction by returning it to the pool of the environment.
+     *
+     * A reset transaction no longer holds on to its snapshot, so it doesn't prevent pages from being reused.
+     */
+    void releaseReadTransaction()
+    {
+        Q_ASSERT(requestedRead);
+        mdb_txn_reset(transaction);
+        EnvironmentData::get(env)->readTransactions.put(transaction);
+        transaction = nullptr;
+        releaseEnvironment();
+    }
+
+    /*
+     * Must be called once the transaction ended, and closes the environment if it has been retired meanwhile.
+     */
+    void releaseEnvironment()
+    {
+        releaseMapLock();
+        releaseEnvironmentUse(env);
+    }
+
+    void releaseMapLock()
+    {
+        if (holdsMapLock) {
+            EnvironmentData::get(env)->mapLock.unlock();
+            holdsMapLock = false;
+        }
+    }
 };
 
 DataStore::Transaction::Transaction() : d(nullptr)
@@ -890,7 +2086,7 @@ DataStore::Transaction &DataStore::Transaction::operator=(DataStore::Transaction
 
 DataStore::Transaction::~Transaction()
 {
-    if (d && d->transaction) {
+    if (*this) {
         if (d->implicitCommit && !d->error) {
             commit();
         } else {
@@ -903,69 +2099,175 @@ DataStore::Transaction::~Transaction()
 
 DataStore::Transaction::operator bool() const
 {
-    return (d && d->transaction);
+    return (d && (d->transaction || d->backend));
 }
 
 bool DataStore::Transaction::commit(const std::function<void(const DataStore::Error &error)> &errorHandler)
 {
+    if (d && d->backend) {
+        const bool committed = d->backend->commit(errorHandler ? errorHandler : d->defaultErrorHandler);
+        d->backend.reset();
+        return committed;
+    }
     if (!d || !d->transaction) {
         return false;
     }
 
     // Trace_area("storage." + d->name.toLatin1()) << "Committing transaction" << mdb_txn_id(d->transaction) << d->transaction;
-    Q_ASSERT(sEnvironments.values().contains(d->env));
-    const int rc = mdb_txn_commit(d->transaction);
+    Q_ASSERT(sOpenEnvironments.contains(d->env));
+    //There is nothing to commit for a read-only transaction (dbis opened by it are already published)
+    if (d->requestedRead) {
+        Q_ASSERT(d->createdDbs.isEmpty());
+        d->releaseReadTransaction();
+        return true;
+    }
+    auto data = EnvironmentData::get(d->env);
+    //A failed write leaves the transaction in an error state, so the commit fails with MDB_BAD_TXN instead of MDB_MAP_FULL
+    MDB_txn *transaction = d->transaction;
+    const bool mapFull = data->mapFullTransaction.compare_exchange_strong(transaction, nullptr);
+    int rc;
+    {
+        MetricsRecorder recorder{data->transactionMetrics, OperationMetrics::Commit};
+        //The next writer must not commit before syncing is enabled again
+        QMutexLocker commitLocker(&data->commitLock);
+        if (d->deferSync) {
+            mdb_env_set_flags(d->env, MDB_NOSYNC, 1);
+        }
+        rc = mdb_txn_commit(d->transaction);
+        if (d->deferSync) {
+            mdb_env_set_flags(d->env, MDB_NOSYNC, 0);
+        }
+    }
+    //The transaction is freed by mdb_txn_commit, also if it fails.
+    d->transaction = nullptr;
     if (rc) {
-        abort();
+        d->createdDbs.clear();
+        const bool recoverable = (rc == MDB_MAP_FULL || mapFull) && data->growable;
+        if (recoverable) {
+            data->growRequested = true;
+        }
+        d->releaseEnvironment();
         Error error(d->name.toLatin1(), ErrorCodes::TransactionError, "Error during transaction commit: " + QByteArray(mdb_strerror(rc)));
         errorHandler ? errorHandler(error) : d->defaultErrorHandler(error);
+        //The transaction is lost, but the map will have grown for the next one.
+        if (recoverable) {
+            return false;
+        }
         //If transactions start failing we're in an unrecoverable situation (i.e. out of diskspace). So throw an exception that will terminate the application.
         throw std::runtime_error("Fatal error while committing transaction.");
     }
 
     //Add the created dbis to the shared environment
     if (!d->createdDbs.isEmpty()) {
-        sDbisLock.lockForWrite();
+        QMutexLocker createDbiLocker(&sCreateDbiLock);
+        auto table = DbiTable::get(d->env);
         for (auto it = d->createdDbs.constBegin(); it != d->createdDbs.constEnd(); it++) {
             //This means we opened the dbi again in a read-only transaction while the write transaction was ongoing.
-            Q_ASSERT(!sDbis.contains(it.key()));
-            if (!sDbis.contains(it.key())) {
-                sDbis.insert(it.key(), it.value());
-            }
+            Q_ASSERT(table->indexOf(it.key()) < 0);
+            table->insert(it.key(), it.value());
         }
         d->createdDbs.clear();
-        sDbisLock.unlock();
     }
 
-    d->transaction = nullptr;
+    if (data->checkpointInterval) {
+        data->dirty = true;
+    }
+    d->releaseEnvironment();
     return !rc;
 }
 
+KAsync::Job<void> DataStore::Transaction::commitAsync(const std::function<void(const DataStore::Error &error)> &errorHandler)
+{
+    //Only write transactions of the LMDB engine are flushed to disk
+    if (!d || !d->transaction || d->requestedRead) {
+        commit(errorHandler);
+        return KAsync::null<void>();
+    }
+    const auto env = d->env;
+    //Environments that are never synced on commit have nothing to wait for
+    const bool synced = EnvironmentData::get(env)->profile.durability != StorageProfile::NoSync;
+    d->deferSync = synced;
+    const bool committed = commit(errorHandler);
+    d->deferSync = false;
+    if (!committed) {
+        return KAsync::error<void>(TransactionError, "Error during transaction commit.");
+    }
+    if (!synced) {
+        return KAsync::null<void>();
+    }
+    auto request = Flusher::instance().flush(env);
+    return KAsync::start<void>([request](KAsync::Future<void> &future) {
+        request->onComplete([&future](bool success) {
+            if (success) {
+                future.setFinished();
+            } else {
+                future.setError(TransactionError, "Error while flushing the transaction to disk.");
+            }
+        });
+    });
+}
+
 void DataStore::Transaction::abort()
 {
+    if (d && d->backend) {
+        d->backend->abort();
+        d->backend.reset();
+        return;
+    }
     if (!d || !d->transaction) {
         return;
     }
 
     // Trace_area("storage." + d->name.toLatin1()) << "Aborting transaction" << mdb_txn_id(d->transaction) << d->transaction;
-    Q_ASSERT(sEnvironments.values().contains(d->env));
+    Q_ASSERT(sOpenEnvironments.contains(d->env));
+    if (d->requestedRead) {
+        d->releaseReadTransaction();
+        return;
+    }
+    MDB_txn *transaction = d->transaction;
+    EnvironmentData::get(d->env)->mapFullTransaction.compare_exchange_strong(transaction, nullptr);
     mdb_txn_abort(d->transaction);
     d->createdDbs.clear();
     d->transaction = nullptr;
+    d->releaseEnvironment();
 }
 
 DataStore::NamedDatabase DataStore::Transaction::openDatabase(const QByteArray &db,
     const std::function<void(const DataStore::Error &error)> &errorHandler, int flags) const
+{
+    DatabaseHandle handle{db, flags};
+    return openDatabase(handle, errorHandler);
+}
+
+DataStore::NamedDatabase DataStore::Transaction::openDatabase(DatabaseHandle &handle,
+    const std::function<void(const DataStore::Error &error)> &errorHandler) const
 {
     if (!d) {
-        SinkError() << "Tried to open database on invalid transaction: " << db;
+        SinkError() << "Tried to open database on invalid transaction: " << handle.name;
         return DataStore::NamedDatabase();
     }
-    Q_ASSERT(d->transaction);
     // We don't now if anything changed
     d->implicitCommit = true;
+    if (d->backend) {
+        auto database = d->backend->openDatabase(handle.name, handle.flags, errorHandler ? errorHandler : d->defaultErrorHandler);
+        if (!database) {
+            return DataStore::NamedDatabase();
+        }
+        auto p = new DataStore::NamedDatabase::Private(
+            handle.name, handle.flags, d->defaultErrorHandler, d->name, nullptr);
+        p->backend = std::move(database);
+        return DataStore::NamedDatabase(p);
+    }
+    Q_ASSERT(d->transaction);
     auto p = new DataStore::NamedDatabase::Private(
-        db, flags, d->defaultErrorHandler, d->name, d->transaction);
+        handle.name, handle.flags, d->defaultErrorHandler, d->name, d->transaction);
+
+    //Handles that have already been resolved in this environment skip the lookup by name
+    auto table = DbiTable::get(d->env);
+    if (table && handle.environment == table->id() && p->openDatabase(handle.index, d->requestedRead)) {
+        return DataStore::NamedDatabase(p);
+    }
+
     auto ret = p->openDatabase(d->requestedRead, errorHandler);
     if (!ret) {
         delete p;
@@ -973,11 +2275,14 @@ DataStore::NamedDatabase DataStore::Transaction::openDatabase(const QByteArray &
     }
 
     if (p->createdNewDbi) {
-        d->createdDbs.insert(p->createdNewDbiName, p->dbi);
+        //Only available to other transactions once committed, so we can't resolve the handle yet.
+        d->createdDbs.insert(handle.name, p->dbi);
+    } else if (table && p->index >= 0) {
+        handle.environment = table->id();
+        handle.index = p->index;
     }
 
-    auto database = DataStore::NamedDatabase(p);
-    return database;
+    return DataStore::NamedDatabase(p);
 }
 
 QList<QByteArray> DataStore::Transaction::getDatabaseNames() const
@@ -986,6 +2291,9 @@ QList<QByteArray> DataStore::Transaction::getDatabaseNames() const
         SinkWarning() << "Invalid transaction";
         return QList<QByteArray>();
     }
+    if (d->backend) {
+        return d->backend->databaseNames();
+    }
     return Sink::Storage::getDatabaseNames(d->transaction);
 
 }
@@ -993,6 +2301,9 @@ QList<QByteArray> DataStore::Transaction::getDatabaseNames() const
 
 DataStore::Transaction::Stat DataStore::Transaction::stat(bool printDetails)
 {
+    if (d->backend) {
+        return d->backend->stat();
+    }
     const int freeDbi = 0;
     const int mainDbi = 1;
 
@@ -1081,6 +2392,10 @@ public:
     QString name;
 
     MDB_env *env = nullptr;
+    //Set instead of the environment if another storage backend was selected
+    std::unique_ptr<Backend::Environment> backend;
+    //The id of the environment's dbi table, which unlike the pointer is never reused
+    quint64 envId = 0;
     AccessMode mode;
     Sink::Log::Context logCtx;
 
@@ -1088,82 +2403,150 @@ public:
     {
         // Ensure the environment is only created once, and that we only have one environment per process
         QReadLocker locker(&sEnvironmentsLock);
-        if (!(env = sEnvironments.value(fullPath))) {
+        env = sEnvironments.value(fullPath);
+        const bool replaced = env && isReplaced(env, fullPath);
+        if (!env || replaced) {
             locker.unlock();
             QWriteLocker envLocker(&sEnvironmentsLock);
-            QWriteLocker dbiLocker(&sDbisLock);
-            if (!(env = sEnvironments.value(fullPath))) {
-                int rc = 0;
-                if ((rc = mdb_env_create(&env))) {
-                    SinkErrorCtx(logCtx) << "mdb_env_create: " << rc << " " << mdb_strerror(rc);
-                    env = nullptr;
-                    throw std::runtime_error("Fatal error while creating db.");
+            const auto current = sEnvironments.value(fullPath);
+            if (replaced && current == env) {
+                SinkTraceCtx(logCtx) << "The environment has been replaced by a compacted copy, reopening: " << fullPath;
+                retireEnvironment(fullPath, env);
+                env = nullptr;
+            } else {
+                env = current;
+            }
+            if (!env) {
+                env = createEnvironment(fullPath, layout);
+            }
+            envId = sOpenEnvironments.value(env);
+            return;
+        }
+        envId = sOpenEnvironments.value(env);
+    }
+
+    /*
+     * Must be called with sEnvironmentsLock locked for writing.
+     */
+    MDB_env *createEnvironment(const QString &fullPath, const DbLayout &layout)
+    {
+        MDB_env *env = nullptr;
+        int rc = 0;
+        if ((rc = mdb_env_create(&env))) {
+            SinkErrorCtx(logCtx) << "mdb_env_create: " << rc << " " << mdb_strerror(rc);
+            env = nullptr;
+            throw std::runtime_error("Fatal error while creating db.");
+        } else {
+            const auto &profile = layout.profile;
+            auto data = new EnvironmentData;
+            data->growable = profile.initialMapSize > 0;
+            data->dbis.setName(name.toUtf8());
+            data->transactionMetrics = OperationMetrics::get(name.toUtf8());
+            mdb_env_set_userctx(env, data);
+            //Limit large enough to accomodate all our named dbs. This only starts to matter if the number gets large, otherwise it's just a bunch of extra entries in the main table.
+            mdb_env_set_maxdbs(env, 50);
+            if (const int rc = mdb_env_set_mapsize(env, data->growable ? profile.initialMapSize : mapsize())) {
+                SinkErrorCtx(logCtx) << "mdb_env_set_mapsize: " << rc << ":" << mdb_strerror(rc);
+                Q_ASSERT(false);
+                throw std::runtime_error("Fatal error while creating db.");
+            }
+            const bool readOnly = (mode == ReadOnly);
+            unsigned int flags = MDB_NOTLS;
+            if (readOnly) {
+                flags |= MDB_RDONLY;
+            } else {
+                if (profile.durability == StorageProfile::NoMetaSync) {
+                    flags |= MDB_NOMETASYNC;
+                } else if (profile.durability == StorageProfile::NoSync) {
+                    flags |= MDB_NOSYNC;
+                }
+                if (profile.writeMap) {
+                    flags |= MDB_WRITEMAP;
+                }
+            }
+            if (profile.noReadAhead) {
+                flags |= MDB_NORDAHEAD;
+            }
+            if ((rc = mdb_env_open(env, fullPath.toStdString().data(), flags, 0664))) {
+                if (readOnly) {
+                    SinkLogCtx(logCtx) << "Tried to open non-existing db: " << fullPath;
                 } else {
-                    //Limit large enough to accomodate all our named dbs. This only starts to matter if the number gets large, otherwise it's just a bunch of extra entries in the main table.
-                    mdb_env_set_maxdbs(env, 50);
-                    if (const int rc = mdb_env_set_mapsize(env, mapsize())) {
-                        SinkErrorCtx(logCtx) << "mdb_env_set_mapsize: " << rc << ":" << mdb_strerror(rc);
-                        Q_ASSERT(false);
-                        throw std::runtime_error("Fatal error while creating db.");
-                    }
-                    const bool readOnly = (mode == ReadOnly);
-                    unsigned int flags = MDB_NOTLS;
-                    if (readOnly) {
-                        flags |= MDB_RDONLY;
-                    }
-                    if ((rc = mdb_env_open(env, fullPath.toStdString().data(), flags, 0664))) {
-                        if (readOnly) {
-                            SinkLogCtx(logCtx) << "Tried to open non-existing db: " << fullPath;
-                        } else {
-                            SinkErrorCtx(logCtx) << "mdb_env_open: " << rc << ":" << mdb_strerror(rc);
-                            Q_ASSERT(false);
-                            throw std::runtime_error("Fatal error while creating db.");
-                        }
-                        mdb_env_close(env);
-                        env = 0;
-                    } else {
-                        Q_ASSERT(env);
-                        sEnvironments.insert(fullPath, env);
-                        //Open all available dbi's
-                        MDB_txn *transaction;
-                        if (const int rc = mdb_txn_begin(env, nullptr, readOnly ? MDB_RDONLY : 0, &transaction)) {
-                            SinkWarning() << "Failed to to open transaction: " << QByteArray(mdb_strerror(rc)) << readOnly << transaction;
-                            return;
+                    SinkErrorCtx(logCtx) << "mdb_env_open: " << rc << ":" << mdb_strerror(rc);
+                    Q_ASSERT(false);
+                    throw std::runtime_error("Fatal error while creating db.");
+                }
+                closeEnvironment(env);
+                env = 0;
+            } else {
+                Q_ASSERT(env);
+                auto table = DbiTable::get(env);
+                data->fileId = fileIdentity(fullPath);
+                data->profile = profile;
+                sEnvironments.insert(fullPath, env);
+                sOpenEnvironments.insert(env, table->id());
+                if (!readOnly && profile.durability != StorageProfile::Synchronous) {
+                    data->checkpointInterval = profile.checkpointInterval;
+                    data->sinceCheckpoint.start();
+                    Flusher::instance().start(profile.checkpointInterval);
+                }
+                //Open all available dbi's
+                MDB_txn *transaction;
+                if (const int rc = mdb_txn_begin(env, nullptr, readOnly ? MDB_RDONLY : 0, &transaction)) {
+                    SinkWarning() << "Failed to to open transaction: " << QByteArray(mdb_strerror(rc)) << readOnly << transaction;
+                    return env;
+                }
+                if (!layout.tables.isEmpty()) {
+
+                    //TODO upgrade db if the layout has changed:
+                    //* read existing layout
+                    //* if layout is not the same create new layout
+
+                    //Create dbis from the given layout.
+                    for (auto it = layout.tables.constBegin(); it != layout.tables.constEnd(); it++) {
+                        const int flags = it.value();
+                        MDB_dbi dbi = 0;
+                        const auto &db = it.key();
+                        if (createDbi(transaction, db, readOnly, flags, dbi)) {
+                            table->insert(db, dbi);
                         }
-                        if (!layout.tables.isEmpty()) {
-
-                            //TODO upgrade db if the layout has changed:
-                            //* read existing layout
-                            //* if layout is not the same create new layout
-
-                            //Create dbis from the given layout.
-                            for (auto it = layout.tables.constBegin(); it != layout.tables.constEnd(); it++) {
-                                const int flags = it.value();
-                                MDB_dbi dbi = 0;
-                                const auto &db = it.key();
-                                const auto dbiName = name + db;
-                                if (createDbi(transaction, db, readOnly, flags, dbi)) {
-                                    sDbis.insert(dbiName, dbi);
-                                }
-                            }
-                        } else {
-                            //Open all available databases
-                            for (const auto &db : getDatabaseNames(transaction)) {
-                                MDB_dbi dbi = 0;
-                                const auto dbiName = name + db;
-                                //We're going to load the flags anyways.
-                                const int flags = 0;
-                                if (createDbi(transaction, db, readOnly, flags, dbi)) {
-                                    sDbis.insert(dbiName, dbi);
-                                }
-                            }
+                    }
+                } else {
+                    //Open all available databases
+                    for (const auto &db : getDatabaseNames(transaction)) {
+                        MDB_dbi dbi = 0;
+                        //We're going to load the flags anyways.
+                        const int flags = 0;
+                        if (createDbi(transaction, db, readOnly, flags, dbi)) {
+                            table->insert(db, dbi);
                         }
-                        //To persist the dbis (this is also necessary for read-only transactions)
-                        mdb_txn_commit(transaction);
                     }
                 }
+                //To persist the dbis (this is also necessary for read-only transactions)
+                mdb_txn_commit(transaction);
+            }
+        }
+        return env;
+    }
+
+    /*
+     * Follows the environment if it has been replaced by a compacted copy.
+     *
+     * Returns false if the environment is gone. Must be called with sEnvironmentsLock locked.
+     */
+    bool refreshEnvironment()
+    {
+        const auto id = sOpenEnvironments.value(env);
+        if (id && id == envId && !EnvironmentData::get(env)->retired) {
+            return true;
+        }
+        if (sCompactedEnvironments.contains(envId)) {
+            if (auto current = sEnvironments.value(storageRoot + '/' + name)) {
+                env = current;
+                envId = sOpenEnvironments.value(current);
+                return true;
             }
         }
+        return false;
     }
 
 };
@@ -1172,6 +2555,10 @@ DataStore::Private::Private(const QString &s, const QString &n, AccessMode m, co
 {
 
     const QString fullPath(storageRoot + '/' + name);
+    if (storageBackend() == StorageBackend::Memory) {
+        backend = MemoryBackend::open(fullPath, name.toUtf8(), mode, layout);
+        return;
+    }
     QFileInfo dirInfo(fullPath);
     if (!dirInfo.exists() && mode == ReadWrite) {
         QDir().mkpath(fullPath);
@@ -1205,18 +2592,24 @@ DataStore::~DataStore()
 
 bool DataStore::exists(const QString &storageRoot, const QString &name)
 {
+    if (storageBackend() == StorageBackend::Memory) {
+        return MemoryBackend::exists(storageRoot + '/' + name);
+    }
     return QFileInfo(storageRoot + '/' + name + "/data.mdb").exists();
 }
 
 bool DataStore::exists() const
 {
+    if (d->backend) {
+        return d->backend->exists();
+    }
     return (d->env != 0) && DataStore::exists(d->storageRoot, d->name);
 }
 
 DataStore::Transaction DataStore::createTransaction(AccessMode type, const std::function<void(const DataStore::Error &error)> &errorHandlerArg)
 {
     auto errorHandler = errorHandlerArg ? errorHandlerArg : defaultErrorHandler();
-    if (!d->env) {
+    if (!d->env && !d->backend) {
         errorHandler(Error(d->name.toLatin1(), ErrorCodes::GenericError, "Failed to create transaction: Missing database environment"));
         return Transaction();
     }
@@ -1227,15 +2620,45 @@ DataStore::Transaction DataStore::createTransaction(AccessMode type, const std::
         errorHandler(Error(d->name.toLatin1(), ErrorCodes::GenericError, "Failed to create transaction: Requested read/write transaction in read-only mode."));
         return Transaction();
     }
-    QReadLocker locker(&sEnvironmentsLock);
-    if (!sEnvironments.values().contains(d->env)) {
-        return {};
+    if (d->backend) {
+        auto transaction = d->backend->createTransaction(requestedRead, errorHandler);
+        if (!transaction) {
+            return {};
+        }
+        return Transaction(new Transaction::Private(std::move(transaction), requestedRead, defaultErrorHandler(), d->name));
+    }
+    while (true) {
+        //The environment must stay open, but we can't hold sEnvironmentsLock while we wait for the writer lock,
+        //because compaction holds the writer lock while it replaces the environment.
+        MDB_env *env = nullptr;
+        {
+            QReadLocker locker(&sEnvironmentsLock);
+            if (!d->refreshEnvironment()) {
+                return {};
+            }
+            env = d->env;
+            EnvironmentData::get(env)->transactions++;
+        }
+        Transaction transaction(new Transaction::Private(requestedRead, defaultErrorHandler(), d->name, env));
+        bool retired = false;
+        {
+            QReadLocker locker(&sEnvironmentsLock);
+            retired = sOpenEnvironments.contains(env) && EnvironmentData::get(env)->retired;
+        }
+        releaseEnvironmentUse(env);
+        //Writes to a replaced environment would be lost, so we start over with the compacted copy
+        if (!retired || requestedRead || !transaction) {
+            return transaction;
+        }
+        transaction.abort();
     }
-    return Transaction(new Transaction::Private(requestedRead, defaultErrorHandler(), d->name, d->env));
 }
 
 qint64 DataStore::diskUsage() const
 {
+    if (d->backend) {
+        return d->backend->diskUsage();
+    }
     QFileInfo info(d->storageRoot + '/' + d->name + "/data.mdb");
     if (!info.exists()) {
         SinkWarning() << "Tried to get filesize for non-existant file: " << info.path();
@@ -1245,17 +2668,15 @@ qint64 DataStore::diskUsage() const
 
 void DataStore::removeFromDisk() const
 {
+    if (d->backend) {
+        d->backend->remove();
+        return;
+    }
     const QString fullPath(d->storageRoot + '/' + d->name);
-    QWriteLocker dbiLocker(&sDbisLock);
     QWriteLocker envLocker(&sEnvironmentsLock);
     SinkTrace() << "Removing database from disk: " << fullPath;
-    auto env = sEnvironments.take(fullPath);
-    for (const auto &key : sDbis.keys()) {
-        if (key.startsWith(d->name)) {
-            sDbis.remove(key);
-        }
-    }
-    mdb_env_close(env);
+    //Closing the environment also disposes of its dbis
+    closeEnvironment(sEnvironments.take(fullPath));
     QDir dir(fullPath);
     if (!dir.removeRecursively()) {
         Error error(d->name.toLatin1(), ErrorCodes::GenericError, QString("Failed to remove directory %1 %2").arg(d->storageRoot).arg(d->name).toLatin1());
@@ -1263,24 +2684,133 @@ void DataStore::removeFromDisk() const
     }
 }
 
+bool DataStore::compact()
+{
+#ifdef Q_OS_WIN
+    //Open files can't be replaced on windows
+    SinkWarningCtx(d->logCtx) << "Compaction is not supported on this platform.";
+    return false;
+#else
+    if (d->mode != ReadWrite) {
+        return false;
+    }
+    if (d->backend) {
+        return d->backend->compact();
+    }
+    const QString fullPath(d->storageRoot + '/' + d->name);
+    const QString compactedPath = fullPath + ".compacted";
+    const QString replacedPath = fullPath + ".replaced";
+    QDir(compactedPath).removeRecursively();
+    QDir(replacedPath).removeRecursively();
+    if (!QDir().mkpath(compactedPath)) {
+        SinkWarningCtx(d->logCtx) << "Failed to create the directory for compaction: " << compactedPath;
+        return false;
+    }
+
+    MDB_env *env = nullptr;
+    {
+        QReadLocker locker(&sEnvironmentsLock);
+        env = sEnvironments.value(fullPath);
+        if (!env) {
+            return false;
+        }
+        //Keeps the environment open while we copy it
+        EnvironmentData::get(env)->transactions++;
+    }
+    QElapsedTimer time;
+    time.start();
+    auto data = EnvironmentData::get(env);
+    //The map must not grow while we copy it
+    if (data->growable) {
+        data->mapLock.lockForRead();
+    }
+    const auto release = [&] {
+        if (data->growable) {
+            data->mapLock.unlock();
+        }
+        releaseEnvironmentUse(env);
+    };
+    //Keeps everybody from writing to the environment while we copy it.
+    //Only the writer lock is held meanwhile, so readers carry on and writers that wait for us don't block sEnvironmentsLock.
+    MDB_txn *writeTransaction;
+    if (const int rc = mdb_txn_begin(env, nullptr, 0, &writeTransaction)) {
+        SinkWarningCtx(d->logCtx) << "Failed to start transaction for compaction: " << QByteArray(mdb_strerror(rc));
+        release();
+        return false;
+    }
+    //Unlike a plain copy, a compacting copy doesn't take the writer lock, which we're holding already.
+    if (const int rc = mdb_env_copy2(env, QFile::encodeName(compactedPath).constData(), MDB_CP_COMPACT)) {
+        SinkWarningCtx(d->logCtx) << "Failed to compact: " << QByteArray(mdb_strerror(rc));
+        mdb_txn_abort(writeTransaction);
+        release();
+        QDir(compactedPath).removeRecursively();
+        return false;
+    }
+    {
+        QWriteLocker locker(&sEnvironmentsLock);
+        //Processes that open the environment between the two renames won't find it.
+        if (!QDir().rename(fullPath, replacedPath)) {
+            SinkWarningCtx(d->logCtx) << "Failed to move the environment out of the way: " << fullPath;
+            mdb_txn_abort(writeTransaction);
+            locker.unlock();
+            release();
+            QDir(compactedPath).removeRecursively();
+            return false;
+        }
+        if (!QDir().rename(compactedPath, fullPath)) {
+            SinkErrorCtx(d->logCtx) << "Failed to move the compacted environment in place: " << compactedPath;
+            QDir().rename(replacedPath, fullPath);
+            mdb_txn_abort(writeTransaction);
+            locker.unlock();
+            release();
+            QDir(compactedPath).removeRecursively();
+            return false;
+        }
+        const auto profile = data->profile;
+        mdb_txn_abort(writeTransaction);
+        if (data->growable) {
+            data->mapLock.unlock();
+        }
+        data->transactions--;
+        retireEnvironment(fullPath, env);
+        d->env = d->createEnvironment(fullPath, DbLayout{d->name.toUtf8(), {}, profile});
+        d->envId = sOpenEnvironments.value(d->env);
+    }
+    //The files remain accessible for transactions of the retired environment and other processes until they close them.
+    QDir(replacedPath).removeRecursively();
+    SinkLogCtx(d->logCtx) << "Compacted the environment in " << Log::TraceTime(time.elapsed());
+    return d->env != nullptr;
+#endif
+}
+
+bool DataStore::compactIfRequired(double maxFreeRatio)
+{
+    //Not worth the trouble for small environments
+    const qint64 minimumSize = 1048576 * 10; // 1MB * 10
+    if (d->mode != ReadWrite || d->backend || diskUsage() < minimumSize) {
+        return false;
+    }
+    const auto stat = createTransaction(ReadOnly).stat(false);
+    if (!stat.totalPages || double(stat.freePages) / double(stat.totalPages) < maxFreeRatio) {
+        return false;
+    }
+    SinkLogCtx(d->logCtx) << "Compacting environment with " << stat.freePages << " free of " << stat.totalPages << " pages";
+    return compact();
+}
+
 void DataStore::clearEnv()
 {
     SinkTrace() << "Clearing environment";
     QWriteLocker locker(&sEnvironmentsLock);
-    QWriteLocker dbiLocker(&sDbisLock);
-    for (const auto &envName : sEnvironments.keys()) {
-        auto env = sEnvironments.value(envName);
+    for (const auto &env : sEnvironments) {
         mdb_env_sync(env, true);
-        for (const auto &k : sDbis.keys()) {
-            if (k.startsWith(envName)) {
-                auto dbi = sDbis.value(k);
-                mdb_dbi_close(env, dbi);
-            }
-        }
-        mdb_env_close(env);
+        closeEnvironment(env);
     }
-    sDbis.clear();
     sEnvironments.clear();
+    for (const auto &env : sRetiredEnvironments) {
+        closeEnvironment(env);
+    }
+    sRetiredEnvironments.clear();
 }
 
 }
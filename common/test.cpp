@@ -28,10 +28,11 @@
 #include "query.h"
 #include "resourceconfig.h"
 #include "definitions.h"
+#include "storage/memorybackend.h"
 
 using namespace Sink;
 
-void Sink::Test::initTest()
+void Sink::Test::initTest(Sink::Storage::StorageBackend backend)
 {
     auto logIniFile = Sink::configLocation() + "/log.ini";
     auto areaAutocompletionFile = Sink::dataLocation() + "/debugAreas.ini";
@@ -49,6 +50,8 @@ void Sink::Test::initTest()
     QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).removeRecursively();
     // qDebug() << "Removing " << QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
     QDir(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)).removeRecursively();
+    Sink::Storage::MemoryBackend::removeAll();
+    Sink::Storage::setStorageBackend(backend);
     Log::setPrimaryComponent("test");
 
     //We copy those files so we can control debug output from outside the test with sinksh
@@ -94,6 +97,21 @@ bool Sink::Test::testModeEnabled()
     return !qEnvironmentVariableIsEmpty("SINK_TESTMODE");
 }
 
+Sink::Storage::StorageBackend Sink::Test::inProcessStorageBackend(Sink::Storage::StorageBackend fallback)
+{
+    const auto backend = qgetenv("SINK_TEST_STORAGE_BACKEND").toLower();
+    if (backend == "memory") {
+        return Sink::Storage::StorageBackend::Memory;
+    }
+    if (backend == "lmdb") {
+        return Sink::Storage::StorageBackend::Lmdb;
+    }
+    if (!backend.isEmpty()) {
+        qWarning() << "Unknown storage backend: " << backend;
+    }
+    return fallback;
+}
+
 template <typename T>
 class TestFacade : public Sink::StoreFacade<T>
 {
@@ -22,6 +22,7 @@
 
 #include "sink_export.h"
 #include "applicationdomaintype.h"
+#include "storage.h"
 
 #include <memory>
 
@@ -32,11 +33,20 @@ namespace Test {
  * 
  * This makes use of QStandardPaths::setTestModeEnabled to avoid writing to the user directory,
  * and clears all data directories.
+ *
+ * The in-memory storage backend can only be used by tests that don't start any resource processes,
+ * since the data isn't shared between processes.
  */
-void SINK_EXPORT initTest();
+void SINK_EXPORT initTest(Sink::Storage::StorageBackend backend = Sink::Storage::StorageBackend::Lmdb);
 void SINK_EXPORT setTestModeEnabled(bool);
 bool SINK_EXPORT testModeEnabled();
 
+/**
+ * The storage backend for tests and benchmarks that don't start resource processes.
+ *
+ * Can be overridden with SINK_TEST_STORAGE_BACKEND set to "lmdb" or "memory", so the same test can be run against both.
+ */
+Sink::Storage::StorageBackend SINK_EXPORT inProcessStorageBackend(Sink::Storage::StorageBackend fallback);
 class SINK_EXPORT TestAccount {
 public:
     QByteArray identifier;
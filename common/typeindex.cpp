@@ -21,14 +21,22 @@
 #include "log.h"
 #include "index.h"
 #include "fulltextindex.h"
+#include "storage/indexkey.h"
+#include "storage/projection.h"
 
 #include <QDateTime>
 #include <QDataStream>
 
+#include <algorithm>
+#include <limits>
+#include <vector>
+
 using namespace Sink;
 
 using Storage::Identifier;
+namespace IndexKey = Storage::IndexKey;
 
+//The key of secondary indexes
 static QByteArray getByteArray(const QVariant &value)
 {
     if (value.type() == QVariant::DateTime) {
@@ -56,29 +64,15 @@ static QByteArray getByteArray(const QVariant &value)
     return "toplevel";
 }
 
-static QByteArray toSortableByteArrayImpl(const QDateTime &date)
-{
-    // Sort invalid last
-    if (!date.isValid()) {
-        return QByteArray::number(std::numeric_limits<unsigned int>::max());
-    }
-    return padNumber(std::numeric_limits<unsigned int>::max() - date.toTime_t());
-}
+//The number of fulltext matches that are read at once, unless the query is limited
+static const int sFulltextPageSize = 50;
+//Continuations of fulltext lookups are marked with this instead of a sort property
+static const QByteArray sFulltextContinuation{"fulltext"};
 
-static QByteArray toSortableByteArray(const QVariant &value)
+static IndexKey::Order sortOrder(int type)
 {
-    if (!value.isValid()) {
-        // FIXME: we don't know the type, so we don't know what to return
-        // This mean we're fixing every sorted index keys to use unsigned int
-        return QByteArray::number(std::numeric_limits<unsigned int>::max());
-    }
-
-    if (value.canConvert<QDateTime>()) {
-        return toSortableByteArrayImpl(value.toDateTime());
-    }
-    SinkWarning() << "Not knowing how to convert a" << value.typeName()
-                    << "to a sortable key, falling back to default conversion";
-    return getByteArray(value);
+    //Dates are sorted newest first
+    return type == QMetaType::QDateTime ? IndexKey::Descending : IndexKey::Ascending;
 }
 
 TypeIndex::TypeIndex(const QByteArray &type, const Sink::Log::Context &ctx) : mLogCtx(ctx), mType(type)
@@ -93,151 +87,409 @@ QByteArray TypeIndex::indexName(const QByteArray &property, const QByteArray &so
     return mType + ".index." + property + ".sort." + sortProperty;
 }
 
+std::function<QByteArray(const QVariant &)> TypeIndex::keyEncoder(const QByteArray &property) const
+{
+    const auto type = mPropertyTypes.value(property);
+    return [type](const QVariant &value) {
+        return IndexKey::encode(value, type);
+    };
+}
+
 QByteArray TypeIndex::sortedIndexName(const QByteArray &property) const
 {
     return mType + ".index." + property + ".sorted";
 }
 
-QByteArray TypeIndex::sampledPeriodIndexName(const QByteArray &rangeBeginProperty, const QByteArray &rangeEndProperty) const
+QByteArray TypeIndex::coveringIndexName(const QByteArray &property, const QByteArray &sortProperty) const
+{
+    return mType + ".index." + property + ".sort." + sortProperty + ".covering";
+}
+
+QByteArray TypeIndex::intervalIndexName(const QByteArray &beginProperty, const QByteArray &endProperty) const
+{
+    return mType + ".index." + beginProperty + ".interval." + endProperty;
+}
+
+QByteArray TypeIndex::ngramIndexName(const QByteArray &property) const
 {
-    return mType + ".index." + rangeBeginProperty + ".range." + rangeEndProperty;
+    return mType + ".index." + property + ".ngram";
 }
 
-static unsigned int bucketOf(const QVariant &value)
+QByteArray TypeIndex::recurrenceIndexName(const QByteArray &beginProperty, const QByteArray &endProperty) const
 {
-    if (value.canConvert<QDateTime>()) {
-        return value.value<QDateTime>().date().toJulianDay() / 7;
+    return intervalIndexName(beginProperty, endProperty) + ".recurrence";
+}
+
+void TypeIndex::update(Action action, const QByteArray &indexName, const QByteArray &key, const QByteArray &value)
+{
+    switch (action) {
+        case Add:
+            mWriter.add(indexName, key, value);
+            break;
+        case Remove:
+            mWriter.remove(indexName, key, value);
+            break;
     }
-    SinkError() << "Not knowing how to get the bucket of a" << value.typeName();
-    return {};
 }
 
-static void update(TypeIndex::Action action, const QByteArray &indexName, const QByteArray &key, const QByteArray &value, Sink::Storage::DataStore::Transaction &transaction)
+void TypeIndex::updateStatistics(Action action, const QByteArray &indexName, const QByteArray &key)
 {
-    Index index(indexName, transaction);
+    auto &statistics = mStatisticsChanges[indexName];
     switch (action) {
-        case TypeIndex::Add:
-            index.add(key, value);
+        case Add:
+            statistics.add(key);
             break;
-        case TypeIndex::Remove:
-            index.remove(key, value);
+        case Remove:
+            statistics.remove(key);
             break;
     }
 }
 
-void TypeIndex::addProperty(const QByteArray &property)
+static bool propertyChanged(const Sink::ApplicationDomain::ApplicationDomainType &oldEntity, const Sink::ApplicationDomain::ApplicationDomainType &newEntity, const QByteArray &property)
+{
+    const auto oldValue = oldEntity.getProperty(property);
+    const auto newValue = newEntity.getProperty(property);
+    if (oldValue.userType() != newValue.userType()) {
+        return true;
+    }
+    //Contacts have no comparison operator, so we compare their encoding instead
+    if (oldValue.userType() == qMetaTypeId<Sink::ApplicationDomain::Mail::Contact>() || oldValue.userType() == qMetaTypeId<QList<Sink::ApplicationDomain::Mail::Contact>>()) {
+        return Sink::Storage::Projection::encode(oldEntity, {property}) != Sink::Storage::Projection::encode(newEntity, {property});
+    }
+    return oldValue != newValue;
+}
+
+static bool dependsOn(const QByteArrayList &inputProperties, const QSet<QByteArray> *changedProperties)
+{
+    if (!changedProperties) {
+        return true;
+    }
+    return std::any_of(inputProperties.cbegin(), inputProperties.cend(), [&](const QByteArray &property) { return changedProperties->contains(property); });
+}
+
+QSet<QByteArray> TypeIndex::changedProperties(const Sink::ApplicationDomain::ApplicationDomainType &oldEntity, const Sink::ApplicationDomain::ApplicationDomainType &newEntity) const
+{
+    QSet<QByteArray> changed;
+    for (const auto &property : mInputProperties) {
+        if (propertyChanged(oldEntity, newEntity, property)) {
+            changed.insert(property);
+        }
+    }
+    return changed;
+}
+
+void TypeIndex::addProperty(const QByteArray &property, int type)
 {
-    auto indexer = [=](Action action, const Identifier &identifier, const QVariant &value, Sink::Storage::DataStore::Transaction &transaction) {
-        update(action, indexName(property), getByteArray(value), identifier.toInternalByteArray(), transaction);
+    const auto name = indexName(property);
+    auto indexer = [=](Action action, const Identifier &identifier, const QVariant &value, Sink::Storage::DataStore::Transaction &) {
+        const auto key = IndexKey::encode(value, type);
+        update(action, name, key, identifier.toInternalByteArray());
+        updateStatistics(action, name, key);
     };
     mIndexer.insert(property, indexer);
+    mPropertyTypes.insert(property, type);
     mProperties << property;
+    mInputProperties.insert(property);
 }
 
-template <>
-void TypeIndex::addSortedProperty<QDateTime>(const QByteArray &property)
+void TypeIndex::addSortedProperty(const QByteArray &property, int type)
 {
+    const auto name = sortedIndexName(property);
     auto indexer = [=](Action action, const Identifier &identifier, const QVariant &value,
-                       Sink::Storage::DataStore::Transaction &transaction) {
-        update(action, sortedIndexName(property), toSortableByteArray(value), identifier.toInternalByteArray(), transaction);
+                       Sink::Storage::DataStore::Transaction &) {
+        const auto key = IndexKey::encode(value, type, sortOrder(type));
+        update(action, name, key, identifier.toInternalByteArray());
+        updateStatistics(action, name, key);
     };
     mSortIndexer.insert(property, indexer);
+    mPropertyTypes.insert(property, type);
     mSortedProperties << property;
+    mInputProperties.insert(property);
 }
 
-template <>
-void TypeIndex::addPropertyWithSorting<QByteArray, QDateTime>(const QByteArray &property, const QByteArray &sortProperty)
+void TypeIndex::addPropertyWithSorting(const QByteArray &property, int type, const QByteArray &sortProperty, int sortType)
 {
-    auto indexer = [=](Action action, const Identifier &identifier, const QVariant &value, const QVariant &sortValue, Sink::Storage::DataStore::Transaction &transaction) {
-        const auto date = sortValue.toDateTime();
-        const auto propertyValue = getByteArray(value);
-        update(action, indexName(property, sortProperty), propertyValue + toSortableByteArray(date), identifier.toInternalByteArray(), transaction);
+    const auto name = indexName(property, sortProperty);
+    auto indexer = [=](Action action, const Identifier &identifier, const QVariant &value, const QVariant &sortValue, Sink::Storage::DataStore::Transaction &) {
+        //The property is the leading component, so a prefix lookup on it yields the ids in sort order
+        const auto propertyKey = IndexKey::encode(value, type);
+        auto key = propertyKey;
+        IndexKey::appendVariant(key, sortValue, sortType, sortOrder(sortType));
+        update(action, name, key, identifier.toInternalByteArray());
+        //Lookups are by the property only
+        updateStatistics(action, name, propertyKey);
     };
     mGroupedSortIndexer.insert(property + sortProperty, indexer);
+    mPropertyTypes.insert(property, type);
     mGroupedSortedProperties.insert(property, sortProperty);
+    mInputProperties.insert(property);
+    mInputProperties.insert(sortProperty);
 }
 
-template <>
-void TypeIndex::addPropertyWithSorting<ApplicationDomain::Reference, QDateTime>(const QByteArray &property, const QByteArray &sortProperty)
+void TypeIndex::addCoveringIndex(const QByteArray &property, int type, const QByteArray &sortProperty, int sortType, const QByteArrayList &coveredProperties)
 {
-    addPropertyWithSorting<QByteArray, QDateTime>(property, sortProperty);
+    const auto name = coveringIndexName(property, sortProperty);
+    const auto properties = QByteArrayList{property, sortProperty} + coveredProperties;
+    auto indexer = [=](Action action, const Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &) {
+        //The projections can be larger than LMDB allows for duplicates, so the id is part of the key instead.
+        //This also means entries can be removed without knowing the stored values.
+        auto key = IndexKey::encode(entity.getProperty(property), type);
+        IndexKey::appendVariant(key, entity.getProperty(sortProperty), sortType, sortOrder(sortType));
+        key += identifier.toInternalByteArray();
+        switch (action) {
+            case TypeIndex::Add:
+                mWriter.write(name, key, Sink::Storage::Projection::encode(entity, properties));
+                break;
+            case TypeIndex::Remove:
+                mWriter.erase(name, key);
+                break;
+        }
+    };
+    mCoveringIndexer.insert(name, indexer);
+    mCoveringIndexes << CoveringIndex{property, type, sortProperty, properties};
+    for (const auto &p : properties) {
+        mInputProperties.insert(p);
+    }
 }
 
-template <>
-void TypeIndex::addSampledPeriodIndex<QDateTime, QDateTime>(
-    const QByteArray &beginProperty, const QByteArray &endProperty)
+/*
+ * The interval index groups the periods by level, the bit length of their length in seconds,
+ * so a period of level l is shorter than 2^l seconds.
+ * The key is the level followed by the begin, the value the end, whether the entity recurs, and the id.
+ * Only periods that begin at most 2^l seconds before a queried period can overlap it, which bounds the scan per level.
+ */
+static const int sMaxIntervalLevel = 64;
+static const char sNonRecurring = 0x00;
+static const char sRecurring = 0x01;
+//The end and the recurrence flag precede the id in the values
+static const int sIntervalIdOffset = 10;
+
+static int intervalLevel(qint64 begin, qint64 end)
 {
-    auto indexer = [=](Action action, const Identifier &identifier, const QVariant &begin,
-                       const QVariant &end, Sink::Storage::DataStore::Transaction &transaction) {
-        const auto beginDate = begin.toDateTime();
-        const auto endDate = end.toDateTime();
+    const quint64 seconds = quint64(end - begin) / 1000 + 1;
+    return sMaxIntervalLevel - qCountLeadingZeroBits(seconds);
+}
 
-        auto beginBucket = bucketOf(beginDate);
-        auto endBucket   = bucketOf(endDate);
+static QByteArray intervalKey(int level, qint64 begin)
+{
+    QByteArray key(1, char(level));
+    IndexKey::appendInteger(key, begin);
+    return key;
+}
 
-        if (beginBucket > endBucket) {
-            SinkError() << "End bucket greater than begin bucket";
+void TypeIndex::addIntervalIndex(const QByteArray &beginProperty, const QByteArray &endProperty, const QByteArrayList &recurrenceSourceProperties, const RecurrenceEncoder &recurrence, const RecurrenceMatcher &occursIn)
+{
+    const auto name = intervalIndexName(beginProperty, endProperty);
+    const auto recurrenceName = recurrenceIndexName(beginProperty, endProperty);
+    auto indexer = [=](Action action, const Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity) {
+        const auto begin = entity.getProperty(beginProperty).toDateTime();
+        if (!begin.isValid()) {
             return;
         }
+        const auto end = entity.getProperty(endProperty).toDateTime();
+        const auto beginValue = begin.toMSecsSinceEpoch();
+        const auto endValue = end.isValid() ? qMax(beginValue, end.toMSecsSinceEpoch()) : beginValue;
+        const auto encodedRecurrence = recurrence ? recurrence(entity) : QByteArray{};
 
-        Index index(sampledPeriodIndexName(beginProperty, endProperty), transaction);
-        for (auto bucket = beginBucket; bucket <= endBucket; ++bucket) {
-            QByteArray bucketKey = padNumber(bucket);
+        QByteArray value;
+        IndexKey::appendInteger(value, endValue);
+        value.append(encodedRecurrence.isEmpty() ? sNonRecurring : sRecurring);
+        value += identifier.toInternalByteArray();
+        update(action, name, intervalKey(intervalLevel(beginValue, endValue), beginValue), value);
+
+        if (!encodedRecurrence.isEmpty()) {
             switch (action) {
                 case TypeIndex::Add:
-                    index.add(bucketKey, identifier.toInternalByteArray());
+                    mWriter.write(recurrenceName, identifier.toInternalByteArray(), encodedRecurrence);
                     break;
                 case TypeIndex::Remove:
-                    index.remove(bucketKey, identifier.toInternalByteArray(), true);
+                    mWriter.erase(recurrenceName, identifier.toInternalByteArray());
                     break;
             }
         }
     };
+    const auto inputs = QByteArrayList{beginProperty, endProperty} + recurrenceSourceProperties;
+    for (const auto &property : inputs) {
+        mInputProperties.insert(property);
+    }
+    mIntervalIndexes << IntervalIndex{beginProperty, endProperty, inputs, recurrence, occursIn, indexer};
+}
 
-    mSampledPeriodProperties.insert({ beginProperty, endProperty });
-    mSampledPeriodIndexer.insert({ beginProperty, endProperty }, indexer);
+bool TypeIndex::occursIn(const QByteArrayList &properties, const QueryBase::Comparator &filter, const Sink::ApplicationDomain::ApplicationDomainType &entity) const
+{
+    if (filter.comparator != QueryBase::Comparator::Overlap) {
+        return true;
+    }
+    for (const auto &index : mIntervalIndexes) {
+        if (properties != QByteArrayList{index.beginProperty, index.endProperty}) {
+            continue;
+        }
+        if (!index.recurrence || !index.occursIn) {
+            return true;
+        }
+        const auto recurrence = index.recurrence(entity);
+        if (recurrence.isEmpty()) {
+            return true;
+        }
+        const auto bounds = filter.value.value<QVariantList>();
+        return index.occursIn(recurrence, bounds.value(0).toDateTime(), bounds.value(1).toDateTime());
+    }
+    return true;
 }
 
-void TypeIndex::updateIndex(Action action, const Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId)
+/*
+ * The n-grams are the case folded substrings of this length at every position, so the last ones of a text are shorter.
+ * Searched texts of at least this length are looked up by all of their n-grams,
+ * shorter ones by a prefix lookup, which finds them at every position thanks to the shorter n-grams.
+ */
+static const int sNgramSize = 3;
+
+/*
+ * The n-grams of @param text by code point, so surrogate pairs are never split.
+ * With @param partial the shorter n-grams at the end of the text are included.
+ */
+static QVector<QByteArray> textNgrams(const QString &text, bool partial)
+{
+    const auto codePoints = text.toUcs4();
+    QVector<QByteArray> grams;
+    for (int i = 0; i < codePoints.size() && (partial || i + sNgramSize <= codePoints.size()); i++) {
+        grams << QString::fromUcs4(codePoints.constData() + i, qMin(sNgramSize, codePoints.size() - i)).toUtf8();
+    }
+    return grams;
+}
+
+static QSet<QByteArray> ngrams(const QVariant &value)
+{
+    QStringList texts;
+    if (!QueryBase::Comparator::containedTexts(value, texts)) {
+        if (value.isValid()) {
+            SinkWarning() << "Not knowing how to get the texts of a" << value.typeName();
+        }
+        return {};
+    }
+    QSet<QByteArray> grams;
+    for (const auto &text : texts) {
+        for (const auto &gram : textNgrams(text.toCaseFolded(), true)) {
+            grams.insert(gram);
+        }
+    }
+    return grams;
+}
+
+void TypeIndex::addNgramIndex(const QByteArray &property)
+{
+    mNgramProperties << property;
+    mInputProperties.insert(property);
+}
+
+void TypeIndex::updatePropertyIndexes(Action action, const Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction, const QSet<QByteArray> *changedProperties)
 {
     for (const auto &property : mProperties) {
+        if (!dependsOn({property}, changedProperties)) {
+            continue;
+        }
         const auto value = entity.getProperty(property);
         auto indexer = mIndexer.value(property);
         indexer(action, identifier, value, transaction);
     }
-    for (const auto &properties : mSampledPeriodProperties) {
-        auto indexer = mSampledPeriodIndexer.value(properties);
-        auto indexRanges = entity.getProperty("indexRanges");
-        if (indexRanges.isValid()) {
-            //This is to override the indexed ranges from the evenpreprocessor
-            const auto list = indexRanges.value<QList<QPair<QDateTime, QDateTime>>>();
-            for (const auto &period : list) {
-                indexer(action, identifier, period.first, period.second, transaction);
-            }
-        } else {
-            //This is the regular case
-            //NOTE Since we don't generate the ranges for removal we just end up trying to remove all possible buckets here instead.
-            const auto beginValue = entity.getProperty(properties.first);
-            const auto endValue   = entity.getProperty(properties.second);
-            indexer(action, identifier, beginValue, endValue, transaction);
-        }
-    }
     for (const auto &property : mSortedProperties) {
+        if (!dependsOn({property}, changedProperties)) {
+            continue;
+        }
         const auto value = entity.getProperty(property);
         auto indexer = mSortIndexer.value(property);
         indexer(action, identifier, value, transaction);
     }
     for (auto it = mGroupedSortedProperties.constBegin(); it != mGroupedSortedProperties.constEnd(); it++) {
+        if (!dependsOn({it.key(), it.value()}, changedProperties)) {
+            continue;
+        }
         const auto value = entity.getProperty(it.key());
         const auto sortValue = entity.getProperty(it.value());
         auto indexer = mGroupedSortIndexer.value(it.key() + it.value());
         indexer(action, identifier, value, sortValue, transaction);
     }
+    for (const auto &index : mCoveringIndexes) {
+        //Any change of a stored value requires a new projection
+        if (!dependsOn(index.properties, changedProperties)) {
+            continue;
+        }
+        auto indexer = mCoveringIndexer.value(coveringIndexName(index.property, index.sortProperty));
+        indexer(action, identifier, entity, transaction);
+    }
+    for (const auto &index : mIntervalIndexes) {
+        if (!dependsOn(index.inputProperties, changedProperties)) {
+            continue;
+        }
+        index.indexer(action, identifier, entity);
+    }
+    for (const auto &property : mNgramProperties) {
+        if (!dependsOn({property}, changedProperties)) {
+            continue;
+        }
+        //On modification the n-grams that remain cancel out in the writer
+        const auto name = ngramIndexName(property);
+        for (const auto &gram : ngrams(entity.getProperty(property))) {
+            update(action, name, gram, identifier.toInternalByteArray());
+        }
+    }
+}
 
+void TypeIndex::clearPropertyIndexes(Sink::Storage::DataStore::Transaction &transaction)
+{
+    mWriter.flush(transaction);
+    QByteArrayList names;
+    for (const auto &property : mProperties) {
+        names << indexName(property);
+    }
+    for (const auto &property : mSortedProperties) {
+        names << sortedIndexName(property);
+    }
+    for (auto it = mGroupedSortedProperties.constBegin(); it != mGroupedSortedProperties.constEnd(); it++) {
+        names << indexName(it.key(), it.value());
+    }
+    for (const auto &property : mNgramProperties) {
+        names << ngramIndexName(property);
+    }
+    QSet<QByteArray> uniqueNames;
+    for (const auto &index : mCoveringIndexes) {
+        names << coveringIndexName(index.property, index.sortProperty);
+        uniqueNames << names.last();
+    }
+    for (const auto &index : mIntervalIndexes) {
+        names << intervalIndexName(index.beginProperty, index.endProperty);
+        names << recurrenceIndexName(index.beginProperty, index.endProperty);
+        uniqueNames << names.last();
+        //The sampled period index the interval index replaced in version 12
+        names << mType + ".index." + index.beginProperty + ".range." + index.endProperty;
+    }
+    for (const auto &name : names) {
+        //Covering indexes and the recurrences of interval indexes don't allow duplicates
+        transaction.openDatabase(name, {}, uniqueNames.contains(name) ? 0 : Sink::Storage::AllowDuplicates).clear();
+        IndexStatistics::remove(transaction, mType, name);
+        mStatisticsChanges.remove(name);
+        SinkTraceCtx(mLogCtx) << "Cleared " << name;
+    }
+}
+
+void TypeIndex::addToPropertyIndexes(const Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction)
+{
+    updatePropertyIndexes(Add, identifier, entity, transaction);
 }
 
 void TypeIndex::commitTransaction()
 {
+    if (!mWriter.isEmpty()) {
+        Q_ASSERT(mTransaction);
+        mWriter.flush(*mTransaction);
+    }
+    if (!mStatisticsChanges.isEmpty()) {
+        Q_ASSERT(mTransaction);
+        for (auto it = mStatisticsChanges.constBegin(); it != mStatisticsChanges.constEnd(); it++) {
+            IndexStatistics::merge(*mTransaction, mType, it.key(), it.value());
+        }
+        mStatisticsChanges.clear();
+    }
     for (const auto &indexer : mCustomIndexer) {
         indexer->commitTransaction();
     }
@@ -245,33 +497,57 @@ void TypeIndex::commitTransaction()
 
 void TypeIndex::abortTransaction()
 {
+    mWriter.clear();
+    mStatisticsChanges.clear();
     for (const auto &indexer : mCustomIndexer) {
         indexer->abortTransaction();
     }
 }
 
-void TypeIndex::add(const Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId)
+void TypeIndex::add(const Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId, bool propertyIndexes)
 {
-    updateIndex(Add, identifier, entity, transaction, resourceInstanceId);
+    if (propertyIndexes) {
+        updatePropertyIndexes(Add, identifier, entity, transaction);
+    }
     for (const auto &indexer : mCustomIndexer) {
         indexer->setup(this, &transaction, resourceInstanceId);
         indexer->add(entity);
     }
 }
 
-void TypeIndex::modify(const Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &oldEntity, const Sink::ApplicationDomain::ApplicationDomainType &newEntity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId)
+void TypeIndex::modify(const Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &oldEntity, const Sink::ApplicationDomain::ApplicationDomainType &newEntity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId, bool oldPropertyIndexes, bool newPropertyIndexes)
 {
-    updateIndex(Remove, identifier, oldEntity, transaction, resourceInstanceId);
-    updateIndex(Add, identifier, newEntity, transaction, resourceInstanceId);
+    //Only the indexes of changed properties are updated, which saves most of the work for e.g. flag changes
+    const auto changed = changedProperties(oldEntity, newEntity);
+    if (oldPropertyIndexes && newPropertyIndexes) {
+        if (!changed.isEmpty()) {
+            updatePropertyIndexes(Remove, identifier, oldEntity, transaction, &changed);
+            updatePropertyIndexes(Add, identifier, newEntity, transaction, &changed);
+        }
+    } else {
+        //While the property indexes are rebuilt, the entity may only be in them on one side
+        if (oldPropertyIndexes) {
+            updatePropertyIndexes(Remove, identifier, oldEntity, transaction);
+        }
+        if (newPropertyIndexes) {
+            updatePropertyIndexes(Add, identifier, newEntity, transaction);
+        }
+    }
     for (const auto &indexer : mCustomIndexer) {
+        const auto inputProperties = indexer->inputProperties();
+        if (!inputProperties.isEmpty() && !dependsOn(inputProperties, &changed)) {
+            continue;
+        }
         indexer->setup(this, &transaction, resourceInstanceId);
         indexer->modify(oldEntity, newEntity);
     }
 }
 
-void TypeIndex::remove(const Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId)
+void TypeIndex::remove(const Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId, bool propertyIndexes)
 {
-    updateIndex(Remove, identifier, entity, transaction, resourceInstanceId);
+    if (propertyIndexes) {
+        updatePropertyIndexes(Remove, identifier, entity, transaction);
+    }
     for (const auto &indexer : mCustomIndexer) {
         indexer->setup(this, &transaction, resourceInstanceId);
         indexer->remove(entity);
@@ -279,7 +555,7 @@ void TypeIndex::remove(const Identifier &identifier, const Sink::ApplicationDoma
 }
 
 static QVector<Identifier> indexLookup(Index &index, QueryBase::Comparator filter,
-    std::function<QByteArray(const QVariant &)> valueToKey = getByteArray)
+    const std::function<QByteArray(const QVariant &)> &valueToKey)
 {
     QVector<Identifier> keys;
     QByteArrayList lookupKeys;
@@ -307,33 +583,34 @@ static QVector<Identifier> indexLookup(Index &index, QueryBase::Comparator filte
     return keys;
 }
 
-static QVector<Identifier> sortedIndexLookup(Index &index, QueryBase::Comparator filter)
+static QVector<Identifier> sortedIndexLookup(Index &index, QueryBase::Comparator filter, int type)
 {
     if (filter.comparator == Query::Comparator::In || filter.comparator == Query::Comparator::Contains) {
         SinkWarning() << "In and Contains comparison not supported on sorted indexes";
     }
 
+    const auto order = sortOrder(type);
     if (filter.comparator != Query::Comparator::Within) {
-        return indexLookup(index, filter, toSortableByteArray);
+        return indexLookup(index, filter, [&](const QVariant &value) {
+            return IndexKey::encode(value, type, order);
+        });
     }
 
-    QByteArray lowerBound, upperBound;
     const auto bounds = filter.value.value<QVariantList>();
-    if (bounds[0].canConvert<QDateTime>()) {
-        // Inverse the bounds because dates are stored newest first
-        upperBound = toSortableByteArray(bounds[0].toDateTime());
-        lowerBound = toSortableByteArray(bounds[1].toDateTime());
-    } else {
-        lowerBound = bounds[0].toByteArray();
-        upperBound = bounds[1].toByteArray();
+    auto lowerBound = IndexKey::encode(bounds[0], type, order);
+    auto upperBound = IndexKey::encode(bounds[1], type, order);
+    if (order == IndexKey::Descending) {
+        std::swap(lowerBound, upperBound);
     }
 
     QVector<Identifier> keys;
+    QSet<Identifier> seen;
     index.rangeLookup(lowerBound, upperBound,
         [&](const QByteArray &value) {
             const auto id = Identifier::fromInternalByteArray(value);
             //Deduplicate because an id could be in multiple buckets
-            if (!keys.contains(id)) {
+            if (!seen.contains(id)) {
+                seen.insert(id);
                 keys << id;
             }
         },
@@ -345,69 +622,331 @@ static QVector<Identifier> sortedIndexLookup(Index &index, QueryBase::Comparator
     return keys;
 }
 
-static QVector<Identifier> sortedIndexLookup(Index &index, int limit)
+static QVector<Identifier> sortedIndexLookup(Index &index, int limit, QByteArray &continuation)
 {
     QVector<Identifier> keys;
-    int count = 0;
-    index.lookup("",
+    index.rangeLookup({}, {}, continuation,
         [&](const QByteArray &value) -> bool {
             keys << Identifier::fromInternalByteArray(value);
-            count++;
-            if (limit && count > limit) {
-                return false;
-            }
-            return true;
+            return !limit || keys.size() < limit;
         },
         [](const Index::Error &error) {
             SinkWarning() << "Lookup error in index: " << error.message;
-        },
-        true);
+        });
     return keys;
 }
 
-static QVector<Identifier> sampledIndexLookup(Index &index, QueryBase::Comparator filter)
+static QVector<Identifier> intervalIndexLookup(const Sink::Storage::DataStore::NamedDatabase &db, const Sink::Storage::DataStore::NamedDatabase &recurrences,
+    const QueryBase::Comparator &filter, const TypeIndex::RecurrenceMatcher &occursIn)
 {
     if (filter.comparator != Query::Comparator::Overlap) {
-        SinkWarning() << "Comparisons other than Overlap not supported on sampled period indexes";
+        SinkWarning() << "Comparisons other than Overlap not supported on interval indexes";
         return {};
     }
-
-
     const auto bounds = filter.value.value<QVariantList>();
+    const auto lower = bounds.value(0).toDateTime();
+    const auto upper = bounds.value(1).toDateTime();
+    if (!lower.isValid() || !upper.isValid()) {
+        SinkWarning() << "Invalid bounds for an interval index lookup:" << bounds;
+        return {};
+    }
+    const auto lowerValue = lower.toMSecsSinceEpoch();
+    const auto upperValue = upper.toMSecsSinceEpoch();
+    QByteArray encodedLower;
+    IndexKey::appendInteger(encodedLower, lowerValue);
 
-    const auto lowerBucket = padNumber(bucketOf(bounds[0]));
-    const auto upperBucket = padNumber(bucketOf(bounds[1]));
+    QVector<Identifier> keys;
+    //Only visit the levels that exist, by seeking to the next one each time
+    auto levels = db.cursor();
+    for (int level = 0; level <= sMaxIntervalLevel && levels.seek(QByteArray(1, char(level))); level++) {
+        level = static_cast<unsigned char>(levels.current().key[0]);
+        //Periods of this level are shorter than the reach, guarding against overflows for the longest ones
+        const qint64 reach = level >= 53 ? std::numeric_limits<qint64>::max() : (qint64(1) << level) * 1000;
+        const auto lowestBegin = lowerValue < std::numeric_limits<qint64>::min() + reach ? std::numeric_limits<qint64>::min() : lowerValue - reach;
+        for (const auto &entry : db.range(intervalKey(level, lowestBegin), intervalKey(level, upperValue))) {
+            if (entry.value.size() != std::size_t(sIntervalIdOffset + Identifier::INTERNAL_REPR_SIZE)) {
+                SinkWarning() << "Invalid entry in interval index";
+                continue;
+            }
+            //Ends before the queried period
+            if (entry.value.substr(0, encodedLower.size()) < std::string_view(encodedLower.constData(), encodedLower.size())) {
+                continue;
+            }
+            const auto id = Identifier::readInternal(entry.value.data() + sIntervalIdOffset);
+            if (entry.value[sIntervalIdOffset - 1] == sRecurring && occursIn) {
+                QByteArray recurrence;
+                recurrences.scan(id.toInternalByteArray(),
+                    [&](const QByteArray &, const QByteArray &value) -> bool {
+                        recurrence = value;
+                        return false;
+                    },
+                    [](const Sink::Storage::DataStore::Error &error) {
+                        SinkWarning() << "Failed to read a recurrence: " << error.message;
+                    });
+                //Without a recurrence we can't rule out an occurrence
+                if (!recurrence.isEmpty() && !occursIn(recurrence, lower, upper)) {
+                    continue;
+                }
+            }
+            keys << id;
+        }
+    }
+    return keys;
+}
 
-    SinkTrace() << "Looking up from bucket:" << lowerBucket << "to:" << upperBucket;
+/*
+ * Candidate sets are kept sorted by identifier, so the results of multiple indexes can be merged in linear time.
+ * This also unions the results of an In lookup, which may contain the same id for multiple values.
+ */
+static QVector<Identifier> toSortedSet(QVector<Identifier> ids)
+{
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+static QVector<Identifier> intersectSorted(const QVector<Identifier> &left, const QVector<Identifier> &right)
+{
+    QVector<Identifier> result;
+    result.reserve(qMin(left.size(), right.size()));
+    std::set_intersection(left.cbegin(), left.cend(), right.cbegin(), right.cend(), std::back_inserter(result));
+    return result;
+}
 
+static QVector<Identifier> ngramIndexLookup(Index &index, const QVariant &value)
+{
+    const auto text = value.toString().toCaseFolded();
+    const auto onError = [&](const Index::Error &error) {
+        SinkWarning() << "Lookup error in index:" << error.message << text;
+    };
     QVector<Identifier> keys;
-    index.rangeLookup(lowerBucket, upperBucket,
-        [&](const QByteArray &value) {
-            const auto id = Identifier::fromInternalByteArray(value);
-            //Deduplicate because an id could be in multiple buckets
-            if (!keys.contains(id)) {
-                keys << id;
-            }
-        },
-        [&](const Index::Error &error) {
-            SinkWarning() << "Lookup error in index:" << error.message
-                          << "with bounds:" << bounds[0] << bounds[1];
+    if (text.toUcs4().size() < sNgramSize) {
+        index.lookup(text.toUtf8(),
+            [&](const QByteArray &value) {
+                keys << Identifier::fromInternalByteArray(value);
+                return true;
+            },
+            onError, true);
+        //The text may occur at multiple positions
+        return toSortedSet(keys);
+    }
+    QSet<QByteArray> lookedUp;
+    for (const auto &gram : textNgrams(text, false)) {
+        if (lookedUp.contains(gram)) {
+            continue;
+        }
+        lookedUp.insert(gram);
+        QVector<Identifier> candidates;
+        index.lookup(gram,
+            [&](const QByteArray &value) {
+                candidates << Identifier::fromInternalByteArray(value);
+                return true;
+            },
+            onError);
+        keys = lookedUp.size() == 1 ? toSortedSet(candidates) : intersectSorted(keys, toSortedSet(candidates));
+        if (keys.isEmpty()) {
+            break;
+        }
+    }
+    return keys;
+}
+
+//Reading an index entry is a lot cheaper than loading and filtering an entity, roughly by this factor
+static const qint64 sEntityLoadCost = 10;
+
+//Estimate of a range lookup on a sorted index, since the statistics don't capture the distribution of the values
+static const qint64 sRangeSelectivity = 4;
+
+struct TypeIndex::Lookup {
+    QByteArrayList filter;
+    //The estimated number of results, or -1 if there are no statistics
+    qint64 estimate;
+    std::function<QVector<Identifier>()> execute;
+};
+
+static bool isCheaper(qint64 left, qint64 right)
+{
+    //Unknown estimates go last, so their order is decided by the index priority
+    if (left < 0) {
+        return false;
+    }
+    return right < 0 || left < right;
+}
+
+qint64 TypeIndex::estimate(const QByteArray &indexName, const QByteArrayList &keys, Sink::Storage::DataStore::Transaction &transaction) const
+{
+    IndexStatistics statistics;
+    if (!IndexStatistics::read(transaction, mType, indexName, statistics)) {
+        return -1;
+    }
+    if (keys.isEmpty()) {
+        return statistics.entries() / sRangeSelectivity;
+    }
+    qint64 sum = 0;
+    for (const auto &key : keys) {
+        sum += statistics.estimateEquals(key);
+    }
+    return sum;
+}
+
+QVector<TypeIndex::Lookup> TypeIndex::applicableLookups(const Sink::QueryBase &query, const QSet<QByteArrayList> &appliedFilters, Sink::Storage::DataStore::Transaction &transaction)
+{
+    //In order of priority, which decides if there are no statistics
+    QVector<Lookup> lookups;
+    const auto baseFilters = query.getBaseFilters();
+    for (auto it = baseFilters.constBegin(); it != baseFilters.constEnd(); it++) {
+        const auto &filter = it.key();
+        if (it.value().comparator != QueryBase::Comparator::Overlap || appliedFilters.contains(filter)) {
+            continue;
+        }
+        const auto hasIntervalIndex = std::any_of(mIntervalIndexes.cbegin(), mIntervalIndexes.cend(), [&](const IntervalIndex &index) {
+            return filter == QByteArrayList{index.beginProperty, index.endProperty};
         });
+        if (!hasIntervalIndex) {
+            SinkWarning() << "Overlap search without interval index";
+        }
+    }
+    if (!mPropertyIndexesAvailable) {
+        return lookups;
+    }
+    for (const auto &index : mIntervalIndexes) {
+        const QByteArrayList filter{index.beginProperty, index.endProperty};
+        if (!baseFilters.contains(filter) || appliedFilters.contains(filter)) {
+            continue;
+        }
+        const auto comparator = baseFilters.value(filter);
+        if (comparator.comparator != QueryBase::Comparator::Overlap) {
+            continue;
+        }
+        const auto name = intervalIndexName(index.beginProperty, index.endProperty);
+        const auto recurrenceName = recurrenceIndexName(index.beginProperty, index.endProperty);
+        const auto occursIn = index.occursIn;
+        lookups << Lookup{filter, -1, [=, &transaction] {
+            return intervalIndexLookup(transaction.openDatabase(name, {}, Sink::Storage::AllowDuplicates), transaction.openDatabase(recurrenceName), comparator, occursIn);
+        }};
+    }
+    for (const auto &property : mSortedProperties) {
+        if (!query.hasFilter(property) || appliedFilters.contains({property})) {
+            continue;
+        }
+        const auto comparator = query.getFilter(property);
+        if (comparator.comparator != QueryBase::Comparator::Equals && comparator.comparator != QueryBase::Comparator::Within) {
+            continue;
+        }
+        const auto type = mPropertyTypes.value(property);
+        const auto name = sortedIndexName(property);
+        QByteArrayList keys;
+        if (comparator.comparator == QueryBase::Comparator::Equals) {
+            keys << IndexKey::encode(comparator.value, type, sortOrder(type));
+        }
+        lookups << Lookup{{property}, estimate(name, keys, transaction), [=, &transaction] {
+            Index index(name, transaction);
+            return sortedIndexLookup(index, comparator, type);
+        }};
+    }
+    for (const auto &property : mNgramProperties) {
+        if (!query.hasFilter(property) || appliedFilters.contains({property})) {
+            continue;
+        }
+        const auto comparator = query.getFilter(property);
+        if (comparator.comparator != QueryBase::Comparator::Contains || comparator.value.toString().isEmpty()) {
+            continue;
+        }
+        const auto name = ngramIndexName(property);
+        lookups << Lookup{{property}, -1, [=, &transaction] {
+            Index index(name, transaction);
+            return ngramIndexLookup(index, comparator.value);
+        }};
+    }
+    for (const auto &property : mProperties) {
+        if (!query.hasFilter(property) || appliedFilters.contains({property})) {
+            continue;
+        }
+        const auto comparator = query.getFilter(property);
+        QByteArrayList keys;
+        const auto encoder = keyEncoder(property);
+        if (comparator.comparator == QueryBase::Comparator::Equals) {
+            keys << encoder(comparator.value);
+        } else if (comparator.comparator == QueryBase::Comparator::In) {
+            for (const QVariant &value : comparator.value.value<QVariantList>()) {
+                keys << encoder(value);
+            }
+        } else {
+            continue;
+        }
+        const auto name = indexName(property);
+        //An In lookup without values matches nothing, so that is known to be cheap
+        lookups << Lookup{{property}, keys.isEmpty() ? 0 : estimate(name, keys, transaction), [=, &transaction] {
+            Index index(name, transaction);
+            return indexLookup(index, comparator, encoder);
+        }};
+    }
+    std::stable_sort(lookups.begin(), lookups.end(), [](const Lookup &left, const Lookup &right) {
+        return isCheaper(left.estimate, right.estimate);
+    });
+    return lookups;
+}
 
-    return keys;
+QVector<Identifier> TypeIndex::intersect(const QVector<Lookup> &lookups, const QVector<Identifier> &keys, QSet<QByteArrayList> &appliedFilters)
+{
+    auto set = toSortedSet(keys);
+    int intersected = 0;
+    for (const auto &lookup : lookups) {
+        if (set.isEmpty()) {
+            break;
+        }
+        //Filtering the remaining candidates is cheaper than reading a large index
+        if (lookup.estimate > sEntityLoadCost * set.size()) {
+            SinkTraceCtx(mLogCtx) << "Skipping index lookup on " << lookup.filter << " with an estimate of " << lookup.estimate << " for " << set.size() << " candidates.";
+            continue;
+        }
+        const auto candidates = lookup.execute();
+        SinkTraceCtx(mLogCtx) << "Index lookup on " << lookup.filter << " found " << candidates.size() << " keys to intersect with, estimated " << lookup.estimate;
+        set = intersectSorted(set, toSortedSet(candidates));
+        appliedFilters << lookup.filter;
+        intersected++;
+    }
+    if (!intersected) {
+        return keys;
+    }
+
+    //Keep the order of the initial lookup, which may already be sorted
+    QVector<Identifier> result;
+    result.reserve(set.size());
+    for (const auto &id : keys) {
+        if (std::binary_search(set.cbegin(), set.cend(), id)) {
+            result << id;
+        }
+    }
+    SinkTraceCtx(mLogCtx) << "Intersection of " << intersected + 1 << " index lookups left " << result.size() << " keys.";
+    return result;
 }
 
-QVector<Identifier> TypeIndex::query(const Sink::QueryBase &query, QSet<QByteArrayList> &appliedFilters, QByteArray &appliedSorting, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId)
+QVector<Identifier> TypeIndex::query(const Sink::QueryBase &query, QSet<QByteArrayList> &appliedFilters, QByteArray &appliedSorting, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId, QByteArray *continuation)
 {
+    mWriter.flush(transaction);
+    if (continuation) {
+        continuation->clear();
+    }
     const auto baseFilters = query.getBaseFilters();
     for (auto it = baseFilters.constBegin(); it != baseFilters.constEnd(); it++) {
         if (it.value().comparator == QueryBase::Comparator::Fulltext) {
             appliedFilters << it.key();
-            appliedSorting = "date";
+            const auto order = query.sortProperty() == "relevance" ? FulltextIndex::RelevanceOrder : FulltextIndex::DateOrder;
+            appliedSorting = order == FulltextIndex::RelevanceOrder ? "relevance" : "date";
             if (FulltextIndex::exists(resourceInstanceId)) {
-                FulltextIndex fulltextIndex{resourceInstanceId};
-                const auto ids = fulltextIndex.lookup(it.value().value.toString());
-                SinkTraceCtx(mLogCtx) << "Fulltext index lookup found " << ids.size() << " keys.";
+                QVector<Identifier> ids;
+                FulltextIndex::withReader(resourceInstanceId, FulltextIndex::generation(transaction), [&](FulltextIndex &fulltextIndex) {
+                    if (!continuation) {
+                        ids = fulltextIndex.lookup(it.value().value.toString());
+                        return;
+                    }
+                    //Only the first page is read, so the first matches show up right away no matter how many there are
+                    QByteArray fulltextContinuation;
+                    ids = fulltextIndex.lookup(it.value().value.toString(), order, query.limit() ? query.limit() : sFulltextPageSize, fulltextContinuation);
+                    *continuation = fulltextContinuation.isEmpty() ? QByteArray{} : sFulltextContinuation + '\0' + fulltextContinuation;
+                });
+                SinkTraceCtx(mLogCtx) << "Fulltext index lookup found " << ids.size() << " keys. Indexed until revision " << FulltextIndex::indexedRevision(transaction);
                 return ids;
             }
             SinkTraceCtx(mLogCtx) << "Fulltext index doesn't exist.";
@@ -415,74 +954,108 @@ QVector<Identifier> TypeIndex::query(const Sink::QueryBase &query, QSet<QByteArr
         }
     }
 
-    for (auto it = baseFilters.constBegin(); it != baseFilters.constEnd(); it++) {
-        if (it.value().comparator == QueryBase::Comparator::Overlap) {
-            if (mSampledPeriodProperties.contains({it.key()[0], it.key()[1]})) {
-                Index index(sampledPeriodIndexName(it.key()[0], it.key()[1]), transaction);
-                const auto keys = sampledIndexLookup(index, query.getFilter(it.key()));
-                appliedFilters << it.key();
-                SinkTraceCtx(mLogCtx) << "Sampled period index lookup on" << it.key() << "found" << keys.size() << "keys.";
-                return keys;
-            } else {
-                SinkWarning() << "Overlap search without sampled period index";
-            }
-        }
+    if (!mPropertyIndexesAvailable) {
+        SinkTraceCtx(mLogCtx) << "The property indexes are being rebuilt";
     }
 
+    //We don't sort the results ourselves, so a lookup that yields the requested order wins over a cheaper one
     for (auto it = mGroupedSortedProperties.constBegin(); it != mGroupedSortedProperties.constEnd(); it++) {
-        if (query.hasFilter(it.key()) && query.sortProperty() == it.value()) {
+        if (mPropertyIndexesAvailable && query.hasFilter(it.key()) && query.sortProperty() == it.value()) {
             Index index(indexName(it.key(), it.value()), transaction);
-            const auto keys = indexLookup(index, query.getFilter(it.key()));
+            const auto keys = indexLookup(index, query.getFilter(it.key()), keyEncoder(it.key()));
             appliedFilters.insert({it.key()});
             appliedSorting = it.value();
             SinkTraceCtx(mLogCtx) << "Grouped sorted index lookup on " << it.key() << it.value() << " found " << keys.size() << " keys.";
-            return keys;
+            return intersect(applicableLookups(query, appliedFilters, transaction), keys, appliedFilters);
         }
     }
 
-    for (const auto &property : mSortedProperties) {
-        if (query.hasFilter(property)) {
-            Index index(sortedIndexName(property), transaction);
-            const auto keys = sortedIndexLookup(index, query.getFilter(property));
-            appliedFilters.insert({property});
-            SinkTraceCtx(mLogCtx) << "Sorted index lookup on " << property << " found " << keys.size() << " keys.";
-            return keys;
-        } else if (query.sortProperty() == property) {
-            Index index(sortedIndexName(property), transaction);
-            //FIXME Setting a limit here breaks our fetchMore logic,
-            //because our initial query will just return
-            //as many results as queried for. We now just query for 10 times
-            //the amount, so fetchMore works for a while, and we can avoid loading
-            //all index results. The primary usecase for this is loading all emails sorted
-            //by date (That's a lot of results).
-            const auto keys = sortedIndexLookup(index, query.limit() * 10);
-            appliedSorting = property;
+    auto lookups = applicableLookups(query, appliedFilters, transaction);
+
+    const auto sortProperty = query.sortProperty();
+    if (mPropertyIndexesAvailable && mSortedProperties.contains(sortProperty)) {
+        const auto sortLookup = std::find_if(lookups.begin(), lookups.end(), [&](const Lookup &lookup) { return lookup.filter == QByteArrayList{sortProperty}; });
+        if (sortLookup != lookups.end()) {
+            std::rotate(lookups.begin(), sortLookup, sortLookup + 1);
+        } else if (std::none_of(lookups.cbegin(), lookups.cend(), [&](const Lookup &lookup) { return lookup.filter.size() == 2 || mSortedProperties.contains(lookup.filter.first()); })) {
+            Index index(sortedIndexName(sortProperty), transaction);
+            //The primary usecase for this is loading all emails sorted by date (That's a lot of results),
+            //so we only read a page of the index and let the caller continue from the token once it needs more.
+            //We don't intersect the pages with the other indexes, since that would mean reading them in full,
+            //just to avoid loading the few entities we're going to filter anyways.
+            QByteArray indexContinuation;
+            const auto keys = sortedIndexLookup(index, continuation ? query.limit() : 0, indexContinuation);
+            if (continuation) {
+                *continuation = indexContinuation.isEmpty() ? QByteArray{} : sortProperty + '\0' + indexContinuation;
+            }
+            appliedSorting = sortProperty;
             return keys;
         }
     }
 
-    for (const auto &property : mProperties) {
-        if (query.hasFilter(property)) {
-            Index index(indexName(property), transaction);
-            const auto keys = indexLookup(index, query.getFilter(property));
-            appliedFilters.insert({property});
-            SinkTraceCtx(mLogCtx) << "Index lookup on " << property << " found " << keys.size() << " keys.";
-            return keys;
+    if (lookups.isEmpty()) {
+        SinkTraceCtx(mLogCtx) << "No matching index";
+        return {};
+    }
+
+    //Start with the cheapest lookup, so the intermediate results stay small
+    const auto primary = lookups.takeFirst();
+    const auto keys = primary.execute();
+    appliedFilters << primary.filter;
+    SinkTraceCtx(mLogCtx) << "Index lookup on " << primary.filter << " found " << keys.size() << " keys, estimated " << primary.estimate;
+    return intersect(lookups, keys, appliedFilters);
+}
+
+QVector<Identifier> TypeIndex::queryMore(QByteArray &continuation, int limit, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId)
+{
+    mWriter.flush(transaction);
+    //The token consists of the sort property, followed by the continuation of the sort index
+    const auto separator = continuation.indexOf('\0');
+    const auto sortProperty = continuation.left(separator);
+    if (separator >= 0 && sortProperty == sFulltextContinuation) {
+        auto fulltextContinuation = continuation.mid(separator + 1);
+        QVector<Identifier> ids;
+        if (FulltextIndex::exists(resourceInstanceId)) {
+            FulltextIndex::withReader(resourceInstanceId, FulltextIndex::generation(transaction), [&](FulltextIndex &fulltextIndex) {
+                ids = fulltextIndex.lookupMore(limit ? limit : sFulltextPageSize, fulltextContinuation);
+            });
+        } else {
+            fulltextContinuation.clear();
         }
+        continuation = fulltextContinuation.isEmpty() ? QByteArray{} : sFulltextContinuation + '\0' + fulltextContinuation;
+        SinkTraceCtx(mLogCtx) << "Fulltext index lookup continued with " << ids.size() << " keys.";
+        return ids;
     }
-    SinkTraceCtx(mLogCtx) << "No matching index";
-    return {};
+    if (separator < 0 || !mSortedProperties.contains(sortProperty)) {
+        SinkWarningCtx(mLogCtx) << "Invalid continuation token";
+        continuation.clear();
+        return {};
+    }
+    if (!mPropertyIndexesAvailable) {
+        SinkWarningCtx(mLogCtx) << "Tried to continue a lookup on " << sortProperty << " while the property indexes are being rebuilt";
+        continuation.clear();
+        return {};
+    }
+    auto indexContinuation = continuation.mid(separator + 1);
+    Index index(sortedIndexName(sortProperty), transaction);
+    const auto keys = sortedIndexLookup(index, limit, indexContinuation);
+    continuation = indexContinuation.isEmpty() ? QByteArray{} : sortProperty + '\0' + indexContinuation;
+    SinkTraceCtx(mLogCtx) << "Sorted index lookup on " << sortProperty << " continued with " << keys.size() << " keys.";
+    return keys;
 }
 
 QVector<Identifier> TypeIndex::lookup(const QByteArray &property, const QVariant &value,
     Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId, const QVector<Sink::Storage::Identifier> &filter)
 {
+    mWriter.flush(transaction);
     SinkTraceCtx(mLogCtx) << "Index lookup on property: " << property << mSecondaryProperties.keys() << mProperties;
     if (property == "fulltext") {
         if (FulltextIndex::exists(resourceInstanceId)) {
-            FulltextIndex fulltextIndex{resourceInstanceId};
             const Sink::Storage::Identifier entityId = filter.isEmpty() ? Sink::Storage::Identifier{} : filter.first();
-            const auto ids = fulltextIndex.lookup(value.toString(), entityId);
+            QVector<Identifier> ids;
+            FulltextIndex::withReader(resourceInstanceId, FulltextIndex::generation(transaction), [&](FulltextIndex &fulltextIndex) {
+                ids = fulltextIndex.lookup(value.toString(), entityId);
+            });
             SinkTraceCtx(mLogCtx) << "Fulltext index lookup found " << ids.size() << " keys.";
             return ids;
         }
@@ -490,9 +1063,13 @@ QVector<Identifier> TypeIndex::lookup(const QByteArray &property, const QVariant
         return {};
     }
     if (mProperties.contains(property)) {
+        if (!mPropertyIndexesAvailable) {
+            SinkWarningCtx(mLogCtx) << "Tried to lookup " << property << " while the property indexes are being rebuilt";
+            return {};
+        }
         QVector<Identifier> keys;
         Index index(indexName(property), transaction);
-        const auto lookupKey = getByteArray(value);
+        const auto lookupKey = IndexKey::encode(value, mPropertyTypes.value(property));
         index.lookup(lookupKey,
             [&](const QByteArray &value) {
                 keys << Identifier::fromInternalByteArray(value);
@@ -528,6 +1105,79 @@ QVector<Identifier> TypeIndex::lookup(const QByteArray &property, const QVariant
     return {};
 }
 
+bool TypeIndex::coveringLookup(const Sink::QueryBase &query, QVector<Identifier> &ids, QVector<QByteArray> &projections, QByteArray &appliedSorting, Sink::Storage::DataStore::Transaction &transaction)
+{
+    mWriter.flush(transaction);
+    //An empty list requests all properties, and the other filter stages may need any property
+    if (!mPropertyIndexesAvailable || query.requestedProperties.isEmpty() || !query.getFilterStages().isEmpty() || query.getPostQueryFilter()) {
+        return false;
+    }
+    const auto baseFilters = query.getBaseFilters();
+    for (const auto &index : mCoveringIndexes) {
+        if (!query.hasFilter(index.property) || (!query.sortProperty().isEmpty() && query.sortProperty() != index.sortProperty)) {
+            continue;
+        }
+        const auto filter = query.getFilter(index.property);
+        if (filter.comparator != QueryBase::Comparator::Equals && filter.comparator != QueryBase::Comparator::In) {
+            continue;
+        }
+        //The remaining filters are applied to the projections
+        const auto isCovered = [&](const QByteArray &property) { return index.properties.contains(property); };
+        if (!std::all_of(query.requestedProperties.cbegin(), query.requestedProperties.cend(), isCovered)) {
+            continue;
+        }
+        bool filtersCovered = true;
+        for (auto it = baseFilters.constBegin(); it != baseFilters.constEnd(); it++) {
+            if (it.value().comparator == QueryBase::Comparator::Fulltext || !std::all_of(it.key().cbegin(), it.key().cend(), isCovered)) {
+                filtersCovered = false;
+                break;
+            }
+        }
+        if (!filtersCovered) {
+            continue;
+        }
+
+        QByteArrayList prefixes;
+        if (filter.comparator == QueryBase::Comparator::Equals) {
+            prefixes << IndexKey::encode(filter.value, index.type);
+        } else {
+            for (const QVariant &value : filter.value.value<QVariantList>()) {
+                prefixes << IndexKey::encode(value, index.type);
+            }
+        }
+        prefixes.removeDuplicates();
+        const auto name = coveringIndexName(index.property, index.sortProperty);
+        const auto db = transaction.openDatabase(name);
+        struct Entry {
+            //The sort value followed by the id
+            QByteArray sortKey;
+            QByteArray projection;
+        };
+        std::vector<Entry> entries;
+        for (const auto &prefix : prefixes) {
+            const auto runStart = entries.size();
+            for (const auto &entry : db.prefix(prefix)) {
+                entries.push_back({QByteArray{entry.key.data() + prefix.size(), int(entry.key.size() - prefix.size())},
+                    QByteArray{entry.value.data(), int(entry.value.size())}});
+            }
+            //The run of each value is sorted, so merging them keeps the results in sort order for the limit
+            std::inplace_merge(entries.begin(), entries.begin() + runStart, entries.end(), [](const Entry &left, const Entry &right) {
+                return left.sortKey < right.sortKey;
+            });
+        }
+        ids.reserve(ids.size() + int(entries.size()));
+        projections.reserve(projections.size() + int(entries.size()));
+        for (const auto &entry : entries) {
+            ids << Identifier::readInternal(entry.sortKey.constData() + entry.sortKey.size() - Identifier::INTERNAL_REPR_SIZE);
+            projections << entry.projection;
+        }
+        appliedSorting = index.sortProperty;
+        SinkTraceCtx(mLogCtx) << "Covering index lookup on " << name << " found " << ids.size() << " entities.";
+        return true;
+    }
+    return false;
+}
+
 template <>
 void TypeIndex::index<QByteArray, QByteArray>(const QByteArray &leftName, const QByteArray &rightName, const QVariant &leftValue, const QVariant &rightValue, Sink::Storage::DataStore::Transaction &transaction)
 {
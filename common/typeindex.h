@@ -23,8 +23,11 @@
 #include "query.h"
 #include "log.h"
 #include "indexer.h"
+#include "indexstatistics.h"
+#include "indexwriter.h"
 #include "storage/key.h"
 #include <QByteArray>
+#include <QDateTime>
 
 namespace Sink {
 namespace Storage {
@@ -37,19 +40,32 @@ class TypeIndex
 public:
     TypeIndex(const QByteArray &type, const Sink::Log::Context &);
 
-    void addProperty(const QByteArray &property);
+    /**
+     * Index keys are encoded as @param type, see Sink::Storage::IndexKey.
+     *
+     * With an unknown type the type of the indexed values is used.
+     */
+    void addProperty(const QByteArray &property, int type = QMetaType::UnknownType);
+    void addSortedProperty(const QByteArray &property, int type);
+    void addPropertyWithSorting(const QByteArray &property, int type, const QByteArray &sortProperty, int sortType);
 
-    //FIXME We currently simply serialize based on the QVariant we get and ignore the index type
     template <typename T>
     void addProperty(const QByteArray &property)
     {
-        addProperty(property);
+        addProperty(property, qMetaTypeId<T>());
     }
 
     template <typename T>
-    void addSortedProperty(const QByteArray &property);
+    void addSortedProperty(const QByteArray &property)
+    {
+        addSortedProperty(property, qMetaTypeId<T>());
+    }
+
     template <typename T, typename S>
-    void addPropertyWithSorting(const QByteArray &property, const QByteArray &sortProperty);
+    void addPropertyWithSorting(const QByteArray &property, const QByteArray &sortProperty)
+    {
+        addPropertyWithSorting(property, qMetaTypeId<T>(), sortProperty, qMetaTypeId<S>());
+    }
 
     template <typename T, typename S>
     void addPropertyWithSorting()
@@ -69,6 +85,19 @@ public:
         addSortedProperty<typename T::Type>(T::name);
     }
 
+    /**
+     * Adds an index of @param property sorted by @param sortProperty, that stores the values of @param coveredProperties next to the ids.
+     *
+     * Queries that only filter on and request stored properties can be answered from this index without reading the entities.
+     */
+    void addCoveringIndex(const QByteArray &property, int type, const QByteArray &sortProperty, int sortType, const QByteArrayList &coveredProperties);
+
+    template <typename Property, typename SortProperty, typename ... CoveredProperties>
+    void addCoveringIndex()
+    {
+        addCoveringIndex(Property::name, qMetaTypeId<typename Property::Type>(), SortProperty::name, qMetaTypeId<typename SortProperty::Type>(), {CoveredProperties::name...});
+    }
+
     template <typename Left, typename Right>
     void addSecondaryProperty()
     {
@@ -78,25 +107,105 @@ public:
     template <typename Left, typename Right, typename CustomIndexer>
     void addSecondaryPropertyIndexer()
     {
-        mCustomIndexer << CustomIndexer::Ptr::create();
+        auto indexer = CustomIndexer::Ptr::create();
+        for (const auto &property : indexer->inputProperties()) {
+            mInputProperties.insert(property);
+        }
+        mCustomIndexer << indexer;
     }
 
-    template <typename Begin, typename End>
-    void addSampledPeriodIndex(const QByteArray &beginProperty, const QByteArray &endProperty);
+    /**
+     * Adds an index of the n-grams of the texts of @param property, for case insensitive Contains lookups.
+     *
+     * The candidates of a lookup contain all n-grams of the searched text, which the query verifies against the entities.
+     * See Sink::QueryBase::Comparator::containedTexts for the indexed texts.
+     */
+    void addNgramIndex(const QByteArray &property);
+
+    template <typename T>
+    void addNgramIndex()
+    {
+        addNgramIndex(T::name);
+    }
+
+    /**
+     * Returns the encoded recurrence of an entity, or nothing if it doesn't recur.
+     */
+    typedef std::function<QByteArray(const Sink::ApplicationDomain::ApplicationDomainType &)> RecurrenceEncoder;
+    /**
+     * Returns true if the encoded @param recurrence has an occurrence that overlaps the period from @param begin to @param end.
+     */
+    typedef std::function<bool(const QByteArray &recurrence, const QDateTime &begin, const QDateTime &end)> RecurrenceMatcher;
+
+    /**
+     * Adds an index of the periods from @param beginProperty to @param endProperty, for Overlap lookups.
+     *
+     * Every entity is stored once, by the order of magnitude of the length of its period and its begin,
+     * so a lookup only has to scan the begins from which a period of each length can reach the queried period.
+     *
+     * Recurring entities are indexed with the period of the whole series, as derived by the preprocessor,
+     * and the encoded recurrence from @param recurrence is stored next to it. Lookups only expand the recurrence
+     * within the queried period with @param occursIn, instead of indexing every occurrence.
+     * @param recurrenceSourceProperties are the properties the recurrence is derived from.
+     */
+    void addIntervalIndex(const QByteArray &beginProperty, const QByteArray &endProperty, const QByteArrayList &recurrenceSourceProperties = {}, const RecurrenceEncoder &recurrence = {}, const RecurrenceMatcher &occursIn = {});
 
     template <typename Begin, typename End>
-    void addSampledPeriodIndex()
+    void addIntervalIndex()
+    {
+        addIntervalIndex(Begin::name, End::name);
+    }
+
+    /**
+     * @param Recurrence provides the static sourceProperties, encode and occursIn functions.
+     */
+    template <typename Begin, typename End, typename Recurrence>
+    void addIntervalIndex()
     {
-        addSampledPeriodIndex<typename Begin::Type, typename End::Type>(Begin::name, End::name);
+        addIntervalIndex(Begin::name, End::name, Recurrence::sourceProperties(), &Recurrence::encode, &Recurrence::occursIn);
     }
 
-    void add(const Sink::Storage::Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId);
-    void modify(const Sink::Storage::Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &oldEntity, const Sink::ApplicationDomain::ApplicationDomainType &newEntity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId);
-    void remove(const Sink::Storage::Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId);
+    /**
+     * Returns false if @param entity recurs without an occurrence in the period of the Overlap @param filter on @param properties.
+     *
+     * This applies the same check as the lookups of the interval index, so filtered entities match the indexed ones.
+     */
+    bool occursIn(const QByteArrayList &properties, const Sink::QueryBase::Comparator &filter, const Sink::ApplicationDomain::ApplicationDomainType &entity) const;
+
+    /**
+     * While the property indexes are rebuilt they only contain the entities the rebuild already processed,
+     * so they are only updated for the entities where @param propertyIndexes is set.
+     *
+     * See Sink::Storage::EntityStore::continuePropertyIndexRebuild.
+     */
+    void add(const Sink::Storage::Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId, bool propertyIndexes = true);
+    void modify(const Sink::Storage::Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &oldEntity, const Sink::ApplicationDomain::ApplicationDomainType &newEntity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId, bool oldPropertyIndexes = true, bool newPropertyIndexes = true);
+    void remove(const Sink::Storage::Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId, bool propertyIndexes = true);
 
-    QVector<Sink::Storage::Identifier> query(const Sink::QueryBase &query, QSet<QByteArrayList> &appliedFilters, QByteArray &appliedSorting, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId);
+    /**
+     * Looks up the entities of @param query.
+     *
+     * If the result is only read from the sort index, and a @param continuation is passed, just the first query.limit() ids are read.
+     * Fulltext lookups are read in pages as well, in date order, or by relevance if the query is sorted by "relevance".
+     * The continuation is then set to an opaque token that queryMore resumes the lookup from, and left empty otherwise.
+     */
+    QVector<Sink::Storage::Identifier> query(const Sink::QueryBase &query, QSet<QByteArrayList> &appliedFilters, QByteArray &appliedSorting, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId, QByteArray *continuation = nullptr);
+    /**
+     * Reads up to @param limit further ids of a sorted lookup, starting after the last id @param continuation was handed out for.
+     *
+     * The continuation is updated to resume after the returned ids, or cleared once the index has been exhausted.
+     */
+    QVector<Sink::Storage::Identifier> queryMore(QByteArray &continuation, int limit, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId = {});
     QVector<Sink::Storage::Identifier> lookup(const QByteArray &property, const QVariant &value, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId = {}, const QVector<Sink::Storage::Identifier> &filter = {});
 
+    /**
+     * Looks up @param query in a covering index that stores all properties the query filters on, sorts by and requests.
+     *
+     * The stored values are returned in @param projections, see Sink::Storage::Projection.
+     * Returns false if no covering index covers the query.
+     */
+    bool coveringLookup(const Sink::QueryBase &query, QVector<Sink::Storage::Identifier> &ids, QVector<QByteArray> &projections, QByteArray &appliedSorting, Sink::Storage::DataStore::Transaction &transaction);
+
     template <typename Left, typename Right>
     QVector<QByteArray> secondaryLookup(const QVariant &value)
     {
@@ -124,6 +233,14 @@ public:
     template <typename LeftType, typename RightType>
     void unindex(const QByteArray &leftName, const QByteArray &rightName, const QVariant &leftValue, const QVariant &rightValue, Sink::Storage::DataStore::Transaction &transaction);
 
+    /**
+     * Removes everything from the value, sorted, covering, interval and n-gram indexes, so they can be rebuilt with addToPropertyIndexes.
+     *
+     * This is required when the encoding of the index keys changed. The other indexes are left untouched.
+     */
+    void clearPropertyIndexes(Sink::Storage::DataStore::Transaction &transaction);
+    void addToPropertyIndexes(const Sink::Storage::Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction);
+
     void commitTransaction();
     void abortTransaction();
 
@@ -134,22 +251,78 @@ public:
 
 private:
     friend class Sink::Storage::EntityStore;
-    void updateIndex(Action action, const Sink::Storage::Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction, const QByteArray &resourceInstanceId);
+    /**
+     * Updates the indexes that depend on any of @param changedProperties, or all indexes if it is null.
+     */
+    void updatePropertyIndexes(Action action, const Sink::Storage::Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction, const QSet<QByteArray> *changedProperties = nullptr);
+    /**
+     * The properties any index depends on that differ between @param oldEntity and @param newEntity.
+     */
+    QSet<QByteArray> changedProperties(const Sink::ApplicationDomain::ApplicationDomainType &oldEntity, const Sink::ApplicationDomain::ApplicationDomainType &newEntity) const;
+    struct Lookup;
+    /**
+     * The lookups of all indexes that apply to filters that are not yet in @param appliedFilters, cheapest first.
+     */
+    QVector<Lookup> applicableLookups(const Sink::QueryBase &query, const QSet<QByteArrayList> &appliedFilters, Sink::Storage::DataStore::Transaction &transaction);
+    /**
+     * Estimates the number of entries of @param indexName matching @param keys, or a range if there are no keys.
+     */
+    qint64 estimate(const QByteArray &indexName, const QByteArrayList &keys, Sink::Storage::DataStore::Transaction &transaction) const;
+    /**
+     * Intersects @param keys with @param lookups, unless filtering the remaining candidates is expected to be cheaper.
+     *
+     * The order of @param keys is preserved.
+     */
+    QVector<Sink::Storage::Identifier> intersect(const QVector<Lookup> &lookups, const QVector<Sink::Storage::Identifier> &keys, QSet<QByteArrayList> &appliedFilters);
+    void updateStatistics(Action action, const QByteArray &indexName, const QByteArray &key);
+    void update(Action action, const QByteArray &indexName, const QByteArray &key, const QByteArray &value);
     QByteArray indexName(const QByteArray &property, const QByteArray &sortProperty = QByteArray()) const;
     QByteArray sortedIndexName(const QByteArray &property) const;
-    QByteArray sampledPeriodIndexName(const QByteArray &rangeBeginProperty, const QByteArray &rangeEndProperty) const;
+    QByteArray coveringIndexName(const QByteArray &property, const QByteArray &sortProperty) const;
+    std::function<QByteArray(const QVariant &)> keyEncoder(const QByteArray &property) const;
+    QByteArray intervalIndexName(const QByteArray &beginProperty, const QByteArray &endProperty) const;
+    QByteArray ngramIndexName(const QByteArray &property) const;
+    QByteArray recurrenceIndexName(const QByteArray &beginProperty, const QByteArray &endProperty) const;
     Sink::Log::Context mLogCtx;
     QByteArray mType;
     QByteArrayList mProperties;
     QByteArrayList mSortedProperties;
     QMap<QByteArray, QByteArray> mGroupedSortedProperties;
+    struct CoveringIndex {
+        QByteArray property;
+        int type;
+        QByteArray sortProperty;
+        //All stored properties, including the property and sort property
+        QByteArrayList properties;
+    };
+    QList<CoveringIndex> mCoveringIndexes;
+    struct IntervalIndex {
+        QByteArray beginProperty;
+        QByteArray endProperty;
+        //The begin and end property and the properties the recurrence is derived from
+        QByteArrayList inputProperties;
+        RecurrenceEncoder recurrence;
+        RecurrenceMatcher occursIn;
+        std::function<void(Action, const Sink::Storage::Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity)> indexer;
+    };
+    QList<IntervalIndex> mIntervalIndexes;
+    QByteArrayList mNgramProperties;
+    //<Property, QMetaType of the index keys>
+    QHash<QByteArray, int> mPropertyTypes;
     //<Property, ResultProperty>
     QMap<QByteArray, QByteArray> mSecondaryProperties;
-    QSet<QPair<QByteArray, QByteArray>> mSampledPeriodProperties;
+    //All properties that are compared on modification
+    QSet<QByteArray> mInputProperties;
     QList<Sink::Indexer::Ptr> mCustomIndexer;
-    Sink::Storage::DataStore::Transaction *mTransaction;
+    Sink::Storage::DataStore::Transaction *mTransaction = nullptr;
+    //Incomplete property indexes are not used for lookups while they are rebuilt
+    bool mPropertyIndexesAvailable = true;
+    //Buffers the updates of the value, sorted, covering, interval and n-gram indexes until commit or the next lookup
+    IndexWriter mWriter;
+    //<Index name, changes of the statistics that are merged on commit>
+    QHash<QByteArray, IndexStatistics> mStatisticsChanges;
     QHash<QByteArray, std::function<void(Action, const Sink::Storage::Identifier &identifier, const QVariant &value, Sink::Storage::DataStore::Transaction &transaction)>> mIndexer;
     QHash<QByteArray, std::function<void(Action, const Sink::Storage::Identifier &identifier, const QVariant &value, Sink::Storage::DataStore::Transaction &transaction)>> mSortIndexer;
     QHash<QByteArray, std::function<void(Action, const Sink::Storage::Identifier &identifier, const QVariant &value, const QVariant &sortValue, Sink::Storage::DataStore::Transaction &transaction)>> mGroupedSortIndexer;
-    QHash<QPair<QByteArray, QByteArray>, std::function<void(Action, const Sink::Storage::Identifier &identifier, const QVariant &begin, const QVariant &end, Sink::Storage::DataStore::Transaction &transaction)>> mSampledPeriodIndexer;
+    QHash<QByteArray, std::function<void(Action, const Sink::Storage::Identifier &identifier, const Sink::ApplicationDomain::ApplicationDomainType &entity, Sink::Storage::DataStore::Transaction &transaction)>> mCoveringIndexer;
 };
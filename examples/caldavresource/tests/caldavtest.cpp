@@ -1,4 +1,5 @@
 #include <QTest>
+#include <QUuid>
 
 #include <KDAV2/DavCollectionsFetchJob>
 #include <KDAV2/DavCollectionCreateJob>
@@ -1,5 +1,6 @@
 
 #include <QTest>
+#include <QUuid>
 
 
 #include "common/resourcecontrol.h"
@@ -22,7 +22,6 @@
 #include "facade.h"
 #include "resourceconfig.h"
 #include "commands.h"
-#include "index.h"
 #include "log.h"
 #include "definitions.h"
 #include "inspection.h"
@@ -975,9 +974,6 @@ protected:
         auto synchronizationStore = QSharedPointer<Sink::Storage::DataStore>::create(Sink::storageLocation(), mResourceContext.instanceId() + ".synchronization", Sink::Storage::DataStore::ReadOnly);
         auto synchronizationTransaction = synchronizationStore->createTransaction(Sink::Storage::DataStore::ReadOnly);
 
-        auto mainStore = QSharedPointer<Sink::Storage::DataStore>::create(Sink::storageLocation(), mResourceContext.instanceId(), Sink::Storage::DataStore::ReadOnly);
-        auto transaction = mainStore->createTransaction(Sink::Storage::DataStore::ReadOnly);
-
         Sink::Storage::EntityStore entityStore(mResourceContext, {"imapresource"});
         auto syncStore = QSharedPointer<Sink::SynchronizerStore>::create(synchronizationTransaction);
 
@@ -1063,13 +1059,8 @@ protected:
                 SinkLog() << "Inspecting cache integrity" << remoteId;
 
                 int expectedCount = 0;
-                Index index("mail.index.folder", transaction);
-                index.lookup(entityId, [&](const QByteArray &sinkId) {
+                entityStore.indexLookup<Sink::ApplicationDomain::Mail, Sink::ApplicationDomain::Mail::Folder>(entityId, [&](const QByteArray &sinkId) {
                     expectedCount++;
-                    return true;
-                },
-                [&](const Index::Error &error) {
-                    SinkWarning() << "Error in index: " <<  error.message << property;
                 });
 
                 auto set = KIMAP2::ImapSet::fromImapSequenceSet("1:*");
@@ -21,7 +21,6 @@
 
 #include "facade.h"
 #include "resourceconfig.h"
-#include "index.h"
 #include "log.h"
 #include "definitions.h"
 #include "libmaildir/maildir.h"
@@ -493,9 +492,6 @@ protected:
         auto synchronizationStore = QSharedPointer<Sink::Storage::DataStore>::create(Sink::storageLocation(), mResourceContext.instanceId() + ".synchronization", Sink::Storage::DataStore::ReadOnly);
         auto synchronizationTransaction = synchronizationStore->createTransaction(Sink::Storage::DataStore::ReadOnly);
 
-        auto mainStore = QSharedPointer<Sink::Storage::DataStore>::create(Sink::storageLocation(), mResourceContext.instanceId(), Sink::Storage::DataStore::ReadOnly);
-        auto transaction = mainStore->createTransaction(Sink::Storage::DataStore::ReadOnly);
-
         Sink::Storage::EntityStore entityStore(mResourceContext, {"maildirresource"});
         auto syncStore = QSharedPointer<SynchronizerStore>::create(synchronizationTransaction);
 
@@ -544,13 +540,8 @@ protected:
                 }
 
                 int expectedCount = 0;
-                Index index("mail.index.folder", transaction);
-                index.lookup(entityId, [&](const QByteArray &sinkId) {
+                entityStore.indexLookup<Sink::ApplicationDomain::Mail, Sink::ApplicationDomain::Mail::Folder>(entityId, [&](const QByteArray &sinkId) {
                     expectedCount++;
-                    return true;
-                },
-                [&](const Index::Error &error) {
-                    SinkWarning() << "Error in index: " <<  error.message << property;
                 });
 
                 QDir dir(remoteId + "/cur");
@@ -21,6 +21,8 @@
 #include <QObject> // tr()
 #include <QTimer>
 #include <QDir>
+#include <QEventLoop>
+#include <algorithm>
 
 #include "common/resource.h"
 #include "common/storage.h"
@@ -28,6 +30,9 @@
 #include "common/log.h"
 #include "common/storage.h"
 #include "common/definitions.h"
+#include "common/resourcecontrol.h"
+#include "common/storage/metrics.h"
+#include "common/indexstatistics.h"
 
 #include "sinksh_utils.h"
 #include "state.h"
@@ -76,25 +81,135 @@ void statResource(const QString &resource, const State &state)
     state.printLine(QObject::tr("Fulltext index size [kb]: %1").arg(dataSize / 1024), 1);
 
     state.printLine();
+
+    //The distinct keys are approximated by the used buckets of the histogram
+    state.printLine(QObject::tr("Index statistics (entries, approximate distinct keys, largest key bucket):"), 1);
+    for (const auto &databaseName : databases) {
+        if (!databaseName.endsWith(".index.stats")) {
+            continue;
+        }
+        auto db = transaction.openDatabase(databaseName);
+        for (const auto &entry : db.cursor()) {
+            const auto statistics = IndexStatistics::fromByteArray(QByteArray{entry.value.data(), int(entry.value.size())});
+            state.printLine(QObject::tr("%1:\t%2\t%3\t%4")
+                    .arg(QString::fromUtf8(entry.key.data(), int(entry.key.size())))
+                    .arg(statistics.entries())
+                    .arg(statistics.usedBuckets())
+                    .arg(statistics.largestBucket()), 1);
+        }
+    }
+
+    state.printLine();
+}
+
+using Sink::Storage::OperationMetrics;
+
+static QVector<OperationMetrics::Snapshot> fetchMetrics(const QByteArray &resource, const State &state)
+{
+    auto future = Sink::ResourceControl::storageMetrics(resource).exec();
+    future.waitForFinished();
+    if (future.errorCode()) {
+        state.printError(QObject::tr("Failed to fetch the storage metrics of %1: %2").arg(QString{resource}).arg(future.errorMessage()));
+        return {};
+    }
+    return OperationMetrics::Snapshot::fromJson(future.value());
+}
+
+/*
+ * Prints what each database of the resource process did since the previous snapshot, the busiest first.
+ */
+static void printMetricsDelta(const QByteArray &resource, const QVector<OperationMetrics::Snapshot> &previous, const QVector<OperationMetrics::Snapshot> &current, double seconds, const State &state)
+{
+    struct Row {
+        QByteArray name;
+        OperationMetrics::Operation operation;
+        OperationMetrics::Counters counters;
+    };
+    QVector<Row> rows;
+    quint64 totalNsecs = 0;
+    for (const auto &snapshot : current) {
+        const auto before = std::find_if(previous.constBegin(), previous.constEnd(), [&](const OperationMetrics::Snapshot &s) { return s.name == snapshot.name; });
+        for (int op = 0; op < OperationMetrics::OperationCount; op++) {
+            auto counters = snapshot.operations[op];
+            if (before != previous.constEnd()) {
+                counters = counters - before->operations[op];
+            }
+            if (counters.count) {
+                rows << Row{snapshot.name, OperationMetrics::Operation(op), counters};
+                totalNsecs += counters.nsecs;
+            }
+        }
+    }
+    std::sort(rows.begin(), rows.end(), [](const Row &lhs, const Row &rhs) { return lhs.counters.nsecs > rhs.counters.nsecs; });
+
+    state.printLine("Resource " + resource + ":");
+    if (rows.isEmpty()) {
+        state.printLine(QObject::tr("No storage activity"), 1);
+    }
+    for (const auto &row : rows) {
+        state.printLine(QObject::tr("%1 %2:\t%3 [ops/s]\t%4 [kb/s]\t%5% of the time\tp50 < %6 [us]\tp99 < %7 [us]")
+                .arg(QString{row.name})
+                .arg(OperationMetrics::operationName(row.operation))
+                .arg(row.counters.count / seconds, 0, 'f', 1)
+                .arg(row.counters.bytes / 1024.0 / seconds, 0, 'f', 1)
+                .arg(totalNsecs ? row.counters.nsecs * 100 / totalNsecs : 0)
+                .arg(row.counters.latencyPercentile(0.5))
+                .arg(row.counters.latencyPercentile(0.99)), 1);
+    }
+    state.printLine();
 }
 
-bool statAllResources(State &state)
+/*
+ * Periodically prints the storage activity of the resource processes until interrupted.
+ */
+static bool statLive(const QByteArrayList &resources, int interval, State &state)
 {
+    QMap<QByteArray, QVector<OperationMetrics::Snapshot>> previous;
+    for (const auto &resource : resources) {
+        previous.insert(resource, fetchMetrics(resource, state));
+    }
+    while (true) {
+        QEventLoop loop;
+        QTimer::singleShot(interval, &loop, &QEventLoop::quit);
+        loop.exec();
+        for (const auto &resource : resources) {
+            const auto current = fetchMetrics(resource, state);
+            printMetricsDelta(resource, previous.value(resource), current, interval / 1000.0, state);
+            previous.insert(resource, current);
+        }
+    }
+    return false;
+}
+
+static QByteArrayList allResources()
+{
+    QByteArrayList resources;
     Sink::Query query;
     for (const auto &r : SinkshUtils::getStore("resource").read(query)) {
-        statResource(SinkshUtils::parseUid(r.identifier()), state);
+        resources << SinkshUtils::parseUid(r.identifier());
     }
-    return false;
+    return resources;
 }
 
 bool stat(const QStringList &args, State &state)
 {
-    if (args.isEmpty()) {
-        return statAllResources(state);
+    const auto options = SyntaxTree::parseOptions(args);
+    QByteArrayList resources;
+    //Arguments following the flag end up as its values
+    for (const auto &r : options.positionalArguments + options.options.value("live")) {
+        resources << SinkshUtils::parseUid(r.toUtf8());
+    }
+    if (resources.isEmpty()) {
+        resources = allResources();
+    }
+
+    if (options.options.contains("live")) {
+        const auto interval = options.options.value("interval").value(0, "1000").toInt();
+        return statLive(resources, qMax(interval, 100), state);
     }
 
-    for (const auto &r : args) {
-        statResource(SinkshUtils::parseUid(r.toUtf8()), state);
+    for (const auto &r : resources) {
+        statResource(r, state);
     }
     return false;
 }
@@ -103,6 +218,8 @@ Syntax::List syntax()
 {
     Syntax state("stat", QObject::tr("Shows database usage for the resources requested"), &SinkStat::stat, Syntax::NotInteractive);
     state.addPositionalArgument({"resourceId", "Show statistics of the given resource(s). If no resource is provided, show statistics of all resources", false, true});
+    state.addFlag("live", "Periodically show the storage activity of the running resource(s), until interrupted");
+    state.addParameter("interval", {"ms", "The interval of the live view in milliseconds (defaults to 1000)"});
     state.completer = &SinkshUtils::resourceCompleter;
     return Syntax::List() << state;
 }
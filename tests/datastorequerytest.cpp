@@ -131,7 +131,171 @@ private slots:
         }
     }
 
+    void testIndexIntersection()
+    {
+        using namespace Sink;
+        ResourceContext resourceContext{resourceInstanceIdentifier.toUtf8(), "dummy", AdaptorFactoryRegistry::instance().getFactories("test")};
+        Storage::EntityStore store(resourceContext, {});
+
+        const auto date = QDateTime::fromString("2018-05-23T13:49:41Z", Qt::ISODate);
+        auto createMail = [&](const QByteArray &folder, bool draft, const QDateTime &date) {
+            auto mail = ApplicationDomain::ApplicationDomainType::createEntity<ApplicationDomain::Mail>("res1");
+            mail.setExtractedMessageId("messageid");
+            mail.setFolder(folder);
+            mail.setDraft(draft);
+            mail.setExtractedDate(date);
+            store.add("mail", mail, false);
+            return mail.identifier();
+        };
+
+        store.startTransaction(Storage::DataStore::ReadWrite);
+        const auto match = createMail("folder1", true, date);
+        createMail("folder1", false, date);
+        createMail("folder2", true, date);
+        createMail("folder1", true, date.addDays(-10));
+
+        {
+            Query query;
+            query.filter<ApplicationDomain::Mail::Folder>("folder1");
+            query.filter<ApplicationDomain::Mail::Draft>(true);
+            QSet<QByteArrayList> appliedFilters;
+            QByteArray appliedSorting;
+            const auto ids = store.indexLookup("mail", query, appliedFilters, appliedSorting);
+            QCOMPARE(ids.size(), 2);
+            QCOMPARE(appliedFilters, (QSet<QByteArrayList>{{"folder"}, {"draft"}}));
+        }
+
+        {
+            Query query;
+            query.filter<ApplicationDomain::Mail::Folder>("folder1");
+            query.filter<ApplicationDomain::Mail::Draft>(true);
+            query.filter<ApplicationDomain::Mail::Date>(QueryBase::Comparator(QVariantList{date.addDays(-1), date.addDays(1)}, QueryBase::Comparator::Within));
+            QSet<QByteArrayList> appliedFilters;
+            QByteArray appliedSorting;
+            const auto ids = store.indexLookup("mail", query, appliedFilters, appliedSorting);
+            QCOMPARE(ids.size(), 1);
+            QCOMPARE(ids.first().toDisplayByteArray(), match);
+            QCOMPARE(appliedFilters, (QSet<QByteArrayList>{{"folder"}, {"draft"}, {"date"}}));
+
+            auto resultset = DataStoreQuery{query, "mail", store}.execute();
+            QCOMPARE(readResult(resultset).creations, QVector<QByteArray>{match});
+        }
+
+        //The order of the grouped sorted index is preserved
+        {
+            Query query;
+            query.filter<ApplicationDomain::Mail::Folder>("folder1");
+            query.filter<ApplicationDomain::Mail::Draft>(true);
+            query.sort<ApplicationDomain::Mail::Date>();
+            QSet<QByteArrayList> appliedFilters;
+            QByteArray appliedSorting;
+            const auto ids = store.indexLookup("mail", query, appliedFilters, appliedSorting);
+            QCOMPARE(ids.size(), 2);
+            QCOMPARE(ids.first().toDisplayByteArray(), match);
+            QCOMPARE(appliedSorting, QByteArray{"date"});
+            QCOMPARE(appliedFilters, (QSet<QByteArrayList>{{"folder"}, {"draft"}}));
+        }
+    }
+
+    void testCoveringIndex()
+    {
+        using namespace Sink;
+        ResourceContext resourceContext{resourceInstanceIdentifier.toUtf8(), "dummy", AdaptorFactoryRegistry::instance().getFactories("test")};
+        Storage::EntityStore store(resourceContext, {});
+
+        const auto date = QDateTime::fromString("2018-05-23T13:49:41Z", Qt::ISODate);
+        auto createMail = [&](const QByteArray &folder, const QString &subject, bool unread, const QDateTime &date) {
+            auto mail = ApplicationDomain::ApplicationDomainType::createEntity<ApplicationDomain::Mail>("res1");
+            mail.setExtractedMessageId("messageid");
+            mail.setFolder(folder);
+            mail.setExtractedSubject(subject);
+            mail.setExtractedSender(ApplicationDomain::Mail::Contact{"Doe", "doe@example.org"});
+            mail.setUnread(unread);
+            mail.setExtractedDate(date);
+            store.add("mail", mail, false);
+            return mail;
+        };
+
+        store.startTransaction(Storage::DataStore::ReadWrite);
+        const auto older = createMail("folder1", "older", true, date.addDays(-1));
+        const auto newer = createMail("folder1", "newer", false, date);
+        createMail("folder2", "other", true, date);
+        auto modified = createMail("folder2", "moved", true, date.addDays(-2));
+        modified.setFolder("folder1");
+        store.modify("mail", modified, QByteArrayList{}, false);
+
+        auto load = [&](const Query &query) {
+            QVector<ApplicationDomain::ApplicationDomainType> entities;
+            auto resultset = DataStoreQuery{query, "mail", store}.execute();
+            resultset.replaySet(0, 0, [&](const ResultSet::Result &r) {
+                entities << r.entity;
+            });
+            return entities;
+        };
 
+        {
+            Query query;
+            query.filter<ApplicationDomain::Mail::Folder>("folder1");
+            query.sort<ApplicationDomain::Mail::Date>();
+            query.request<ApplicationDomain::Mail::Subject>();
+            query.request<ApplicationDomain::Mail::Sender>();
+            query.request<ApplicationDomain::Mail::Unread>();
+            const auto entities = load(query);
+            QCOMPARE(entities.size(), 3);
+            QCOMPARE(entities.at(0).identifier(), newer.identifier());
+            QCOMPARE(entities.at(1).identifier(), older.identifier());
+            QCOMPARE(entities.at(2).identifier(), modified.identifier());
+            const auto entity = entities.at(1);
+            QCOMPARE(entity.getProperty(ApplicationDomain::Mail::Subject::name).toString(), QString{"older"});
+            QCOMPARE(entity.getProperty(ApplicationDomain::Mail::Sender::name).value<ApplicationDomain::Mail::Contact>().emailAddress, QString{"doe@example.org"});
+            QCOMPARE(entity.getProperty(ApplicationDomain::Mail::Unread::name).toBool(), true);
+            //Only the covered properties are available, since the entity was never read
+            QVERIFY(!entity.availableProperties().contains(ApplicationDomain::Mail::MimeMessage::name));
+        }
+
+        //The covered properties can be filtered on
+        {
+            Query query;
+            query.filter<ApplicationDomain::Mail::Folder>("folder1");
+            query.filter<ApplicationDomain::Mail::Unread>(true);
+            query.request<ApplicationDomain::Mail::Subject>();
+            const auto entities = load(query);
+            QCOMPARE(entities.size(), 2);
+        }
+
+        //Requesting a property that is not covered reads the entities
+        {
+            Query query;
+            query.filter<ApplicationDomain::Mail::Folder>("folder1");
+            query.request<ApplicationDomain::Mail::Subject>();
+            query.request<ApplicationDomain::Mail::MimeMessage>();
+            const auto entities = load(query);
+            QCOMPARE(entities.size(), 3);
+            QVERIFY(entities.first().availableProperties().contains(ApplicationDomain::Mail::MimeMessage::name));
+        }
+
+        //The results of multiple values are merged in sort order
+        {
+            Query query;
+            query.filter<ApplicationDomain::Mail::Folder>(QueryBase::Comparator(QVariantList{QByteArray{"folder1"}, QByteArray{"folder2"}}, QueryBase::Comparator::In));
+            query.sort<ApplicationDomain::Mail::Date>();
+            query.request<ApplicationDomain::Mail::Subject>();
+            const auto entities = load(query);
+            QCOMPARE(entities.size(), 4);
+            QCOMPARE(entities.at(0).getProperty(ApplicationDomain::Mail::Date::name).toDateTime(), date);
+            QCOMPARE(entities.at(1).getProperty(ApplicationDomain::Mail::Date::name).toDateTime(), date);
+            QCOMPARE(entities.at(2).identifier(), older.identifier());
+            QCOMPARE(entities.at(3).identifier(), modified.identifier());
+        }
+
+        store.remove("mail", older, false);
+        {
+            Query query;
+            query.filter<ApplicationDomain::Mail::Folder>("folder1");
+            query.request<ApplicationDomain::Mail::Subject>();
+            QCOMPARE(load(query).size(), 2);
+        }
+    }
 };
 
 QTEST_MAIN(DataStoreQueryTest)
@@ -247,6 +247,42 @@ class DummyResourceWriteBenchmark : public QObject
         std::cout << std::endl;
     }
 
+    /*
+     * Writes monotonically increasing revisions the way the entity store does,
+     * either with regular writes or in append mode.
+     */
+    qint64 writeRevisions(int num, bool append)
+    {
+        Sink::Storage::DataStore(Sink::storageLocation(), "testSortedAppend").removeFromDisk();
+        Sink::Storage::DataStore store(Sink::storageLocation(), {"testSortedAppend", Sink::Storage::DataStore::baseDbs()}, Sink::Storage::DataStore::ReadWrite);
+
+        int bufferSize = 0;
+        const auto buffer = createEntityBuffer(1000, bufferSize);
+
+        QTime time;
+        time.start();
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+        for (int i = 1; i <= num; i++) {
+            auto db = transaction.openDatabase("mail.main", {}, Sink::Storage::IntegerKeys);
+            auto revisions = transaction.openDatabase("revisions", {}, Sink::Storage::IntegerKeys);
+            if (append) {
+                db.append(size_t(i), buffer);
+                revisions.append(size_t(i), "uid");
+            } else {
+                db.write(size_t(i), buffer);
+                revisions.write(size_t(i), "uid");
+            }
+            if ((i % 1000) == 0) {
+                transaction.commit();
+                transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+            }
+        }
+        transaction.commit();
+        const auto elapsed = time.elapsed();
+        store.removeFromDisk();
+        return elapsed;
+    }
+
 private slots:
     void initTestCase()
     {
@@ -284,6 +320,22 @@ private slots:
         testDiskUsage(1000);
     }
 
+    void testSortedAppend()
+    {
+        const int num = 50000;
+        const auto writeTime = writeRevisions(num, false);
+        const auto appendTime = writeRevisions(num, true);
+
+        HAWD::Dataset dataset("dummy_write_append", m_hawdState);
+        HAWD::Dataset::Row row = dataset.row();
+        row.setValue("rows", num);
+        row.setValue("write", (qreal)num/writeTime);
+        row.setValue("append", (qreal)num/appendTime);
+        row.setTimestamp(mTimeStamp);
+        dataset.insertRow(row);
+        HAWD::Formatter::print(dataset);
+    }
+
     // This allows to run individual parts without doing a cleanup, but still cleaning up normally
     void testCleanupForCompleteTest()
     {
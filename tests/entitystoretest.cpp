@@ -191,6 +191,86 @@ private slots:
         store.abortTransaction();
 
     }
+
+    void testPropertyIndexRebuild()
+    {
+        using namespace Sink;
+        ResourceContext resourceContext{resourceInstanceIdentifier.toUtf8(), "dummy", AdaptorFactoryRegistry::instance().getFactories("test")};
+        Storage::EntityStore store(resourceContext, {});
+
+        auto createMail = [](const QByteArray &messageId) {
+            auto mail = ApplicationDomain::ApplicationDomainType::createEntity<ApplicationDomain::Mail>("res1");
+            mail.setExtractedMessageId(messageId);
+            mail.setExtractedSubject("subject");
+            //FIXME see above
+            mail.setDraft(false);
+            return mail;
+        };
+        auto lookup = [&](const QByteArray &messageId) {
+            store.startTransaction(Storage::DataStore::ReadOnly);
+            QByteArrayList uids;
+            store.indexLookup("mail", ApplicationDomain::Mail::MessageId::name, messageId, [&](const QByteArray &uid) {
+                uids << uid;
+            });
+            store.abortTransaction();
+            return uids;
+        };
+
+        auto mail1 = createMail("messageid1");
+        auto mail2 = createMail("messageid2");
+        store.startTransaction(Storage::DataStore::ReadWrite);
+        //The revisions of other types don't count towards the progress of mails
+        store.add("event", ApplicationDomain::ApplicationDomainType::createEntity<ApplicationDomain::Event>("res1"), false);
+        store.add("mail", mail1, false);
+        store.add("mail", mail2, false);
+        store.startPropertyIndexRebuild({"mail"});
+        QVERIFY(store.isRebuildingPropertyIndexes("mail"));
+        QVERIFY(!store.isRebuildingPropertyIndexes("event"));
+        store.commitTransaction();
+
+        //The lookup falls back to scanning the entities
+        QCOMPARE(lookup("messageid2"), QByteArrayList{mail2.identifier()});
+
+        qint64 progress = 0;
+        qint64 total = 0;
+        store.startTransaction(Storage::DataStore::ReadWrite);
+        QCOMPARE(store.continuePropertyIndexRebuild(1, progress, total), QByteArray{"mail"});
+        QCOMPARE(progress, qint64{1});
+        QCOMPARE(total, qint64{2});
+        store.commitTransaction();
+
+        //Modify the processed entity, remove the unprocessed one, and add a new one while the rebuild is running
+        store.startTransaction(Storage::DataStore::ReadWrite);
+        mail1.setExtractedMessageId("messageid1b");
+        store.modify("mail", mail1, QByteArrayList{}, false);
+        store.remove("mail", mail2, false);
+        auto mail3 = createMail("messageid3");
+        store.add("mail", mail3, false);
+        store.commitTransaction();
+
+        int batches = 0;
+        while (true) {
+            store.startTransaction(Storage::DataStore::ReadWrite);
+            const auto type = store.continuePropertyIndexRebuild(1, progress, total);
+            store.commitTransaction();
+            if (type.isEmpty()) {
+                break;
+            }
+            batches++;
+        }
+        //The remaining four revisions, one at a time
+        QCOMPARE(batches, 4);
+        QCOMPARE(progress, total);
+
+        store.startTransaction(Storage::DataStore::ReadOnly);
+        QVERIFY(!store.isRebuildingPropertyIndexes("mail"));
+        store.abortTransaction();
+
+        QVERIFY(lookup("messageid1").isEmpty());
+        QCOMPARE(lookup("messageid1b"), QByteArrayList{mail1.identifier()});
+        QVERIFY(lookup("messageid2").isEmpty());
+        QCOMPARE(lookup("messageid3"), QByteArrayList{mail3.identifier()});
+    }
 };
 
 QTEST_MAIN(EntityStoreTest)
@@ -0,0 +1,168 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) version 3, or any
+ * later version accepted by the membership of KDE e.V. (or its
+ * successor approved by the membership of KDE e.V.), which shall
+ * act as a proxy defined in Section 6 of version 3 of the license.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <QTest>
+
+#include <QString>
+
+#include "testimplementations.h"
+
+#include <common/resultprovider.h>
+#include <common/definitions.h>
+#include <common/query.h>
+#include <common/storage/entitystore.h>
+#include <common/eventpreprocessor.h>
+
+#include "hawd/dataset.h"
+#include "hawd/formatter.h"
+
+#include <KCalendarCore/Event>
+#include <KCalendarCore/ICalFormat>
+
+#include <iostream>
+
+#include "test.h"
+
+using namespace Sink;
+using namespace Sink::ApplicationDomain;
+
+/**
+ * Benchmark overlap queries on a calendar with many long running recurring series.
+ */
+class EventQueryBenchmark : public QObject
+{
+    Q_OBJECT
+
+    QByteArray resourceIdentifier;
+    HAWD::State mHawdState;
+    const QDateTime mStart = QDateTime::fromString("2018-01-01T08:00:00Z", Qt::ISODate);
+
+    void populateDatabase(int count)
+    {
+        TestResource::removeFromDisk(resourceIdentifier);
+
+        Sink::ResourceContext resourceContext{resourceIdentifier, "test", {{"event", QSharedPointer<TestEventAdaptorFactory>::create()}}};
+        Sink::Storage::EntityStore entityStore{resourceContext, {}};
+        entityStore.startTransaction(Sink::Storage::DataStore::ReadWrite);
+
+        EventPropertyExtractor extractor;
+        for (int i = 0; i < count; i++) {
+            auto icalEvent = KCalendarCore::Event::Ptr::create();
+            icalEvent->setSummary(QString("series%1").arg(i));
+            icalEvent->setDtStart(mStart.addSecs(i * 60));
+            icalEvent->setDtEnd(mStart.addSecs(i * 60 + 30 * 60));
+            if (i % 2) {
+                //A daily series over two years
+                icalEvent->recurrence()->setDaily(1);
+                icalEvent->recurrence()->setDuration(730);
+            } else {
+                //A weekly series without end
+                icalEvent->recurrence()->setWeekly(1);
+            }
+
+            auto event = Event::createEntity<Event>(resourceIdentifier);
+            event.setIcal(KCalendarCore::ICalFormat().toICalString(icalEvent).toUtf8());
+            extractor.newEntity(event);
+            entityStore.add("event", event, false);
+        }
+        entityStore.commitTransaction();
+    }
+
+    //Execute query and block until the initial query is complete
+    int load(const Sink::Query &query)
+    {
+        auto domainTypeAdaptorFactory = QSharedPointer<TestEventAdaptorFactory>::create();
+        Sink::ResourceContext context{resourceIdentifier, "test", {{"event", domainTypeAdaptorFactory}}};
+        context.mResourceAccess = QSharedPointer<TestResourceAccess>::create();
+        TestResourceFacade facade(context);
+
+        auto ret = facade.load(query, Sink::Log::Context{"benchmark"});
+        ret.first.exec().waitForFinished();
+        auto emitter = ret.second;
+        int i = 0;
+        emitter->onAdded([&](const Event::Ptr &) { i++; });
+        bool done = false;
+        emitter->onInitialResultSetComplete([&done](bool) { done = true; });
+        emitter->fetch();
+        QUICK_TRY_VERIFY(done);
+        return i;
+    }
+
+    int indexEntries()
+    {
+        Sink::Storage::DataStore store(Sink::storageLocation(), resourceIdentifier, Sink::Storage::DataStore::ReadOnly);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+        int entries = 0;
+        for (const auto &entry : transaction.openDatabase("event.index.startTime.interval.endTime", {}, Sink::Storage::AllowDuplicates).cursor()) {
+            Q_UNUSED(entry);
+            entries++;
+        }
+        return entries;
+    }
+
+private slots:
+
+    void initTestCase()
+    {
+        Sink::Storage::setStorageBackend(Sink::Test::inProcessStorageBackend(Sink::Storage::StorageBackend::Lmdb));
+    }
+
+    void init()
+    {
+        resourceIdentifier = "sink.test.instance1";
+    }
+
+    void testOverlap()
+    {
+        const int count = 10000;
+        populateDatabase(count);
+
+        //A week within the daily series
+        Sink::Query query;
+        query.request<Event::Summary>();
+        query.filter<Event::StartTime, Event::EndTime>(QueryBase::Comparator(
+            QVariantList{mStart.addDays(300), mStart.addDays(307)}, QueryBase::Comparator::Overlap));
+
+        //Warm-up
+        load(query);
+
+        QTime time;
+        time.start();
+        const auto results = load(query);
+        const auto queryTime = time.elapsed();
+        //Every series occurs within the week
+        QCOMPARE(results, count);
+
+        const auto entries = indexEntries();
+        const auto dbSize = Sink::Storage::DataStore(Sink::storageLocation(), resourceIdentifier, Sink::Storage::DataStore::ReadOnly).diskUsage();
+        std::cout << "The query took [ms]: " << queryTime << std::endl;
+        std::cout << "Interval index entries: " << entries << std::endl;
+
+        HAWD::Dataset dataset("event_overlap_query", mHawdState);
+        HAWD::Dataset::Row row = dataset.row();
+        row.setValue("series", count);
+        row.setValue("results", results);
+        row.setValue("queryTime", queryTime);
+        row.setValue("indexEntries", entries);
+        row.setValue("dbSize", dbSize / 1024);
+        dataset.insertRow(row);
+        HAWD::Formatter::print(dataset);
+    }
+};
+
+QTEST_MAIN(EventQueryBenchmark)
+#include "eventquerybenchmark.moc"
@@ -74,6 +74,152 @@ private slots:
         QCOMPARE(values[1], key1);
         QCOMPARE(values[2], key2);
     }
+
+    void testPagination()
+    {
+        FulltextIndex index("sink.dummy.instance1", Sink::Storage::DataStore::ReadWrite);
+        const QDateTime dt{{2022,5,26},{9,38,0}};
+        QVector<Sink::Storage::Identifier> keys;
+        for (int i = 0; i < 7; i++) {
+            const auto key = Sink::Storage::Identifier::createIdentifier();
+            //Pairs of documents share a date, so pages end in the middle of them
+            index.add(key, QString{"value%1 common"}.arg(i), dt.addDays(i / 2));
+            keys << key;
+        }
+        index.commitTransaction();
+
+        const auto all = index.lookup("common");
+        QCOMPARE(all.size(), keys.size());
+
+        for (const auto order : {FulltextIndex::DateOrder, FulltextIndex::RelevanceOrder}) {
+            QByteArray continuation;
+            auto results = index.lookup("common", order, 2, continuation);
+            QCOMPARE(results.size(), 2);
+            while (!continuation.isEmpty()) {
+                const auto page = index.lookupMore(2, continuation);
+                QVERIFY(page.size() <= 2);
+                results << page;
+            }
+            QCOMPARE(results.size(), keys.size());
+            QCOMPARE(results.toList().toSet(), keys.toList().toSet());
+            if (order == FulltextIndex::DateOrder) {
+                QCOMPARE(results, all);
+                QCOMPARE(results.first(), keys.last());
+            }
+        }
+
+        //Matches that are not part of a page yet show up on later pages
+        QByteArray continuation;
+        const auto first = index.lookup("common", FulltextIndex::DateOrder, 3, continuation);
+        QCOMPARE(first.size(), 3);
+        const auto key = Sink::Storage::Identifier::createIdentifier();
+        index.add(key, "common", dt.addDays(-1));
+        index.commitTransaction();
+        QVector<Sink::Storage::Identifier> rest;
+        while (!continuation.isEmpty()) {
+            rest << index.lookupMore(100, continuation);
+        }
+        QCOMPARE(rest.size(), keys.size() - 3 + 1);
+        QCOMPARE(rest.last(), key);
+    }
+
+    void testGeneration()
+    {
+        Sink::Storage::DataStore store(Sink::storageLocation(), "sink.dummy.instance1", Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+        QCOMPARE(FulltextIndex::generation(transaction).counter, qint64{0});
+        QVERIFY(FulltextIndex::generation(transaction).instance.isEmpty());
+        FulltextIndex::increaseGeneration(transaction);
+        const auto generation = FulltextIndex::generation(transaction);
+        QCOMPARE(generation.counter, qint64{1});
+        QVERIFY(!generation.instance.isEmpty());
+        FulltextIndex::increaseGeneration(transaction);
+        QCOMPARE(FulltextIndex::generation(transaction).counter, qint64{2});
+        QCOMPARE(FulltextIndex::generation(transaction).instance, generation.instance);
+    }
+
+    void testSharedReader()
+    {
+        FulltextIndex index("sink.dummy.instance1", Sink::Storage::DataStore::ReadWrite);
+        const auto key1 = Sink::Storage::Identifier::createIdentifier();
+        const auto key2 = Sink::Storage::Identifier::createIdentifier();
+        const auto key3 = Sink::Storage::Identifier::createIdentifier();
+
+        auto lookup = [](const QByteArray &instance, qint64 counter, const QString &term) {
+            QVector<Sink::Storage::Identifier> ids;
+            FulltextIndex::withReader("sink.dummy.instance1", {instance, counter}, [&](FulltextIndex &reader) {
+                ids = reader.lookup(term);
+            });
+            return ids;
+        };
+
+        index.add(key1, "value1");
+        index.commitTransaction();
+        QCOMPARE(lookup("instance1", 1, "value1").size(), 1);
+
+        index.add(key2, "value2");
+        index.commitTransaction();
+        //The reader is only reopened once the generation moved
+        QCOMPARE(lookup("instance1", 1, "value2").size(), 0);
+        QCOMPARE(lookup("instance1", 2, "value2").size(), 1);
+        //An older generation keeps the newer reader
+        QCOMPARE(lookup("instance1", 1, "value2").size(), 1);
+        QCOMPARE(lookup("instance1", 2, "value").size(), 2);
+
+        index.add(key3, "value3");
+        index.commitTransaction();
+        //A recreated resource starts over with the generation, but with another instance
+        QCOMPARE(lookup("instance2", 1, "value3").size(), 1);
+    }
+
+    void testQueue()
+    {
+        using Sink::Storage::DataStore;
+        const auto key1 = Sink::Storage::Identifier::createIdentifier();
+        const auto key2 = Sink::Storage::Identifier::createIdentifier();
+        const QList<QPair<QString, QString>> values1{{"subject", "value1"}};
+        const QList<QPair<QString, QString>> values2{{"subject", "value2"}};
+
+        DataStore store(Sink::storageLocation(), "sink.dummy.instance1", DataStore::ReadWrite);
+        {
+            auto transaction = store.createTransaction(DataStore::ReadWrite);
+            DataStore::setMaxRevision(transaction, 2);
+            FulltextIndex::enqueue(transaction, 1, {FulltextIndex::QueuedChange{key1, false, values1, {}}});
+            FulltextIndex::enqueue(transaction, 2, {FulltextIndex::QueuedChange{key2, false, values2, {}}});
+            QCOMPARE(FulltextIndex::indexedRevision(transaction), qint64{0});
+            transaction.commit();
+        }
+
+        //The changes of a transaction are indexed together, even if they exceed the batch
+        qint64 indexedRevision = -1;
+        QVERIFY(!FulltextIndex::indexQueue("sink.dummy.instance1", 1, indexedRevision));
+        QCOMPARE(indexedRevision, qint64{1});
+        QVERIFY(FulltextIndex::indexQueue("sink.dummy.instance1", 1, indexedRevision));
+        QCOMPARE(indexedRevision, qint64{2});
+        QCOMPARE(FulltextIndex::indexedRevision(store.createTransaction(DataStore::ReadOnly)), qint64{2});
+        {
+            FulltextIndex index("sink.dummy.instance1");
+            QCOMPARE(index.lookup("value").size(), 2);
+        }
+
+        {
+            auto transaction = store.createTransaction(DataStore::ReadWrite);
+            DataStore::setMaxRevision(transaction, 3);
+            FulltextIndex::enqueue(transaction, 3, {FulltextIndex::QueuedChange{key1, true, {}, {}}});
+            QCOMPARE(FulltextIndex::indexedRevision(transaction), qint64{2});
+            transaction.commit();
+        }
+        QVERIFY(FulltextIndex::indexQueue("sink.dummy.instance1", 100, indexedRevision));
+        QCOMPARE(indexedRevision, qint64{3});
+        {
+            FulltextIndex index("sink.dummy.instance1");
+            QCOMPARE(index.lookup("value"), QVector<Sink::Storage::Identifier>{key2});
+        }
+        //Nothing left to index
+        indexedRevision = -1;
+        QVERIFY(FulltextIndex::indexQueue("sink.dummy.instance1", 100, indexedRevision));
+        QCOMPARE(indexedRevision, qint64{-1});
+    }
 };
 
 QTEST_MAIN(FulltextIndexTest)
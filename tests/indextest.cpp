@@ -6,6 +6,35 @@
 #include "store.h"
 #include "storage.h"
 #include "index.h"
+#include "typeindex.h"
+#include "indexstatistics.h"
+#include "indexwriter.h"
+#include "storage/indexkey.h"
+#include "eventrecurrence.h"
+
+#include <KCalendarCore/Event>
+#include <KCalendarCore/ICalFormat>
+
+namespace IndexKey = Sink::Storage::IndexKey;
+
+class CountingIndexer : public Sink::Indexer
+{
+public:
+    typedef QSharedPointer<CountingIndexer> Ptr;
+    void add(const Sink::ApplicationDomain::ApplicationDomainType &) Q_DECL_OVERRIDE {}
+    void modify(const Sink::ApplicationDomain::ApplicationDomainType &, const Sink::ApplicationDomain::ApplicationDomainType &) Q_DECL_OVERRIDE
+    {
+        modifications++;
+    }
+    void remove(const Sink::ApplicationDomain::ApplicationDomainType &) Q_DECL_OVERRIDE {}
+    QByteArrayList inputProperties() const Q_DECL_OVERRIDE
+    {
+        return {"subject"};
+    }
+    static int modifications;
+};
+
+int CountingIndexer::modifications = 0;
 
 /**
  * Test of the index implementation
@@ -60,6 +89,438 @@ private slots:
             QCOMPARE(values.size(), 3);
         }
     }
+
+    void testIndexKeyOrder()
+    {
+        const auto date = QDateTime::fromString("2018-05-23T13:49:41Z", Qt::ISODate);
+        const QList<QVariantList> orderedValues{
+            {false, true},
+            {std::numeric_limits<qint64>::min(), -1000, -1, 0, 1, 255, 256, std::numeric_limits<qint64>::max()},
+            {date.addYears(-100), date.addMSecs(-1), date, date.addMSecs(1), date.addYears(100)},
+            {QByteArray{"a"}, QByteArray{"a\0", 2}, QByteArray{"a\0b", 3}, QByteArray{"ab"}, QByteArray{"b"}, QByteArray{"\xff"}},
+            {QString{"a"}, QString{"z"}, QString::fromUtf8("\xc3\xa4")}
+        };
+        for (const auto &values : orderedValues) {
+            const auto type = values.first().userType();
+            //Null sorts first
+            QByteArray previous = IndexKey::encode({}, type);
+            QByteArray previousDescending;
+            for (const auto &value : values) {
+                const auto key = IndexKey::encode(value, type);
+                QVERIFY2(previous < key, qPrintable(value.toString()));
+                previous = key;
+
+                const auto descending = IndexKey::encode(value, type, IndexKey::Descending);
+                QVERIFY(previousDescending.isEmpty() || descending < previousDescending);
+                previousDescending = descending;
+            }
+        }
+
+        //Empty values are null
+        QCOMPARE(IndexKey::encode(QByteArray{}, QMetaType::QByteArray), IndexKey::encode({}, QMetaType::QByteArray));
+        QCOMPARE(IndexKey::encode(QDateTime{}, QMetaType::QDateTime), IndexKey::encode({}, QMetaType::QDateTime));
+        //Invalid dates sort last in descending order
+        QVERIFY(IndexKey::encode(date, QMetaType::QDateTime, IndexKey::Descending) < IndexKey::encode(QDateTime{}, QMetaType::QDateTime, IndexKey::Descending));
+        //Values are converted to the index type
+        QCOMPARE(IndexKey::encode(QByteArray{"5"}, QMetaType::Int), IndexKey::encode(5, QMetaType::Int));
+
+        //A component is never the prefix of a different component, so composite keys can be looked up by their leading component
+        auto composite = [&](const QByteArray &value, const QDateTime &sortValue) {
+            auto key = IndexKey::encode(value, QMetaType::QByteArray);
+            IndexKey::appendDateTime(key, sortValue, IndexKey::Descending);
+            return key;
+        };
+        const auto prefix = IndexKey::encode(QByteArray{"folder1"}, QMetaType::QByteArray);
+        QVERIFY(composite("folder1", date).startsWith(prefix));
+        QVERIFY(!composite("folder10", date).startsWith(prefix));
+        QVERIFY(composite("folder1", date.addDays(1)) < composite("folder1", date));
+        QVERIFY(composite("folder1", date) < composite("folder10", date.addDays(1)));
+    }
+
+    void testSortedIndexRange()
+    {
+        Sink::Storage::DataStore store("./testindex", "sink.dummy.testindex", Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+
+        TypeIndex index{"test", Sink::Log::Context{"test"}};
+        index.addSortedProperty<int>("count");
+        index.addSortedProperty<QString>("name");
+        index.addProperty<int>("value");
+
+        const QStringList names{"alpha", "beta", "gamma", "delta", "epsilon"};
+        QHash<Sink::Storage::Identifier, int> countById;
+        for (int i = 0; i < names.size(); i++) {
+            Sink::ApplicationDomain::ApplicationDomainType entity;
+            entity.setProperty("count", i - 2);
+            entity.setProperty("name", names.at(i));
+            entity.setProperty("value", i % 2);
+            const auto id = Sink::Storage::Identifier::createIdentifier();
+            index.add(id, entity, transaction, {});
+            countById.insert(id, i - 2);
+        }
+
+        auto lookup = [&](const Sink::QueryBase &query) {
+            QSet<QByteArrayList> appliedFilters;
+            QByteArray appliedSorting;
+            const auto ids = index.query(query, appliedFilters, appliedSorting, transaction, {});
+            QList<int> counts;
+            for (const auto &id : ids) {
+                counts << countById.value(id);
+            }
+            return counts;
+        };
+
+        {
+            Sink::Query query;
+            query.filter("count", Sink::QueryBase::Comparator(QVariantList{-1, 1}, Sink::QueryBase::Comparator::Within));
+            QCOMPARE(lookup(query), (QList<int>{-1, 0, 1}));
+        }
+        {
+            Sink::Query query;
+            query.filter("name", Sink::QueryBase::Comparator(QVariantList{"b", "e"}, Sink::QueryBase::Comparator::Within));
+            QCOMPARE(lookup(query), (QList<int>{-1, 1}));
+        }
+        {
+            Sink::Query query;
+            query.filter("count", Sink::QueryBase::Comparator(-2));
+            QCOMPARE(lookup(query), (QList<int>{-2}));
+        }
+        {
+            Sink::Query query;
+            query.filter("count", Sink::QueryBase::Comparator(QVariantList{-2, 2}, Sink::QueryBase::Comparator::Within));
+            query.filter("value", Sink::QueryBase::Comparator(1));
+            QCOMPARE(lookup(query), (QList<int>{-1, 1}));
+        }
+    }
+
+    void testSortedIndexContinuation()
+    {
+        Sink::Storage::DataStore store("./testindex", "sink.dummy.testindex", Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+
+        TypeIndex index{"test", Sink::Log::Context{"test"}};
+        index.addSortedProperty<int>("count");
+
+        //Pairs of entities share a sort key, so pages end in the middle of the duplicates
+        QHash<Sink::Storage::Identifier, int> countById;
+        for (int i = 0; i < 9; i++) {
+            Sink::ApplicationDomain::ApplicationDomainType entity;
+            entity.setProperty("count", i / 2);
+            const auto id = Sink::Storage::Identifier::createIdentifier();
+            index.add(id, entity, transaction, {});
+            countById.insert(id, i / 2);
+        }
+
+        Sink::Query query;
+        query.setSortProperty("count");
+        query.limit(2);
+
+        QSet<QByteArrayList> appliedFilters;
+        QByteArray appliedSorting;
+        QByteArray continuation;
+        auto ids = index.query(query, appliedFilters, appliedSorting, transaction, {}, &continuation);
+        QCOMPARE(appliedSorting, QByteArray{"count"});
+        QCOMPARE(ids.size(), 2);
+        QVERIFY(!continuation.isEmpty());
+        while (!continuation.isEmpty()) {
+            const auto page = index.queryMore(continuation, 2, transaction);
+            QVERIFY(page.size() <= 2);
+            ids << page;
+        }
+        QCOMPARE(ids.size(), countById.size());
+        QCOMPARE(ids.toList().toSet().size(), countById.size());
+        QList<int> counts;
+        for (const auto &id : ids) {
+            counts << countById.value(id);
+        }
+        QCOMPARE(counts, (QList<int>{0, 0, 1, 1, 2, 2, 3, 3, 4}));
+
+        //Without a continuation the whole index is read
+        appliedSorting.clear();
+        QCOMPARE(index.query(query, appliedFilters, appliedSorting, transaction, {}).size(), countById.size());
+    }
+
+    void testIndexWriter()
+    {
+        Sink::Storage::DataStore store("./testindex", "sink.dummy.testindex", Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+        Index index("index", transaction);
+        index.add("existing", "value1");
+
+        IndexWriter writer;
+        writer.add("index", "key2", "value2");
+        writer.add("index", "key1", "value1");
+        writer.add("index", "key1", "value0");
+        //A modification that doesn't change the value cancels out
+        writer.remove("index", "existing", "value1");
+        writer.add("index", "existing", "value1");
+        //An entry that is added and removed again is never written
+        writer.add("index", "transient", "value");
+        writer.remove("index", "transient", "value");
+        writer.write("unique", "key", "first");
+        writer.write("unique", "key", "second");
+        writer.write("unique", "removed", "value");
+        writer.erase("unique", "removed");
+
+        //Nothing is written before the flush
+        QCOMPARE(index.lookup("key1"), QByteArray{});
+        QVERIFY(!writer.isEmpty());
+
+        writer.flush(transaction);
+        QVERIFY(writer.isEmpty());
+
+        QByteArrayList values;
+        index.lookup("key1", [&](const QByteArray &value) { values << value; return true; }, [](const Index::Error &) {});
+        QCOMPARE(values, (QByteArrayList{"value0", "value1"}));
+        QCOMPARE(index.lookup("key2"), QByteArray{"value2"});
+        QCOMPARE(index.lookup("existing"), QByteArray{"value1"});
+        QCOMPARE(index.lookup("transient"), QByteArray{});
+
+        auto unique = transaction.openDatabase("unique");
+        QByteArrayList uniqueKeys;
+        for (const auto &entry : unique.cursor()) {
+            uniqueKeys << QByteArray{entry.key.data(), int(entry.key.size())};
+            QCOMPARE(QByteArray(entry.value.data(), int(entry.value.size())), QByteArray{"second"});
+        }
+        QCOMPARE(uniqueKeys, QByteArrayList{"key"});
+
+        //Discarded mutations are never written
+        writer.add("index", "aborted", "value");
+        writer.clear();
+        writer.flush(transaction);
+        QCOMPARE(index.lookup("aborted"), QByteArray{});
+    }
+
+    void testIndexStatistics()
+    {
+        IndexStatistics statistics;
+        for (int i = 0; i < 10; i++) {
+            statistics.add("common");
+        }
+        statistics.add("rare");
+        statistics.add("removed");
+        statistics.remove("removed");
+        QCOMPARE(statistics.entries(), qint64{11});
+        QVERIFY(statistics.estimateEquals("common") >= 10);
+        QVERIFY(statistics.largestBucket() >= 10);
+
+        const auto restored = IndexStatistics::fromByteArray(statistics.toByteArray());
+        QCOMPARE(restored.entries(), statistics.entries());
+        QCOMPARE(restored.estimateEquals("rare"), statistics.estimateEquals("rare"));
+        QCOMPARE(restored.usedBuckets(), statistics.usedBuckets());
+    }
+
+    void testCostBasedLookup()
+    {
+        Sink::Storage::DataStore store("./testindex", "sink.dummy.testindex", Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+
+        TypeIndex index{"test", Sink::Log::Context{"test"}};
+        index.addProperty<QByteArray>("folder");
+        index.addProperty<bool>("flagged");
+
+        IndexStatistics folderStatistics;
+        IndexStatistics flaggedStatistics;
+        Sink::Storage::Identifier flaggedId;
+        for (int i = 0; i < 100; i++) {
+            Sink::ApplicationDomain::ApplicationDomainType entity;
+            entity.setProperty("folder", QByteArray{"inbox"});
+            entity.setProperty("flagged", i == 0);
+            const auto id = Sink::Storage::Identifier::createIdentifier();
+            if (i == 0) {
+                flaggedId = id;
+            }
+            index.add(id, entity, transaction, {});
+            folderStatistics.add(IndexKey::encode(QByteArray{"inbox"}, QMetaType::QByteArray));
+            flaggedStatistics.add(IndexKey::encode(i == 0, QMetaType::Bool));
+        }
+
+        Sink::Query query;
+        query.filter("folder", Sink::QueryBase::Comparator(QByteArray{"inbox"}));
+        query.filter("flagged", Sink::QueryBase::Comparator(true));
+
+        {
+            //Without statistics all indexes are intersected
+            QSet<QByteArrayList> appliedFilters;
+            QByteArray appliedSorting;
+            const auto ids = index.query(query, appliedFilters, appliedSorting, transaction, {});
+            QCOMPARE(ids, QVector<Sink::Storage::Identifier>{flaggedId});
+            QCOMPARE(appliedFilters, (QSet<QByteArrayList>{{"folder"}, {"flagged"}}));
+        }
+
+        IndexStatistics::merge(transaction, "test", "test.index.folder", folderStatistics);
+        IndexStatistics::merge(transaction, "test", "test.index.flagged", flaggedStatistics);
+
+        {
+            //The selective index is looked up first, and the folder is left to the filter
+            QSet<QByteArrayList> appliedFilters;
+            QByteArray appliedSorting;
+            const auto ids = index.query(query, appliedFilters, appliedSorting, transaction, {});
+            QCOMPARE(ids, QVector<Sink::Storage::Identifier>{flaggedId});
+            QCOMPARE(appliedFilters, (QSet<QByteArrayList>{{"flagged"}}));
+        }
+    }
+
+    void testModifyChangedProperties()
+    {
+        Sink::Storage::DataStore store("./testindex", "sink.dummy.testindex", Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+
+        TypeIndex index{"test", Sink::Log::Context{"test"}};
+        index.addProperty<QByteArray>("folder");
+        index.addProperty<bool>("flagged");
+        index.addSecondaryPropertyIndexer<Sink::ApplicationDomain::Mail::Subject, Sink::ApplicationDomain::Mail::Subject, CountingIndexer>();
+        CountingIndexer::modifications = 0;
+
+        auto create = [](bool flagged, const QString &subject, bool unread) {
+            Sink::ApplicationDomain::ApplicationDomainType entity;
+            entity.setProperty("folder", QByteArray{"inbox"});
+            entity.setProperty("flagged", flagged);
+            entity.setProperty("subject", subject);
+            entity.setProperty("unread", unread);
+            return entity;
+        };
+        const auto id = Sink::Storage::Identifier::createIdentifier();
+        index.add(id, create(false, "subject", true), transaction, {});
+
+        //Nothing indexed changed
+        index.modify(id, create(false, "subject", true), create(false, "subject", false), transaction, {});
+        QCOMPARE(CountingIndexer::modifications, 0);
+        QCOMPARE(index.lookup("folder", QByteArray{"inbox"}, transaction), QVector<Sink::Storage::Identifier>{id});
+        QCOMPARE(index.lookup("flagged", false, transaction), QVector<Sink::Storage::Identifier>{id});
+
+        //Only the flagged index is updated
+        index.modify(id, create(false, "subject", false), create(true, "subject", false), transaction, {});
+        QCOMPARE(CountingIndexer::modifications, 0);
+        QCOMPARE(index.lookup("folder", QByteArray{"inbox"}, transaction), QVector<Sink::Storage::Identifier>{id});
+        QCOMPARE(index.lookup("flagged", true, transaction), QVector<Sink::Storage::Identifier>{id});
+        QVERIFY(index.lookup("flagged", false, transaction).isEmpty());
+
+        index.modify(id, create(true, "subject", false), create(true, "renamed", false), transaction, {});
+        QCOMPARE(CountingIndexer::modifications, 1);
+    }
+
+    void testNgramIndex()
+    {
+        using Sink::ApplicationDomain::Contact;
+        Sink::Storage::DataStore store("./testindex", "sink.dummy.testindex", Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+
+        TypeIndex index{"contact", Sink::Log::Context{"test"}};
+        index.addNgramIndex<Contact::Fn>();
+        index.addNgramIndex<Contact::Emails>();
+
+        auto create = [](const QString &fn, const QString &email) {
+            Sink::ApplicationDomain::ApplicationDomainType entity;
+            entity.setProperty(Contact::Fn::name, fn);
+            entity.setProperty(Contact::Emails::name, QVariant::fromValue(QList<Contact::Email>{{Contact::Email::Work, email}}));
+            return entity;
+        };
+        const auto john = Sink::Storage::Identifier::createIdentifier();
+        const auto jane = Sink::Storage::Identifier::createIdentifier();
+        index.add(john, create("John Doe", "john.doe@example.org"), transaction, {});
+        index.add(jane, create("Jane Doe", "jane@example.com"), transaction, {});
+
+        auto find = [&](const QByteArray &property, const QString &text) {
+            Sink::Query query;
+            query.filter(property, Sink::QueryBase::Comparator(text, Sink::QueryBase::Comparator::Contains));
+            QSet<QByteArrayList> appliedFilters;
+            QByteArray appliedSorting;
+            return index.query(query, appliedFilters, appliedSorting, transaction, {}).toList().toSet();
+        };
+        using Ids = QSet<Sink::Storage::Identifier>;
+
+        QCOMPARE(find(Contact::Fn::name, "doe"), (Ids{john, jane}));
+        QCOMPARE(find(Contact::Fn::name, "JOHN D"), Ids{john});
+        QCOMPARE(find(Contact::Fn::name, "smith"), Ids{});
+        QCOMPARE(find(Contact::Emails::name, "example.org"), Ids{john});
+        //Shorter texts are found at every position
+        QCOMPARE(find(Contact::Emails::name, "ja"), Ids{jane});
+        QCOMPARE(find(Contact::Emails::name, "g"), Ids{john});
+        QCOMPARE(find(Contact::Emails::name, "om"), Ids{jane});
+
+        //Surrogate pairs are not split
+        const auto smiley = QString::fromUtf8("\xF0\x9F\x98\x80");
+        const auto party = Sink::Storage::Identifier::createIdentifier();
+        index.add(party, create("Party " + smiley + smiley, "party@example.com"), transaction, {});
+        QCOMPARE(find(Contact::Fn::name, "y " + smiley), Ids{party});
+        QCOMPARE(find(Contact::Fn::name, smiley + smiley), Ids{party});
+        QCOMPARE(find(Contact::Fn::name, smiley), Ids{party});
+
+        index.modify(john, create("John Doe", "john.doe@example.org"), create("John Smith", "john.doe@example.org"), transaction, {});
+        QCOMPARE(find(Contact::Fn::name, "doe"), Ids{jane});
+        QCOMPARE(find(Contact::Fn::name, "smith"), Ids{john});
+        QCOMPARE(find(Contact::Emails::name, "doe"), Ids{john});
+
+        index.remove(jane, create("Jane Doe", "jane@example.com"), transaction, {});
+        QCOMPARE(find(Contact::Fn::name, "doe"), Ids{});
+    }
+
+    void testIntervalIndex()
+    {
+        using Sink::ApplicationDomain::Event;
+        Sink::Storage::DataStore store("./testindex", "sink.dummy.testindex", Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+
+        TypeIndex index{"event", Sink::Log::Context{"test"}};
+        index.addIntervalIndex<Event::StartTime, Event::EndTime, EventRecurrence>();
+
+        auto create = [](const QString &start, const QString &end, const QString &seriesEnd = {}) {
+            auto icalEvent = KCalendarCore::Event::Ptr::create();
+            icalEvent->setDtStart(QDateTime::fromString(start, Qt::ISODate));
+            icalEvent->setDtEnd(QDateTime::fromString(end, Qt::ISODate));
+            Sink::ApplicationDomain::ApplicationDomainType entity;
+            entity.setProperty(Event::StartTime::name, icalEvent->dtStart());
+            entity.setProperty(Event::EndTime::name, icalEvent->dtEnd());
+            if (!seriesEnd.isEmpty()) {
+                //Every three weeks, the end of the series is extracted by the preprocessor
+                icalEvent->recurrence()->setWeekly(3);
+                entity.setProperty(Event::EndTime::name, QDateTime::fromString(seriesEnd, Qt::ISODate));
+            }
+            entity.setProperty(Event::Ical::name, KCalendarCore::ICalFormat().toICalString(icalEvent).toUtf8());
+            return entity;
+        };
+
+        const auto shortId = Sink::Storage::Identifier::createIdentifier();
+        const auto longId = Sink::Storage::Identifier::createIdentifier();
+        const auto seriesId = Sink::Storage::Identifier::createIdentifier();
+        index.add(shortId, create("2018-05-23T12:00:00Z", "2018-05-23T13:00:00Z"), transaction, {});
+        index.add(longId, create("2018-05-30T22:00:00Z", "2019-04-25T03:00:00Z"), transaction, {});
+        const auto series = create("2018-05-10T13:00:00Z", "2018-05-10T14:00:00Z", "2028-04-27T14:00:00Z");
+        index.add(seriesId, series, transaction, {});
+
+        auto findInRange = [&](const QString &start, const QString &end) {
+            Sink::Query query;
+            query.filter<Event::StartTime, Event::EndTime>(Sink::QueryBase::Comparator(
+                QVariantList{QDateTime::fromString(start, Qt::ISODate), QDateTime::fromString(end, Qt::ISODate)},
+                Sink::QueryBase::Comparator::Overlap));
+            QSet<QByteArrayList> appliedFilters;
+            QByteArray appliedSorting;
+            return index.query(query, appliedFilters, appliedSorting, transaction, {}).toList().toSet();
+        };
+        using Ids = QSet<Sink::Storage::Identifier>;
+
+        //Each period is stored once, regardless of its length or recurrence
+        int entries = 0;
+        for (const auto &entry : transaction.openDatabase("event.index.startTime.interval.endTime", {}, Sink::Storage::AllowDuplicates).cursor()) {
+            Q_UNUSED(entry);
+            entries++;
+        }
+        QCOMPARE(entries, 3);
+
+        QCOMPARE(findInRange("2018-05-23T12:30:00Z", "2018-05-23T12:31:00Z"), Ids{shortId});
+        QCOMPARE(findInRange("2018-05-22T12:00:00Z", "2018-05-22T13:00:00Z"), Ids{});
+        //Bounds are inclusive
+        QCOMPARE(findInRange("2018-05-23T13:00:00Z", "2018-05-23T13:30:00Z"), Ids{shortId});
+        //The series doesn't occur between the 10th and the 31st
+        QCOMPARE(findInRange("2018-05-15T12:00:00Z", "2018-05-30T13:00:00Z"), Ids{shortId});
+        QCOMPARE(findInRange("2018-05-31T13:30:00Z", "2018-05-31T13:45:00Z"), (Ids{longId, seriesId}));
+        QCOMPARE(findInRange("2019-05-06T00:00:00Z", "2019-05-13T00:00:00Z"), Ids{});
+
+        index.remove(seriesId, series, transaction, {});
+        QCOMPARE(findInRange("2018-05-31T13:30:00Z", "2018-05-31T13:45:00Z"), Ids{longId});
+        QCOMPARE(transaction.openDatabase("event.index.startTime.interval.endTime.recurrence").scan(seriesId.toInternalByteArray(), [](const QByteArray &, const QByteArray &) { return true; }), 0);
+    }
 };
 
 QTEST_MAIN(IndexTest)
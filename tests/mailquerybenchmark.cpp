@@ -28,6 +28,7 @@
 #include <common/query.h>
 #include <common/storage/entitystore.h>
 #include <common/resourcecontrol.h>
+#include <common/fulltextindex.h>
 
 #include "hawd/dataset.h"
 #include "hawd/formatter.h"
@@ -146,6 +147,12 @@ class MailQueryBenchmark : public QObject
 
 private slots:
 
+    void initTestCase()
+    {
+        //SINK_TEST_STORAGE_BACKEND=memory measures everything above the storage engine
+        Sink::Storage::setStorageBackend(Sink::Test::inProcessStorageBackend(Sink::Storage::StorageBackend::Lmdb));
+    }
+
     void init()
     {
         resourceIdentifier = "sink.test.instance1";
@@ -239,6 +246,82 @@ private slots:
         HAWD::Formatter::print(dataset);
     }
 
+    void testIndexIntersection_data()
+    {
+        QTest::addColumn<int>("predicates");
+        QTest::addColumn<int>("expectedSize");
+
+        //Every 15th mail is a draft in folder0
+        QTest::newRow("folder and draft") << 2 << 3334;
+        //...and of those every mail within the last week
+        QTest::newRow("folder, draft and date range") << 3 << 673;
+    }
+
+    void testIndexIntersection()
+    {
+        QFETCH(int, predicates);
+        QFETCH(int, expectedSize);
+
+        int count = 50000;
+        TestResource::removeFromDisk(resourceIdentifier);
+        const auto date = QDateTime::currentDateTimeUtc();
+        {
+            Sink::ResourceContext resourceContext{resourceIdentifier, "test", {{"mail", QSharedPointer<TestMailAdaptorFactory>::create()}}};
+            Sink::Storage::EntityStore entityStore{resourceContext, {}};
+            entityStore.startTransaction(Sink::Storage::DataStore::ReadWrite);
+            for (int i = 0; i < count; i++) {
+                auto domainObject = Mail::createEntity<Mail>(resourceIdentifier);
+                domainObject.setExtractedMessageId("uid");
+                domainObject.setExtractedSubject(QString("subject%1").arg(i));
+                //One mail per minute
+                domainObject.setExtractedDate(date.addSecs(-i * 60));
+                domainObject.setFolder(QByteArray("folder") + QByteArray::number(i % 5));
+                domainObject.setDraft(i % 3 == 0);
+                entityStore.add("mail", domainObject, false);
+            }
+            entityStore.commitTransaction();
+        }
+
+        Sink::Query query;
+        query.request<Mail::Subject>()
+            .request<Mail::Date>();
+        query.filter<Mail::Folder>("folder0");
+        query.filter<Mail::Draft>(true);
+        if (predicates > 2) {
+            const auto lastWeek = date.addSecs(-7 * 24 * 60 * 60 - 30);
+            query.filter<Mail::Date>(QueryBase::Comparator(QVariantList{lastWeek, date.addSecs(30)}, QueryBase::Comparator::Within));
+        }
+
+        int loadedResults = 0;
+        QBENCHMARK {
+            loadedResults = load(query);
+        }
+        QCOMPARE(loadedResults, expectedSize);
+    }
+
+    void testFulltextLookup()
+    {
+        int count = 20000;
+        TestResource::removeFromDisk(resourceIdentifier);
+        const auto date = QDateTime::currentDateTimeUtc();
+        {
+            FulltextIndex index{resourceIdentifier, Sink::Storage::DataStore::ReadWrite};
+            for (int i = 0; i < count; i++) {
+                const QList<QPair<QString, QString>> values{{"subject", QString("subject%1 common").arg(i)}};
+                index.add(Sink::Storage::Identifier::createIdentifier(), values, date.addSecs(-i * 60));
+            }
+            index.commitTransaction();
+        }
+
+        //All matches are resolved to identifiers
+        FulltextIndex index{resourceIdentifier};
+        int loadedResults = 0;
+        QBENCHMARK {
+            loadedResults = index.lookup("common").size();
+        }
+        QCOMPARE(loadedResults, count);
+    }
+
     void testIncremental()
     {
         Sink::Query query{Sink::Query::LiveQuery};
@@ -1,6 +1,7 @@
 #include <QTest>
 #include <QSignalSpy>
 #include <QTimer>
+#include <QCoreApplication>
 
 #include <QString>
 #include <QQueue>
@@ -8,19 +9,30 @@
 #include "store.h"
 #include "storage.h"
 #include "messagequeue.h"
+#include "storage/key.h"
 #include "log.h"
 #include "test.h"
 
 /**
  * Test of the messagequeue implementation.
+ *
+ * Runs against the storage backend it is constructed with.
  */
 class MessageQueueTest : public QObject
 {
     Q_OBJECT
+public:
+    explicit MessageQueueTest(Sink::Storage::StorageBackend backend) : QObject(), mBackend(backend)
+    {
+    }
+
+private:
+    Sink::Storage::StorageBackend mBackend;
+
 private slots:
     void initTestCase()
     {
-        Sink::Test::initTest();
+        Sink::Test::initTest(mBackend);
         Sink::Storage::DataStore store(Sink::Store::storageLocation(), "sink.dummy.testqueue", Sink::Storage::DataStore::ReadWrite);
         store.removeFromDisk();
     }
@@ -259,7 +271,51 @@ private slots:
         QCOMPARE(count, num);
 
     }
+
+    void testMigrateDisplayKeys()
+    {
+        {
+            //The layout of queues before messages were stored under integer keys
+            Sink::Storage::DataStore store(Sink::Store::storageLocation(), "sink.dummy.testqueue", Sink::Storage::DataStore::ReadWrite);
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+            for (int i = 1; i <= 11; i++) {
+                transaction.openDatabase().write(Sink::Storage::Revision{size_t(i)}.toDisplayByteArray(), "value" + QByteArray::number(i));
+            }
+            Sink::Storage::DataStore::setMaxRevision(transaction, 11);
+            transaction.commit();
+        }
+
+        MessageQueue queue(Sink::Store::storageLocation(), "sink.dummy.testqueue");
+        QVERIFY(!queue.isEmpty());
+        queue.enqueue("value12");
+
+        int count = 0;
+        queue.dequeueBatch(20, [&count](const QByteArray &data) {
+                 count++;
+                 ASYNCCOMPARE(data, QByteArray{"value"} + QByteArray::number(count));
+                 return KAsync::null<void>();
+             }).exec().waitForFinished();
+        QCOMPARE(count, 12);
+        QVERIFY(queue.isEmpty());
+
+        {
+            Sink::Storage::DataStore store(Sink::Store::storageLocation(), "sink.dummy.testqueue", Sink::Storage::DataStore::ReadWrite);
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+            transaction.openDatabase().write(Sink::Storage::Revision{size_t(13)}.toDisplayByteArray(), "value13");
+            transaction.commit();
+        }
+        //The migration only runs once
+        MessageQueue migratedQueue(Sink::Store::storageLocation(), "sink.dummy.testqueue");
+        QVERIFY(migratedQueue.isEmpty());
+    }
 };
 
-QTEST_MAIN(MessageQueueTest)
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    MessageQueueTest lmdbTest{Sink::Storage::StorageBackend::Lmdb};
+    MessageQueueTest memoryTest{Sink::Storage::StorageBackend::Memory};
+    const auto lmdbResult = QTest::qExec(&lmdbTest, argc, argv);
+    return QTest::qExec(&memoryTest, argc, argv) | lmdbResult;
+}
 #include "messagequeuetest.moc"
@@ -42,6 +42,7 @@
 #include "mail_generated.h"
 #include "createentity_generated.h"
 #include "getrssusage.h"
+#include "test.h"
 
 /**
  * Benchmark pipeline processing speed.
@@ -103,6 +104,12 @@ class PipelineBenchmark : public QObject
 
 private slots:
 
+    void initTestCase()
+    {
+        //SINK_TEST_STORAGE_BACKEND=memory measures everything above the storage engine
+        Sink::Storage::setStorageBackend(Sink::Test::inProcessStorageBackend(Sink::Storage::StorageBackend::Lmdb));
+    }
+
     void init()
     {
         Sink::Log::setDebugOutputLevel(Sink::Log::Warning);
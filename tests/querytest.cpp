@@ -2294,6 +2294,23 @@ private slots:
 
     void testRecurringEvents()
     {
+        auto overlapQuery = [](const QString &begin, const QString &end) {
+            Sink::Query query;
+            query.resourceFilter("sink.dummy.instance1");
+            query.setFlags(Query::LiveQuery);
+            query.filter<Event::StartTime, Event::EndTime>(QueryBase::Comparator(
+                QVariantList{ QDateTime::fromString(begin, Qt::ISODate),
+                    QDateTime::fromString(end, Qt::ISODate) },
+                QueryBase::Comparator::Overlap));
+            return query;
+        };
+
+        //The series spans this period, but doesn't occur in it.
+        //The live query already exists, so the event is only checked by the filter of the incremental update.
+        auto filteredGapModel = Sink::Store::loadModel<Event>(overlapQuery("2018-05-15T12:00:00Z", "2018-05-30T13:00:00Z"));
+        QTRY_VERIFY(filteredGapModel->data(QModelIndex(), Sink::Store::ChildrenFetchedRole).toBool());
+
+        //Occurs on 2018-05-10, 2018-05-31 and every third week after that
         auto icalEvent = KCalendarCore::Event::Ptr::create();
         icalEvent->setSummary("test");
         icalEvent->setDtStart(QDateTime::fromString("2018-05-10T13:00:00Z", Qt::ISODate));
@@ -2305,17 +2322,18 @@ private slots:
         VERIFYEXEC(Sink::Store::create(event));
         VERIFYEXEC(Sink::ResourceControl::flushMessageQueue("sink.dummy.instance1"));
 
-        Sink::Query query;
-        query.resourceFilter("sink.dummy.instance1");
-        query.setFlags(Query::LiveQuery);
-        query.filter<Event::StartTime, Event::EndTime>(QueryBase::Comparator(
-            QVariantList{ QDateTime::fromString("2018-05-15T12:00:00Z", Qt::ISODate),
-                QDateTime::fromString("2018-05-30T13:00:00Z", Qt::ISODate) },
-            QueryBase::Comparator::Overlap));
-        auto model = Sink::Store::loadModel<Event>(query);
+        auto model = Sink::Store::loadModel<Event>(overlapQuery("2018-05-15T12:00:00Z", "2018-06-01T13:00:00Z"));
         QTRY_VERIFY(model->data(QModelIndex(), Sink::Store::ChildrenFetchedRole).toBool());
         QCOMPARE(model->rowCount(), 1);
 
+        //Looked up in the interval index
+        auto gapModel = Sink::Store::loadModel<Event>(overlapQuery("2018-05-15T12:00:00Z", "2018-05-30T13:00:00Z"));
+        QTRY_VERIFY(gapModel->data(QModelIndex(), Sink::Store::ChildrenFetchedRole).toBool());
+        QCOMPARE(gapModel->rowCount(), 0);
+
+        QTest::qWait(100);
+        QCOMPARE(filteredGapModel->rowCount(), 0);
+
         VERIFYEXEC(Sink::Store::remove(event));
         QTRY_COMPARE(model->rowCount(), 0);
     }
@@ -2350,31 +2368,72 @@ private slots:
 
         VERIFYEXEC(Sink::ResourceControl::flushMessageQueue("sink.dummy.instance1"));
 
-        {
+        auto overlapQuery = [](const QString &begin, const QString &end) {
             Sink::Query query;
             query.resourceFilter("sink.dummy.instance1");
             query.filter<Event::StartTime, Event::EndTime>(QueryBase::Comparator(
-                QVariantList{ QDateTime::fromString("2018-05-15T12:00:00Z", Qt::ISODate),
-                    QDateTime::fromString("2018-05-30T13:00:00Z", Qt::ISODate) },
+                QVariantList{ QDateTime::fromString(begin, Qt::ISODate),
+                    QDateTime::fromString(end, Qt::ISODate) },
                 QueryBase::Comparator::Overlap));
-            auto model = Sink::Store::loadModel<Event>(query);
+            return query;
+        };
+
+        //The exception on its original start and the series on 2018-05-31
+        {
+            auto model = Sink::Store::loadModel<Event>(overlapQuery("2018-05-15T12:00:00Z", "2018-06-01T13:00:00Z"));
             QTRY_VERIFY(model->data(QModelIndex(), Sink::Store::ChildrenFetchedRole).toBool());
             QCOMPARE(model->rowCount(), 2);
         }
+        //The exception on its new start, the series only occurs on 2018-07-12
         {
-            Sink::Query query;
-            query.resourceFilter("sink.dummy.instance1");
-            query.filter<Event::StartTime, Event::EndTime>(QueryBase::Comparator(
-                QVariantList{ QDateTime::fromString("2018-07-15T12:00:00Z", Qt::ISODate),
-                    QDateTime::fromString("2018-07-30T13:00:00Z", Qt::ISODate) },
-                QueryBase::Comparator::Overlap));
-            auto model = Sink::Store::loadModel<Event>(query);
+            auto model = Sink::Store::loadModel<Event>(overlapQuery("2018-07-09T12:00:00Z", "2018-07-11T13:00:00Z"));
             QTRY_VERIFY(model->data(QModelIndex(), Sink::Store::ChildrenFetchedRole).toBool());
             QCOMPARE(model->rowCount(), 1);
         }
+        //Both span this period, but neither occurs in it
+        {
+            auto model = Sink::Store::loadModel<Event>(overlapQuery("2018-06-01T12:00:00Z", "2018-06-20T13:00:00Z"));
+            QTRY_VERIFY(model->data(QModelIndex(), Sink::Store::ChildrenFetchedRole).toBool());
+            QCOMPARE(model->rowCount(), 0);
+        }
     }
 
 
+    void testContainsText()
+    {
+        auto createContact = [](const QString &fn, const QString &email) {
+            Contact contact("sink.dummy.instance1");
+            contact.setFn(fn);
+            contact.setEmails({Contact::Email{Contact::Email::Work, email}});
+            VERIFYEXEC(Sink::Store::create(contact));
+        };
+        createContact("John Doe", "john.doe@example.org");
+        createContact("Jane Doe", "jane@example.com");
+        createContact("Joe Average", "average@example.org");
+        VERIFYEXEC(Sink::ResourceControl::flushMessageQueue("sink.dummy.instance1"));
+
+        auto findByEmail = [](const QString &text) {
+            Sink::Query query;
+            query.resourceFilter("sink.dummy.instance1");
+            query.containsFilter<Contact::Emails>(text);
+            return Sink::Store::read<Contact>(query).size();
+        };
+        QCOMPARE(findByEmail("example.org"), 2);
+        QCOMPARE(findByEmail("JANE@"), 1);
+        QCOMPARE(findByEmail("e@"), 3);
+        QCOMPARE(findByEmail("example.net"), 0);
+
+        auto findByName = [](const QString &text) {
+            Sink::Query query;
+            query.resourceFilter("sink.dummy.instance1");
+            query.containsFilter<Contact::Fn>(text);
+            return Sink::Store::read<Contact>(query).size();
+        };
+        QCOMPARE(findByName("doe"), 2);
+        QCOMPARE(findByName("Jo"), 2);
+        QCOMPARE(findByName("e A"), 1);
+    }
+
     void testQueryUpdate()
     {
         // Setup
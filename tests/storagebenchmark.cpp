@@ -14,6 +14,7 @@
 #include <QDebug>
 #include <QString>
 #include <QTime>
+#include <QElapsedTimer>
 
 using namespace Sink::ApplicationDomain::Buffer;
 using namespace flatbuffers;
@@ -50,6 +51,7 @@ private:
     QString dbName;
     QString filePath;
     const int count = 50000;
+    const char *keyPrefix = "key";
 
 private slots:
     void initTestCase()
@@ -72,8 +74,6 @@ private slots:
 
         QScopedPointer<Sink::Storage::DataStore> store(new Sink::Storage::DataStore(testDataPath, dbName, Sink::Storage::DataStore::ReadWrite));
 
-        const char *keyPrefix = "key";
-
         QTime time;
         time.start();
         // Test db write time
@@ -188,6 +188,60 @@ private slots:
         }
     }
 
+    /*
+     * Compares the per-entry cost of a callback based scan with a cursor over the same range.
+     */
+    void testIterationCost()
+    {
+        QScopedPointer<Sink::Storage::DataStore> store(new Sink::Storage::DataStore(testDataPath, dbName, Sink::Storage::DataStore::ReadOnly));
+        auto transaction = store->createTransaction(Sink::Storage::DataStore::ReadOnly);
+        auto db = transaction.openDatabase();
+
+        QElapsedTimer time;
+        time.start();
+        size_t scanBytes = 0;
+        const int scanned = db.scan("", [&](const QByteArray &key, const QByteArray &value) -> bool {
+            scanBytes += key.size() + value.size();
+            return true;
+        });
+        const qint64 scanDuration = time.nsecsElapsed();
+        QCOMPARE(scanned, count);
+
+        time.restart();
+        size_t cursorBytes = 0;
+        int iterated = 0;
+        for (const auto &entry : db.cursor()) {
+            cursorBytes += entry.key.size() + entry.value.size();
+            iterated++;
+        }
+        const qint64 cursorDuration = time.nsecsElapsed();
+        QCOMPARE(iterated, count);
+        QCOMPARE(cursorBytes, scanBytes);
+
+        time.restart();
+        for (int i = 0; i < count; i++) {
+            db.scan(keyPrefix + QByteArray::number(i), [](const QByteArray &key, const QByteArray &value) -> bool { return true; });
+        }
+        const qint64 scanLookupDuration = time.nsecsElapsed();
+
+        time.restart();
+        for (int i = 0; i < count; i++) {
+            auto cursor = db.find(keyPrefix + QByteArray::number(i));
+            QVERIFY(cursor.first());
+        }
+        const qint64 cursorLookupDuration = time.nsecsElapsed();
+
+        HAWD::Dataset dataset("storage_iteration", m_hawdState);
+        HAWD::Dataset::Row row = dataset.row();
+        row.setValue("rows", count);
+        row.setValue("scan", scanDuration / count);
+        row.setValue("cursor", cursorDuration / count);
+        row.setValue("scanLookup", scanLookupDuration / count);
+        row.setValue("cursorLookup", cursorLookupDuration / count);
+        dataset.insertRow(row);
+        HAWD::Formatter::print(dataset);
+    }
+
     void testBufferCreation()
     {
         HAWD::Dataset dataset("buffer_creation", m_hawdState);
@@ -286,6 +340,100 @@ private slots:
         }
     }
 
+    /*
+     * Write throughput per storage profile, committing in small batches so the cost of flushing shows.
+     */
+    void testProfiles()
+    {
+        using Sink::Storage::StorageProfile;
+        auto entity = createEntity();
+        const int batchSize = 100;
+
+        auto measure = [&](const QByteArray &name, const StorageProfile &profile) {
+            Sink::Storage::DataStore(testDataPath, name).removeFromDisk();
+            Sink::Storage::DataStore store(testDataPath, {name, {{"default", 0}}, profile}, Sink::Storage::DataStore::ReadWrite);
+            QElapsedTimer time;
+            time.start();
+            for (int i = 0; i < count; i += batchSize) {
+                auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+                auto db = transaction.openDatabase();
+                for (int j = i; j < qMin(i + batchSize, count); j++) {
+                    db.write(keyPrefix + QByteArray::number(j), entity);
+                }
+                transaction.commit();
+            }
+            const qreal opsPerMs = count / qMax(qreal(time.elapsed()), qreal(1));
+            {
+                auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+                QCOMPARE(transaction.openDatabase().stat().numEntries, size_t(count));
+            }
+            store.removeFromDisk();
+            return opsPerMs;
+        };
+
+        StorageProfile noMetaSync;
+        noMetaSync.durability = StorageProfile::NoMetaSync;
+        StorageProfile noSync;
+        noSync.durability = StorageProfile::NoSync;
+        //Starts with a map that is much too small, so we measure the growth as well.
+        StorageProfile growing;
+        growing.initialMapSize = 1048576; // 1MB
+
+        HAWD::Dataset dataset("storage_profiles", m_hawdState);
+        HAWD::Dataset::Row row = dataset.row();
+        row.setValue("rows", count);
+        row.setValue("synchronous", measure("profileSynchronous", {}));
+        row.setValue("noMetaSync", measure("profileNoMetaSync", noMetaSync));
+        row.setValue("noSync", measure("profileNoSync", noSync));
+        row.setValue("disposable", measure("profileDisposable", StorageProfile::disposable()));
+        row.setValue("growing", measure("profileGrowing", growing));
+        dataset.insertRow(row);
+        HAWD::Formatter::print(dataset);
+    }
+
+    void testIdentifierRoundTrip_data()
+    {
+        QTest::addColumn<int>("representation");
+        QTest::newRow("internal") << 0;
+        QTest::newRow("display") << 1;
+        QTest::newRow("key display") << 2;
+        QTest::newRow("hash") << 3;
+    }
+
+    void testIdentifierRoundTrip()
+    {
+        using Sink::Storage::Identifier;
+        using Sink::Storage::Key;
+        QFETCH(int, representation);
+        QVector<Identifier> ids;
+        for (int i = 0; i < 1000; i++) {
+            ids << Identifier::createIdentifier();
+        }
+
+        uint sum = 0;
+        QBENCHMARK {
+            for (const auto &id : ids) {
+                switch (representation) {
+                    case 0:
+                        sum += Identifier::fromInternalByteArray(id.toInternalByteArray()) == id;
+                        break;
+                    case 1:
+                        sum += Identifier::fromDisplayByteArray(id.toDisplayByteArray()) == id;
+                        break;
+                    case 2: {
+                        const Key key{id, 42};
+                        sum += Key::fromDisplayByteArray(key.toDisplayByteArray()) == key;
+                        break;
+                    }
+                    case 3:
+                        sum += qHash(id);
+                        break;
+                }
+            }
+        }
+        QVERIFY(sum);
+    }
+
 private:
     HAWD::State m_hawdState;
 };
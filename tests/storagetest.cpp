@@ -5,9 +5,12 @@
 #include <QDebug>
 #include <QString>
 #include <QtConcurrent/QtConcurrentRun>
+#include <QUuid>
 
 #include "common/storage.h"
 #include "storage/key.h"
+#include "storage/metrics.h"
+#include "utils.h"
 
 /**
  * Test of the storage implementation to ensure it can do the low level operations as expected.
@@ -612,6 +615,168 @@ private slots:
         QCOMPARE(results3, (QByteArrayList{"value1", "value2"}));
     }
 
+    void testDatabaseHandle()
+    {
+        Sink::Storage::DataStore store(testDataPath, {dbName, {{"test", 0}}}, Sink::Storage::DataStore::ReadWrite);
+        Sink::Storage::DataStore::DatabaseHandle handle{"test"};
+        Sink::Storage::DataStore::DatabaseHandle dynamicHandle{"dynamic"};
+        {
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+            transaction.openDatabase(handle).write("key", "value");
+            transaction.openDatabase(dynamicHandle).write("key", "dynamicValue");
+            transaction.commit();
+        }
+        //The resolved handles are reused by subsequent transactions
+        for (int i = 0; i < 2; i++) {
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+            QByteArray result;
+            transaction.openDatabase(handle).scan("key", [&](const QByteArray &, const QByteArray &value) {
+                result = value;
+                return false;
+            });
+            QCOMPARE(result, QByteArray{"value"});
+            transaction.openDatabase(dynamicHandle).scan("key", [&](const QByteArray &, const QByteArray &value) {
+                result = value;
+                return false;
+            });
+            QCOMPARE(result, QByteArray{"dynamicValue"});
+        }
+    }
+
+    void testAppend()
+    {
+        const int flags = Sink::Storage::IntegerKeys;
+        Sink::Storage::DataStore store(testDataPath, {dbName, {{"test", flags}}}, Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+        auto db = transaction.openDatabase("test", {}, flags);
+        QVERIFY(db.append(size_t{1}, "value1"));
+        QVERIFY(db.append(size_t{3}, "value3"));
+        //Violates the ordering and falls back to a regular write
+        QVERIFY(db.append(size_t{2}, "value2"));
+        QVERIFY(db.append(size_t{3}, "value4"));
+
+        QByteArrayList results;
+        db.scan("", [&](const QByteArray &, const QByteArray &value) {
+            results << value;
+            return true;
+        });
+        QCOMPARE(results, (QByteArrayList{"value1", "value2", "value4"}));
+    }
+
+    void testAppendDuplicates()
+    {
+        const int flags = Sink::Storage::AllowDuplicates | Sink::Storage::IntegerValues;
+        Sink::Storage::DataStore store(testDataPath, {dbName, {{"test", flags}}}, Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+        auto db = transaction.openDatabase("test", {}, flags);
+        const size_t one = 1;
+        const size_t two = 2;
+        const size_t three = 3;
+        QVERIFY(db.append("key", Sink::sizeTToByteArray(one)));
+        QVERIFY(db.append("key", Sink::sizeTToByteArray(three)));
+        QVERIFY(db.append("key", Sink::sizeTToByteArray(two)));
+
+        QList<size_t> results;
+        db.scan("key", [&](const QByteArray &, const QByteArray &value) {
+            results << Sink::byteArrayToSizeT(value);
+            return true;
+        });
+        QCOMPARE(results, (QList<size_t>{1, 2, 3}));
+    }
+
+    void testCursorPrefix()
+    {
+        Sink::Storage::DataStore store(testDataPath, {dbName, {{"test", 0}}}, Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+        auto db = transaction.openDatabase("test");
+        db.write("sub1", "value1");
+        db.write("sub2", "value2");
+        db.write("wub3", "value3");
+
+        QByteArrayList results;
+        for (const auto &entry : db.prefix("sub")) {
+            results << QByteArray{entry.value.data(), int(entry.value.size())};
+        }
+        QCOMPARE(results, (QByteArrayList{"value1", "value2"}));
+
+        auto cursor = db.prefix("sub");
+        QVERIFY(cursor.last());
+        QCOMPARE(QByteArray(cursor.current().value.data(), int(cursor.current().value.size())), QByteArray("value2"));
+        QVERIFY(!cursor.next());
+
+        QVERIFY(!db.prefix("nothing").first());
+    }
+
+    void testCursorRange()
+    {
+        Sink::Storage::DataStore store(testDataPath, dbName, Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+        auto db = transaction.openDatabase("test");
+        setupTestFindRange(db);
+
+        QByteArrayList results;
+        for (const auto &entry : db.range("0003", "0004")) {
+            results << QByteArray{entry.value.data(), int(entry.value.size())};
+        }
+        QCOMPARE(results, (QByteArrayList{"value2", "value3"}));
+
+        auto cursor = db.range("0000", "0010");
+        QVERIFY(cursor.seek("0004"));
+        QCOMPARE(QByteArray(cursor.current().key.data(), int(cursor.current().key.size())), QByteArray("0004"));
+        QVERIFY(cursor.prev());
+        QCOMPARE(QByteArray(cursor.current().key.data(), int(cursor.current().key.size())), QByteArray("0003"));
+        QVERIFY(cursor.last());
+        QCOMPARE(QByteArray(cursor.current().key.data(), int(cursor.current().key.size())), QByteArray("0005"));
+
+        QVERIFY(!db.range("0006", "0010").first());
+    }
+
+    void testCursorDuplicates()
+    {
+        Sink::Storage::DataStore store(testDataPath, {dbName, {{"test", 0}}}, Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+        auto db = transaction.openDatabase("test", nullptr, Sink::Storage::AllowDuplicates);
+        db.write("key", "value1");
+        db.write("key", "value2");
+        db.write("key1", "value3");
+
+        QByteArrayList results;
+        for (const auto &entry : db.find("key")) {
+            results << QByteArray{entry.value.data(), int(entry.value.size())};
+        }
+        QCOMPARE(results, (QByteArrayList{"value1", "value2"}));
+
+        auto cursor = db.find("key");
+        QVERIFY(cursor.last());
+        QCOMPARE(QByteArray(cursor.current().value.data(), int(cursor.current().value.size())), QByteArray("value2"));
+    }
+
+    void testCursorIntegerKeys()
+    {
+        const int flags = Sink::Storage::IntegerKeys;
+        Sink::Storage::DataStore store(testDataPath, {dbName, {{"test", flags}}}, Sink::Storage::DataStore::ReadWrite);
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+        auto db = transaction.openDatabase("test", {}, flags);
+        for (size_t i = 1; i <= 300; i++) {
+            db.write(i, "value" + QByteArray::number(qulonglong(i)));
+        }
+
+        auto cursor = db.cursor();
+        QVERIFY(cursor.seek(size_t{256}));
+        QCOMPARE(cursor.current().integerKey(), size_t{256});
+
+        QList<size_t> keys;
+        for (const auto &entry : db.range(size_t{255}, size_t{257})) {
+            keys << entry.integerKey();
+        }
+        QCOMPARE(keys, (QList<size_t>{255, 256, 257}));
+
+        auto single = db.find(size_t{42});
+        QVERIFY(single.first());
+        QCOMPARE(QByteArray(single.current().value.data(), int(single.current().value.size())), QByteArray("value42"));
+        QVERIFY(!single.next());
+    }
+
     void testTransactionVisibility()
     {
         auto readValue = [](const Sink::Storage::DataStore::NamedDatabase &db, const QByteArray) {
@@ -647,6 +812,334 @@ private slots:
         }
     }
 
+    void testRecycledReadTransactions()
+    {
+        Sink::Storage::DataStore store(testDataPath, {dbName, {{"testRecycledReadTransactions", 0}}}, Sink::Storage::DataStore::ReadWrite);
+        auto readCount = [&] {
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+            return transaction.openDatabase("testRecycledReadTransactions").stat().numEntries;
+        };
+        //Hold on to a snapshot while the other read transactions are recycled
+        auto longLived = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+        for (int i = 0; i < 50; i++) {
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+            transaction.openDatabase("testRecycledReadTransactions").write(QByteArray::number(i), "value");
+            transaction.commit();
+            //A recycled transaction must always see the latest snapshot
+            QCOMPARE(readCount(), size_t(i + 1));
+        }
+        QCOMPARE(longLived.openDatabase("testRecycledReadTransactions").stat().numEntries, size_t(0));
+    }
+
+    void testMapGrowth()
+    {
+        Sink::Storage::StorageProfile profile;
+        profile.initialMapSize = 1048576; // 1MB
+        profile.durability = Sink::Storage::StorageProfile::NoSync;
+        Sink::Storage::DataStore store(testDataPath, {dbName, {{"testMapGrowth", 0}}, profile}, Sink::Storage::DataStore::ReadWrite);
+        const QByteArray value(1024 * 10, 'x');
+        //Write well beyond the initial map size in small transactions
+        for (int i = 0; i < 100; i++) {
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+            auto db = transaction.openDatabase("testMapGrowth");
+            for (int j = 0; j < 10; j++) {
+                QVERIFY(db.write(QByteArray::number(i * 10 + j), value));
+            }
+            QVERIFY(transaction.commit());
+        }
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+        QCOMPARE(transaction.openDatabase("testMapGrowth").stat().numEntries, size_t(1000));
+    }
+
+    void testMapFullRecovery()
+    {
+        Sink::Storage::StorageProfile profile;
+        profile.initialMapSize = 1048576; // 1MB
+        profile.durability = Sink::Storage::StorageProfile::NoSync;
+        Sink::Storage::DataStore store(testDataPath, {dbName, {{"testMapFullRecovery", 0}}, profile}, Sink::Storage::DataStore::ReadWrite);
+        const QByteArray value(1024 * 10, 'x');
+        const auto ignoreErrors = [](const Sink::Storage::DataStore::Error &) {};
+        auto writeAll = [&] {
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+            auto db = transaction.openDatabase("testMapFullRecovery");
+            bool written = true;
+            for (int i = 0; i < 120; i++) {
+                written &= db.write(QByteArray::number(i), value, ignoreErrors);
+            }
+            return transaction.commit(ignoreErrors) && written;
+        };
+        //A single transaction that exceeds the map fails, and the map grows for the retry
+        QVERIFY(!writeAll());
+        QVERIFY(writeAll());
+        auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+        QCOMPARE(transaction.openDatabase("testMapFullRecovery").stat().numEntries, size_t(120));
+    }
+
+    void testCompaction()
+    {
+#ifdef Q_OS_WIN
+        QSKIP("Compaction is not supported on windows");
+#endif
+        Sink::Storage::DataStore store(testDataPath, {dbName, {{"testCompaction", 0}}}, Sink::Storage::DataStore::ReadWrite);
+        const QByteArray value(1024 * 10, 'x');
+        {
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+            auto db = transaction.openDatabase("testCompaction");
+            for (int i = 0; i < 1000; i++) {
+                db.write(QByteArray::number(i), value);
+            }
+            transaction.commit();
+        }
+        {
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+            auto db = transaction.openDatabase("testCompaction");
+            for (int i = 10; i < 1000; i++) {
+                db.remove(QByteArray::number(i));
+            }
+            transaction.commit();
+        }
+        const auto sizeBefore = store.diskUsage();
+
+        //A transaction of the old environment must remain usable
+        auto oldTransaction = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+        QVERIFY(store.compact());
+        QVERIFY(store.diskUsage() < sizeBefore);
+        QCOMPARE(oldTransaction.openDatabase("testCompaction").stat().numEntries, size_t(10));
+        oldTransaction.abort();
+
+        //The existing store continues with the compacted environment
+        {
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+            QVERIFY(transaction);
+            auto db = transaction.openDatabase("testCompaction");
+            QCOMPARE(db.stat().numEntries, size_t(10));
+            QVERIFY(db.write("new", value));
+            transaction.commit();
+        }
+        Sink::Storage::DataStore newStore(testDataPath, dbName, Sink::Storage::DataStore::ReadOnly);
+        auto transaction = newStore.createTransaction(Sink::Storage::DataStore::ReadOnly);
+        QCOMPARE(transaction.openDatabase("testCompaction").stat().numEntries, size_t(11));
+    }
+
+    void testOperationMetrics()
+    {
+        using Sink::Storage::OperationMetrics;
+        auto counters = [&] (OperationMetrics::Operation operation) {
+            for (const auto &snapshot : OperationMetrics::snapshot()) {
+                if (snapshot.name == dbName + "/testOperationMetrics") {
+                    return snapshot.operations[operation];
+                }
+            }
+            return OperationMetrics::Counters{};
+        };
+        const auto writesBefore = counters(OperationMetrics::Write);
+        const auto scansBefore = counters(OperationMetrics::Scan);
+
+        Sink::Storage::DataStore store(testDataPath, {dbName, {{"testOperationMetrics", 0}}}, Sink::Storage::DataStore::ReadWrite);
+        {
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+            auto db = transaction.openDatabase("testOperationMetrics");
+            for (int i = 0; i < 10; i++) {
+                db.write("key" + QByteArray::number(i), "value");
+            }
+            transaction.commit();
+        }
+        {
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+            transaction.openDatabase("testOperationMetrics").scan("", [] (const QByteArray &, const QByteArray &) { return true; });
+        }
+
+        const auto writes = counters(OperationMetrics::Write) - writesBefore;
+        QCOMPARE(writes.count, quint64(10));
+        QCOMPARE(writes.bytes, quint64(10 * 9));
+        const auto scans = counters(OperationMetrics::Scan) - scansBefore;
+        QCOMPARE(scans.count, quint64(1));
+        QCOMPARE(scans.bytes, quint64(10 * 9));
+
+        //The metrics survive the roundtrip through the inspection
+        const auto roundtrip = OperationMetrics::Snapshot::fromJson(OperationMetrics::Snapshot::toJson(OperationMetrics::snapshot()));
+        const auto it = std::find_if(roundtrip.constBegin(), roundtrip.constEnd(), [&] (const OperationMetrics::Snapshot &s) { return s.name == dbName + "/testOperationMetrics"; });
+        QVERIFY(it != roundtrip.constEnd());
+        QCOMPARE(it->operations[OperationMetrics::Write].count, counters(OperationMetrics::Write).count);
+        QCOMPARE(it->operations[OperationMetrics::Write].latency, counters(OperationMetrics::Write).latency);
+    }
+
+    void testMemoryBackend()
+    {
+        using Sink::Storage::StorageBackend;
+        const int dupFlags = Sink::Storage::AllowDuplicates;
+        const int integerFlags = Sink::Storage::IntegerKeys;
+        auto run = [&](StorageBackend backend) {
+            Sink::Storage::setStorageBackend(backend);
+            QList<QByteArray> results;
+            Sink::Storage::DataStore store(testDataPath, {dbName, {{"dups", dupFlags}, {"integers", integerFlags}}}, Sink::Storage::DataStore::ReadWrite);
+            {
+                auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+                auto dups = transaction.openDatabase("dups", nullptr, dupFlags);
+                dups.write("key", "b");
+                dups.write("key", "a");
+                dups.write("key", "c");
+                dups.write("key2", "d");
+                auto integers = transaction.openDatabase("integers", nullptr, integerFlags);
+                integers.write(size_t{300}, "300");
+                integers.write(size_t{2}, "2");
+                integers.write(size_t{1} << 20, "big");
+                transaction.commit();
+            }
+
+            auto snapshot = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+            {
+                auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+                transaction.openDatabase("dups", nullptr, dupFlags).write("key", "0");
+                transaction.commit();
+            }
+            auto collect = [&](const QByteArray &key, const QByteArray &value) {
+                results << key + '=' + value;
+                return true;
+            };
+            snapshot.openDatabase("dups", nullptr, dupFlags).scan("key", collect);
+            snapshot.openDatabase("integers", nullptr, integerFlags).scan("", [&](const QByteArray &, const QByteArray &value) {
+                results << value;
+                return true;
+            });
+            snapshot.abort();
+
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+            auto dups = transaction.openDatabase("dups", nullptr, dupFlags);
+            dups.scan("key", collect);
+            dups.findLatest("key", [&](const QByteArray &key, const QByteArray &value) { collect(key, value); });
+            auto cursor = dups.cursor();
+            for (bool valid = cursor.last(); valid; valid = cursor.prev()) {
+                const auto value = cursor.current().value;
+                results << QByteArray(value.data(), int(value.size()));
+            }
+            int errorCode = 0;
+            transaction.openDatabase("integers", nullptr, integerFlags).scan(size_t{3}, [](size_t, const QByteArray &) { return true; },
+                [&](const Sink::Storage::DataStore::Error &error) { errorCode = error.code; });
+            results << QByteArray::number(errorCode);
+            results << (transaction.openDatabase("missing") ? "open" : "missing");
+            transaction.abort();
+
+            store.removeFromDisk();
+            Sink::Storage::setStorageBackend(StorageBackend::Lmdb);
+            return results;
+        };
+
+        const auto lmdbResults = run(StorageBackend::Lmdb);
+        QCOMPARE(lmdbResults, (QList<QByteArray>{"key=a", "key=b", "key=c", "2", "300", "big",
+            "key=0", "key=a", "key=b", "key=c", "key2=d", "d", "c", "b", "a", "0",
+            QByteArray::number(Sink::Storage::DataStore::NotFound), "missing"}));
+        QCOMPARE(run(StorageBackend::Memory), lmdbResults);
+        QVERIFY(!Sink::Storage::DataStore::exists(testDataPath, dbName));
+    }
+
+    void testClear()
+    {
+        using Sink::Storage::StorageBackend;
+        const int dupFlags = Sink::Storage::AllowDuplicates;
+        auto run = [&](StorageBackend backend) {
+            Sink::Storage::setStorageBackend(backend);
+            QList<QByteArray> results;
+            Sink::Storage::DataStore store(testDataPath, {dbName, {{"dups", dupFlags}}}, Sink::Storage::DataStore::ReadWrite);
+            {
+                auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+                auto dups = transaction.openDatabase("dups", nullptr, dupFlags);
+                dups.write("key", "a");
+                dups.write("key", "b");
+                dups.write("key2", "c");
+                transaction.commit();
+            }
+
+            auto snapshot = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+            {
+                auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadWrite);
+                auto dups = transaction.openDatabase("dups", nullptr, dupFlags);
+                dups.clear();
+                results << QByteArray::number(dups.stat().numEntries);
+                //The database remains usable
+                dups.write("key3", "d");
+                transaction.commit();
+            }
+            auto collect = [&](const QByteArray &key, const QByteArray &value) {
+                results << key + '=' + value;
+                return true;
+            };
+            snapshot.openDatabase("dups", nullptr, dupFlags).scan("", collect);
+            snapshot.abort();
+
+            auto transaction = store.createTransaction(Sink::Storage::DataStore::ReadOnly);
+            transaction.openDatabase("dups", nullptr, dupFlags).scan("", collect);
+            int errorCode = 0;
+            transaction.openDatabase("dups", nullptr, dupFlags).clear([&](const Sink::Storage::DataStore::Error &error) { errorCode = error.code; });
+            results << (errorCode ? "error" : "cleared");
+            transaction.abort();
+
+            store.removeFromDisk();
+            Sink::Storage::setStorageBackend(StorageBackend::Lmdb);
+            return results;
+        };
+
+        const auto lmdbResults = run(StorageBackend::Lmdb);
+        QCOMPARE(lmdbResults, (QList<QByteArray>{"0", "key=a", "key=b", "key2=c", "key3=d", "error"}));
+        QCOMPARE(run(StorageBackend::Memory), lmdbResults);
+    }
+
+    void testCommitAsync()
+    {
+        Sink::Storage::DataStore store(testDataPath, {dbName, {{"default", 0}}}, Sink::Storage::DataStore::ReadWrite);
+        Sink::Storage::DataStore otherStore(testDataPath, {dbName + "2", {{"default", 0}}}, Sink::Storage::DataStore::ReadWrite);
+
+        QList<KAsync::Future<void>> futures;
+        for (int i = 0; i < 10; i++) {
+            for (auto s : {&store, &otherStore}) {
+                auto transaction = s->createTransaction(Sink::Storage::DataStore::ReadWrite);
+                transaction.openDatabase().write(keyPrefix + QByteArray::number(i), keyPrefix + QByteArray::number(i));
+                futures << transaction.commitAsync().exec();
+            }
+            //Visible before it is on disk
+            QVERIFY(verify(store, i));
+        }
+        for (auto &future : futures) {
+            future.waitForFinished();
+            QVERIFY(!future.errorCode());
+        }
+
+        //There is nothing to flush for read-only transactions
+        auto future = store.createTransaction(Sink::Storage::DataStore::ReadOnly).commitAsync().exec();
+        future.waitForFinished();
+        QVERIFY(!future.errorCode());
+
+        otherStore.removeFromDisk();
+    }
+
+    void testIdentifierCodec()
+    {
+        using Sink::Storage::Identifier;
+        using Sink::Storage::Key;
+        for (int i = 0; i < 100; i++) {
+            const auto id = Identifier::createIdentifier();
+            const QUuid uuid = QUuid::fromRfc4122(id.toInternalByteArray());
+            QCOMPARE(id.toDisplayByteArray(), uuid.toByteArray());
+            QCOMPARE(id.toDisplayString(), uuid.toString());
+            QCOMPARE(Identifier::fromDisplayByteArray(uuid.toByteArray()), id);
+            QCOMPARE(Identifier::fromDisplayByteArray(uuid.toByteArray().toUpper()), id);
+            QCOMPARE(Identifier::fromInternalByteArray(id.toInternalByteArray()), id);
+
+            const Key key{id, size_t(i) * 1000};
+            QCOMPARE(key.toDisplayByteArray(), uuid.toByteArray() + Sink::padNumber(size_t(i) * 1000));
+            QCOMPARE(Key::fromDisplayByteArray(key.toDisplayByteArray()), key);
+            QCOMPARE(Key::fromInternalByteArray(key.toInternalByteArray()), key);
+        }
+
+        QVERIFY(Identifier{}.isNull());
+        QVERIFY(!Identifier::isValidDisplay("{00000000-0000-0000-0000-000000000000}"));
+        QVERIFY(!Identifier::isValidDisplay("{0a000000-0000-0000-0000-00000000000g}"));
+        QVERIFY(!Identifier::isValidDisplay("{0a000000-0000-0000-0000-000000000000"));
+        QVERIFY(!Identifier::isValidDisplay("{0a000000+0000-0000-0000-000000000000}"));
+        QVERIFY(Identifier::isValidDisplay("{0a000000-0000-0000-0000-00000000000F}"));
+        QVERIFY(Key::isValidDisplay(Key{Identifier::createIdentifier(), 3}.toDisplayByteArray()));
+    }
+
     void testCopyTransaction()
     {
         Sink::Storage::DataStore store(testDataPath, {dbName, {{"a", 0}, {"b", 0}, {"c", 0}}}, Sink::Storage::DataStore::ReadWrite);
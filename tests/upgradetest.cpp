@@ -97,6 +97,48 @@ private slots:
             QCOMPARE(version, Sink::latestDatabaseVersion());
         }
     }
+
+    void upgradeRebuildsIndexes()
+    {
+        Event event("sink.dummy.instance1");
+        event.setProperty("uid", "testuid");
+        event.setProperty("summary", "summaryValue");
+        Sink::Store::create<Event>(event).exec().waitForFinished();
+
+        // Ensure all local data is processed
+        VERIFYEXEC(Sink::ResourceControl::flushMessageQueue("sink.dummy.instance1"));
+
+        //Pretend the database is from before the index key change, with an index we have to rebuild.
+        {
+            Sink::Storage::DataStore store(Sink::storageLocation(), "sink.dummy.instance1", Sink::Storage::DataStore::ReadWrite);
+            auto t = store.createTransaction();
+            auto db = t.openDatabase("event.index.uid", {}, Sink::Storage::AllowDuplicates);
+            QByteArrayList keys;
+            for (const auto &entry : db.cursor()) {
+                keys << QByteArray{entry.key.data(), int(entry.key.size())};
+            }
+            QVERIFY(!keys.isEmpty());
+            for (const auto &key : keys) {
+                db.remove(key);
+            }
+            Sink::Storage::DataStore::setDatabaseVersion(t, 8);
+            t.commit();
+        }
+
+        auto upgradeJob = Sink::Store::upgrade()
+            .then([](const Sink::Store::UpgradeResult &result) {
+                ASYNCVERIFY(result.upgradeExecuted);
+                return KAsync::null();
+            });
+        VERIFYEXEC(upgradeJob);
+
+        //The event was kept, and is found through the rebuilt index
+        Sink::Query query;
+        query.resourceFilter("sink.dummy.instance1");
+        query.filter<Event::Uid>("testuid");
+        const auto events = Sink::Store::read<Event>(query);
+        QCOMPARE(events.size(), 1);
+    }
 };
 
 QTEST_MAIN(UpgradeTest)